@@ -0,0 +1,72 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "model.h"
+
+// Most files read and parsed at the same time, the rest wait their turn
+#define ASSET_LOADER_MAX_THREADS 8
+
+#define ASSET_PATH_LENGTH 512
+
+typedef enum AssetState {
+    ASSET_QUEUED,
+    ASSET_LOADING,
+    ASSET_READY,
+    ASSET_FAILED
+} AssetState;
+
+// Handle of one requested mesh, polled by whoever asked for it. The loader
+// is done with it once it is ready or failed, and the mesh is the caller's
+typedef struct AssetLoad {
+    char path[ASSET_PATH_LENGTH];
+    char directory[ASSET_PATH_LENGTH];
+
+    // Stored compact on the loader thread when the settings asked for it at load time
+    int compact;
+
+    // Only read after state says ready
+    Mesh *mesh;
+    atomic_int state;
+
+    // Known once the vertex pass is done, long before the faces are. Only
+    // read after bounded is set, the view draws the box until the swap
+    float bounds_min[3];
+    float bounds_max[3];
+    atomic_int bounded;
+
+    struct AssetLoad *next;
+} AssetLoad;
+
+// Background threads that read and parse assets while frames keep rendering.
+// Not jobs on the frame's JobSystem: a load sits in fgets for seconds, and a
+// worker blocked on the disk is a core the frames can't use and the job system
+// can't replace. These threads sleep in the kernel instead and the OS hands
+// their cores to the workers, and quitting never waits on a parse inside
+// free_job_system
+typedef struct AssetLoader {
+    int thread_count;
+    pthread_t threads[ASSET_LOADER_MAX_THREADS];
+
+    // Loads in the order they were asked for
+    AssetLoad *head;
+    AssetLoad *tail;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int running;
+} AssetLoader;
+
+AssetLoader *create_asset_loader(int);
+void free_asset_loader(AssetLoader *);
+AssetLoad *load_mesh_async(AssetLoader *, const char *, const char *, int);
+AssetState get_asset_state(AssetLoad *);
+int get_asset_bounds(AssetLoad *, float *, float *);
+void free_asset_load(AssetLoad *);
+
+void load_asset(AssetLoad *);
+void *run_asset_thread(void *);
+
+#endif
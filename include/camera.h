@@ -34,12 +34,15 @@ typedef struct Camera {
     CameraSettings settings;
 } UserCamera;
 
-UserCamera *create_camera(void);
+UserCamera *create_camera(float);
 void camera_look_at(UserCamera *, fVec4 *, fVec4 *, fVec4 *);
 void camera_look_at_front(UserCamera *, fVec4 *, fVec4 *, fVec4 *);
 void update_projection_mat(UserCamera *);
 void update_frustum_planes(UserCamera *);
+void build_sub_frustum(fMatrix44 *, float, float, float, float, float, float, CameraFrustum *);
+int sphere_in_frustum(CameraFrustum *, fVec4 *, float);
 void perspective(float *, float *, float *, float *, float *, float *, float *, float *);
 void frustum(float *, float *, float *, float *, float *, float *, fMatrix44 *);
+void orthographic(float *, float *, float *, float *, float *, float *, fMatrix44 *);
 
 #endif
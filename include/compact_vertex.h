@@ -0,0 +1,47 @@
+#ifndef COMPACT_VERTEX_H
+#define COMPACT_VERTEX_H
+
+#include <stdint.h>
+
+#include "geometry.h"
+#include "job_system.h"
+#include "model.h"
+#include "shading.h"
+
+// Steps a position axis is split into across the mesh box
+#define COMPACT_POSITION_STEPS 65535.0f
+
+// Vertices decoded onto the stack at a time before lighting them
+#define COMPACT_LIGHT_BLOCK 64
+
+// Lighting straight from the compact stream, shared out over the job system
+typedef struct CompactLightJob {
+    LightingScene *scene;
+    const CompactVertices *compact;
+    const unsigned char *mask;
+    float *red;
+    float *green;
+    float *blue;
+} CompactLightJob;
+
+// Building (when the settings store the mesh compact)
+CompactVertices *build_compact_vertices(Mesh *);
+int store_mesh_compact(Mesh *);
+void set_compact_vertex_box(CompactVertices *, const float *, const float *);
+void encode_compact_vertex(const CompactVertices *, const fVec4 *, const fVec4 *, CompactVertex *);
+uint32_t encode_compact_uv(const fVec2 *);
+void free_compact_vertices(CompactVertices *);
+uint16_t float_to_half(float);
+float half_to_float(uint16_t);
+
+// Decoding
+void decode_compact_position(const CompactVertices *, int, fVec4 *);
+void decode_compact_normal(const CompactVertices *, int, fVec4 *);
+void decode_compact_uv(const CompactVertices *, int, float *, float *);
+fVec4 *read_mesh_position(const Mesh *, int, fVec4 *);
+fVec4 *read_mesh_normal(const Mesh *, int, fVec4 *);
+void build_compact_projection(const CompactVertices *, fMatrix44 *, fMatrix44 *);
+void light_compact_vertices(LightingScene *, const CompactVertices *, const unsigned char *, float *, float *, float *, JobSystem *);
+void light_compact_range(void *, int, int);
+
+#endif
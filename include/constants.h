@@ -10,8 +10,10 @@
 #define MAX_TRIANLGE_COUNT_PER_MODEL 5000000
 #define NO_ATTRIBUTE -100
 
-#define SCREEN_WIDTH 1280
-#define SCREEN_HEIGHT 720
+// Fixed point precision of screen space vertices
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_SCALE (1 << SUBPIXEL_BITS)
+#define SUBPIXEL_HALF (SUBPIXEL_SCALE >> 1)
 
 #define FIELD_OF_VIEW 90
 #define NEAR_FRUSTUM 0.1f
@@ -19,6 +21,9 @@
 
 #define NUM_FRUSTUM_PLANES 6
 
+// Guard band extent in NDC units, triangles inside it skip x/y clipping
+#define GUARD_BAND_SCALE 4.0f
+
 #define NEGATIVE_OF_PLANE -1
 #define ON_PLANE 0
 #define POSITIVE_OF_PLANE 1
@@ -29,6 +34,9 @@
 
 #define NORMAL_VECTOR_LENGTH 20.f
 
+// Enough for a scatter of small point lights, the deferred pass culls them per tile
+#define MAX_LIGHT_COUNT 256
+
 #define MOVEMENT_SPEED_MULTIPLIER .1f
 #define TURNING_SPEED_DEG 1
 #define TURNING_SPEED_RAD 1.0f / 180.0f
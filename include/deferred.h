@@ -0,0 +1,58 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "frame_arena.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "job_system.h"
+#include "material.h"
+#include "shading.h"
+
+// Square screen tiles the lights are culled against, a job takes whole rows
+// of them and idle workers steal the rows of the busy middle of the screen
+#define DEFERRED_TILE_SIZE 16
+
+typedef struct DeferredLightingJob {
+    Framebuffer *framebuffer;
+
+    // NULL leaves every pixel at its unlit material color
+    LightingScene *lighting;
+    MaterialLibrary *materials;
+
+    // Also keeps the unclamped light here for tone mapping when not NULL
+    float *hdr;
+
+    // Per range tile scratch, bumped from whichever worker runs the range
+    FrameArena *arena;
+
+    // Screen position plus G-buffer depth back to world space, and the
+    // forward one to cut per tile frustums out of
+    fMatrix44 inverse_view_projection;
+    fMatrix44 view_projection;
+
+    // Added to by every range, how many pixels were actually lit and how
+    // many lights the non-empty tiles kept in total
+    _Atomic uint64_t lit_pixels;
+    _Atomic uint64_t lit_tiles;
+    _Atomic uint64_t tile_lights;
+} DeferredLightingJob;
+
+// Shared by every render context lighting at the same time
+typedef struct DeferredLightingStats {
+    _Atomic uint64_t passes;
+    _Atomic uint64_t pixels;
+    _Atomic uint64_t tiles;
+    _Atomic uint64_t tile_lights;
+    _Atomic uint64_t time_ns;
+    atomic_int workers;
+} DeferredLightingStats;
+
+void light_gbuffer(Framebuffer *, LightingScene *, MaterialLibrary *, fMatrix44 *, float *, FrameArena *, JobSystem *);
+void light_gbuffer_tiles(void *, int, int);
+int cull_tile_lights(LightingScene *, fMatrix44 *, float, float, float, float, float, float, uint16_t *);
+void print_deferred_lighting_stats(void);
+
+#endif
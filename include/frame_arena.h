@@ -0,0 +1,58 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "job_system.h"
+
+// First block a thread gets, later ones double until a frame fits in one
+#define FRAME_ARENA_BLOCK_SIZE (256 * 1024)
+
+// Every allocation starts on its own cache line
+#define FRAME_ARENA_ALIGNMENT 64
+
+typedef struct FrameArenaBlock {
+    struct FrameArenaBlock *next;
+    size_t size;
+
+    // Offsets into data, start is where the first aligned byte is
+    size_t start;
+    size_t used;
+    unsigned char data[];
+} FrameArenaBlock;
+
+// Bump allocator of one thread, blocks that filled up this frame wait in
+// full until the reset swaps them for one big enough for all of them
+typedef struct ThreadArena {
+    FrameArenaBlock *block;
+    FrameArenaBlock *full;
+    size_t used;
+} ThreadArena;
+
+// Transient buffers of one frame, gone all at once when it is recorded again.
+// Every job worker bumps its own arena so allocating never takes a lock
+typedef struct FrameArena {
+    ThreadArena threads[JOB_MAX_WORKERS];
+} FrameArena;
+
+typedef struct FrameArenaStats {
+    _Atomic uint64_t frames;
+    _Atomic uint64_t used;
+    _Atomic uint64_t peak;
+    _Atomic uint64_t capacity;
+} FrameArenaStats;
+
+void init_frame_arena(FrameArena *);
+void free_frame_arena(FrameArena *);
+void reset_frame_arena(FrameArena *);
+void *frame_arena_alloc(FrameArena *, size_t);
+void *thread_arena_alloc(ThreadArena *, size_t);
+size_t reset_thread_arena(ThreadArena *);
+FrameArenaBlock *create_frame_arena_block(size_t);
+
+void record_frame_arena_stats(uint64_t, uint64_t);
+void print_frame_arena_stats(void);
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "job_system.h"
+#include "model.h"
+#include "render_pipeline.h"
+#include "shading.h"
+#include <SDL3/SDL.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Frames in flight, one being recorded and one being drawn
+#define FRAME_PIPELINE_DEPTH 2
+
+// Pixels added around the model's projected box, lines and edges round outwards
+#define FRAME_DIRTY_PADDING 2
+
+// How the scene differs from the last recorded frame
+typedef enum {
+    FRAME_UNCHANGED,
+    FRAME_MODEL_CHANGED,
+    FRAME_CHANGED
+} FrameChange;
+
+// What the last recorded frame was drawn from, compared against every frame
+// like a shadow map is against its light
+typedef struct FrameSnapshot {
+    int valid;
+    RenderSettings settings;
+    fMatrix44 camera_mat;
+    fMatrix44 projection_mat;
+
+    const ModelObject *model;
+    const Mesh *mesh;
+    fMatrix44 model_mat;
+
+    // Own copy of the lights, the scene's owner edits them in place
+    LightingScene lighting;
+
+    // Where the model landed on screen, empty when it was out of view
+    ScreenRect bounds;
+} FrameSnapshot;
+
+typedef struct FrameReuseStats {
+    _Atomic uint64_t frames;
+    _Atomic uint64_t reused;
+    _Atomic uint64_t partial;
+    _Atomic uint64_t drawn_pixels;
+    _Atomic uint64_t target_pixels;
+} FrameReuseStats;
+
+// What the back end job needs to draw one recorded frame
+typedef struct FrameDrawJob {
+    Framebuffer *framebuffer;
+    RenderFrame *frame;
+} FrameDrawJob;
+
+// Geometry of frame N is clipped, set up and binned while a worker rasterizes
+// frame N - 1, which is presented once N is recorded
+typedef struct FramePipeline {
+    RenderFrame frames[FRAME_PIPELINE_DEPTH];
+    int recording;
+
+    // Frame handed to the back end and not presented yet, -1 when there is none
+    int drawing;
+    JobCounter drawn;
+    FrameDrawJob draw_job;
+
+    // Frame the framebuffer last went to the screen with, shown again while nothing changes
+    int presented;
+    FrameSnapshot snapshot;
+
+    // Every frame of the view lights through these, no other view draws into them
+    ShadowMapSet shadow_maps;
+
+    JobSystem *jobs;
+    FrameTimer timer;
+} FramePipeline;
+
+FramePipeline *create_frame_pipeline(JobSystem *);
+void free_frame_pipeline(FramePipeline *);
+int run_frame_pipeline(FramePipeline *, SDL_Renderer *, SDL_Texture *, Framebuffer *, RenderSettings *, ModelObject *, UserCamera *);
+void wait_for_frame_pipeline(FramePipeline *);
+void draw_frame_job(void *);
+
+// Static frame and dirty region detection
+FrameChange compare_frame_snapshot(const FrameSnapshot *, const RenderSettings *, const ModelObject *, const UserCamera *);
+void take_frame_snapshot(FrameSnapshot *, const RenderSettings *, const ModelObject *, const UserCamera *, ScreenRect);
+int same_render_settings(const RenderSettings *, const RenderSettings *);
+int same_lighting_scene(const LightingScene *, const LightingScene *);
+int can_redraw_partially(const RenderSettings *);
+ScreenRect project_model_bounds(const ModelObject *, const UserCamera *, int, int);
+ScreenRect merge_dirty_bounds(ScreenRect, ScreenRect, int, int);
+
+void record_frame_reuse_stats(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+void print_frame_reuse_stats(void);
+
+#endif
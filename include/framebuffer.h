@@ -0,0 +1,53 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <stdint.h>
+
+#include "gbuffer.h"
+
+// Pixels are ARGB8888, untouched pixels stay transparent when presented
+#define FRAMEBUFFER_CLEAR_COLOR 0x00000000u
+#define FRAMEBUFFER_FILL_COLOR 0xFFFFFFFFu
+#define FRAMEBUFFER_WIREFRAME_COLOR 0xFF00FFFFu
+
+// NDC depth, the far plane sits at 1 so anything in the frustum passes a cleared pixel
+#define FRAMEBUFFER_CLEAR_DEPTH 1.0f
+
+// Samples per pixel of the multisampled planes, resolved into color at the end
+#define FRAMEBUFFER_SAMPLE_COUNT 4
+
+typedef struct Framebuffer {
+    int width;
+    int height;
+
+    // NULL for depth only targets like shadow maps
+    uint32_t *color;
+    float *depth;
+
+    // Only allocated once the deferred path is first used
+    GBuffer *gbuffer;
+
+    // Only allocated once post processing is first used. hdr is the deferred
+    // pass's unclamped light as rgb triples, luma and resolve are the FXAA
+    // input and the buffer it writes before trading places with color
+    float *hdr;
+    uint8_t *luma;
+    uint32_t *resolve;
+
+    // Only allocated once multisampling is first used, FRAMEBUFFER_SAMPLE_COUNT
+    // consecutive samples per pixel
+    uint32_t *sample_color;
+    float *sample_depth;
+} Framebuffer;
+
+Framebuffer *create_framebuffer(int, int);
+Framebuffer *create_depth_framebuffer(int, int);
+int create_post_process_targets(Framebuffer *);
+int create_multisample_targets(Framebuffer *);
+void clear_multisample_targets(Framebuffer *, uint32_t);
+void resolve_multisample_targets(Framebuffer *);
+void clear_framebuffer(Framebuffer *, uint32_t);
+void clear_framebuffer_rect(Framebuffer *, uint32_t, int, int, int, int);
+void free_framebuffer(Framebuffer *);
+
+#endif
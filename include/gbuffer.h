@@ -0,0 +1,37 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <stdint.h>
+
+// Material id of a pixel no opaque surface was drawn to
+#define GBUFFER_EMPTY_MATERIAL 0xFFFF
+
+// Everything the lighting pass needs about the visible surface, depth comes
+// from the framebuffer it belongs to. 9 bytes a pixel
+typedef struct GBuffer {
+    int width;
+    int height;
+
+    // Octahedral normal, 8 bits per axis
+    uint16_t *normal;
+
+    // Fractional u and v, 16 bits each, sampling wraps so the integer part is not needed
+    uint32_t *uv;
+    uint16_t *material;
+    uint8_t *texture_level;
+} GBuffer;
+
+GBuffer *create_gbuffer(int, int);
+void clear_gbuffer(GBuffer *);
+void free_gbuffer(GBuffer *);
+
+void fold_octahedral_normal(float, float, float, float *, float *);
+void unfold_octahedral_normal(float, float, float *, float *, float *);
+uint32_t encode_octahedral_normal(float, float, float);
+void decode_octahedral_normal(uint32_t, float *, float *, float *);
+uint16_t encode_gbuffer_normal(float, float, float);
+void decode_gbuffer_normal(uint16_t, float *, float *, float *);
+uint32_t encode_gbuffer_uv(float, float);
+void decode_gbuffer_uv(uint32_t, float *, float *);
+
+#endif
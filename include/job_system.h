@@ -0,0 +1,88 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define JOB_MAX_WORKERS 32
+
+// Jobs one worker can have waiting, a push into a full deque runs the job on the spot
+#define JOB_DEQUE_CAPACITY 1024
+
+// Most ranges a parallel for splits into, bigger loops get bigger ranges
+#define JOB_MAX_RANGES 256
+
+typedef void (*JobFunc)(void *);
+typedef void (*JobRangeFunc)(void *, int, int);
+
+// Jobs still to finish, also the group they belong to. Whoever waits on it
+// runs jobs of the same group meanwhile and sleeps once there are none left
+typedef struct JobCounter {
+    atomic_int pending;
+} JobCounter;
+
+typedef struct Job {
+    JobFunc func;
+    void *data;
+
+    // Counted down once the job has run, may be NULL
+    JobCounter *counter;
+} Job;
+
+// The owner pushes and pops at the bottom, thieves take the oldest job from the top
+typedef struct JobDeque {
+    pthread_mutex_t lock;
+    Job jobs[JOB_DEQUE_CAPACITY];
+    int top;
+    int bottom;
+} JobDeque;
+
+struct JobSystem;
+
+typedef struct JobWorker {
+    struct JobSystem *system;
+    int index;
+} JobWorker;
+
+typedef struct JobSystem {
+    // Worker 0 is whichever thread submits, the rest are spawned
+    int worker_count;
+    pthread_t threads[JOB_MAX_WORKERS];
+    JobWorker workers[JOB_MAX_WORKERS];
+    JobDeque deques[JOB_MAX_WORKERS];
+
+    // Idle workers sleep until something is queued
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t wake;
+    atomic_int queued;
+
+    // Waiters sleep until a counter runs out or another batch is submitted
+    pthread_cond_t progress;
+    atomic_int submits;
+    atomic_int running;
+} JobSystem;
+
+// One slice of a parallel for
+typedef struct JobRange {
+    JobRangeFunc func;
+    void *data;
+    int start;
+    int end;
+} JobRange;
+
+JobSystem *create_job_system(int);
+void free_job_system(JobSystem *);
+int get_job_worker_count(const JobSystem *);
+int get_default_worker_count(void);
+int get_job_worker_index(void);
+
+void submit_jobs(JobSystem *, Job *, int, JobCounter *);
+void wait_for_counter(JobSystem *, JobCounter *);
+void parallel_for(JobSystem *, int, int, JobRangeFunc, void *);
+
+int take_job(JobSystem *, int, JobCounter *, Job *);
+void run_job(JobSystem *, Job *);
+void *run_job_worker(void *);
+void run_job_range(void *);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "texture.h"
+
+#define MAX_MATERIAL_NAME_SIZE 64
+#define MAX_MATERIAL_PATH_SIZE 512
+
+// Faces without a usemtl (or naming a material nobody defined) use this slot
+#define DEFAULT_MATERIAL 0
+
+typedef struct Material {
+    char name[MAX_MATERIAL_NAME_SIZE];
+
+    // Kd, Ks and Ns from the .mtl
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+
+    // d, or 1 - Tr when only that is given
+    float opacity;
+
+    // map_Kd, shared with any other material naming the same file
+    char diffuse_map[MAX_MATERIAL_PATH_SIZE];
+    Texture *diffuse_texture;
+} Material;
+
+typedef struct MaterialLibrary {
+    Material *materials;
+    int count;
+    int capacity;
+} MaterialLibrary;
+
+MaterialLibrary *create_material_library(void);
+Material *add_material(MaterialLibrary *, const char *);
+int load_material_library(MaterialLibrary *, const char *, const char *);
+int find_material(MaterialLibrary *, const char *);
+Texture *find_loaded_texture(MaterialLibrary *, const char *);
+void strip_line_end(char *);
+void free_material_library(MaterialLibrary *);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "camera.h"
+#include "frame_arena.h"
+#include "model.h"
+
+// Faces per meshlet, small enough that a closed mesh has whole runs facing away
+#define MESHLET_TRIANGLES 64
+
+typedef struct MeshletStats {
+    _Atomic uint64_t frames;
+    _Atomic uint64_t tested;
+    _Atomic uint64_t frustum_culled;
+    _Atomic uint64_t cone_culled;
+} MeshletStats;
+
+// Meshlet building (done once at import)
+void build_mesh_meshlets(Mesh *);
+void bound_mesh_meshlet(Mesh *, MeshMeshlet *, VecConnectionsPoints *, int);
+
+// Per frame culling
+unsigned char *cull_mesh_meshlets(UserCamera *, Mesh *, FrameArena *, unsigned char **);
+int is_meshlet_backfacing(MeshMeshlet *, fVec4 *);
+
+void record_meshlet_stats(uint64_t, uint64_t, uint64_t);
+void print_meshlet_stats(void);
+
+#endif
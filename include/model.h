@@ -1,18 +1,91 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <stdint.h>
+
 #include "constants.h"
 #include "geometry.h"
+#include "material.h"
 #include "transform.h"
 #include "triangle.h"
 
 typedef struct LLVecConnections {
     struct LLVecConnections *next;
-    fVec4 *triangle_points[NUM_TRIANGLE_VERTEX];
+
+    // Indices into Mesh.vec_arr, or into the compact vertices when the mesh is stored compact
+    int vertices[NUM_TRIANGLE_VERTEX];
     fVec4 *surface_normal;
 
+    // Indices into Mesh.uv_arr per corner (-1 when the face has none), kept apart
+    // from the positions since a seam gives one position several uvs
+    int uvs[NUM_TRIANGLE_VERTEX];
+
+    // Indices into Mesh.edges, one per side of the triangle
+    int edges[NUM_TRIANGLE_VERTEX];
+
+    // Index into Mesh.materials
+    int material;
+
 } VecConnectionsPoints;
 
+// Unique edge between two welded vertices of Mesh.vec_arr
+typedef struct MeshEdge {
+    int v0;
+    int v1;
+} MeshEdge;
+
+// Run of triangles sharing one material, walked for triangle_count from head.
+// Runs are contiguous in Mesh.head for an obj, a paged mesh keeps them apart
+typedef struct MeshSubmesh {
+    int material;
+    int first_triangle;
+    int triangle_count;
+    VecConnectionsPoints *head;
+
+    // Its meshlets, consecutive in Mesh.meshlets
+    int first_meshlet;
+    int meshlet_count;
+} MeshSubmesh;
+
+// Run of consecutive faces of one submesh, culled whole before any of its
+// vertices are transformed
+typedef struct MeshMeshlet {
+    // Bounding sphere of its vertices
+    fVec4 center;
+    float radius;
+
+    // Every face normal lies within the cone around the axis, a cutoff of 1 never culls
+    fVec4 cone_axis;
+    float cone_cutoff;
+
+    // Its unique vertices, a run of Mesh.meshlet_vertices
+    int first_vertex;
+    int vertex_count;
+} MeshMeshlet;
+
+// 12 bytes standing in for a 16 byte position and a 16 byte normal
+typedef struct CompactVertex {
+    // Steps across the mesh box, the fourth keeps the normal 4 byte aligned
+    uint16_t position[4];
+
+    // Octahedral, 16 bits per axis
+    uint32_t normal;
+} CompactVertex;
+
+// Quantized copy of the vertex data the per frame loops read, decoded on the fly
+typedef struct CompactVertices {
+    CompactVertex *vertices;
+    int count;
+
+    // uv_arr as half floats, u in the high half
+    uint32_t *uvs;
+    int uv_count;
+
+    // position = origin + steps * step, per axis
+    float origin[3];
+    float step[3];
+} CompactVertices;
+
 typedef struct Mesh {
     int face_count;
     int vec_count;
@@ -21,9 +94,33 @@ typedef struct Mesh {
     int num_triangles;
 
     fVec4 *vec_arr;
+
+    // Averaged surface normals, one per vec_arr entry, for Gouraud shading
+    fVec4 *normal_arr;
+
+    // Parsed vt entries, v is flipped so 0 is the top row of the texture
+    fVec2 *uv_arr;
     fVec4 *bounding_box_vec[NUM_BOUNDING_BOX_VERTEX];
 
     VecConnectionsPoints *head;
+
+    MeshEdge *edges;
+    int edge_count;
+
+    // Grouped by material at import and ordered by pipeline state, so a draw
+    // switches texture and kernel once per submesh instead of per triangle
+    MaterialLibrary *materials;
+    MeshSubmesh *submeshes;
+    int submesh_count;
+
+    // Built after the submeshes, a meshlet never spans two of them
+    MeshMeshlet *meshlets;
+    int meshlet_count;
+    int *meshlet_vertices;
+
+    // Set instead of vec_arr, normal_arr and uv_arr when the settings store the
+    // mesh compact, anything else reading vertices decodes them on demand
+    CompactVertices *compact;
 } Mesh;
 
 typedef struct ModelObject {
@@ -14,13 +14,20 @@ typedef enum AttributeType {
 } VertexAttribute;
 
 FILE *open_file(char *);
-void generate_mesh(FILE *, Mesh *);
-void populate_vertex_connections(int *, int, Mesh *);
+void generate_mesh(FILE *, const char *, Mesh *);
+void read_mesh_vertices(FILE *, Mesh *);
+void read_mesh_faces(FILE *, const char *, Mesh *);
+void populate_vertex_connections(int *, int *, int, int, Mesh *);
+int compare_submesh_keys(const void *, const void *);
+void group_mesh_submeshes(Mesh *);
+int get_submesh_key(MaterialLibrary *, int);
 void calculate_surface_normal(VecConnectionsPoints *, fVec4 *, fVec4 *, fVec4 *);
+void compute_face_normal(const fVec4 *, const fVec4 *, const fVec4 *, fVec4 *);
+void calculate_vertex_normals(Mesh *);
 int *parse_vertex_attributes(FILE *);
 void determine_min_max(float *, float *, float *, float *, float *, float *, float, float, float);
 void define_bounding_box(Mesh *, float, float, float, float, float, float);
-void parse_vertex_connections(FILE *, Mesh *);
+void parse_vertex_connections(FILE *, const char *, Mesh *);
 void populate_vertices_arr(FILE *, Mesh *);
 void free_obj_reader(Mesh *);
 
@@ -0,0 +1,250 @@
+#ifndef PAGED_MESH_H
+#define PAGED_MESH_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "camera.h"
+#include "material.h"
+#include "model.h"
+
+// "PMSH", files are written and read on machines with the same byte order
+#define PAGED_MESH_MAGIC 0x48534d50u
+#define PAGED_MESH_VERSION 1
+
+// Unit the file is read in and the cache holds, a cluster never straddles two
+#define PAGED_MESH_PAGE_SIZE (64 * 1024)
+
+// Triangles per cluster, neighbours along a Morton curve so each is a compact patch.
+// Even with no shared vertices a cluster fits in half a page
+#define PAGED_MESH_CLUSTER_TRIANGLES 256
+
+// Cells per axis the coarse level snaps a cluster's vertices to
+#define PAGED_MESH_COARSE_GRID 4
+
+// Clusters closer than this many of their radii want full detail
+#define PAGED_MESH_DETAIL_DISTANCE 24.0f
+
+// Faces the converter sorts in memory at once, bigger meshes spill sorted runs
+// of this many to a temp file and merge them back, reading a few at a time
+#define PAGED_MESH_SPILL_FACES (1 << 20)
+#define PAGED_MESH_MERGE_FACES 1024
+
+// Resident full detail pages, and how many the stream may read in one frame
+#define PAGED_MESH_CACHE_PAGES 256
+#define PAGED_MESH_PAGES_PER_FRAME 8
+
+typedef enum PagedClusterLevel {
+    PAGED_CLUSTER_HIDDEN,
+    PAGED_CLUSTER_COARSE,
+    PAGED_CLUSTER_FULL
+} PagedClusterLevel;
+
+// Page 0 of the file, the full detail pages follow it and the directory,
+// materials and coarse clusters come after the last page
+typedef struct PagedMeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t page_count;
+    uint32_t cluster_count;
+    uint32_t material_count;
+    uint32_t has_uvs;
+    float min[3];
+    float max[3];
+    uint64_t coarse_size;
+} PagedMeshHeader;
+
+// Where one cluster lives, the whole directory stays in memory
+typedef struct PagedCluster {
+    float min[3];
+    float max[3];
+    uint32_t page;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t coarse_offset;
+    uint32_t coarse_size;
+} PagedCluster;
+
+// Material as stored, the texture is loaded again from diffuse_map
+typedef struct PagedMaterial {
+    char name[MAX_MATERIAL_NAME_SIZE];
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+    float opacity;
+    char diffuse_map[MAX_MATERIAL_PATH_SIZE];
+} PagedMaterial;
+
+// One triangle of the obj on its way into a cluster. Sorted along the Morton
+// curve, ties go by draw order and then the way the triangle list had them
+typedef struct PagedFace {
+    uint32_t morton;
+    uint32_t order;
+    uint32_t serial;
+    int32_t material;
+    int32_t vertices[NUM_TRIANGLE_VERTEX];
+    int32_t uvs[NUM_TRIANGLE_VERTEX];
+} PagedFace;
+
+// Sorted run of faces being merged, the rest of it is still in the spill file
+typedef struct PagedRun {
+    PagedFace *faces;
+    int count;
+    int next;
+    off_t offset;
+    int64_t remaining;
+} PagedRun;
+
+// Visible cluster and how far it is, the nearest ones get pages first
+typedef struct PagedClusterOrder {
+    float distance;
+    int cluster;
+} PagedClusterOrder;
+
+// Resident page of the cache, the one needed longest ago is replaced first
+typedef struct PagedPageSlot {
+    int page;
+    uint64_t last_used;
+    unsigned char *data;
+} PagedPageSlot;
+
+// Free run of a geometry pool
+typedef struct PagedRange {
+    int first;
+    int count;
+} PagedRange;
+
+// Ranges handed out of one pool, first fit from the free runs, which are kept in
+// order and merged when released. Nothing at or past high is in use
+typedef struct PagedRanges {
+    PagedRange *free;
+    int free_count;
+    int free_capacity;
+    int capacity;
+    int high;
+} PagedRanges;
+
+// What one cluster adds at one level, built when the cluster comes in and kept
+// until its level changes. The ranges are into the paged mesh's pools
+typedef struct PagedPiece {
+    int level;
+    int first_vertex;
+    int vertex_count;
+    int first_corner;
+    int corner_count;
+    int first_triangle;
+    int triangle_count;
+    int first_edge;
+    int edge_count;
+    int first_meshlet_vertex;
+    int meshlet_vertex_count;
+
+    // One run per material in draw order, meshlets are counted from the piece's own
+    MeshSubmesh *runs;
+    int run_count;
+    MeshMeshlet *meshlets;
+    int meshlet_count;
+} PagedPiece;
+
+// Mesh bigger than memory, streamed in clusters. Only the directory and the
+// coarse level are always resident, full detail comes in pages near the camera
+typedef struct PagedMesh {
+    FILE *file;
+    PagedMeshHeader header;
+    PagedCluster *clusters;
+    unsigned char *coarse;
+    MaterialLibrary *materials;
+
+    // LRU page cache, page_slots maps a file page to its slot or -1
+    PagedPageSlot *slots;
+    int slot_count;
+    int *page_slots;
+    int pages_per_frame;
+    uint64_t frame;
+
+    // Level of every cluster in mesh, and scratch to pick the next ones
+    unsigned char *levels;
+    unsigned char *wanted;
+    PagedClusterOrder *order;
+
+    // Geometry of the resident pieces, allocated once at open so nothing a mesh
+    // points into ever moves. Vertices, corners and triangles share indices
+    // across their arrays, every mesh indexes the pools directly. Vertices and
+    // corners are either floats or compact, whichever compact_storage says
+    int compact_storage;
+    fVec4 *vertices;
+    fVec4 *normals;
+    CompactVertex *compact_vertices;
+    fVec2 *uvs;
+    uint32_t *compact_uvs;
+    VecConnectionsPoints *triangles;
+    fVec4 *surface_normals;
+    MeshEdge *edges;
+    int *meshlet_vertices;
+    PagedRanges vertex_ranges;
+    PagedRanges corner_ranges;
+    PagedRanges triangle_ranges;
+    PagedRanges edge_ranges;
+    PagedRanges meshlet_vertex_ranges;
+
+    // Quantized against the whole mesh box, so pieces encode on their own
+    CompactVertices compact;
+
+    // Piece of every cluster, and the ones replaced at the last rebuild that the
+    // retired mesh still draws
+    PagedPiece *pieces;
+    PagedPiece *quarantine;
+    int quarantine_count;
+
+    // What the renderer draws, retired is still read by the frame being presented
+    Mesh *mesh;
+    Mesh *retired;
+} PagedMesh;
+
+typedef struct PagedMeshStats {
+    _Atomic uint64_t frames;
+    _Atomic uint64_t page_reads;
+    _Atomic uint64_t rebuilds;
+    _Atomic uint64_t built_clusters;
+    _Atomic uint64_t full_clusters;
+    _Atomic uint64_t coarse_clusters;
+} PagedMeshStats;
+
+// Writing, streamed from the obj so the triangle list is never built
+int write_paged_mesh(FILE *, const char *, const char *);
+int read_paged_face_corners(char *, int **, int **, int *);
+int spill_paged_faces(FILE *, PagedFace *, int);
+int take_paged_face(FILE *, PagedRun *, int *, int *, PagedFace *);
+void sift_paged_runs(PagedRun *, int *, int, int);
+int compare_paged_faces(const void *, const void *);
+uint32_t compute_morton_code(float, float, float);
+size_t pack_paged_cluster(unsigned char *, int, const float *, const float *, int, const uint32_t *, const float *, const int32_t *);
+size_t build_paged_cluster(const fVec4 *, const fVec4 *, const fVec2 *, const PagedFace *, int, int *, unsigned char *, unsigned char *, size_t *, PagedCluster *);
+
+// Streaming
+PagedMesh *open_paged_mesh(const char *, int, int);
+void free_paged_mesh(PagedMesh *);
+int update_paged_mesh(PagedMesh *, UserCamera *);
+int set_paged_mesh_storage(PagedMesh *, int);
+unsigned char *fetch_paged_page(PagedMesh *, int, int *);
+const unsigned char *get_paged_cluster_data(PagedMesh *, int, int);
+int create_paged_mesh_pools(PagedMesh *);
+void free_paged_mesh_pools(PagedMesh *);
+int take_paged_range(PagedRanges *, int, int *, int *);
+void release_paged_range(PagedRanges *, int, int);
+int build_paged_piece(PagedMesh *, const unsigned char *, PagedPiece *);
+void release_paged_piece(PagedMesh *, PagedPiece *);
+void release_paged_quarantine(PagedMesh *);
+Mesh *assemble_paged_mesh(PagedMesh *, const unsigned char *, uint64_t *);
+Mesh *link_paged_pieces(PagedMesh *);
+void free_paged_mesh_geometry(Mesh *);
+int compare_paged_distances(const void *, const void *);
+int compare_paged_keys(const void *, const void *);
+
+void record_paged_mesh_stats(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+void print_paged_mesh_stats(void);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "frame_arena.h"
+#include "framebuffer.h"
+#include "job_system.h"
+
+// Rows handed out as one job, small enough that edge heavy bands get stolen
+#define POST_PROCESS_ROW_BAND 16
+
+// Tone mapped values index straight into the sRGB encode table
+#define POST_PROCESS_GAMMA_LUT_SIZE 4096
+
+// FXAA leaves a pixel alone when its local luma range is below either threshold
+#define FXAA_EDGE_THRESHOLD 0.125f
+#define FXAA_EDGE_THRESHOLD_MIN 8
+
+// Pixels walked along an edge in each direction looking for its ends
+#define FXAA_SEARCH_STEPS 8
+
+// How much of the single pixel aliasing gets smoothed, 1 is the softest
+#define FXAA_SUBPIXEL_QUALITY 0.75f
+
+typedef struct PostProcessJob {
+    Framebuffer *framebuffer;
+
+    // Scales linear light before the tone curve
+    float exposure;
+
+    // The deferred pass left its unclamped light in framebuffer->hdr this frame
+    int use_hdr;
+
+    // Row scratch comes from the worker's part of the frame's arena
+    FrameArena *arena;
+
+    // Added to by the FXAA bands, pixels they actually blended
+    _Atomic uint64_t edge_pixels;
+} PostProcessJob;
+
+// Shared by every render context post processing at the same time
+typedef struct PostProcessStats {
+    _Atomic uint64_t passes;
+    _Atomic uint64_t pixels;
+    _Atomic uint64_t edge_pixels;
+    _Atomic uint64_t time_ns;
+    atomic_int workers;
+} PostProcessStats;
+
+void post_process_framebuffer(Framebuffer *, float, int, FrameArena *, JobSystem *);
+void tone_map_rows(void *, int, int);
+void fxaa_rows(void *, int, int);
+uint32_t fxaa_pixel(const Framebuffer *, int, int, uint64_t *);
+float tone_map_aces(float);
+void build_display_lut(void);
+void fill_display_lut(void);
+void print_post_process_stats(void);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef RASTER_BINS_H
+#define RASTER_BINS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "framebuffer.h"
+#include "job_system.h"
+#include "raster_kernel.h"
+#include "triangle_setup.h"
+
+// Screen tiles one raster job owns, a multiple of RASTER_BLOCK_SIZE so a
+// block never straddles two of them
+#define RASTER_TILE_SIZE 64
+
+// Most triangles one front end job clips, sets up and bins
+#define RASTER_BIN_CHUNK_TRIANGLES 2048
+
+// Set up triangles one segment holds, a chunk that emits more fills another.
+// Memory follows what survives culling instead of every triangle clipping to 7
+#define RASTER_SEGMENT_TRIANGLES 1024
+
+// Segments one set of bins keeps, about 16 MB with uvs. Setup stops when they
+// run out and the raster back end draws, recycles and sets up the rest
+#define RASTER_SEGMENT_BUDGET 64
+
+// Fixed size piece of one chunk's set up output, sorted by the tiles it touches
+typedef struct RasterSegment {
+    RasterQueue *queue;
+
+    // Tile t owns entries offsets[t] up to offsets[t + 1], a triangle is
+    // listed under every tile its bounding box reaches
+    int *triangle_offsets;
+    int *triangle_indices;
+    int triangle_index_capacity;
+
+    // Micro triangles cover one pixel, so one tile each
+    int *pixel_offsets;
+    RasterPixel *pixels;
+
+    // Next segment of the same chunk, or of the free list
+    struct RasterSegment *next;
+} RasterSegment;
+
+struct LLVecConnections;
+
+// Set up output of one chunk of a draw, in submission order
+typedef struct RasterChunk {
+    RasterSegment *segments;
+
+    // Input triangle setup goes on from, the chunk is done once next reaches end
+    struct LLVecConnections *triangle;
+    int next;
+    int end;
+} RasterChunk;
+
+typedef struct RasterBins {
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    int tile_count;
+
+    // Chunks of every draw binned so far, kept in submission order and
+    // reused by the next set of draws instead of freed
+    RasterChunk *chunks;
+    int chunk_count;
+    int chunk_capacity;
+
+    // Segments no chunk holds, setup jobs take them as theirs fill up. Only
+    // the back end's oldest unfinished chunk may grow them past the budget
+    RasterSegment *free_segments;
+    int segment_count;
+    pthread_mutex_t segment_lock;
+
+    // Input triangles per chunk, small meshes get small chunks
+    int chunk_triangles;
+    int attribute_count;
+} RasterBins;
+
+// Shared by the tile jobs of one draw
+typedef struct RasterTileJob {
+    Framebuffer *framebuffer;
+    RasterBins *bins;
+    int first_chunk;
+    int last_chunk;
+    const RasterKernel *kernel;
+    const RasterState *state;
+
+    _Atomic uint64_t pixels;
+} RasterTileJob;
+
+RasterBins *create_raster_bins(int, int, int, int);
+RasterBins *prepare_raster_bins(RasterBins *, int, int, int, int);
+void reset_raster_bins(RasterBins *);
+int reserve_raster_chunks(RasterBins *, int);
+void free_raster_bins(RasterBins *);
+
+RasterSegment *create_raster_segment(RasterBins *);
+RasterSegment *take_raster_segment(RasterBins *, int);
+void release_raster_segment(RasterBins *, RasterSegment *);
+void release_raster_chunks(RasterBins *, int, int);
+void free_raster_segment(RasterSegment *);
+
+void bin_raster_segment(RasterBins *, RasterSegment *);
+void rasterize_raster_bins(Framebuffer *, RasterBins *, int, int, const RasterKernel *, const RasterState *, JobSystem *);
+void rasterize_tiles(void *, int, int);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef RASTER_KERNEL_H
+#define RASTER_KERNEL_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "framebuffer.h"
+#include "texture.h"
+#include "triangle_setup.h"
+
+// Pipeline state the per pixel loop is specialized on, picked once per draw
+#define RASTER_DEPTH_COUNT 2
+#define RASTER_SAMPLE_MODE_COUNT 2
+
+typedef enum RasterShade {
+    RASTER_SHADE_FLAT,
+    RASTER_SHADE_INTERPOLATED,
+    RASTER_SHADE_TEXTURED,
+
+    // Writes the framebuffer's G-buffer instead of color, lit later in one pass
+    RASTER_SHADE_GBUFFER,
+
+    // Depth writes only, no color and no planes beyond 1/w, for shadow maps
+    RASTER_SHADE_DEPTH,
+    RASTER_SHADE_COUNT
+} RasterShade;
+
+typedef enum RasterBlend {
+    RASTER_BLEND_OPAQUE,
+    RASTER_BLEND_ALPHA,
+    RASTER_BLEND_COUNT
+} RasterBlend;
+
+#define RASTER_KERNEL_COUNT (RASTER_SAMPLE_MODE_COUNT * RASTER_DEPTH_COUNT * RASTER_SHADE_COUNT * RASTER_BLEND_COUNT)
+
+// Per draw constants read by the kernels
+typedef struct RasterState {
+    // Source weight for blended kernels, 0 - 256
+    uint32_t alpha;
+
+    // Sampled by the textured kernels, modulated by the interpolated color
+    const Texture *texture;
+
+    // Written to the G-buffer by the G-buffer kernels
+    uint16_t material;
+} RasterState;
+
+typedef void (*RasterSpanFunc)(Framebuffer *, RasterTriangle *, const RasterState *, int, int, int, int);
+typedef void (*RasterPartialFunc)(Framebuffer *, RasterTriangle *, const RasterState *, int64_t[NUM_TRIANGLE_VERTEX], int64_t[NUM_TRIANGLE_VERTEX],
+                                  int, int, int, int, int, int);
+typedef void (*RasterPixelFunc)(Framebuffer *, const RasterPixel *, int, const RasterState *);
+
+typedef struct RasterKernel {
+    const char *name;
+    int index;
+
+    // Samples per pixel it writes, multisampled kernels go to the sample planes
+    int samples;
+
+    // Fully covered block, block crossed by an edge, and micro triangle pixels
+    RasterSpanFunc fill_spans;
+    RasterPartialFunc fill_partial;
+    RasterPixelFunc draw_pixels;
+} RasterKernel;
+
+// Shadow maps and the frame being drawn can both be rasterizing at once
+typedef struct RasterKernelStats {
+    _Atomic uint64_t triangles;
+    _Atomic uint64_t pixels;
+    _Atomic uint64_t time_ns;
+} RasterKernelStats;
+
+const RasterKernel *select_raster_kernel(int, RasterShade, RasterBlend, int);
+void evaluate_planes(RasterTriangle *, int, int, float *);
+
+void record_raster_kernel_stats(const RasterKernel *, uint64_t, uint64_t, uint64_t);
+void print_raster_kernel_stats(void);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef RENDER_CONTEXT_H
+#define RENDER_CONTEXT_H
+
+#include "camera.h"
+#include "frame_pipeline.h"
+#include "framebuffer.h"
+#include "model.h"
+#include "render_pipeline.h"
+#include "shading.h"
+#include <SDL3/SDL.h>
+
+// One independent view: its own target, camera, settings and frame scratch.
+// Contexts share nothing but the scene they reference, so each one can be
+// rendered from its own thread (not from inside a job) at the same time
+typedef struct RenderContext {
+    int width;
+    int height;
+
+    // Color and depth the view is drawn into
+    Framebuffer *framebuffer;
+    UserCamera *camera;
+
+    // Not owned and only read while drawing, the scene's owner moves the
+    // model between frames. Frames light through their own copy of the
+    // lights and shadow maps no other view touches
+    ModelObject *model;
+
+    // Box drawn in place of a model that is still loading
+    int has_proxy;
+    float proxy_min[3];
+    float proxy_max[3];
+
+    RenderSettings settings;
+
+    // Recorded frames with their vertex caches and bins, kept between frames
+    FramePipeline *pipeline;
+} RenderContext;
+
+RenderContext *create_render_context(int, int, RenderSettings *);
+void free_render_context(RenderContext *);
+void set_render_context_scene(RenderContext *, ModelObject *, LightingScene *);
+void set_render_context_proxy(RenderContext *, const float *, const float *);
+int render_context_frame(RenderContext *, SDL_Renderer *, SDL_Texture *);
+void render_context_still(RenderContext *);
+void wait_for_render_context(RenderContext *);
+void drop_render_context_frame(RenderContext *);
+
+#endif
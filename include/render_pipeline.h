@@ -2,23 +2,267 @@
 #define RENDER_PIPELINE_H
 
 #include "camera.h"
+#include "frame_arena.h"
+#include "framebuffer.h"
+#include "job_system.h"
 #include "model.h"
+#include "post_process.h"
+#include "raster_bins.h"
+#include "raster_kernel.h"
+#include "shading.h"
+#include "shadow.h"
+#include "triangle_setup.h"
 #include <SDL3/SDL.h>
+#include <stdint.h>
 
-typedef struct {
-    fVec4 position;
-} ClipVertex;
+// Outcode bits, one per clip plane the vertex lies outside of
+typedef enum ClipOutcode {
+    OUTCODE_LEFT = 1 << 0,
+    OUTCODE_RIGHT = 1 << 1,
+    OUTCODE_BOTTOM = 1 << 2,
+    OUTCODE_TOP = 1 << 3,
+    OUTCODE_NEAR = 1 << 4,
+    OUTCODE_FAR = 1 << 5,
+    OUTCODE_GUARD_LEFT = 1 << 6,
+    OUTCODE_GUARD_RIGHT = 1 << 7,
+    OUTCODE_GUARD_BOTTOM = 1 << 8,
+    OUTCODE_GUARD_TOP = 1 << 9
+} ClipOutcode;
+
+// Planes that force a triangle down the geometric clipping path
+#define OUTCODE_CLIP_MASK (OUTCODE_NEAR | OUTCODE_FAR | OUTCODE_GUARD_LEFT | OUTCODE_GUARD_RIGHT | OUTCODE_GUARD_BOTTOM | OUTCODE_GUARD_TOP)
+
+// Vertices one job transforms and outcodes
+#define VERTEX_TRANSFORM_GRAIN 4096
+
+typedef enum RenderMode {
+    RENDER_MODE_FILLED,
+    RENDER_MODE_WIREFRAME
+} RenderMode;
+
+// Where wireframe lines end up, straight in the framebuffer or batched to SDL
+typedef enum WireframeTarget {
+    WIREFRAME_TARGET_FRAMEBUFFER,
+    WIREFRAME_TARGET_RENDERER
+} WireframeTarget;
+
+// Which submeshes a triangle pass draws and where it writes them
+typedef enum RenderPass {
+    RENDER_PASS_FORWARD,
+
+    // Forward into the multisampled planes, resolved into color afterwards
+    RENDER_PASS_MULTISAMPLE,
+    RENDER_PASS_GBUFFER,
+    RENDER_PASS_TRANSPARENT
+} RenderPass;
+
+typedef struct RenderSettings {
+    RenderMode mode;
+    WireframeTarget wireframe_target;
+
+    ShadingMode shading;
+    LightingScene *lighting;
+
+    // Picks the raster kernel, blended draws cover what is behind them by opacity
+    int depth_test;
+    RasterBlend blend;
+    float opacity;
+
+    // Materials with a diffuse map sample it when set
+    int textured;
+
+    // Opaque surfaces go to a G-buffer and every visible pixel is lit once
+    int deferred;
+
+    // Lights with a shadow map draw it when stale and sample it while lighting
+    int shadows;
+
+    // 4x MSAA for the forward path, shaded once per pixel and resolved at the end
+    int multisample;
+
+    // Tone mapping, gamma and FXAA over the finished frame, exposure scales
+    // linear light before the tone curve
+    int post_process;
+    float exposure;
+
+    // Meshes are stored as the quantized stream instead of floats, the vertex
+    // loops read whichever one the mesh has
+    int compact_vertices;
+
+    // Every frame is drawn even when nothing changed, and the per stage stats
+    // print with the FPS about once a second
+    int benchmark;
+
+    // Workers every stage splits its loops over, NULL runs them all in place
+    JobSystem *jobs;
+} RenderSettings;
+
+// Frame rate of one view, printed with the module stats about once a second
+typedef struct FrameTimer {
+    uint64_t last_frame_time;
+    uint32_t frame_count;
+    uint64_t last_fps_update;
+    float fps;
+} FrameTimer;
 
 typedef struct {
     ClipVertex vertices[NUM_CLIP_TRIANLGE_VERTEX];
     int count;
+    int attribute_count;
 } ClipVertexList;
 
+// Clip space position and outcode of every mesh vertex, built once per frame
+typedef struct {
+    ClipVertex *vertices;
+    uint16_t *outcodes;
+    int count;
+
+    // Attributes filled in per vertex, everything past it is never read
+    int attribute_count;
+
+    // Vertices of meshlets that survived culling, NULL transforms all of them
+    const unsigned char *vertex_mask;
+
+    // Quantized vertices read in place of the float arrays, NULL reads the floats
+    const CompactVertices *compact;
+} ClipVertexCache;
+
+// Shared by the jobs transforming one mesh's vertices
+typedef struct VertexTransformJob {
+    Mesh *mesh;
+    ClipVertexCache *vertex_cache;
+    fMatrix44 *view_projection;
+
+    // View projection with the compact stream's scale and origin folded in
+    fMatrix44 decode_projection;
+} VertexTransformJob;
+
+// One submesh draw's front end, every job clips, sets up and bins whole chunks
+typedef struct TriangleChunkJob {
+    Mesh *mesh;
+    ClipVertexCache *vertex_cache;
+    RasterBins *bins;
+
+    int first_triangle;
+    int triangle_count;
+
+    // Per face light replacing the vertex colors when not NULL, times diffuse
+    const float *face_colors;
+    float diffuse[3];
+
+    // Each chunk starts its own setup batch from these
+    int attribute_count;
+    int viewport_width;
+    int viewport_height;
+    int multisample;
+
+    // Positions only, casters drawn into a shadow map have nothing else
+    int depth_only;
+
+    // Faces of culled meshlets are skipped, NULL sets up every face
+    const unsigned char *meshlet_visible;
+    int first_meshlet;
+
+    // Where this submesh's chunks start in the bins, earlier draws keep theirs
+    int first_chunk;
+
+    // Chunk that may grow the segment pool past its budget, so the back end's
+    // oldest unfinished one always finishes. -1 keeps every chunk to the budget
+    int force_chunk;
+} TriangleChunkJob;
+
+// What the raster back end does with a recorded command
+typedef enum RenderCommandType {
+    RENDER_COMMAND_DRAW,
+    RENDER_COMMAND_CLEAR_SAMPLES,
+    RENDER_COMMAND_RESOLVE_SAMPLES,
+    RENDER_COMMAND_CLEAR_GBUFFER,
+    RENDER_COMMAND_LIGHT_GBUFFER
+} RenderCommandType;
+
+typedef struct RenderCommand {
+    RenderCommandType type;
+    RenderPass pass;
+
+    // Draws rasterize chunks first_chunk up to first_chunk + chunk_count of the frame's bins
+    int first_chunk;
+    int chunk_count;
+    const RasterKernel *kernel;
+    RasterState state;
+
+    // Sets up whatever the front end left of the chunks when the segments ran out
+    TriangleChunkJob setup;
+} RenderCommand;
+
+// Pixels x0 up to x1 of rows y0 up to y1, empty when x0 >= x1 or y0 >= y1
+typedef struct ScreenRect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} ScreenRect;
+
+// Everything the geometry front end hands the raster back end for one frame,
+// recording the next one never touches it
+typedef struct RenderFrame {
+    // Copied when recording starts, key presses after that wait for the next frame.
+    // Its lighting is the frame's own copy of the scene's lights
+    RenderSettings settings;
+    LightingScene lighting;
+
+    // The view's shadow maps, shared with its other frames
+    ShadowMapSet *shadow_maps;
+    Mesh *mesh;
+    fMatrix44 view_projection;
+
+    // Model was in the frustum and has geometry to draw
+    int visible;
+
+    // Meshlets left after frustum and cone culling, NULL when nothing was culled
+    unsigned char *meshlet_visible;
+
+    // Part of the framebuffer cleared before drawing, the rest still holds the
+    // frame before. The whole target unless only the model changed
+    ScreenRect dirty;
+
+    // Vertex cache and shading buffers, all dropped when the frame is recorded again
+    FrameArena arena;
+    ClipVertexCache vertex_cache;
+
+    // Binned triangles of every draw, the chunks are kept from frame to frame
+    RasterBins *bins;
+
+    RenderCommand *commands;
+    int command_count;
+    int command_capacity;
+} RenderFrame;
+
 // Main pipeline
-void execute_render_pipeline(SDL_Renderer *, ModelObject *, UserCamera *);
-void start_render(SDL_Renderer *, ModelObject *, UserCamera *);
-void render_model_geometry(SDL_Renderer *, UserCamera *, ModelObject *);
-void render_triangle_3d(SDL_Renderer *, UserCamera *, VecConnectionsPoints *, iVec2 *, int *);
+void record_render_frame(RenderFrame *, Framebuffer *, RenderSettings *, ModelObject *, UserCamera *, JobCounter *);
+void draw_render_frame(Framebuffer *, RenderFrame *);
+void present_render_frame(SDL_Renderer *, SDL_Texture *, Framebuffer *, RenderFrame *);
+void free_render_frame(RenderFrame *);
+RenderCommand *push_render_command(RenderFrame *, RenderCommandType);
+void replay_render_command(Framebuffer *, RenderFrame *, RenderCommand *);
+void record_model_geometry(RenderFrame *, Framebuffer *, UserCamera *, ModelObject *);
+int mesh_uses_textures(RenderSettings *, Mesh *);
+void record_model_deferred(RenderFrame *, UserCamera *, Mesh *);
+RasterBlend resolve_material_blend(RenderSettings *, Material *, float *);
+void bin_model_triangles(RenderFrame *, RenderPass);
+int bin_submesh_triangles(TriangleChunkJob *, MeshSubmesh *, JobSystem *);
+void setup_triangle_chunks(void *, int, int);
+void rasterize_submesh_chunks(Framebuffer *, TriangleChunkJob *, int, const RasterKernel *, const RasterState *, JobSystem *);
+void copy_frame_lighting(RenderFrame *, LightingScene *);
+void update_shadow_maps(RenderSettings *, ShadowMapSet *, ModelObject *, JobCounter *, FrameArena *);
+void render_shadow_map(ShadowMap *, Mesh *, JobSystem *, FrameArena *);
+void shade_mesh_vertices(RenderSettings *, Mesh *, ClipVertexCache *, FrameArena *);
+float *shade_mesh_faces(RenderSettings *, Mesh *, FrameArena *);
+void encode_mesh_vertex_normals(Mesh *, ClipVertexCache *);
+float *encode_mesh_face_normals(RenderSettings *, Mesh *, FrameArena *);
+void render_triangle_3d(Mesh *, VecConnectionsPoints *, ClipVertexCache *, const float *, const float *, TriangleSetupBatch *, RasterQueue *);
+void submit_clip_triangle(ClipVertex[3], uint16_t[3], int, TriangleSetupBatch *, RasterQueue *);
+void transform_mesh_vertices(UserCamera *, Mesh *, ClipVertexCache *, JobSystem *);
+void transform_vertex_range(void *, int, int);
 
 // Culling and Visibility
 int check_model_in_frustum(ModelObject *, UserCamera *);
@@ -27,17 +271,19 @@ int is_front_facing(iVec2 *);
 int determine_winding_order(iVec2 *);
 
 // Clipping Pipleline
-ClipVertex interpolate_clip_vertex(const ClipVertex *, const ClipVertex *, float);
-int clip_triangle_3d(ClipVertex[3], ClipVertexList *);
-int clip_to_screen(const ClipVertex *, iVec2 *);
+ClipVertex interpolate_clip_vertex(const ClipVertex *, const ClipVertex *, float, int);
+uint16_t compute_clip_outcode(const fVec4 *);
+int clip_triangle_3d(ClipVertex[3], uint16_t, int, ClipVertexList *);
+int clip_to_screen(const ClipVertex *, iVec2 *, int, int);
 void clip_against_plane(ClipVertexList *, ClipVertexList *, float[4]);
 
 // Utility Functions
 void clear_screen(SDL_Renderer *);
-void update_fps(void);
+void present_framebuffer(SDL_Renderer *, SDL_Texture *, Framebuffer *);
+void update_fps(FrameTimer *, int);
 void update_model_space(ModelObject *);
-fVec4 *calculate_triangle_centroid(fVec4 *[3]);
+fVec4 *calculate_triangle_centroid(Mesh *, VecConnectionsPoints *);
 fVec4 *calculate_normal_endpoint(fVec4 *, fVec4 *);
-void render_normal_vector(SDL_Renderer *, UserCamera *, VecConnectionsPoints *, iVec2 *);
+void render_normal_vector(SDL_Renderer *, UserCamera *, Mesh *, VecConnectionsPoints *, iVec2 *);
 
 #endif
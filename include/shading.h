@@ -0,0 +1,84 @@
+#ifndef SHADING_H
+#define SHADING_H
+
+#include <stdint.h>
+
+#include "geometry.h"
+#include "job_system.h"
+
+// Points one job lights, enough for the per light loops to stay worth batching
+#define LIGHT_POINTS_GRAIN 1024
+
+// Points past a mask gathered onto the stack at a time before lighting them
+#define LIGHT_MASKED_BLOCK 64
+
+typedef enum ShadingMode {
+    SHADING_UNLIT,
+    SHADING_FLAT,
+    SHADING_GOURAUD
+} ShadingMode;
+
+typedef enum LightType {
+    LIGHT_DIRECTIONAL,
+    LIGHT_POINT,
+    LIGHT_SPOT
+} LightType;
+
+struct ShadowMap;
+
+typedef struct Light {
+    LightType type;
+
+    // Directional lights shine along direction, point lights fall off to zero at range,
+    // spot lights do both and fade out between the inner and outer cone
+    fVec4 direction;
+    fVec4 position;
+    float range;
+    float cos_inner_cone;
+    float cos_outer_cone;
+
+    fVec4 color;
+    float intensity;
+
+    // Texels a side of the map every view keeps of this light, 0 casts no shadows
+    int shadow_size;
+
+    // NULL in the scene, a view's own copy of the lights points it at the view's map
+    struct ShadowMap *shadow;
+} Light;
+
+typedef struct LightingScene {
+    Light *lights;
+    int light_count;
+    int light_capacity;
+
+    fVec4 ambient;
+} LightingScene;
+
+// A light_points call shared out over the job system
+typedef struct LightPointsJob {
+    LightingScene *scene;
+    const fVec4 *positions;
+    const fVec4 *normals;
+    const unsigned char *mask;
+    float *red;
+    float *green;
+    float *blue;
+} LightPointsJob;
+
+LightingScene *create_lighting_scene(int);
+Light *add_directional_light(LightingScene *, fVec4, fVec4, float);
+Light *add_point_light(LightingScene *, fVec4, float, fVec4, float);
+Light *add_spot_light(LightingScene *, fVec4, fVec4, float, float, fVec4, float);
+Light *scatter_point_lights(LightingScene *, fVec4 *, fVec4 *, int, float, uint32_t);
+void free_lighting_scene(LightingScene *);
+
+void light_points(LightingScene *, const fVec4 *, const fVec4 *, int, float *, float *, float *);
+void light_points_parallel(LightingScene *, const fVec4 *, const fVec4 *, const unsigned char *, int, float *, float *, float *, JobSystem *);
+void light_point_range(void *, int, int);
+void light_points_culled(LightingScene *, const uint16_t *, int, const fVec4 *, const fVec4 *, int, float *, float *, float *);
+void apply_light(const Light *, const fVec4 *, const fVec4 *, int, float *, float *, float *);
+uint32_t pack_color(float, float, float);
+uint32_t blend_pixel(uint32_t, uint32_t, uint32_t);
+
+#endif
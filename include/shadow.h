@@ -0,0 +1,80 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "raster_bins.h"
+#include "shading.h"
+
+#define SHADOW_MAP_SIZE 1024
+
+// Texels on each side of the center tap, 1 is a 3x3 percentage closer filter
+#define SHADOW_PCF_RADIUS 1
+
+// Receivers are pushed this many shadow texels along their normal before the lookup
+#define SHADOW_NORMAL_OFFSET_TEXELS 1.5f
+#define SHADOW_DEPTH_BIAS 0.004f
+
+typedef struct ShadowMap {
+    int size;
+
+    // Depth only target the casters are drawn into
+    Framebuffer *depth_map;
+    RasterBins *bins;
+
+    // Sits at the light, orthographic for directional lights and a
+    // perspective frustum for spot lights
+    UserCamera *light_camera;
+    fMatrix44 light_view_projection;
+
+    // World units a receiver moves along its normal, one texel wide at the casters
+    float normal_offset;
+
+    // Set by the pipeline every frame, a disabled map leaves its light unshadowed
+    int enabled;
+
+    // What the map was last drawn from, it is only drawn again when one changes
+    int valid;
+    LightType rendered_type;
+    fVec4 rendered_direction;
+    fVec4 rendered_position;
+    float rendered_range;
+    float rendered_cone;
+    const Mesh *rendered_mesh;
+    int rendered_compact;
+    fMatrix44 rendered_model_mat;
+} ShadowMap;
+
+// One view's maps, map i is of light i in the scene the view draws. Its
+// frames share them, a map is only redrawn once the frame in flight is done
+typedef struct ShadowMapSet {
+    ShadowMap **maps;
+    int count;
+} ShadowMapSet;
+
+typedef struct ShadowMapStats {
+    _Atomic uint64_t renders;
+    _Atomic uint64_t reuses;
+    _Atomic uint64_t time_ns;
+} ShadowMapStats;
+
+ShadowMap *create_shadow_map(int);
+int attach_shadow_map(Light *, int);
+void free_shadow_map(ShadowMap *);
+ShadowMap *find_view_shadow_map(ShadowMapSet *, int, int);
+void free_shadow_map_set(ShadowMapSet *);
+
+int is_shadow_map_stale(const ShadowMap *, const Light *, const ModelObject *);
+void mark_shadow_map_rendered(ShadowMap *, const Light *, const ModelObject *);
+int fit_shadow_camera(ShadowMap *, const Light *, const Mesh *);
+float sample_shadow_map(const ShadowMap *, const fVec4 *, const fVec4 *);
+
+void record_shadow_map_stats(int, uint64_t);
+void print_shadow_map_stats(void);
+
+#endif
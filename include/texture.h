@@ -0,0 +1,47 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Texels are stored in 4x4 tiles, one tile is 64 bytes so a bilinear
+// footprint almost always lands in a single cache line
+#define TEXTURE_TILE_SIZE 4
+#define TEXTURE_TILE_SHIFT 2
+#define TEXTURE_TILE_TEXELS (TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE)
+
+// Texel coordinates are clamped to this before wrapping
+#define TEXTURE_COORD_LIMIT 1048576.0f
+
+// Enough levels for a 32k texture down to 1x1
+#define TEXTURE_MAX_LEVELS 16
+
+typedef struct TextureLevel {
+    int width;
+    int height;
+
+    // Tiles are stored row by row, texels inside a tile are row major
+    int tiles_x;
+    uint32_t *texels;
+} TextureLevel;
+
+typedef struct Texture {
+    int level_count;
+    TextureLevel levels[TEXTURE_MAX_LEVELS];
+} Texture;
+
+Texture *load_texture(const char *);
+Texture *create_texture(const uint32_t *, int, int);
+void free_texture(Texture *);
+
+uint32_t *read_ppm(FILE *, int *, int *);
+uint32_t *read_tga(FILE *, int *, int *);
+
+uint32_t *downsample_level(const uint32_t *, int, int, int *, int *);
+int tile_level(TextureLevel *, const uint32_t *, int, int);
+
+int select_texture_level(const Texture *, float);
+uint32_t fetch_texel(const TextureLevel *, int, int);
+uint32_t sample_texture_bilinear(const TextureLevel *, float, float);
+
+#endif
@@ -3,7 +3,13 @@
 
 #include <SDL3/SDL.h>
 
+#include "framebuffer.h"
 #include "geometry.h"
+#include "raster_kernel.h"
+#include "triangle_setup.h"
+
+// Rasterizer block size, blocks are accepted or rejected before any pixel test
+#define RASTER_BLOCK_SIZE 8
 
 typedef struct triangle {
     iVec2 *v1;
@@ -13,8 +19,7 @@ typedef struct triangle {
 
 Triangle *create_triangle(SDL_Renderer *, iVec2 *, iVec2 *, iVec2 *);
 void draw_triangle(SDL_Renderer *, iVec2 *, iVec2 *, iVec2 *);
-void batch_draw_triangles(SDL_Renderer *, int, iVec2 *);
-void populate_uv_map(Triangle *);
-void fill_triangle(SDL_Renderer *, iVec2 *, iVec2 *, iVec2 *);
+void batch_draw_triangles(SDL_Renderer *, RasterQueue *);
+uint64_t fill_triangle(Framebuffer *, RasterTriangle *, const RasterKernel *, const RasterState *, int, int, int, int);
 
 #endif
@@ -0,0 +1,119 @@
+#ifndef TRIANGLE_SETUP_H
+#define TRIANGLE_SETUP_H
+
+#include <stdint.h>
+
+#include "constants.h"
+#include "geometry.h"
+
+// Triangles gathered before running setup on all of them at once
+#define TRIANGLE_SETUP_LANES 8
+
+// Floats of per vertex data that ride along through clipping and rasterization
+#define MAX_VERTEX_ATTRIBUTES 16
+
+// Slots in ClipVertex.attributes, only the first attribute_count are touched
+#define ATTRIBUTE_COLOR 0
+#define ATTRIBUTE_COLOR_SIZE 3
+#define ATTRIBUTE_UV (ATTRIBUTE_COLOR + ATTRIBUTE_COLOR_SIZE)
+#define ATTRIBUTE_UV_SIZE 2
+
+// Farthest a multisample position sits from its pixel center, in subpixels
+// along either axis
+#define RASTER_SAMPLE_REACH 6
+
+// 1/w plus attribute/w for every active attribute
+#define RASTER_PLANE_COUNT(attribute_count) ((attribute_count) + 1)
+
+// Vertex after projection, attributes are lerped along with it through clipping
+typedef struct {
+    fVec4 position;
+    float attributes[MAX_VERTEX_ATTRIBUTES];
+} ClipVertex;
+
+// Clip space triangles stored structure-of-arrays, one lane per triangle
+typedef struct TriangleSetupBatch {
+    float x[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    float y[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    float z[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    float w[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+
+    float attributes[MAX_VERTEX_ATTRIBUTES][NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    int attribute_count;
+
+    // Size of the target NDC maps onto, the screen or a shadow map
+    int viewport_width;
+    int viewport_height;
+
+    // Triangles are kept for every pixel one of their samples could cover,
+    // none are reduced to a single pixel
+    int multisample;
+
+    int count;
+} TriangleSetupBatch;
+
+// Screen space triangle that survived culling. The edge equations
+// E(x, y) = a * x + b * y + c are evaluated at pixel centers, are >= 0
+// for covered pixels and already follow the top-left fill rule
+typedef struct RasterTriangle {
+    iVec2 points[NUM_TRIANGLE_VERTEX];
+
+    // Range of pixels whose centers fall in the bounding box
+    int min_x, min_y;
+    int max_x, max_y;
+
+    int edge_a[NUM_TRIANGLE_VERTEX];
+    int edge_b[NUM_TRIANGLE_VERTEX];
+    int64_t edge_c[NUM_TRIANGLE_VERTEX];
+
+    int64_t area;
+
+    // Color used by the flat kernels, exact when every vertex shares it
+    uint32_t flat_color;
+
+    // NDC depth is already linear in screen space, so it needs no 1/w
+    float depth_origin;
+    float depth_dx;
+    float depth_dy;
+
+    // Perspective correct planes for 1/w then each attribute/w, laid out as
+    // plane_count values at min_x/min_y, then their x steps, then their y steps
+    int plane_count;
+    float *planes;
+} RasterTriangle;
+
+// Micro triangle reduced to the one pixel it covers
+typedef struct RasterPixel {
+    int x;
+    int y;
+    uint32_t color;
+    float depth;
+
+    // Full triangles queued before it, it is drawn after those and before the rest
+    int order;
+} RasterPixel;
+
+typedef struct RasterQueue {
+    RasterTriangle *triangles;
+    int count;
+    int capacity;
+
+    // Backing store for every triangle's planes, sized by the active attributes
+    float *planes;
+    int attribute_count;
+
+    // Micro triangles that cover a single pixel, written without rasterizing
+    RasterPixel *pixels;
+    int pixel_count;
+} RasterQueue;
+
+RasterQueue *create_raster_queue(int, int);
+void reset_raster_queue(RasterQueue *);
+int raster_queue_full(const RasterQueue *);
+void free_raster_queue(RasterQueue *);
+
+void push_setup_triangle(TriangleSetupBatch *, RasterQueue *, const ClipVertex *, const ClipVertex *, const ClipVertex *);
+void flush_triangle_setup_batch(TriangleSetupBatch *, RasterQueue *);
+uint32_t resolve_plane_color(const float *);
+
+#endif
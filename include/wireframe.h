@@ -0,0 +1,40 @@
+#ifndef WIREFRAME_H
+#define WIREFRAME_H
+
+#include <SDL3/SDL.h>
+#include <stdint.h>
+
+#include "framebuffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "render_pipeline.h"
+
+// Cohen-Sutherland outcode bits against the screen rectangle
+#define LINE_OUTCODE_LEFT 1
+#define LINE_OUTCODE_RIGHT 2
+#define LINE_OUTCODE_TOP 4
+#define LINE_OUTCODE_BOTTOM 8
+
+// Edge extraction (done once at import)
+void build_mesh_edges(Mesh *);
+int *weld_mesh_vertices(Mesh *);
+int find_or_add_edge(Mesh *, int *, int, int, int);
+
+// Per frame wireframe rendering
+void render_wireframe(SDL_Renderer *, Framebuffer *, RenderSettings *, Mesh *, ClipVertexCache *);
+void mark_visible_edges(Mesh *, ClipVertexCache *, uint8_t *);
+int is_front_facing_clip(const fVec4 *, const fVec4 *, const fVec4 *);
+
+// Stand-in while the mesh loads, its box in model space
+void draw_bounding_box(Framebuffer *, fMatrix44 *, const float *, const float *);
+
+// Line clipping
+int clip_line_near_far(fVec4 *, fVec4 *);
+int compute_line_outcode(float, float, int, int);
+int clip_line_to_viewport(float *, float *, float *, float *, int, int);
+
+// Line drawing, endpoints must already be on screen
+void draw_line_unchecked(Framebuffer *, int, int, int, int, uint32_t);
+int append_line_points(SDL_FPoint **, int *, int *, int, int, int, int);
+
+#endif
@@ -0,0 +1,195 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asset_loader.h"
+#include "compact_vertex.h"
+#include "constants.h"
+#include "geometry.h"
+#include "model.h"
+#include "obj_reader.h"
+
+AssetLoader *create_asset_loader(int thread_count) {
+    AssetLoader *loader = (AssetLoader *)malloc(sizeof(AssetLoader));
+    if (!loader) {
+        printf("Could not allocate mem for asset loader");
+        return NULL;
+    }
+
+    loader->head = NULL;
+    loader->tail = NULL;
+    loader->running = 1;
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->wake, NULL);
+
+    // Disks and parsers gain little past a few at once, so the limit is the caller's
+    thread_count = thread_count < 1 ? 1 : (thread_count > ASSET_LOADER_MAX_THREADS ? ASSET_LOADER_MAX_THREADS : thread_count);
+    loader->thread_count = 0;
+
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&loader->threads[i], NULL, run_asset_thread, loader) != 0) {
+            printf("Could not start asset thread %d", i);
+            break;
+        }
+        loader->thread_count = i + 1;
+    }
+
+    if (loader->thread_count == 0) {
+        free_asset_loader(loader);
+        return NULL;
+    }
+
+    return loader;
+}
+
+void free_asset_loader(AssetLoader *loader) {
+    if (loader == NULL) {
+        return;
+    }
+
+    // Loads already being parsed finish, the ones still queued never start
+    pthread_mutex_lock(&loader->lock);
+    loader->running = 0;
+    pthread_cond_broadcast(&loader->wake);
+    pthread_mutex_unlock(&loader->lock);
+
+    for (int i = 0; i < loader->thread_count; i++) {
+        pthread_join(loader->threads[i], NULL);
+    }
+
+    while (loader->head) {
+        AssetLoad *next = loader->head->next;
+        atomic_store(&loader->head->state, ASSET_FAILED);
+        loader->head = next;
+    }
+
+    pthread_cond_destroy(&loader->wake);
+    pthread_mutex_destroy(&loader->lock);
+    free(loader);
+}
+
+AssetLoad *load_mesh_async(AssetLoader *loader, const char *path, const char *directory, int compact) {
+    AssetLoad *load = (AssetLoad *)malloc(sizeof(AssetLoad));
+    if (!load) {
+        printf("Could not allocate mem for asset load");
+        return NULL;
+    }
+
+    snprintf(load->path, ASSET_PATH_LENGTH, "%s", path);
+    snprintf(load->directory, ASSET_PATH_LENGTH, "%s", directory);
+    load->compact = compact;
+    load->mesh = NULL;
+    load->next = NULL;
+    atomic_init(&load->state, ASSET_QUEUED);
+    atomic_init(&load->bounded, 0);
+
+    pthread_mutex_lock(&loader->lock);
+    if (loader->tail) {
+        loader->tail->next = load;
+    } else {
+        loader->head = load;
+    }
+    loader->tail = load;
+    pthread_cond_signal(&loader->wake);
+    pthread_mutex_unlock(&loader->lock);
+
+    return load;
+}
+
+AssetState get_asset_state(AssetLoad *load) {
+    return (AssetState)atomic_load(&load->state);
+}
+
+int get_asset_bounds(AssetLoad *load, float *bounds_min, float *bounds_max) {
+    if (!atomic_load(&load->bounded)) {
+        return 0;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        bounds_min[i] = load->bounds_min[i];
+        bounds_max[i] = load->bounds_max[i];
+    }
+
+    return 1;
+}
+
+void free_asset_load(AssetLoad *load) {
+    // The mesh went to whoever polled it ready, only the handle is left
+    free(load);
+}
+
+void load_asset(AssetLoad *load) {
+    FILE *file = open_file(load->path);
+    Mesh *mesh = file ? (Mesh *)calloc(1, sizeof(Mesh)) : NULL;
+
+    if (!mesh) {
+        printf("Could not load asset %s", load->path);
+        if (file) {
+            fclose(file);
+        }
+        atomic_store(&load->state, ASSET_FAILED);
+        return;
+    }
+
+    read_mesh_vertices(file, mesh);
+
+    // The first and last corners are the min and max, published before the flag like the mesh
+    fVec4 *low = mesh->bounding_box_vec[0];
+    fVec4 *high = mesh->bounding_box_vec[NUM_BOUNDING_BOX_VERTEX - 1];
+    load->bounds_min[0] = low->x;
+    load->bounds_min[1] = low->y;
+    load->bounds_min[2] = low->z;
+    load->bounds_max[0] = high->x;
+    load->bounds_max[1] = high->y;
+    load->bounds_max[2] = high->z;
+    atomic_store(&load->bounded, 1);
+
+    // mtllib and map_Kd paths are relative to the obj, textures load here too
+    read_mesh_faces(file, load->directory, mesh);
+    fclose(file);
+
+    if (mesh->num_triangles == 0) {
+        printf("Asset %s has no triangles", load->path);
+        free_obj_reader(mesh);
+        atomic_store(&load->state, ASSET_FAILED);
+        return;
+    }
+
+    // The float arrays go here instead of on the main thread at the swap
+    if (load->compact) {
+        store_mesh_compact(mesh);
+    }
+
+    // Published before the state, a reader that sees ready sees the whole mesh
+    load->mesh = mesh;
+    atomic_store(&load->state, ASSET_READY);
+}
+
+void *run_asset_thread(void *arg) {
+    AssetLoader *loader = (AssetLoader *)arg;
+
+    pthread_mutex_lock(&loader->lock);
+    while (loader->running) {
+        AssetLoad *load = loader->head;
+        if (!load) {
+            pthread_cond_wait(&loader->wake, &loader->lock);
+            continue;
+        }
+
+        loader->head = load->next;
+        if (!loader->head) {
+            loader->tail = NULL;
+        }
+        atomic_store(&load->state, ASSET_LOADING);
+
+        // Reading and parsing happen unlocked, other threads take the next loads
+        pthread_mutex_unlock(&loader->lock);
+        load_asset(load);
+        pthread_mutex_lock(&loader->lock);
+    }
+    pthread_mutex_unlock(&loader->lock);
+
+    return NULL;
+}
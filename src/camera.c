@@ -7,7 +7,7 @@
 #include "constants.h"
 #include "geometry.h"
 
-UserCamera *create_camera() {
+UserCamera *create_camera(float aspect_ratio) {
     UserCamera *camera = (UserCamera *)malloc(sizeof(UserCamera));
     if (!camera) {
         printf("Could not allocate mem for camera");
@@ -20,7 +20,7 @@ UserCamera *create_camera() {
     camera->settings.fov = FIELD_OF_VIEW;
     camera->settings.near = NEAR_FRUSTUM;
     camera->settings.far = FAR_FRUSTUM;
-    camera->settings.aspect_ratio = SCREEN_WIDTH / (float)SCREEN_HEIGHT;
+    camera->settings.aspect_ratio = aspect_ratio;
 
     perspective(&camera->settings.fov,
                 &camera->settings.aspect_ratio,
@@ -133,6 +133,41 @@ void update_frustum_planes(UserCamera *camera) {
     camera->frustum.planes[FAR_PLANE].b = view_projection_mat->mat[1][3] - view_projection_mat->mat[1][2];
     camera->frustum.planes[FAR_PLANE].c = view_projection_mat->mat[2][3] - view_projection_mat->mat[2][2];
     camera->frustum.planes[FAR_PLANE].d = view_projection_mat->mat[3][3] - view_projection_mat->mat[3][2];
+
+    free(view_projection_mat);
+}
+
+void build_sub_frustum(fMatrix44 *view_projection_mat, float left, float right, float bottom, float top, float near, float far, CameraFrustum *sub_frustum) {
+    // Same extraction as update_frustum_planes, with the NDC box shrunk from
+    // -1..1 to the given bounds: x >= left * w becomes column 0 - left * column 3
+    float bounds[NUM_FRUSTUM_PLANES] = {left, right, bottom, top, near, far};
+    int axis[NUM_FRUSTUM_PLANES] = {0, 0, 1, 1, 2, 2};
+
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; i++) {
+        // Even planes bound from below, odd planes from above
+        float sign = (i & 1) ? -1.0f : 1.0f;
+        int column = axis[i];
+
+        sub_frustum->planes[i].a = sign * (view_projection_mat->mat[0][column] - bounds[i] * view_projection_mat->mat[0][3]);
+        sub_frustum->planes[i].b = sign * (view_projection_mat->mat[1][column] - bounds[i] * view_projection_mat->mat[1][3]);
+        sub_frustum->planes[i].c = sign * (view_projection_mat->mat[2][column] - bounds[i] * view_projection_mat->mat[2][3]);
+        sub_frustum->planes[i].d = sign * (view_projection_mat->mat[3][column] - bounds[i] * view_projection_mat->mat[3][3]);
+    }
+}
+
+int sphere_in_frustum(CameraFrustum *frustum, fVec4 *center, float radius) {
+    // Planes are not normalized, so scale the radius by each normal's length
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; i++) {
+        fPlane *plane = &frustum->planes[i];
+        float distance = plane->a * center->x + plane->b * center->y + plane->c * center->z + plane->d;
+        float length = sqrtf(plane->a * plane->a + plane->b * plane->b + plane->c * plane->c);
+
+        if (distance < -radius * length) {
+            return 0;
+        }
+    }
+
+    return 1;
 }
 
 void perspective(float *angle_of_view, float *aspect_ratio, float *near, float *far, float *bottom, float *top, float *left, float *right) {
@@ -164,3 +199,27 @@ void frustum(float *bottom, float *top, float *left, float *right, float *near,
     mat->mat[3][2] = -2 * (*far) * (*near) / ((*far) - (*near));
     mat->mat[3][3] = 0;
 }
+
+void orthographic(float *bottom, float *top, float *left, float *right, float *near, float *far, fMatrix44 *mat) {
+    // Same conventions as frustum, looking down -z with near at -1 and far at 1,
+    // but w stays 1 so depth is linear and there is no perspective divide
+    mat->mat[0][0] = 2 / ((*right) - (*left));
+    mat->mat[0][1] = 0;
+    mat->mat[0][2] = 0;
+    mat->mat[0][3] = 0;
+
+    mat->mat[1][0] = 0;
+    mat->mat[1][1] = 2 / ((*top) - (*bottom));
+    mat->mat[1][2] = 0;
+    mat->mat[1][3] = 0;
+
+    mat->mat[2][0] = 0;
+    mat->mat[2][1] = 0;
+    mat->mat[2][2] = -2 / ((*far) - (*near));
+    mat->mat[2][3] = 0;
+
+    mat->mat[3][0] = -((*right) + (*left)) / ((*right) - (*left));
+    mat->mat[3][1] = -((*top) + (*bottom)) / ((*top) - (*bottom));
+    mat->mat[3][2] = -((*far) + (*near)) / ((*far) - (*near));
+    mat->mat[3][3] = 1;
+}
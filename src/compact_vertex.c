@@ -0,0 +1,252 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compact_vertex.h"
+#include "gbuffer.h"
+#include "geometry.h"
+#include "job_system.h"
+#include "model.h"
+#include "shading.h"
+
+// BUILDING //
+
+CompactVertices *build_compact_vertices(Mesh *mesh) {
+    CompactVertices *compact = (CompactVertices *)calloc(1, sizeof(CompactVertices));
+    if (!compact) {
+        printf("Could not allocate mem for compact vertices");
+        return NULL;
+    }
+
+    compact->count = mesh->vec_count;
+    compact->uv_count = mesh->uv_arr ? mesh->vec_texture_count : 0;
+    compact->vertices = (CompactVertex *)malloc((compact->count ? compact->count : 1) * sizeof(CompactVertex));
+    compact->uvs = compact->uv_count ? (uint32_t *)malloc(compact->uv_count * sizeof(uint32_t)) : NULL;
+
+    if (!compact->vertices || (compact->uv_count && !compact->uvs)) {
+        printf("Could not allocate mem for compact vertices");
+        free_compact_vertices(compact);
+        return NULL;
+    }
+
+    // Steps run across the box of the vertices themselves, a flat axis has a single step
+    float min[3] = {0.0f, 0.0f, 0.0f};
+    float max[3] = {0.0f, 0.0f, 0.0f};
+    for (int v = 0; v < compact->count; v++) {
+        float point[3] = {mesh->vec_arr[v].x, mesh->vec_arr[v].y, mesh->vec_arr[v].z};
+        for (int i = 0; i < 3; i++) {
+            min[i] = v == 0 || point[i] < min[i] ? point[i] : min[i];
+            max[i] = v == 0 || point[i] > max[i] ? point[i] : max[i];
+        }
+    }
+    set_compact_vertex_box(compact, min, max);
+
+    for (int v = 0; v < compact->count; v++) {
+        encode_compact_vertex(compact, &mesh->vec_arr[v], mesh->normal_arr ? &mesh->normal_arr[v] : NULL, &compact->vertices[v]);
+    }
+
+    for (int t = 0; t < compact->uv_count; t++) {
+        compact->uvs[t] = encode_compact_uv(&mesh->uv_arr[t]);
+    }
+
+    return compact;
+}
+
+int store_mesh_compact(Mesh *mesh) {
+    if (!mesh->vec_arr) {
+        return mesh->compact != NULL;
+    }
+
+    CompactVertices *compact = build_compact_vertices(mesh);
+    if (!compact) {
+        return 0;
+    }
+
+    // Triangles hold indices, nothing points into the floats once they're gone
+    free(mesh->vec_arr);
+    free(mesh->normal_arr);
+    free(mesh->uv_arr);
+    mesh->vec_arr = NULL;
+    mesh->normal_arr = NULL;
+    mesh->uv_arr = NULL;
+
+    free_compact_vertices(mesh->compact);
+    mesh->compact = compact;
+    return 1;
+}
+
+void set_compact_vertex_box(CompactVertices *compact, const float *min, const float *max) {
+    for (int i = 0; i < 3; i++) {
+        compact->origin[i] = min[i];
+        compact->step[i] = max[i] > min[i] ? (max[i] - min[i]) / COMPACT_POSITION_STEPS : 0.0f;
+    }
+}
+
+void encode_compact_vertex(const CompactVertices *compact, const fVec4 *position, const fVec4 *normal, CompactVertex *vertex) {
+    float point[3] = {position->x, position->y, position->z};
+    for (int i = 0; i < 3; i++) {
+        float steps = compact->step[i] > 0 ? roundf((point[i] - compact->origin[i]) / compact->step[i]) : 0.0f;
+        steps = steps < 0.0f ? 0.0f : (steps > COMPACT_POSITION_STEPS ? COMPACT_POSITION_STEPS : steps);
+        vertex->position[i] = (uint16_t)steps;
+    }
+    vertex->position[3] = 0;
+
+    vertex->normal = normal ? encode_octahedral_normal(normal->x, normal->y, normal->z) : encode_octahedral_normal(0.0f, 0.0f, 1.0f);
+}
+
+uint32_t encode_compact_uv(const fVec2 *uv) {
+    return ((uint32_t)float_to_half(uv->x) << 16) | float_to_half(uv->y);
+}
+
+void free_compact_vertices(CompactVertices *compact) {
+    if (compact == NULL) {
+        return;
+    }
+
+    free(compact->vertices);
+    free(compact->uvs);
+    free(compact);
+}
+
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t float_exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    int exponent = (int)float_exponent - 127 + 15;
+
+    // Infinity and NaN stay what they are, anything too big becomes infinity
+    if (float_exponent == 0xFF) {
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    }
+    if (exponent >= 31) {
+        return sign | 0x7C00;
+    }
+
+    // Too small for a normal half, shifted into a subnormal or flushed to zero
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        half += (mantissa >> (shift - 1)) & 1;
+        return sign | half;
+    }
+
+    // Rounded to nearest, a carry out of the mantissa bumps the exponent as it should
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    half += (mantissa >> 12) & 1;
+    return (uint16_t)half;
+}
+
+float half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    // Subnormals are exact in a float
+    if (exponent == 0) {
+        float value = mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+
+    uint32_t bits = exponent == 31 ? sign | 0x7F800000 | (mantissa << 13) : sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// DECODING //
+
+void decode_compact_position(const CompactVertices *compact, int index, fVec4 *out) {
+    const uint16_t *steps = compact->vertices[index].position;
+    out->x = compact->origin[0] + steps[0] * compact->step[0];
+    out->y = compact->origin[1] + steps[1] * compact->step[1];
+    out->z = compact->origin[2] + steps[2] * compact->step[2];
+    out->w = 1.0f;
+}
+
+void decode_compact_normal(const CompactVertices *compact, int index, fVec4 *out) {
+    decode_octahedral_normal(compact->vertices[index].normal, &out->x, &out->y, &out->z);
+    out->w = 0.0f;
+}
+
+void decode_compact_uv(const CompactVertices *compact, int index, float *u, float *v) {
+    uint32_t uv = compact->uvs[index];
+    *u = half_to_float((uint16_t)(uv >> 16));
+    *v = half_to_float((uint16_t)(uv & 0xFFFF));
+}
+
+fVec4 *read_mesh_position(const Mesh *mesh, int index, fVec4 *decoded) {
+    // Floats are read in place, a compact mesh decodes into the caller's vector
+    if (mesh->vec_arr) {
+        return &mesh->vec_arr[index];
+    }
+
+    decode_compact_position(mesh->compact, index, decoded);
+    return decoded;
+}
+
+fVec4 *read_mesh_normal(const Mesh *mesh, int index, fVec4 *decoded) {
+    if (mesh->normal_arr) {
+        return &mesh->normal_arr[index];
+    }
+    if (!mesh->compact) {
+        return NULL;
+    }
+
+    decode_compact_normal(mesh->compact, index, decoded);
+    return decoded;
+}
+
+void build_compact_projection(const CompactVertices *compact, fMatrix44 *view_projection, fMatrix44 *out) {
+    // Dequantizing is a scale and a translation, folded into the view projection
+    // so steps go to clip space with the same 12 multiply adds as a float position
+    for (int j = 0; j < 4; j++) {
+        out->mat[3][j] = view_projection->mat[3][j];
+        for (int i = 0; i < 3; i++) {
+            out->mat[i][j] = compact->step[i] * view_projection->mat[i][j];
+            out->mat[3][j] += compact->origin[i] * view_projection->mat[i][j];
+        }
+    }
+}
+
+void light_compact_vertices(LightingScene *scene, const CompactVertices *compact, const unsigned char *mask, float *red, float *green, float *blue, JobSystem *jobs) {
+    CompactLightJob job = {scene, compact, mask, red, green, blue};
+    parallel_for(jobs, compact->count, LIGHT_POINTS_GRAIN, light_compact_range, &job);
+}
+
+void light_compact_range(void *arg, int start, int end) {
+    CompactLightJob *job = (CompactLightJob *)arg;
+
+    // Decoded a block at a time, the float copies never leave the stack.
+    // Vertices the mask drops are skipped, the rest scattered back
+    fVec4 positions[COMPACT_LIGHT_BLOCK];
+    fVec4 normals[COMPACT_LIGHT_BLOCK];
+    float channels[COMPACT_LIGHT_BLOCK * 3];
+    int indices[COMPACT_LIGHT_BLOCK];
+    for (int i = start; i < end;) {
+        int count = 0;
+        for (; i < end && count < COMPACT_LIGHT_BLOCK; i++) {
+            if (!job->mask || job->mask[i]) {
+                decode_compact_position(job->compact, i, &positions[count]);
+                decode_compact_normal(job->compact, i, &normals[count]);
+                indices[count++] = i;
+            }
+        }
+
+        light_points(job->scene, positions, normals, count, channels, channels + COMPACT_LIGHT_BLOCK, channels + COMPACT_LIGHT_BLOCK * 2);
+        for (int j = 0; j < count; j++) {
+            job->red[indices[j]] = channels[j];
+            job->green[indices[j]] = channels[COMPACT_LIGHT_BLOCK + j];
+            job->blue[indices[j]] = channels[COMPACT_LIGHT_BLOCK * 2 + j];
+        }
+    }
+}
@@ -0,0 +1,229 @@
+#include <SDL3/SDL.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "camera.h"
+#include "constants.h"
+#include "deferred.h"
+#include "frame_arena.h"
+#include "framebuffer.h"
+#include "gbuffer.h"
+#include "geometry.h"
+#include "job_system.h"
+#include "material.h"
+#include "shading.h"
+#include "texture.h"
+
+static DeferredLightingStats deferred_lighting_stats;
+
+void light_gbuffer(Framebuffer *framebuffer, LightingScene *lighting, MaterialLibrary *materials, fMatrix44 *view_projection, float *hdr, FrameArena *arena, JobSystem *jobs) {
+    uint64_t start_time = SDL_GetTicksNS();
+
+    // Inverting eliminates in place, keep the forward matrix for the tile frustums
+    fMatrix44 eliminated = *view_projection;
+    fMatrix44 *inverse = create_inverse_matrix(&eliminated);
+    if (!inverse) {
+        return;
+    }
+
+    DeferredLightingJob job;
+    job.framebuffer = framebuffer;
+    job.lighting = lighting;
+    job.materials = materials;
+    job.hdr = hdr;
+    job.arena = arena;
+    job.inverse_view_projection = *inverse;
+    job.view_projection = *view_projection;
+    atomic_init(&job.lit_pixels, 0);
+    atomic_init(&job.lit_tiles, 0);
+    atomic_init(&job.tile_lights, 0);
+    free(inverse);
+
+    // One range per tile row, light counts vary a lot so rows get stolen
+    int tile_rows = (framebuffer->height + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE;
+    parallel_for(jobs, tile_rows, 1, light_gbuffer_tiles, &job);
+
+    deferred_lighting_stats.passes++;
+    deferred_lighting_stats.pixels += atomic_load(&job.lit_pixels);
+    deferred_lighting_stats.tiles += atomic_load(&job.lit_tiles);
+    deferred_lighting_stats.tile_lights += atomic_load(&job.tile_lights);
+    deferred_lighting_stats.workers = get_job_worker_count(jobs);
+    deferred_lighting_stats.time_ns += SDL_GetTicksNS() - start_time;
+}
+
+void light_gbuffer_tiles(void *arg, int first_row, int last_row) {
+    DeferredLightingJob *job = (DeferredLightingJob *)arg;
+    Framebuffer *framebuffer = job->framebuffer;
+    GBuffer *gbuffer = framebuffer->gbuffer;
+    int width = framebuffer->width;
+    int height = framebuffer->height;
+
+    // One tile of visible pixels at a time, gathered so the lights run their
+    // batched loops over them. Scratch comes from the worker's frame arena
+    int tile_pixels = DEFERRED_TILE_SIZE * DEFERRED_TILE_SIZE;
+    int light_capacity = job->lighting ? job->lighting->light_capacity : 0;
+    fVec4 *positions = (fVec4 *)frame_arena_alloc(job->arena, tile_pixels * sizeof(fVec4));
+    fVec4 *normals = (fVec4 *)frame_arena_alloc(job->arena, tile_pixels * sizeof(fVec4));
+    float *channels = (float *)frame_arena_alloc(job->arena, tile_pixels * 3 * sizeof(float));
+    int *offsets = (int *)frame_arena_alloc(job->arena, tile_pixels * sizeof(int));
+    uint16_t *light_indices = (uint16_t *)frame_arena_alloc(job->arena, (light_capacity + 1) * sizeof(uint16_t));
+
+    if (!positions || !normals || !channels || !offsets || !light_indices) {
+        printf("Could not allocate mem for deferred lighting tiles");
+        return;
+    }
+
+    float *red = channels;
+    float *green = channels + tile_pixels;
+    float *blue = channels + tile_pixels * 2;
+
+    // NDC of a pixel center is a linear function of its column and row
+    float ndc_step_x = 2.0f / width;
+    float ndc_step_y = -2.0f / height;
+
+    uint64_t lit_pixels = 0;
+    uint64_t lit_tiles = 0;
+    uint64_t tile_lights = 0;
+
+    for (int tile_y = first_row * DEFERRED_TILE_SIZE; tile_y < height && tile_y < last_row * DEFERRED_TILE_SIZE; tile_y += DEFERRED_TILE_SIZE) {
+        int tile_y_end = tile_y + DEFERRED_TILE_SIZE < height ? tile_y + DEFERRED_TILE_SIZE : height;
+
+        for (int tile_x = 0; tile_x < width; tile_x += DEFERRED_TILE_SIZE) {
+            int tile_x_end = tile_x + DEFERRED_TILE_SIZE < width ? tile_x + DEFERRED_TILE_SIZE : width;
+
+            int count = 0;
+            float min_depth = 1.0f;
+            float max_depth = -1.0f;
+
+            for (int y = tile_y; y < tile_y_end; y++) {
+                int row = y * width;
+                float ndc_y = 1.0f + (y + 0.5f) * ndc_step_y;
+
+                for (int x = tile_x; x < tile_x_end; x++) {
+                    if (gbuffer->material[row + x] == GBUFFER_EMPTY_MATERIAL) {
+                        continue;
+                    }
+
+                    float depth = framebuffer->depth[row + x];
+                    min_depth = depth < min_depth ? depth : min_depth;
+                    max_depth = depth > max_depth ? depth : max_depth;
+
+                    fVec4 ndc = {-1.0f + (x + 0.5f) * ndc_step_x, ndc_y, depth, 1.0f};
+                    fVec4 *position = &positions[count];
+                    multiply_fvec4_matrix44(&ndc, position, &job->inverse_view_projection);
+
+                    float inv_w = 1.0f / position->w;
+                    position->x *= inv_w;
+                    position->y *= inv_w;
+                    position->z *= inv_w;
+                    position->w = 1.0f;
+
+                    fVec4 *normal = &normals[count];
+                    decode_gbuffer_normal(gbuffer->normal[row + x], &normal->x, &normal->y, &normal->z);
+                    normal->w = 0;
+
+                    offsets[count++] = row + x;
+                }
+            }
+
+            // Nothing opaque here, no frustum to build
+            if (count == 0) {
+                continue;
+            }
+
+            if (job->lighting) {
+                // Tile edges in NDC, y flips because rows grow downwards
+                int light_count = cull_tile_lights(job->lighting, &job->view_projection,
+                                                   -1.0f + tile_x * ndc_step_x, -1.0f + tile_x_end * ndc_step_x,
+                                                   1.0f + tile_y_end * ndc_step_y, 1.0f + tile_y * ndc_step_y,
+                                                   min_depth, max_depth, light_indices);
+                light_points_culled(job->lighting, light_indices, light_count, positions, normals, count, red, green, blue);
+
+                tile_lights += light_count;
+            } else {
+                for (int i = 0; i < count; i++) {
+                    red[i] = 1.0f;
+                    green[i] = 1.0f;
+                    blue[i] = 1.0f;
+                }
+            }
+
+            // Material color, textured when the material has a diffuse map
+            for (int i = 0; i < count; i++) {
+                int offset = offsets[i];
+                Material *material = &job->materials->materials[gbuffer->material[offset]];
+
+                float r = red[i] * material->diffuse[0];
+                float g = green[i] * material->diffuse[1];
+                float b = blue[i] * material->diffuse[2];
+
+                if (material->diffuse_texture) {
+                    const Texture *texture = material->diffuse_texture;
+                    int level = gbuffer->texture_level[offset] < texture->level_count ? gbuffer->texture_level[offset] : texture->level_count - 1;
+
+                    float u;
+                    float v;
+                    decode_gbuffer_uv(gbuffer->uv[offset], &u, &v);
+                    uint32_t texel = sample_texture_bilinear(&texture->levels[level], u, v);
+
+                    r *= ((texel >> 16) & 0xFF) * (1.0f / 255.0f);
+                    g *= ((texel >> 8) & 0xFF) * (1.0f / 255.0f);
+                    b *= (texel & 0xFF) * (1.0f / 255.0f);
+                }
+
+                framebuffer->color[offset] = pack_color(r, g, b);
+
+                if (job->hdr) {
+                    job->hdr[offset * 3] = r;
+                    job->hdr[offset * 3 + 1] = g;
+                    job->hdr[offset * 3 + 2] = b;
+                }
+            }
+
+            lit_pixels += count;
+            lit_tiles++;
+        }
+    }
+
+    atomic_fetch_add(&job->lit_pixels, lit_pixels);
+    atomic_fetch_add(&job->lit_tiles, lit_tiles);
+    atomic_fetch_add(&job->tile_lights, tile_lights);
+}
+
+int cull_tile_lights(LightingScene *lighting, fMatrix44 *view_projection, float left, float right, float bottom, float top, float min_depth, float max_depth, uint16_t *light_indices) {
+    // The tile's slice of the view frustum, clamped in depth to what it actually shows
+    CameraFrustum tile_frustum;
+    build_sub_frustum(view_projection, left, right, bottom, top, min_depth, max_depth, &tile_frustum);
+
+    int count = 0;
+    for (int l = 0; l < lighting->light_count; l++) {
+        Light *light = &lighting->lights[l];
+
+        // Directional lights reach everything, point lights only their range sphere
+        if (light->type == LIGHT_DIRECTIONAL || sphere_in_frustum(&tile_frustum, &light->position, light->range)) {
+            light_indices[count++] = (uint16_t)l;
+        }
+    }
+
+    return count;
+}
+
+void print_deferred_lighting_stats() {
+    DeferredLightingStats *stats = &deferred_lighting_stats;
+    if (stats->passes == 0) {
+        return;
+    }
+
+    double seconds = stats->time_ns / NS_TO_SEC_FLOAT;
+    double lights_per_tile = stats->tiles ? (double)stats->tile_lights / stats->tiles : 0.0;
+    printf("  %-20s %8.2f ms/pass %8.2f Mpix/s %6.2f lights/tile (%d workers)\n", "deferred_lighting",
+           seconds * 1000.0 / stats->passes, stats->pixels / seconds / 1e6, lights_per_tile, stats->workers);
+
+    stats->passes = 0;
+    stats->pixels = 0;
+    stats->tiles = 0;
+    stats->tile_lights = 0;
+    stats->time_ns = 0;
+}
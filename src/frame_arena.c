@@ -0,0 +1,142 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame_arena.h"
+#include "job_system.h"
+
+static FrameArenaStats frame_arena_stats;
+
+void init_frame_arena(FrameArena *arena) {
+    // Blocks come with the first allocation, threads that never allocate cost nothing
+    memset(arena, 0, sizeof(FrameArena));
+}
+
+void free_frame_arena(FrameArena *arena) {
+    for (int i = 0; i < JOB_MAX_WORKERS; i++) {
+        ThreadArena *thread = &arena->threads[i];
+        FrameArenaBlock *lists[2] = {thread->block, thread->full};
+
+        for (int j = 0; j < 2; j++) {
+            while (lists[j]) {
+                FrameArenaBlock *next = lists[j]->next;
+                free(lists[j]);
+                lists[j] = next;
+            }
+        }
+    }
+
+    init_frame_arena(arena);
+}
+
+void reset_frame_arena(FrameArena *arena) {
+    uint64_t used = 0;
+    uint64_t capacity = 0;
+
+    for (int i = 0; i < JOB_MAX_WORKERS; i++) {
+        used += reset_thread_arena(&arena->threads[i]);
+        capacity += arena->threads[i].block ? arena->threads[i].block->size : 0;
+    }
+
+    record_frame_arena_stats(used, capacity);
+}
+
+void *frame_arena_alloc(FrameArena *arena, size_t size) {
+    return thread_arena_alloc(&arena->threads[get_job_worker_index()], size);
+}
+
+void *thread_arena_alloc(ThreadArena *thread, size_t size) {
+    size = (size + FRAME_ARENA_ALIGNMENT - 1) & ~(size_t)(FRAME_ARENA_ALIGNMENT - 1);
+
+    FrameArenaBlock *block = thread->block;
+    if (!block || block->used + size > block->start + block->size) {
+        size_t block_size = block ? block->size * 2 : FRAME_ARENA_BLOCK_SIZE;
+        block_size = block_size < size ? size : block_size;
+
+        FrameArenaBlock *next = create_frame_arena_block(block_size);
+        if (!next) {
+            return NULL;
+        }
+
+        // Whatever is left of the old block goes unused until the reset
+        if (block) {
+            block->next = thread->full;
+            thread->full = block;
+        }
+        thread->block = next;
+        block = next;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    thread->used += size;
+    return ptr;
+}
+
+size_t reset_thread_arena(ThreadArena *thread) {
+    size_t used = thread->used;
+    thread->used = 0;
+
+    if (thread->block) {
+        thread->block->used = thread->block->start;
+    }
+
+    // Outgrew a block this frame, one that holds it all keeps the next resets O(1)
+    if (thread->full) {
+        FrameArenaBlock *block = create_frame_arena_block(used > thread->block->size ? used : thread->block->size);
+        if (block) {
+            while (thread->full) {
+                FrameArenaBlock *next = thread->full->next;
+                free(thread->full);
+                thread->full = next;
+            }
+            free(thread->block);
+            thread->block = block;
+        }
+    }
+
+    return used;
+}
+
+FrameArenaBlock *create_frame_arena_block(size_t size) {
+    // Padding so the data can start on an aligned address
+    FrameArenaBlock *block = (FrameArenaBlock *)malloc(sizeof(FrameArenaBlock) + size + FRAME_ARENA_ALIGNMENT);
+    if (!block) {
+        printf("Could not allocate mem for frame arena block");
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->start = ((uintptr_t)block->data % FRAME_ARENA_ALIGNMENT) ? FRAME_ARENA_ALIGNMENT - (uintptr_t)block->data % FRAME_ARENA_ALIGNMENT : 0;
+    block->used = block->start;
+    return block;
+}
+
+void record_frame_arena_stats(uint64_t used, uint64_t capacity) {
+    atomic_fetch_add(&frame_arena_stats.frames, 1);
+    atomic_fetch_add(&frame_arena_stats.used, used);
+    atomic_store(&frame_arena_stats.capacity, capacity);
+
+    // High water mark of a single frame since the last print
+    uint64_t peak = atomic_load(&frame_arena_stats.peak);
+    while (used > peak && !atomic_compare_exchange_weak(&frame_arena_stats.peak, &peak, used)) {
+    }
+}
+
+void print_frame_arena_stats() {
+    FrameArenaStats *stats = &frame_arena_stats;
+    if (stats->frames == 0) {
+        return;
+    }
+
+    printf("  %-20s %8.1f KB/frame %8.1f KB peak %8.1f KB kept\n", "frame_arena",
+           stats->used / 1024.0 / stats->frames, stats->peak / 1024.0, stats->capacity / 1024.0);
+
+    stats->frames = 0;
+    stats->used = 0;
+    stats->peak = 0;
+}
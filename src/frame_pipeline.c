@@ -0,0 +1,326 @@
+#include <SDL3/SDL.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camera.h"
+#include "constants.h"
+#include "frame_pipeline.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "job_system.h"
+#include "model.h"
+#include "raster_bins.h"
+#include "render_pipeline.h"
+#include "shading.h"
+#include "shadow.h"
+
+static FrameReuseStats frame_reuse_stats;
+
+FramePipeline *create_frame_pipeline(JobSystem *jobs) {
+    FramePipeline *pipeline = (FramePipeline *)malloc(sizeof(FramePipeline));
+    if (!pipeline) {
+        printf("Could not allocate mem for frame pipeline");
+        return NULL;
+    }
+
+    // Every frame starts out empty, buffers grow the first time they are recorded
+    memset(pipeline->frames, 0, sizeof(pipeline->frames));
+    pipeline->shadow_maps.maps = NULL;
+    pipeline->shadow_maps.count = 0;
+    for (int i = 0; i < FRAME_PIPELINE_DEPTH; i++) {
+        pipeline->frames[i].shadow_maps = &pipeline->shadow_maps;
+    }
+    pipeline->recording = 0;
+    pipeline->drawing = -1;
+    pipeline->presented = 0;
+    memset(&pipeline->snapshot, 0, sizeof(FrameSnapshot));
+    atomic_init(&pipeline->drawn.pending, 0);
+    pipeline->jobs = jobs;
+    memset(&pipeline->timer, 0, sizeof(FrameTimer));
+
+    return pipeline;
+}
+
+void free_frame_pipeline(FramePipeline *pipeline) {
+    if (pipeline == NULL) {
+        return;
+    }
+
+    wait_for_frame_pipeline(pipeline);
+
+    for (int i = 0; i < FRAME_PIPELINE_DEPTH; i++) {
+        free_render_frame(&pipeline->frames[i]);
+    }
+
+    free_shadow_map_set(&pipeline->shadow_maps);
+    free(pipeline->snapshot.lighting.lights);
+    free(pipeline);
+}
+
+int run_frame_pipeline(FramePipeline *pipeline, SDL_Renderer *renderer, SDL_Texture *texture, Framebuffer *framebuffer,
+                       RenderSettings *settings, ModelObject *model, UserCamera *camera) {
+    uint64_t target_pixels = (uint64_t)framebuffer->width * framebuffer->height;
+    FrameChange change = settings->benchmark ? FRAME_CHANGED : compare_frame_snapshot(&pipeline->snapshot, settings, model, camera);
+
+    // Nothing moved since the last recorded frame, the framebuffer has it or soon will
+    if (change == FRAME_UNCHANGED) {
+        if (pipeline->drawing >= 0) {
+            wait_for_frame_pipeline(pipeline);
+            update_fps(&pipeline->timer, settings->benchmark);
+            pipeline->presented = pipeline->drawing;
+            pipeline->drawing = -1;
+        }
+        present_render_frame(renderer, texture, framebuffer, &pipeline->frames[pipeline->presented]);
+        record_frame_reuse_stats(1, 1, 0, 0, target_pixels);
+        return 0;
+    }
+
+    RenderFrame *frame = &pipeline->frames[pipeline->recording];
+
+    // Front end, overlaps whatever the back end still has left of the last frame
+    record_render_frame(frame, framebuffer, settings, model, camera, pipeline->drawing >= 0 ? &pipeline->drawn : NULL);
+
+    // Only the model or its lights changed, so only the tiles it left and the ones it
+    // covers now are cleared, everything else is still the last frame's
+    ScreenRect bounds = frame->visible ? project_model_bounds(model, camera, framebuffer->width, framebuffer->height) : (ScreenRect){0, 0, 0, 0};
+    int partial = change == FRAME_MODEL_CHANGED && can_redraw_partially(settings);
+    if (partial) {
+        frame->dirty = merge_dirty_bounds(pipeline->snapshot.bounds, bounds, framebuffer->width, framebuffer->height);
+    }
+    take_frame_snapshot(&pipeline->snapshot, settings, model, camera, bounds);
+
+    uint64_t dirty_pixels = frame->dirty.x1 > frame->dirty.x0 && frame->dirty.y1 > frame->dirty.y0 ? (uint64_t)(frame->dirty.x1 - frame->dirty.x0) * (frame->dirty.y1 - frame->dirty.y0) : 0;
+    record_frame_reuse_stats(1, 0, partial, dirty_pixels, target_pixels);
+
+    // Last frame has to leave the framebuffer before this one goes in
+    if (pipeline->drawing >= 0) {
+        wait_for_frame_pipeline(pipeline);
+        update_fps(&pipeline->timer, settings->benchmark);
+        present_render_frame(renderer, texture, framebuffer, &pipeline->frames[pipeline->drawing]);
+        pipeline->presented = pipeline->drawing;
+        pipeline->drawing = -1;
+    }
+
+    // Nobody to overlap with, so draw and show it right away
+    if (get_job_worker_count(pipeline->jobs) < 2) {
+        update_fps(&pipeline->timer, settings->benchmark);
+        draw_render_frame(framebuffer, frame);
+        present_render_frame(renderer, texture, framebuffer, frame);
+        pipeline->presented = pipeline->recording;
+        return 1;
+    }
+
+    pipeline->draw_job.framebuffer = framebuffer;
+    pipeline->draw_job.frame = frame;
+
+    Job job;
+    job.func = draw_frame_job;
+    job.data = &pipeline->draw_job;
+    job.counter = NULL;
+    submit_jobs(pipeline->jobs, &job, 1, &pipeline->drawn);
+
+    pipeline->drawing = pipeline->recording;
+    pipeline->recording = (pipeline->recording + 1) % FRAME_PIPELINE_DEPTH;
+    return 1;
+}
+
+void wait_for_frame_pipeline(FramePipeline *pipeline) {
+    // Whatever the back end reads (the mesh, shadow maps, the framebuffer) is safe to change after this
+    if (pipeline->drawing >= 0) {
+        wait_for_counter(pipeline->jobs, &pipeline->drawn);
+    }
+}
+
+void draw_frame_job(void *arg) {
+    FrameDrawJob *job = (FrameDrawJob *)arg;
+    draw_render_frame(job->framebuffer, job->frame);
+}
+
+// STATIC FRAMES AND DIRTY REGIONS //
+
+FrameChange compare_frame_snapshot(const FrameSnapshot *snapshot, const RenderSettings *settings, const ModelObject *model, const UserCamera *camera) {
+    if (!snapshot->valid || snapshot->model != model || !same_render_settings(&snapshot->settings, settings)) {
+        return FRAME_CHANGED;
+    }
+
+    // A camera that moved or turned changes every pixel
+    if (memcmp(&snapshot->camera_mat, camera->camera_mat, sizeof(fMatrix44)) != 0 ||
+        memcmp(&snapshot->projection_mat, camera->projection_mat, sizeof(fMatrix44)) != 0) {
+        return FRAME_CHANGED;
+    }
+
+    // The model is all there is to light, so lights only change the pixels it covers
+    if (snapshot->mesh != model->mesh ||
+        memcmp(&snapshot->model_mat, model->model_mat, sizeof(fMatrix44)) != 0 ||
+        !same_lighting_scene(&snapshot->lighting, settings->lighting)) {
+        return FRAME_MODEL_CHANGED;
+    }
+
+    return FRAME_UNCHANGED;
+}
+
+void take_frame_snapshot(FrameSnapshot *snapshot, const RenderSettings *settings, const ModelObject *model, const UserCamera *camera, ScreenRect bounds) {
+    LightingScene *lighting = settings->lighting;
+    int light_count = lighting ? lighting->light_count : 0;
+
+    if (light_count > snapshot->lighting.light_capacity) {
+        Light *lights = (Light *)realloc(snapshot->lighting.lights, light_count * sizeof(Light));
+        if (!lights) {
+            // Every frame is drawn in full until the lights fit
+            printf("Could not allocate mem for frame snapshot lights");
+            snapshot->valid = 0;
+            return;
+        }
+        snapshot->lighting.lights = lights;
+        snapshot->lighting.light_capacity = light_count;
+    }
+
+    snapshot->valid = 1;
+    snapshot->settings = *settings;
+    snapshot->camera_mat = *camera->camera_mat;
+    snapshot->projection_mat = *camera->projection_mat;
+    snapshot->model = model;
+    snapshot->mesh = model->mesh;
+    snapshot->model_mat = *model->model_mat;
+    snapshot->bounds = bounds;
+
+    snapshot->lighting.light_count = light_count;
+    snapshot->lighting.ambient = lighting ? lighting->ambient : (fVec4){0, 0, 0, 0};
+    if (light_count > 0) {
+        memcpy(snapshot->lighting.lights, lighting->lights, light_count * sizeof(Light));
+    }
+}
+
+int same_render_settings(const RenderSettings *a, const RenderSettings *b) {
+    return a->mode == b->mode &&
+           a->wireframe_target == b->wireframe_target &&
+           a->shading == b->shading &&
+           a->lighting == b->lighting &&
+           a->depth_test == b->depth_test &&
+           a->blend == b->blend &&
+           a->opacity == b->opacity &&
+           a->textured == b->textured &&
+           a->deferred == b->deferred &&
+           a->shadows == b->shadows &&
+           a->multisample == b->multisample &&
+           a->post_process == b->post_process &&
+           a->exposure == b->exposure &&
+           a->compact_vertices == b->compact_vertices &&
+           a->jobs == b->jobs;
+}
+
+int same_lighting_scene(const LightingScene *snapshot, const LightingScene *lighting) {
+    // Which scene it is was already compared with the settings
+    if (!lighting) {
+        return 1;
+    }
+
+    return snapshot->light_count == lighting->light_count &&
+           memcmp(&snapshot->ambient, &lighting->ambient, sizeof(fVec4)) == 0 &&
+           (lighting->light_count == 0 || memcmp(snapshot->lights, lighting->lights, lighting->light_count * sizeof(Light)) == 0);
+}
+
+int can_redraw_partially(const RenderSettings *settings) {
+    // Post processing would run again over pixels it already went over, and the
+    // deferred and multisampled passes clear and resolve their whole targets
+    if (settings->post_process) {
+        return 0;
+    }
+
+    return settings->mode != RENDER_MODE_FILLED || (!settings->deferred && !settings->multisample);
+}
+
+ScreenRect project_model_bounds(const ModelObject *model, const UserCamera *camera, int width, int height) {
+    ScreenRect whole = {0, 0, width, height};
+    fMatrix44 *view_projection = mult_fmatrix44(camera->camera_mat, camera->projection_mat);
+    if (!view_projection) {
+        return whole;
+    }
+
+    // The model matrix is not applied, so the box is where the mesh has it
+    float min_x = INFINITY;
+    float min_y = INFINITY;
+    float max_x = -INFINITY;
+    float max_y = -INFINITY;
+    for (int i = 0; i < NUM_BOUNDING_BOX_VERTEX; i++) {
+        fVec4 clip;
+        multiply_fvec4_matrix44(model->mesh->bounding_box_vec[i], &clip, view_projection);
+
+        // Near plane clipping can put a vertex anywhere on screen once a corner is this close
+        if (clip.w < NEAR_FRUSTUM) {
+            free(view_projection);
+            return whole;
+        }
+
+        float x = (clip.x / clip.w + 1.0f) * 0.5f * width;
+        float y = (1.0f - (clip.y / clip.w + 1.0f) * 0.5f) * height;
+        min_x = x < min_x ? x : min_x;
+        min_y = y < min_y ? y : min_y;
+        max_x = x > max_x ? x : max_x;
+        max_y = y > max_y ? y : max_y;
+    }
+    free(view_projection);
+
+    // Clamped as floats first, a box far off to the side would overflow an int
+    min_x = fmaxf(floorf(min_x) - FRAME_DIRTY_PADDING, 0.0f);
+    min_y = fmaxf(floorf(min_y) - FRAME_DIRTY_PADDING, 0.0f);
+    max_x = fminf(ceilf(max_x) + FRAME_DIRTY_PADDING, (float)width);
+    max_y = fminf(ceilf(max_y) + FRAME_DIRTY_PADDING, (float)height);
+
+    return (ScreenRect){(int)min_x, (int)min_y, (int)max_x, (int)max_y};
+}
+
+ScreenRect merge_dirty_bounds(ScreenRect previous, ScreenRect current, int width, int height) {
+    int previous_empty = previous.x0 >= previous.x1 || previous.y0 >= previous.y1;
+    int current_empty = current.x0 >= current.x1 || current.y0 >= current.y1;
+    if (previous_empty && current_empty) {
+        return (ScreenRect){0, 0, 0, 0};
+    }
+
+    ScreenRect merged = previous_empty ? current : previous;
+    if (!previous_empty && !current_empty) {
+        merged.x0 = current.x0 < merged.x0 ? current.x0 : merged.x0;
+        merged.y0 = current.y0 < merged.y0 ? current.y0 : merged.y0;
+        merged.x1 = current.x1 > merged.x1 ? current.x1 : merged.x1;
+        merged.y1 = current.y1 > merged.y1 ? current.y1 : merged.y1;
+    }
+
+    // Whole raster tiles, the ones the model's triangles get binned to
+    merged.x0 = merged.x0 / RASTER_TILE_SIZE * RASTER_TILE_SIZE;
+    merged.y0 = merged.y0 / RASTER_TILE_SIZE * RASTER_TILE_SIZE;
+    merged.x1 = (merged.x1 + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE * RASTER_TILE_SIZE;
+    merged.y1 = (merged.y1 + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE * RASTER_TILE_SIZE;
+    merged.x1 = merged.x1 < width ? merged.x1 : width;
+    merged.y1 = merged.y1 < height ? merged.y1 : height;
+
+    return merged;
+}
+
+void record_frame_reuse_stats(uint64_t frames, uint64_t reused, uint64_t partial, uint64_t drawn_pixels, uint64_t target_pixels) {
+    atomic_fetch_add(&frame_reuse_stats.frames, frames);
+    atomic_fetch_add(&frame_reuse_stats.reused, reused);
+    atomic_fetch_add(&frame_reuse_stats.partial, partial);
+    atomic_fetch_add(&frame_reuse_stats.drawn_pixels, drawn_pixels);
+    atomic_fetch_add(&frame_reuse_stats.target_pixels, target_pixels);
+}
+
+void print_frame_reuse_stats() {
+    FrameReuseStats *stats = &frame_reuse_stats;
+    if (stats->frames == 0 || stats->target_pixels == 0) {
+        return;
+    }
+
+    printf("  %-20s %7.1f%% reused %7.1f%% partial %7.1f%% pixels redrawn\n", "frame_reuse",
+           100.0 * stats->reused / (double)stats->frames,
+           100.0 * stats->partial / (double)stats->frames,
+           100.0 * stats->drawn_pixels / (double)stats->target_pixels);
+
+    stats->frames = 0;
+    stats->reused = 0;
+    stats->partial = 0;
+    stats->drawn_pixels = 0;
+    stats->target_pixels = 0;
+}
@@ -0,0 +1,177 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "framebuffer.h"
+
+Framebuffer *create_framebuffer(int width, int height) {
+    Framebuffer *framebuffer = (Framebuffer *)malloc(sizeof(Framebuffer));
+    if (!framebuffer) {
+        printf("Could not allocate mem for framebuffer");
+        return NULL;
+    }
+
+    framebuffer->width = width;
+    framebuffer->height = height;
+    framebuffer->color = (uint32_t *)calloc(width * height, sizeof(uint32_t));
+    framebuffer->depth = (float *)malloc(width * height * sizeof(float));
+    framebuffer->gbuffer = NULL;
+    framebuffer->hdr = NULL;
+    framebuffer->luma = NULL;
+    framebuffer->resolve = NULL;
+    framebuffer->sample_color = NULL;
+    framebuffer->sample_depth = NULL;
+
+    if (!framebuffer->color || !framebuffer->depth) {
+        printf("Could not allocate mem for framebuffer color");
+        free(framebuffer->color);
+        free(framebuffer->depth);
+        free(framebuffer);
+        return NULL;
+    }
+
+    return framebuffer;
+}
+
+Framebuffer *create_depth_framebuffer(int width, int height) {
+    Framebuffer *framebuffer = (Framebuffer *)malloc(sizeof(Framebuffer));
+    if (!framebuffer) {
+        printf("Could not allocate mem for depth framebuffer");
+        return NULL;
+    }
+
+    // Only ever drawn with depth only kernels, so there is no color to keep
+    framebuffer->width = width;
+    framebuffer->height = height;
+    framebuffer->color = NULL;
+    framebuffer->depth = (float *)malloc(width * height * sizeof(float));
+    framebuffer->gbuffer = NULL;
+    framebuffer->hdr = NULL;
+    framebuffer->luma = NULL;
+    framebuffer->resolve = NULL;
+    framebuffer->sample_color = NULL;
+    framebuffer->sample_depth = NULL;
+
+    if (!framebuffer->depth) {
+        printf("Could not allocate mem for framebuffer depth");
+        free(framebuffer);
+        return NULL;
+    }
+
+    return framebuffer;
+}
+
+int create_post_process_targets(Framebuffer *framebuffer) {
+    int size = framebuffer->width * framebuffer->height;
+
+    if (!framebuffer->hdr) {
+        framebuffer->hdr = (float *)malloc(size * 3 * sizeof(float));
+    }
+    if (!framebuffer->luma) {
+        framebuffer->luma = (uint8_t *)malloc(size * sizeof(uint8_t));
+    }
+    if (!framebuffer->resolve) {
+        framebuffer->resolve = (uint32_t *)malloc(size * sizeof(uint32_t));
+    }
+
+    if (!framebuffer->hdr || !framebuffer->luma || !framebuffer->resolve) {
+        printf("Could not allocate mem for post process targets");
+        return 0;
+    }
+
+    return 1;
+}
+
+int create_multisample_targets(Framebuffer *framebuffer) {
+    size_t samples = (size_t)framebuffer->width * framebuffer->height * FRAMEBUFFER_SAMPLE_COUNT;
+
+    if (!framebuffer->sample_color) {
+        framebuffer->sample_color = (uint32_t *)malloc(samples * sizeof(uint32_t));
+    }
+    if (!framebuffer->sample_depth) {
+        framebuffer->sample_depth = (float *)malloc(samples * sizeof(float));
+    }
+
+    if (!framebuffer->sample_color || !framebuffer->sample_depth) {
+        printf("Could not allocate mem for multisample targets");
+        return 0;
+    }
+
+    return 1;
+}
+
+void clear_multisample_targets(Framebuffer *framebuffer, uint32_t color) {
+    size_t samples = (size_t)framebuffer->width * framebuffer->height * FRAMEBUFFER_SAMPLE_COUNT;
+
+    for (size_t i = 0; i < samples; i++) {
+        framebuffer->sample_color[i] = color;
+        framebuffer->sample_depth[i] = FRAMEBUFFER_CLEAR_DEPTH;
+    }
+}
+
+void resolve_multisample_targets(Framebuffer *framebuffer) {
+    int size = framebuffer->width * framebuffer->height;
+
+    for (int i = 0; i < size; i++) {
+        const uint32_t *samples = &framebuffer->sample_color[i * FRAMEBUFFER_SAMPLE_COUNT];
+        const float *depths = &framebuffer->sample_depth[i * FRAMEBUFFER_SAMPLE_COUNT];
+
+        // Box filter, two channels per add like blend_pixel, uncovered samples
+        // keep the clear color so edges fade out in alpha too
+        uint32_t ag = 0;
+        uint32_t rb = 0;
+        float depth = depths[0];
+        for (int s = 0; s < FRAMEBUFFER_SAMPLE_COUNT; s++) {
+            ag += (samples[s] >> 8) & 0x00FF00FFu;
+            rb += samples[s] & 0x00FF00FFu;
+            depth = depths[s] < depth ? depths[s] : depth;
+        }
+
+        framebuffer->color[i] = (((ag + 0x00020002u) << 6) & 0xFF00FF00u) | (((rb + 0x00020002u) >> 2) & 0x00FF00FFu);
+        framebuffer->depth[i] = depth;
+    }
+}
+
+void clear_framebuffer(Framebuffer *framebuffer, uint32_t color) {
+    int size = framebuffer->width * framebuffer->height;
+    if (!framebuffer->color) {
+        for (int i = 0; i < size; i++) {
+            framebuffer->depth[i] = FRAMEBUFFER_CLEAR_DEPTH;
+        }
+        return;
+    }
+
+    for (int i = 0; i < size; i++) {
+        framebuffer->color[i] = color;
+        framebuffer->depth[i] = FRAMEBUFFER_CLEAR_DEPTH;
+    }
+}
+
+void clear_framebuffer_rect(Framebuffer *framebuffer, uint32_t color, int x0, int y0, int x1, int y1) {
+    // Pixels x0 up to x1 of rows y0 up to y1, everything else keeps what it had
+    for (int y = y0; y < y1; y++) {
+        int row = y * framebuffer->width;
+        for (int x = x0; x < x1; x++) {
+            if (framebuffer->color) {
+                framebuffer->color[row + x] = color;
+            }
+            framebuffer->depth[row + x] = FRAMEBUFFER_CLEAR_DEPTH;
+        }
+    }
+}
+
+void free_framebuffer(Framebuffer *framebuffer) {
+    if (framebuffer == NULL) {
+        return;
+    }
+
+    free(framebuffer->color);
+    free(framebuffer->depth);
+    free_gbuffer(framebuffer->gbuffer);
+    free(framebuffer->hdr);
+    free(framebuffer->luma);
+    free(framebuffer->resolve);
+    free(framebuffer->sample_color);
+    free(framebuffer->sample_depth);
+    free(framebuffer);
+}
@@ -0,0 +1,131 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gbuffer.h"
+
+GBuffer *create_gbuffer(int width, int height) {
+    GBuffer *gbuffer = (GBuffer *)malloc(sizeof(GBuffer));
+    if (!gbuffer) {
+        printf("Could not allocate mem for gbuffer");
+        return NULL;
+    }
+
+    int size = width * height;
+    gbuffer->width = width;
+    gbuffer->height = height;
+    gbuffer->normal = (uint16_t *)malloc(size * sizeof(uint16_t));
+    gbuffer->uv = (uint32_t *)malloc(size * sizeof(uint32_t));
+    gbuffer->material = (uint16_t *)malloc(size * sizeof(uint16_t));
+    gbuffer->texture_level = (uint8_t *)malloc(size * sizeof(uint8_t));
+
+    if (!gbuffer->normal || !gbuffer->uv || !gbuffer->material || !gbuffer->texture_level) {
+        printf("Could not allocate mem for gbuffer planes");
+        free_gbuffer(gbuffer);
+        return NULL;
+    }
+
+    clear_gbuffer(gbuffer);
+    return gbuffer;
+}
+
+void clear_gbuffer(GBuffer *gbuffer) {
+    // Only the material marks a pixel as written, the rest is never read without it
+    memset(gbuffer->material, 0xFF, gbuffer->width * gbuffer->height * sizeof(uint16_t));
+}
+
+void free_gbuffer(GBuffer *gbuffer) {
+    if (gbuffer == NULL) {
+        return;
+    }
+
+    free(gbuffer->normal);
+    free(gbuffer->uv);
+    free(gbuffer->material);
+    free(gbuffer->texture_level);
+    free(gbuffer);
+}
+
+void fold_octahedral_normal(float x, float y, float z, float *u, float *v) {
+    // Project onto the octahedron |x| + |y| + |z| = 1, so the length does not
+    // matter, then fold the lower half over the diagonals
+    float inv_length = 1.0f / (fabsf(x) + fabsf(y) + fabsf(z) + 1e-12f);
+    float ox = x * inv_length;
+    float oy = y * inv_length;
+
+    if (z < 0) {
+        float fold_x = (1.0f - fabsf(oy)) * (ox >= 0 ? 1.0f : -1.0f);
+        float fold_y = (1.0f - fabsf(ox)) * (oy >= 0 ? 1.0f : -1.0f);
+        ox = fold_x;
+        oy = fold_y;
+    }
+
+    *u = ox;
+    *v = oy;
+}
+
+void unfold_octahedral_normal(float u, float v, float *x, float *y, float *z) {
+    float ox = u;
+    float oy = v;
+    float oz = 1.0f - fabsf(ox) - fabsf(oy);
+
+    // Unfold the lower half
+    float t = oz < 0 ? -oz : 0;
+    ox += ox >= 0 ? -t : t;
+    oy += oy >= 0 ? -t : t;
+
+    float inv_length = 1.0f / sqrtf(ox * ox + oy * oy + oz * oz);
+    *x = ox * inv_length;
+    *y = oy * inv_length;
+    *z = oz * inv_length;
+}
+
+uint32_t encode_octahedral_normal(float x, float y, float z) {
+    // 16 bits per axis, for vertex normals that are stored once and read many times
+    float u;
+    float v;
+    fold_octahedral_normal(x, y, z, &u, &v);
+
+    uint32_t ex = (uint32_t)((u * 0.5f + 0.5f) * 65535.0f + 0.5f);
+    uint32_t ey = (uint32_t)((v * 0.5f + 0.5f) * 65535.0f + 0.5f);
+    return (ex << 16) | ey;
+}
+
+void decode_octahedral_normal(uint32_t encoded, float *x, float *y, float *z) {
+    unfold_octahedral_normal((encoded >> 16) * (2.0f / 65535.0f) - 1.0f, (encoded & 0xFFFF) * (2.0f / 65535.0f) - 1.0f, x, y, z);
+}
+
+uint16_t encode_gbuffer_normal(float x, float y, float z) {
+    // 8 bits per axis, every pixel of the G-buffer pays for it on both ends of the frame
+    float u;
+    float v;
+    fold_octahedral_normal(x, y, z, &u, &v);
+
+    uint32_t ex = (uint32_t)((u * 0.5f + 0.5f) * 255.0f + 0.5f);
+    uint32_t ey = (uint32_t)((v * 0.5f + 0.5f) * 255.0f + 0.5f);
+    return (uint16_t)((ex << 8) | ey);
+}
+
+void decode_gbuffer_normal(uint16_t encoded, float *x, float *y, float *z) {
+    unfold_octahedral_normal((encoded >> 8) * (2.0f / 255.0f) - 1.0f, (encoded & 0xFF) * (2.0f / 255.0f) - 1.0f, x, y, z);
+}
+
+uint32_t encode_gbuffer_uv(float u, float v) {
+    float fu = u - floorf(u);
+    float fv = v - floorf(v);
+
+    // fu can round up to exactly 1 for tiny negative u, and NaN must not reach the cast
+    uint32_t eu = fu >= 0 && fu < 1.0f ? (uint32_t)(fu * 65536.0f) : 0;
+    uint32_t ev = fv >= 0 && fv < 1.0f ? (uint32_t)(fv * 65536.0f) : 0;
+    eu = eu > 0xFFFF ? 0xFFFF : eu;
+    ev = ev > 0xFFFF ? 0xFFFF : ev;
+
+    return (eu << 16) | ev;
+}
+
+void decode_gbuffer_uv(uint32_t encoded, float *u, float *v) {
+    *u = (encoded >> 16) * (1.0f / 65536.0f);
+    *v = (encoded & 0xFFFF) * (1.0f / 65536.0f);
+}
@@ -0,0 +1,272 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "job_system.h"
+
+// Deque a thread pushes to and pops from first, threads the system did not
+// spawn all share worker 0's
+static _Thread_local int job_worker_index = 0;
+
+JobSystem *create_job_system(int worker_count) {
+    JobSystem *system = (JobSystem *)malloc(sizeof(JobSystem));
+    if (!system) {
+        printf("Could not allocate mem for job system");
+        return NULL;
+    }
+
+    worker_count = worker_count < 1 ? 1 : (worker_count > JOB_MAX_WORKERS ? JOB_MAX_WORKERS : worker_count);
+    system->worker_count = worker_count;
+    atomic_init(&system->queued, 0);
+    atomic_init(&system->running, 1);
+    pthread_mutex_init(&system->sleep_lock, NULL);
+    pthread_cond_init(&system->wake, NULL);
+    pthread_cond_init(&system->progress, NULL);
+    atomic_init(&system->submits, 0);
+
+    for (int i = 0; i < JOB_MAX_WORKERS; i++) {
+        pthread_mutex_init(&system->deques[i].lock, NULL);
+        system->deques[i].top = 0;
+        system->deques[i].bottom = 0;
+        system->workers[i].system = system;
+        system->workers[i].index = i;
+    }
+
+    // A worker that fails to start just leaves fewer threads to steal
+    for (int i = 1; i < worker_count; i++) {
+        if (pthread_create(&system->threads[i], NULL, run_job_worker, &system->workers[i]) != 0) {
+            printf("Could not start job worker %d", i);
+            system->worker_count = i;
+            break;
+        }
+    }
+
+    return system;
+}
+
+void free_job_system(JobSystem *system) {
+    if (system == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&system->sleep_lock);
+    atomic_store(&system->running, 0);
+    pthread_cond_broadcast(&system->wake);
+    pthread_mutex_unlock(&system->sleep_lock);
+
+    for (int i = 1; i < system->worker_count; i++) {
+        pthread_join(system->threads[i], NULL);
+    }
+
+    for (int i = 0; i < JOB_MAX_WORKERS; i++) {
+        pthread_mutex_destroy(&system->deques[i].lock);
+    }
+    pthread_mutex_destroy(&system->sleep_lock);
+    pthread_cond_destroy(&system->wake);
+    pthread_cond_destroy(&system->progress);
+    free(system);
+}
+
+int get_job_worker_count(const JobSystem *system) {
+    return system ? system->worker_count : 1;
+}
+
+int get_default_worker_count() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores < 1 ? 1 : (cores > JOB_MAX_WORKERS ? JOB_MAX_WORKERS : (int)cores);
+}
+
+int get_job_worker_index() {
+    return job_worker_index;
+}
+
+void submit_jobs(JobSystem *system, Job *jobs, int count, JobCounter *counter) {
+    if (counter) {
+        atomic_fetch_add(&counter->pending, count);
+    }
+
+    // Counted before anyone can see them, a thief taking one straight away
+    // never drives queued below zero
+    atomic_fetch_add(&system->queued, count);
+
+    JobDeque *deque = &system->deques[job_worker_index % system->worker_count];
+    int pushed = 0;
+
+    for (int i = 0; i < count; i++) {
+        Job job = jobs[i];
+        job.counter = counter;
+
+        pthread_mutex_lock(&deque->lock);
+        int full = deque->bottom - deque->top >= JOB_DEQUE_CAPACITY;
+        if (!full) {
+            deque->jobs[deque->bottom % JOB_DEQUE_CAPACITY] = job;
+            deque->bottom++;
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        // No room to queue it, so nobody else gets to steal it either
+        if (full) {
+            atomic_fetch_sub(&system->queued, 1);
+            run_job(system, &job);
+        } else {
+            pushed++;
+        }
+    }
+
+    if (pushed == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&system->sleep_lock);
+    atomic_fetch_add(&system->submits, 1);
+    pthread_cond_broadcast(&system->wake);
+    pthread_cond_broadcast(&system->progress);
+    pthread_mutex_unlock(&system->sleep_lock);
+}
+
+void wait_for_counter(JobSystem *system, JobCounter *counter) {
+    // Help with the jobs being waited on, they may be queued right here. Jobs
+    // of other groups are left alone, one could be far bigger than the wait
+    while (atomic_load(&counter->pending) > 0) {
+        int submits = atomic_load(&system->submits);
+
+        Job job;
+        if (take_job(system, job_worker_index % system->worker_count, counter, &job)) {
+            run_job(system, &job);
+            continue;
+        }
+
+        // The rest are running elsewhere, sleep until one of them finishes the
+        // group or more work gets queued
+        pthread_mutex_lock(&system->sleep_lock);
+        while (atomic_load(&counter->pending) > 0 && atomic_load(&system->submits) == submits) {
+            pthread_cond_wait(&system->progress, &system->sleep_lock);
+        }
+        pthread_mutex_unlock(&system->sleep_lock);
+    }
+}
+
+void parallel_for(JobSystem *system, int count, int grain, JobRangeFunc func, void *data) {
+    if (count <= 0) {
+        return;
+    }
+
+    grain = grain < 1 ? 1 : grain;
+    int range_count = (count + grain - 1) / grain;
+
+    // Not worth handing out, or nobody to hand it to
+    if (!system || system->worker_count < 2 || range_count < 2) {
+        func(data, 0, count);
+        return;
+    }
+
+    range_count = range_count > JOB_MAX_RANGES ? JOB_MAX_RANGES : range_count;
+
+    JobRange ranges[JOB_MAX_RANGES];
+    Job jobs[JOB_MAX_RANGES];
+    for (int i = 0; i < range_count; i++) {
+        ranges[i].func = func;
+        ranges[i].data = data;
+        ranges[i].start = (int)((int64_t)count * i / range_count);
+        ranges[i].end = (int)((int64_t)count * (i + 1) / range_count);
+        jobs[i].func = run_job_range;
+        jobs[i].data = &ranges[i];
+        jobs[i].counter = NULL;
+    }
+
+    // The caller keeps the first range for itself
+    JobCounter counter;
+    atomic_init(&counter.pending, 0);
+    submit_jobs(system, &jobs[1], range_count - 1, &counter);
+
+    run_job_range(&ranges[0]);
+    wait_for_counter(system, &counter);
+}
+
+int take_job(JobSystem *system, int worker, JobCounter *group, Job *job) {
+    if (atomic_load(&system->queued) <= 0) {
+        return 0;
+    }
+
+    // Newest of our own first, it is the one most likely still in cache
+    JobDeque *own = &system->deques[worker];
+    pthread_mutex_lock(&own->lock);
+    int found = 0;
+    for (int i = own->bottom - 1; i >= own->top && !found; i--) {
+        found = !group || own->jobs[i % JOB_DEQUE_CAPACITY].counter == group;
+        if (found) {
+            // Newer jobs of other groups close the gap
+            *job = own->jobs[i % JOB_DEQUE_CAPACITY];
+            for (int j = i; j < own->bottom - 1; j++) {
+                own->jobs[j % JOB_DEQUE_CAPACITY] = own->jobs[(j + 1) % JOB_DEQUE_CAPACITY];
+            }
+            own->bottom--;
+        }
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    // Then the oldest of everyone else's, the biggest piece of work they have left
+    for (int v = 1; v < system->worker_count && !found; v++) {
+        JobDeque *victim = &system->deques[(worker + v) % system->worker_count];
+
+        pthread_mutex_lock(&victim->lock);
+        for (int i = victim->top; i < victim->bottom && !found; i++) {
+            found = !group || victim->jobs[i % JOB_DEQUE_CAPACITY].counter == group;
+            if (found) {
+                *job = victim->jobs[i % JOB_DEQUE_CAPACITY];
+                for (int j = i; j > victim->top; j--) {
+                    victim->jobs[j % JOB_DEQUE_CAPACITY] = victim->jobs[(j - 1) % JOB_DEQUE_CAPACITY];
+                }
+                victim->top++;
+            }
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    if (found) {
+        atomic_fetch_sub(&system->queued, 1);
+    }
+
+    return found;
+}
+
+void run_job(JobSystem *system, Job *job) {
+    job->func(job->data);
+
+    // Last of its group, whoever sleeps on the counter gets woken
+    if (job->counter && atomic_fetch_sub(&job->counter->pending, 1) == 1) {
+        pthread_mutex_lock(&system->sleep_lock);
+        pthread_cond_broadcast(&system->progress);
+        pthread_mutex_unlock(&system->sleep_lock);
+    }
+}
+
+void *run_job_worker(void *arg) {
+    JobWorker *worker = (JobWorker *)arg;
+    JobSystem *system = worker->system;
+    job_worker_index = worker->index;
+
+    while (atomic_load(&system->running)) {
+        Job job;
+        if (take_job(system, worker->index, NULL, &job)) {
+            run_job(system, &job);
+            continue;
+        }
+
+        pthread_mutex_lock(&system->sleep_lock);
+        while (atomic_load(&system->queued) <= 0 && atomic_load(&system->running)) {
+            pthread_cond_wait(&system->wake, &system->sleep_lock);
+        }
+        pthread_mutex_unlock(&system->sleep_lock);
+    }
+
+    return NULL;
+}
+
+void run_job_range(void *arg) {
+    JobRange *range = (JobRange *)arg;
+    range->func(range->data, range->start, range->end);
+}
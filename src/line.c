@@ -25,8 +25,13 @@ void render_line(SDL_Renderer *renderer, iVec2 *start, iVec2 *end) {
     int y0 = start->y;
     int y1 = end->y;
 
-    if ((x0 < 0 && x1 < 0) || (x0 >= SCREEN_WIDTH && x1 >= SCREEN_WIDTH) ||
-        (y0 < 0 && y1 < 0) || (y0 >= SCREEN_HEIGHT && y1 >= SCREEN_HEIGHT)) {
+    // Whatever the renderer currently draws to, not a fixed screen
+    int width = 0;
+    int height = 0;
+    SDL_GetCurrentRenderOutputSize(renderer, &width, &height);
+
+    if ((x0 < 0 && x1 < 0) || (x0 >= width && x1 >= width) ||
+        (y0 < 0 && y1 < 0) || (y0 >= height && y1 >= height)) {
         return;
     }
 
@@ -37,7 +42,7 @@ void render_line(SDL_Renderer *renderer, iVec2 *start, iVec2 *end) {
     int error = dx + dy;
 
     while (1) {
-        if (x0 >= 0 && x0 < SCREEN_WIDTH && y0 >= 0 && y0 < SCREEN_HEIGHT) {
+        if (x0 >= 0 && x0 < width && y0 >= 0 && y0 < height) {
             SDL_RenderPoint(renderer, x0, y0);
         }
 
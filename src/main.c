@@ -23,67 +23,137 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "asset_loader.h"
 #include "camera.h"
 #include "constants.h"
+#include "framebuffer.h"
 #include "geometry.h"
 #include "input.h"
+#include "job_system.h"
 #include "line.h"
 #include "model.h"
 #include "obj_reader.h"
+#include "paged_mesh.h"
+#include "render_context.h"
 #include "render_pipeline.h"
 #include "triangle.h"
 
-static SDL_Window *window = NULL;
-static SDL_Renderer *renderer = NULL;
-
-float delta_tick;
-float last_tick;
-float current_tick;
-
-UserCamera *camera;
-UserInput *input;
-
-float yaw = -90.0f;
-float pitch = 0.0f;
-int first_mouse_read = 1;
-
-uint8_t *z_buffer;
-
-Mesh *mesh;
-ModelObject *model;
-
-void update_user_input(UserInput *);
-void run_program(void);
-void test_functions(void);
-
-static SDL_AppResult initialize_rendering_pipeline(void);
-static SDL_AppResult initialize_user_input(void);
-static SDL_AppResult initialize_camera(void);
-static SDL_AppResult initialize_objects(void);
+#define WINDOW_WIDTH 1280
+#define WINDOW_HEIGHT 720
+
+// Assets read and parsed at once, in the background of the render loop
+#define ASSET_LOAD_THREADS 2
+
+// Sleep after a frame that only showed the last one again, so an idle view leaves the core alone
+#define IDLE_FRAME_DELAY_MS 8
+
+// Everything the app keeps between callbacks, SDL hands it back as appstate
+typedef struct AppState {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *framebuffer_texture;
+
+    float delta_tick;
+    float last_tick;
+    float current_tick;
+
+    UserInput *input;
+    float yaw;
+    float pitch;
+    int first_mouse_read;
+
+    JobSystem *job_system;
+    LightingScene *lighting;
+    uint32_t light_seed;
+
+    // NULL until the load is ready, frames render without a model meanwhile
+    AssetLoader *asset_loader;
+    AssetLoad *mesh_load;
+    const char *mesh_path;
+    const char *mesh_directory;
+    Mesh *mesh;
+    ModelObject *model;
+
+    // Given a .pmesh on the command line, the model draws whatever clusters it streamed in
+    const char *paged_path;
+    PagedMesh *paged_mesh;
+
+    // The one view the window shows
+    RenderContext *context;
+} AppState;
+
+void update_user_input(AppState *);
+void run_program(AppState *);
+void update_asset_loads(AppState *);
+void update_paged_meshes(AppState *);
+void update_mesh_storage(AppState *);
+int load_app_mesh(AppState *);
+int convert_paged_mesh(const char *, const char *);
+void print_usage(const char *);
+void test_functions(AppState *);
+
+static SDL_AppResult initialize_rendering_pipeline(AppState *, int);
+static SDL_AppResult initialize_user_input(AppState *);
+static SDL_AppResult initialize_camera(AppState *);
+static SDL_AppResult initialize_objects(AppState *);
 
 /* This function runs once at startup. */
 SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) { /* Create the window */
-    SDL_CreateWindowAndRenderer("Simulation", SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_RESIZABLE,
-                                &window, &renderer);
-    SDL_AppResult result = initialize_rendering_pipeline();
+    AppState *app = (AppState *)calloc(1, sizeof(AppState));
+    if (!app) {
+        printf("Could not allocate app mem, quitting.");
+        return SDL_APP_FAILURE;
+    }
+    *appstate = app;
+    app->yaw = -90.0f;
+    app->pitch = 0.0f;
+    app->first_mouse_read = 1;
+    app->light_seed = 1;
+
+    // renderer --page in.obj out.pmesh converts and quits, renderer out.pmesh streams it,
+    // --benchmark draws every frame and prints the per stage stats
+    if (argc > 1 && strcmp(argv[1], "--page") == 0) {
+        if (argc != 4) {
+            print_usage(argv[0]);
+            return SDL_APP_FAILURE;
+        }
+        return convert_paged_mesh(argv[2], argv[3]) ? SDL_APP_SUCCESS : SDL_APP_FAILURE;
+    }
+    int benchmark = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--benchmark") == 0) {
+            benchmark = 1;
+        } else if (strncmp(argv[i], "--", 2) == 0 || app->paged_path) {
+            // A typo or a second path is not a mesh to stream
+            print_usage(argv[0]);
+            return SDL_APP_FAILURE;
+        } else {
+            app->paged_path = argv[i];
+        }
+    }
+
+    SDL_CreateWindowAndRenderer("Simulation", WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_RESIZABLE,
+                                &app->window, &app->renderer);
+    SDL_AppResult result = initialize_rendering_pipeline(app, benchmark);
     if (result == SDL_APP_FAILURE) {
         return SDL_APP_FAILURE;
     }
 
     // Get mouse
-    SDL_SetWindowMouseGrab(window, 1);
-    SDL_SetWindowRelativeMouseMode(window, 1);
+    SDL_SetWindowMouseGrab(app->window, 1);
+    SDL_SetWindowRelativeMouseMode(app->window, 1);
 
     // Initialize current tick
-    current_tick = 0;
+    app->current_tick = 0;
 
     // More initialization
-    initialize_user_input();
-    initialize_camera();
+    initialize_user_input(app);
+    initialize_camera(app);
 
     // Initialize the model
-    result = initialize_objects();
+    result = initialize_objects(app);
 
     if (result == SDL_APP_FAILURE) {
         return SDL_APP_FAILURE;
@@ -92,21 +162,62 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) { /* Create t
     return SDL_APP_CONTINUE;
 }
 
-static SDL_AppResult initialize_rendering_pipeline() {
-    z_buffer = (uint8_t *)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(int));
+static SDL_AppResult initialize_rendering_pipeline(AppState *app, int benchmark) {
+    // Every core takes part in the frame, without workers it all runs here
+    app->job_system = create_job_system(get_default_worker_count());
+
+    // A key light from above and a warm point light near the camera
+    app->lighting = create_lighting_scene(MAX_LIGHT_COUNT);
+    if (!app->lighting) {
+        printf("Could not allocate lighting mem, quitting.");
+        return SDL_APP_FAILURE;
+    }
+    Light *key_light = add_directional_light(app->lighting, (fVec4){-0.4f, -1.0f, -0.6f, 0.0f}, (fVec4){1.0f, 1.0f, 1.0f, 0.0f}, 0.8f);
+    attach_shadow_map(key_light, SHADOW_MAP_SIZE);
+    add_point_light(app->lighting, (fVec4){150.0f, 100.0f, 250.0f, 1.0f}, 600.0f, (fVec4){1.0f, 0.8f, 0.6f, 0.0f}, 0.6f);
+
+    RenderSettings settings = {
+        .mode = RENDER_MODE_FILLED,
+        .wireframe_target = WIREFRAME_TARGET_FRAMEBUFFER,
+        .shading = SHADING_UNLIT,
+        .lighting = app->lighting,
+        .depth_test = 1,
+        .blend = RASTER_BLEND_OPAQUE,
+        .opacity = 0.5f,
+        .textured = 1,
+        .deferred = 0,
+        .shadows = 0,
+        .multisample = 0,
+        .post_process = 0,
+        .exposure = 1.0f,
+        .compact_vertices = 0,
+        .benchmark = benchmark,
+        .jobs = app->job_system,
+    };
+
+    // Framebuffer, camera and frame scratch of the window's view
+    app->context = create_render_context(WINDOW_WIDTH, WINDOW_HEIGHT, &settings);
+    if (!app->context) {
+        printf("Could not allocate render context mem, quitting.");
+        return SDL_APP_FAILURE;
+    }
 
-    if (!z_buffer) {
-        printf("Could not allocate z-buffer mem, quitting.");
+    // Streaming texture the framebuffer is uploaded into every frame
+    app->framebuffer_texture = SDL_CreateTexture(app->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (!app->framebuffer_texture) {
+        printf("Could not create framebuffer texture, quitting.");
         return SDL_APP_FAILURE;
     }
+    // Blended pixels end up premultiplied against the transparent clear
+    SDL_SetTextureBlendMode(app->framebuffer_texture, SDL_BLENDMODE_BLEND_PREMULTIPLIED);
 
     return SDL_APP_CONTINUE;
 }
 
-static SDL_AppResult initialize_user_input() {
+static SDL_AppResult initialize_user_input(AppState *app) {
     // Initialize the user's input
-    input = create_user_input();
-    if (!input) {
+    app->input = create_user_input();
+    if (!app->input) {
         printf("Could not allocate input mem, quitting");
         return SDL_APP_FAILURE;
     }
@@ -114,9 +225,9 @@ static SDL_AppResult initialize_user_input() {
     return SDL_APP_CONTINUE;
 }
 
-static SDL_AppResult initialize_camera() {
-    // Create a new user camera
-    camera = create_camera();
+static SDL_AppResult initialize_camera(AppState *app) {
+    // The context made the camera, it only needs placing
+    UserCamera *camera = app->context->camera;
 
     // Position and target
     camera->camera_position = create_fvec4(0.0f, 0.0f, 3.0f, 1.0f);
@@ -126,80 +237,141 @@ static SDL_AppResult initialize_camera() {
     // Tweaked look_at function
     camera_look_at_front(camera, camera->camera_position, camera->camera_front, camera->camera_up);
 
-    if (!camera) {
-        printf("Could not allocate mem for user camera");
-        return SDL_APP_FAILURE;
-    }
-
     return SDL_APP_CONTINUE;
 }
 
-static SDL_AppResult initialize_objects() {
-    mesh = (Mesh *)malloc(sizeof(Mesh));
-    if (!mesh) {
-        printf("Could not allocate mem for mesh");
-        return SDL_APP_FAILURE;
+static SDL_AppResult initialize_objects(AppState *app) {
+    if (app->paged_path) {
+        app->paged_mesh = open_paged_mesh(app->paged_path, PAGED_MESH_CACHE_PAGES, app->context->settings.compact_vertices);
+        if (!app->paged_mesh) {
+            return SDL_APP_FAILURE;
+        }
+
+        // First pass picks and reads the clusters the camera starts out seeing
+        update_paged_mesh(app->paged_mesh, app->context->camera);
+        app->model = create_model_object(app->paged_mesh->mesh);
+        if (!app->model) {
+            printf("Could not allocate mem for model");
+            return SDL_APP_FAILURE;
+        }
+
+        set_render_context_scene(app->context, app->model, app->lighting);
+        return SDL_APP_CONTINUE;
     }
 
-    FILE *file = open_file("/home/zoly/Documents/3d-renderer/assets/Cube/Cube.obj");
-    // FILE *file = open_file("/home/zoly/Documents/obj-assets/sword-futuristic/Futuristic_Sword_Upload.obj");
-    if (!file) {
-        printf("Could not open file");
+    // Parsing a big obj takes seconds, the window starts rendering right away
+    app->asset_loader = create_asset_loader(ASSET_LOAD_THREADS);
+    if (!app->asset_loader) {
+        printf("Could not allocate mem for asset loader");
         return SDL_APP_FAILURE;
     }
 
-    // Create the new mesh
-    generate_mesh(file, mesh);
-    model = create_model_object(mesh);
-    if (!model) {
-        printf("Could not allocate mem for model");
+    // mtllib and map_Kd paths are relative to the obj
+    app->mesh_path = "/home/zoly/Documents/3d-renderer/assets/Cube/Cube.obj";
+    app->mesh_directory = "/home/zoly/Documents/3d-renderer/assets/Cube/";
+    // app->mesh_path = "/home/zoly/Documents/obj-assets/sword-futuristic/Futuristic_Sword_Upload.obj";
+    // app->mesh_directory = "/home/zoly/Documents/obj-assets/sword-futuristic/";
+    if (!load_app_mesh(app)) {
         return SDL_APP_FAILURE;
     }
 
+    set_render_context_scene(app->context, NULL, app->lighting);
+
     return SDL_APP_CONTINUE;
 }
 
 /* This function runs when a new event (mouse input, keypresses, etc) occurs. */
 SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
+    AppState *app = (AppState *)appstate;
+    RenderSettings *settings = &app->context->settings;
+
     if (event->type == SDL_EVENT_QUIT) {
         return SDL_APP_SUCCESS;
     }
     if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_ESCAPE) {
         return SDL_APP_SUCCESS;
     }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_F) {
+        // Toggle between filled triangles and the plain wireframe
+        settings->mode = (settings->mode == RENDER_MODE_FILLED) ? RENDER_MODE_WIREFRAME : RENDER_MODE_FILLED;
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_G) {
+        // Cycle unlit -> flat -> gouraud
+        settings->shading = (settings->shading + 1) % (SHADING_GOURAUD + 1);
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_Z) {
+        settings->depth_test = !settings->depth_test;
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_B) {
+        // Toggle see-through blending of the whole model
+        settings->blend = (settings->blend == RASTER_BLEND_OPAQUE) ? RASTER_BLEND_ALPHA : RASTER_BLEND_OPAQUE;
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_T) {
+        settings->textured = !settings->textured;
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_L) {
+        // Toggle forward shading and the G-buffer lighting pass
+        settings->deferred = !settings->deferred;
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_H) {
+        // Toggle the key light's shadow map
+        settings->shadows = !settings->shadows;
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_M) {
+        // Toggle 4x multisampling of the forward path
+        settings->multisample = !settings->multisample;
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_X) {
+        // Toggle tone mapping, gamma and FXAA over the finished frame
+        settings->post_process = !settings->post_process;
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_V) {
+        // Toggle storing the mesh as the quantized vertex stream instead of floats
+        settings->compact_vertices = !settings->compact_vertices;
+        update_mesh_storage(app);
+    }
+    if (event->type == SDL_EVENT_KEY_DOWN && event->key.scancode == SDL_SCANCODE_P) {
+        // Sprinkle small colored point lights around the model, a new batch every press
+        Mesh *mesh = app->model ? app->model->mesh : NULL;
+        if (!mesh) {
+            return SDL_APP_CONTINUE;
+        }
+        float range = (mesh->bounding_box_vec[NUM_BOUNDING_BOX_VERTEX - 1]->x - mesh->bounding_box_vec[0]->x) * 0.5f;
+        // The frame being drawn still reads the lights
+        wait_for_render_context(app->context);
+        scatter_point_lights(app->lighting, mesh->bounding_box_vec[0], mesh->bounding_box_vec[NUM_BOUNDING_BOX_VERTEX - 1], 32, range, app->light_seed++ * 2654435761u);
+    }
 
     return SDL_APP_CONTINUE;
 }
 
 /* This function runs once per frame, and is the heart of the program. */
 SDL_AppResult SDL_AppIterate(void *appstate) {
-    last_tick = current_tick;
-    current_tick = SDL_GetPerformanceCounter();
+    AppState *app = (AppState *)appstate;
+    app->last_tick = app->current_tick;
+    app->current_tick = SDL_GetPerformanceCounter();
 
-    delta_tick = (double)((current_tick - last_tick) * 1000 / (double)SDL_GetPerformanceFrequency());
+    app->delta_tick = (double)((app->current_tick - app->last_tick) * 1000 / (double)SDL_GetPerformanceFrequency());
 
     // Make sure the update what the user has done BEFORE updating screen
-    update_user_input(input);
-    run_program();
+    update_user_input(app);
+    run_program(app);
 
     return SDL_APP_CONTINUE;
 }
 
-void update_user_input(UserInput *input) {
+void update_user_input(AppState *app) {
+    UserInput *input = app->input;
+    UserCamera *camera = app->context->camera;
     input->keyboard_state = SDL_GetKeyboardState(NULL);
-    uint32_t mouse_button;
 
     // Get the mouse button pressed
-    if (first_mouse_read) {
-        mouse_button = SDL_GetMouseState(&input->cursorx, &input->cursory);
-        first_mouse_read = 0;
-    } else {
-        mouse_button = SDL_GetMouseState(&input->cursorx, &input->cursory);
-    }
+    SDL_GetMouseState(&input->cursorx, &input->cursory);
+    app->first_mouse_read = 0;
 
     // Get how far the cursor went in x and y
-    float xoffset = input->cursorx - SCREEN_WIDTH / 2.0f;
-    float yoffset = SCREEN_HEIGHT / 2.0f - input->cursory;
+    float xoffset = input->cursorx - WINDOW_WIDTH / 2.0f;
+    float yoffset = WINDOW_HEIGHT / 2.0f - input->cursory;
 
     // Sensitivity for slower or faster movement
     float sensitivity = 0.1f;
@@ -207,25 +379,25 @@ void update_user_input(UserInput *input) {
     yoffset *= sensitivity;
 
     // Add to the current yaw and pitch of the UserCamera
-    yaw += xoffset;
-    pitch += yoffset;
+    app->yaw += xoffset;
+    app->pitch += yoffset;
 
     // Readjust back to the middle of the window
-    SDL_WarpMouseInWindow(window, SCREEN_WIDTH / 2.0f, SCREEN_HEIGHT / 2.0f);
+    SDL_WarpMouseInWindow(app->window, WINDOW_WIDTH / 2.0f, WINDOW_HEIGHT / 2.0f);
 
     // Lock so that they do not further than usual up or down
-    if (pitch > 89.0f)
-        pitch = 89.0f;
-    if (pitch < -89.0f)
-        pitch = -89.0f;
+    if (app->pitch > 89.0f)
+        app->pitch = 89.0f;
+    if (app->pitch < -89.0f)
+        app->pitch = -89.0f;
 
     // Calcuations for what we are now looking at
-    camera->camera_front->x = cos(convert_deg_to_rad(yaw)) * cos(convert_deg_to_rad(pitch));
-    camera->camera_front->y = sin(convert_deg_to_rad(pitch));
-    camera->camera_front->z = sin(convert_deg_to_rad(yaw)) * cos(convert_deg_to_rad(pitch));
+    camera->camera_front->x = cos(convert_deg_to_rad(app->yaw)) * cos(convert_deg_to_rad(app->pitch));
+    camera->camera_front->y = sin(convert_deg_to_rad(app->pitch));
+    camera->camera_front->z = sin(convert_deg_to_rad(app->yaw)) * cos(convert_deg_to_rad(app->pitch));
 
     // Normalize movement speed based on current tick
-    float adjusted_movement_speed = delta_tick * MOVEMENT_SPEED_MULTIPLIER;
+    float adjusted_movement_speed = app->delta_tick * MOVEMENT_SPEED_MULTIPLIER;
 
     if (input->keyboard_state[SDL_SCANCODE_W]) {
         camera->camera_position->x += camera->camera_front->x * adjusted_movement_speed;
@@ -261,53 +433,230 @@ void update_user_input(UserInput *input) {
     camera_look_at_front(camera, camera->camera_position, camera->camera_front, camera->camera_up);
 }
 
-void test_functions() {
+void test_functions(AppState *app) {
+    SDL_Renderer *renderer = app->renderer;
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
     SDL_SetRenderDrawColor(renderer, 255, 0, 255, 255);
-    iVec2 *p0 = create_ivec2(2 * SCREEN_WIDTH / 3, 500);
-    iVec2 *p1 = create_ivec2(SCREEN_WIDTH / 3, 500);
-    iVec2 *p2 = create_ivec2(SCREEN_WIDTH / 2, 100);
+    iVec2 *p0 = create_ivec2(2 * WINDOW_WIDTH / 3, 500);
+    iVec2 *p1 = create_ivec2(WINDOW_WIDTH / 3, 500);
+    iVec2 *p2 = create_ivec2(WINDOW_WIDTH / 2, 100);
 
     create_triangle(renderer, p2, p1, p0);
 
     SDL_RenderPresent(renderer);
 }
 
-void run_program() {
-    clear_screen(renderer);
-    update_fps();
+void run_program(AppState *app) {
+    update_asset_loads(app);
+    update_paged_meshes(app);
 
-    execute_render_pipeline(renderer, model, camera);
+    // The scene moves before any view of it is recorded
+    if (app->model) {
+        update_model_space(app->model);
+    }
 
-    SDL_RenderPresent(renderer);
+    if (!render_context_frame(app->context, app->renderer, app->framebuffer_texture)) {
+        SDL_Delay(IDLE_FRAME_DELAY_MS);
+    }
+}
+
+void update_asset_loads(AppState *app) {
+    if (!app->mesh_load) {
+        return;
+    }
+
+    AssetState state = get_asset_state(app->mesh_load);
+    if (state == ASSET_QUEUED || state == ASSET_LOADING) {
+        // The box stands in from the vertex pass until the swap
+        float bounds_min[3];
+        float bounds_max[3];
+        if (!app->context->has_proxy && get_asset_bounds(app->mesh_load, bounds_min, bounds_max)) {
+            set_render_context_proxy(app->context, bounds_min, bounds_max);
+        }
+        return;
+    }
+
+    RenderSettings *settings = &app->context->settings;
+    int compact = app->mesh_load->compact;
+
+    if (state == ASSET_READY && app->model) {
+        // Reloaded for V, nothing is left to present the old one. The new mesh is
+        // another pointer, so the shadow maps see the change
+        drop_render_context_frame(app->context);
+        free_obj_reader(app->mesh);
+        app->mesh = app->mesh_load->mesh;
+        app->model->mesh = app->mesh;
+    } else if (state == ASSET_READY) {
+        app->mesh = app->mesh_load->mesh;
+        app->model = create_model_object(app->mesh);
+
+        // Swapped in between frames, the next one recorded is the first to see it
+        if (app->model) {
+            set_render_context_scene(app->context, app->model, app->lighting);
+        } else {
+            printf("Could not allocate mem for model");
+        }
+    } else if (app->mesh) {
+        // The mesh we have stays, and so does its format
+        printf("Could not load mesh %s", app->mesh_load->path);
+        settings->compact_vertices = app->mesh->vec_arr == NULL;
+        compact = settings->compact_vertices;
+    } else {
+        // No mesh is coming to fill the box
+        printf("Could not load mesh %s", app->mesh_load->path);
+        app->context->has_proxy = 0;
+    }
+
+    free_asset_load(app->mesh_load);
+    app->mesh_load = NULL;
+
+    // V was pressed while it loaded
+    if (app->model && compact != settings->compact_vertices) {
+        load_app_mesh(app);
+    }
+}
+
+int load_app_mesh(AppState *app) {
+    app->mesh_load = load_mesh_async(app->asset_loader, app->mesh_path, app->mesh_directory, app->context->settings.compact_vertices);
+    if (!app->mesh_load) {
+        printf("Could not allocate mem for mesh load");
+        return 0;
+    }
+    return 1;
+}
+
+void update_paged_meshes(AppState *app) {
+    if (!app->paged_mesh || !app->model) {
+        return;
+    }
+
+    // Frames only ever copy the mesh pointer when recorded, the one still drawing keeps
+    // the retired mesh and it goes on the next rebuild
+    if (update_paged_mesh(app->paged_mesh, app->context->camera)) {
+        app->model->mesh = app->paged_mesh->mesh;
+    }
+}
+
+void update_mesh_storage(AppState *app) {
+    RenderSettings *settings = &app->context->settings;
+    int compact = settings->compact_vertices;
+
+    if (app->paged_mesh) {
+        // The pools go, the frame being drawn reads them and presenting it reads the edges
+        drop_render_context_frame(app->context);
+
+        if (!set_paged_mesh_storage(app->paged_mesh, compact)) {
+            settings->compact_vertices = !compact;
+        }
+
+        // Both meshes went with the old pools, the pieces come back from the cached pages
+        if (!app->paged_mesh->mesh) {
+            update_paged_mesh(app->paged_mesh, app->context->camera);
+        }
+        if (app->model) {
+            app->model->mesh = app->paged_mesh->mesh;
+        }
+        return;
+    }
+
+    // The obj is parsed again in the new format, the current one draws until it's ready.
+    // Decoding the compact stream back would keep its rounding in the floats
+    if (app->model && !app->mesh_load && !load_app_mesh(app)) {
+        settings->compact_vertices = !compact;
+    }
+}
+
+void print_usage(const char *program) {
+    printf("Usage: %s [--benchmark] [mesh.pmesh]\n       %s --page in.obj out.pmesh\n", program, program);
+}
+
+int convert_paged_mesh(const char *obj_path, const char *paged_path) {
+    // mtllib paths are relative to the obj, so is everything up to the last slash
+    char directory[ASSET_PATH_LENGTH];
+    snprintf(directory, ASSET_PATH_LENGTH, "%s", obj_path);
+    char *slash = strrchr(directory, '/');
+    if (slash) {
+        slash[1] = '\0';
+    } else {
+        directory[0] = '\0';
+    }
+
+    FILE *file = open_file((char *)obj_path);
+    if (!file) {
+        printf("Could not load mesh %s", obj_path);
+        return 0;
+    }
+
+    // Streamed straight from the obj, the mesh is never built in memory
+    int triangles = write_paged_mesh(file, directory, paged_path);
+    fclose(file);
+
+    if (triangles > 0) {
+        printf("Paged %d triangles of %s into %s\n", triangles, obj_path, paged_path);
+    }
+
+    return triangles > 0;
 }
 
 /* This function runs once at shutdown. */
 void SDL_AppQuit(void *appstate, SDL_AppResult result) {
-    if (camera->camera_mat) {
-        free(camera->camera_mat);
-        camera->camera_mat = NULL;
+    AppState *app = (AppState *)appstate;
+    if (!app) {
+        return;
     }
 
-    if (camera->projection_mat) {
-        free(camera->projection_mat);
-        camera->projection_mat = NULL;
+    // A load still parsing finishes first, one still queued never starts
+    if (app->asset_loader) {
+        free_asset_loader(app->asset_loader);
+        app->asset_loader = NULL;
     }
 
-    if (mesh) {
-        free_obj_reader(mesh);
-        mesh = NULL;
+    if (app->mesh_load) {
+        if (get_asset_state(app->mesh_load) == ASSET_READY) {
+            free_obj_reader(app->mesh_load->mesh);
+        }
+        free_asset_load(app->mesh_load);
+        app->mesh_load = NULL;
     }
 
-    if (model) {
-        free(model);
-        model = NULL;
+    // Nothing below can go while a worker is still drawing with it
+    if (app->context) {
+        free_render_context(app->context);
+        app->context = NULL;
     }
 
-    if (z_buffer) {
-        free(z_buffer);
-        z_buffer = NULL;
+    if (app->mesh) {
+        free_obj_reader(app->mesh);
+        app->mesh = NULL;
     }
+
+    if (app->paged_mesh) {
+        free_paged_mesh(app->paged_mesh);
+        app->paged_mesh = NULL;
+    }
+
+    if (app->model) {
+        free(app->model);
+        app->model = NULL;
+    }
+
+    if (app->framebuffer_texture) {
+        SDL_DestroyTexture(app->framebuffer_texture);
+        app->framebuffer_texture = NULL;
+    }
+
+    if (app->lighting) {
+        free_lighting_scene(app->lighting);
+        app->lighting = NULL;
+    }
+
+    if (app->job_system) {
+        free_job_system(app->job_system);
+        app->job_system = NULL;
+    }
+
+    free(app->input);
+    free(app);
 }
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "material.h"
+#include "texture.h"
+
+MaterialLibrary *create_material_library(void) {
+    MaterialLibrary *library = (MaterialLibrary *)malloc(sizeof(MaterialLibrary));
+    if (!library) {
+        printf("Could not allocate mem for material library");
+        return NULL;
+    }
+
+    library->materials = NULL;
+    library->count = 0;
+    library->capacity = 0;
+
+    // Slot 0 is the plain white material untagged faces fall back to
+    if (!add_material(library, "default")) {
+        free(library);
+        return NULL;
+    }
+
+    return library;
+}
+
+Material *add_material(MaterialLibrary *library, const char *name) {
+    if (library->count == library->capacity) {
+        int capacity = library->capacity ? library->capacity * 2 : 8;
+        Material *materials = (Material *)realloc(library->materials, capacity * sizeof(Material));
+        if (!materials) {
+            printf("Could not allocate mem for materials");
+            return NULL;
+        }
+
+        library->materials = materials;
+        library->capacity = capacity;
+    }
+
+    Material *material = &library->materials[library->count++];
+    memset(material, 0, sizeof(Material));
+    snprintf(material->name, sizeof(material->name), "%s", name);
+
+    material->diffuse[0] = 1.0f;
+    material->diffuse[1] = 1.0f;
+    material->diffuse[2] = 1.0f;
+    material->opacity = 1.0f;
+
+    return material;
+}
+
+Texture *find_loaded_texture(MaterialLibrary *library, const char *path) {
+    for (int i = 0; i < library->count; i++) {
+        if (library->materials[i].diffuse_texture && strcmp(library->materials[i].diffuse_map, path) == 0) {
+            return library->materials[i].diffuse_texture;
+        }
+    }
+
+    return NULL;
+}
+
+void strip_line_end(char *line) {
+    size_t length = strlen(line);
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) {
+        line[--length] = '\0';
+    }
+}
+
+int load_material_library(MaterialLibrary *library, const char *directory, const char *filename) {
+    char path[MAX_MATERIAL_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s%s", directory, filename);
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("ERROR: Could not find material library %s", path);
+        return 0;
+    }
+
+    char buffer[MAX_BUFFER_SIZE];
+    Material *material = NULL;
+
+    while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        strip_line_end(buffer);
+
+        // Leading whitespace is common in exported .mtl files
+        char *line = buffer + strspn(buffer, " \t");
+
+        if (strncmp(line, "newmtl ", 7) == 0) {
+            material = add_material(library, line + 7);
+            if (!material) {
+                break;
+            }
+            continue;
+        }
+
+        // Anything before the first newmtl has nothing to apply to
+        if (!material) {
+            continue;
+        }
+
+        if (strncmp(line, "Kd ", 3) == 0) {
+            sscanf(line, "Kd %f %f %f", &material->diffuse[0], &material->diffuse[1], &material->diffuse[2]);
+        } else if (strncmp(line, "Ks ", 3) == 0) {
+            sscanf(line, "Ks %f %f %f", &material->specular[0], &material->specular[1], &material->specular[2]);
+        } else if (strncmp(line, "Ns ", 3) == 0) {
+            sscanf(line, "Ns %f", &material->shininess);
+        } else if (strncmp(line, "d ", 2) == 0) {
+            sscanf(line, "d %f", &material->opacity);
+        } else if (strncmp(line, "Tr ", 3) == 0) {
+            float transparency = 0;
+            if (sscanf(line, "Tr %f", &transparency) == 1) {
+                material->opacity = 1.0f - transparency;
+            }
+        } else if (strncmp(line, "map_Kd ", 7) == 0) {
+            // Options like -s or -o come first, the file name is the last token
+            char *name = strrchr(line, ' ') + 1;
+            snprintf(material->diffuse_map, sizeof(material->diffuse_map), "%s%s", directory, name);
+
+            // Many materials often share one texture, only load it once
+            material->diffuse_texture = find_loaded_texture(library, material->diffuse_map);
+            if (!material->diffuse_texture) {
+                material->diffuse_texture = load_texture(material->diffuse_map);
+            }
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
+
+int find_material(MaterialLibrary *library, const char *name) {
+    for (int i = 0; i < library->count; i++) {
+        if (strcmp(library->materials[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return DEFAULT_MATERIAL;
+}
+
+void free_material_library(MaterialLibrary *library) {
+    if (library == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < library->count; i++) {
+        Texture *texture = library->materials[i].diffuse_texture;
+
+        // Shared textures are owned by the first material that loaded them
+        int owner = 1;
+        for (int j = 0; j < i && owner; j++) {
+            owner = library->materials[j].diffuse_texture != texture;
+        }
+        if (owner) {
+            free_texture(texture);
+        }
+    }
+
+    free(library->materials);
+    free(library);
+}
@@ -0,0 +1,238 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camera.h"
+#include "compact_vertex.h"
+#include "frame_arena.h"
+#include "geometry.h"
+#include "meshlet.h"
+#include "model.h"
+
+static MeshletStats meshlet_stats;
+
+// BUILDING //
+
+void build_mesh_meshlets(Mesh *mesh) {
+    mesh->meshlets = NULL;
+    mesh->meshlet_vertices = NULL;
+    mesh->meshlet_count = 0;
+
+    int meshlet_count = 0;
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        mesh->submeshes[i].first_meshlet = 0;
+        mesh->submeshes[i].meshlet_count = 0;
+        meshlet_count += (mesh->submeshes[i].triangle_count + MESHLET_TRIANGLES - 1) / MESHLET_TRIANGLES;
+    }
+
+    // Worst case every corner and both welded ends of every side are vertices of their own
+    MeshMeshlet *meshlets = (MeshMeshlet *)malloc((meshlet_count ? meshlet_count : 1) * sizeof(MeshMeshlet));
+    int *vertices = (int *)malloc((mesh->num_triangles ? mesh->num_triangles : 1) * NUM_TRIANGLE_VERTEX * 3 * sizeof(int));
+    int *last_meshlet = (int *)malloc((mesh->vec_count ? mesh->vec_count : 1) * sizeof(int));
+
+    if (!meshlets || !vertices || !last_meshlet) {
+        // Without meshlets every frame just transforms and sets up everything
+        printf("Could not allocate mem for meshlets");
+        free(meshlets);
+        free(vertices);
+        free(last_meshlet);
+        return;
+    }
+
+    for (int v = 0; v < mesh->vec_count; v++) {
+        last_meshlet[v] = -1;
+    }
+
+    // Runs of the submesh lists as they are, faces stay in draw order
+    mesh->meshlet_vertices = vertices;
+    int m = 0;
+    int vertex_total = 0;
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        MeshSubmesh *submesh = &mesh->submeshes[i];
+        submesh->first_meshlet = m;
+
+        VecConnectionsPoints *triangle = submesh->head;
+        for (int remaining = submesh->triangle_count; remaining > 0 && triangle != NULL && m < meshlet_count; m++) {
+            MeshMeshlet *meshlet = &meshlets[m];
+            VecConnectionsPoints *first = triangle;
+            int count = remaining < MESHLET_TRIANGLES ? remaining : MESHLET_TRIANGLES;
+
+            // Each vertex is listed once per meshlet, the first time one of its faces uses it.
+            // Wireframe edges run between welded vertices, which can sit in another meshlet
+            meshlet->first_vertex = vertex_total;
+            int t = 0;
+            for (; t < count && triangle != NULL; t++, triangle = triangle->next) {
+                for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+                    int corner = triangle->vertices[k];
+                    int ends[3] = {corner, corner, corner};
+                    if (mesh->edges) {
+                        ends[1] = mesh->edges[triangle->edges[k]].v0;
+                        ends[2] = mesh->edges[triangle->edges[k]].v1;
+                    }
+
+                    for (int e = 0; e < 3; e++) {
+                        if (last_meshlet[ends[e]] != m) {
+                            last_meshlet[ends[e]] = m;
+                            vertices[vertex_total++] = ends[e];
+                        }
+                    }
+                }
+            }
+            meshlet->vertex_count = vertex_total - meshlet->first_vertex;
+            bound_mesh_meshlet(mesh, meshlet, first, t);
+
+            remaining -= t;
+        }
+
+        submesh->meshlet_count = m - submesh->first_meshlet;
+    }
+
+    free(last_meshlet);
+    mesh->meshlets = meshlets;
+    mesh->meshlet_count = m;
+
+    // Sized for the worst case, most vertices are shared within a meshlet
+    int *trimmed = (int *)realloc(vertices, (vertex_total ? vertex_total : 1) * sizeof(int));
+    if (trimmed) {
+        mesh->meshlet_vertices = trimmed;
+    }
+}
+
+void bound_mesh_meshlet(Mesh *mesh, MeshMeshlet *meshlet, VecConnectionsPoints *first, int count) {
+    int *vertices = &mesh->meshlet_vertices[meshlet->first_vertex];
+
+    // Sphere around the box of its vertices, grown to the farthest one
+    fVec4 min = {INFINITY, INFINITY, INFINITY, 1.0f};
+    fVec4 max = {-INFINITY, -INFINITY, -INFINITY, 1.0f};
+    for (int v = 0; v < meshlet->vertex_count; v++) {
+        fVec4 decoded;
+        fVec4 *point = read_mesh_position(mesh, vertices[v], &decoded);
+        min.x = point->x < min.x ? point->x : min.x;
+        min.y = point->y < min.y ? point->y : min.y;
+        min.z = point->z < min.z ? point->z : min.z;
+        max.x = point->x > max.x ? point->x : max.x;
+        max.y = point->y > max.y ? point->y : max.y;
+        max.z = point->z > max.z ? point->z : max.z;
+    }
+
+    meshlet->center = (fVec4){(min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f, 1.0f};
+    meshlet->radius = 0.0f;
+    for (int v = 0; v < meshlet->vertex_count; v++) {
+        fVec4 decoded;
+        fVec4 *point = read_mesh_position(mesh, vertices[v], &decoded);
+        float dx = point->x - meshlet->center.x;
+        float dy = point->y - meshlet->center.y;
+        float dz = point->z - meshlet->center.z;
+        float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+        meshlet->radius = distance > meshlet->radius ? distance : meshlet->radius;
+    }
+
+    // Cone axis is the average face normal, zero area faces have none and setup drops them anyway
+    fVec4 axis = {0.0f, 0.0f, 0.0f, 0.0f};
+    VecConnectionsPoints *triangle = first;
+    for (int t = 0; t < count && triangle != NULL; t++, triangle = triangle->next) {
+        axis.x += triangle->surface_normal->x;
+        axis.y += triangle->surface_normal->y;
+        axis.z += triangle->surface_normal->z;
+    }
+    normalize_fvec4(&axis);
+    meshlet->cone_axis = axis;
+
+    // Widest angle between the axis and a face normal, past a right angle some
+    // face looks back at any viewpoint and the meshlet is never culled
+    float min_dot = 1.0f;
+    triangle = first;
+    for (int t = 0; t < count && triangle != NULL; t++, triangle = triangle->next) {
+        if (dot_fvec4(triangle->surface_normal, triangle->surface_normal) == 0.0f) {
+            continue;
+        }
+
+        float dot = dot_fvec4(&axis, triangle->surface_normal);
+        min_dot = dot < min_dot ? dot : min_dot;
+    }
+
+    int has_axis = dot_fvec4(&axis, &axis) > 0.0f;
+    meshlet->cone_cutoff = has_axis && min_dot > 0.0f ? sqrtf(1.0f - min_dot * min_dot) : 1.0f;
+}
+
+// CULLING //
+
+unsigned char *cull_mesh_meshlets(UserCamera *camera, Mesh *mesh, FrameArena *arena, unsigned char **vertex_mask) {
+    *vertex_mask = NULL;
+    if (!mesh->meshlets || mesh->meshlet_count == 0) {
+        return NULL;
+    }
+
+    unsigned char *visible = (unsigned char *)frame_arena_alloc(arena, mesh->meshlet_count);
+    unsigned char *mask = (unsigned char *)frame_arena_alloc(arena, mesh->vec_count ? mesh->vec_count : 1);
+    if (!visible || !mask) {
+        printf("Could not allocate mem for meshlet culling");
+        return NULL;
+    }
+
+    // The model matrix is not applied, so meshlets are tested where the mesh has them
+    uint64_t frustum_culled = 0;
+    uint64_t cone_culled = 0;
+    memset(mask, 0, mesh->vec_count);
+    for (int m = 0; m < mesh->meshlet_count; m++) {
+        MeshMeshlet *meshlet = &mesh->meshlets[m];
+        visible[m] = 0;
+
+        if (!sphere_in_frustum(&camera->frustum, &meshlet->center, meshlet->radius)) {
+            frustum_culled++;
+            continue;
+        }
+        if (is_meshlet_backfacing(meshlet, camera->camera_position)) {
+            cone_culled++;
+            continue;
+        }
+
+        // Vertices of the meshlets left are the only ones transformed this frame
+        visible[m] = 1;
+        int *vertices = &mesh->meshlet_vertices[meshlet->first_vertex];
+        for (int v = 0; v < meshlet->vertex_count; v++) {
+            mask[vertices[v]] = 1;
+        }
+    }
+
+    record_meshlet_stats(mesh->meshlet_count, frustum_culled, cone_culled);
+    *vertex_mask = mask;
+    return visible;
+}
+
+int is_meshlet_backfacing(MeshMeshlet *meshlet, fVec4 *eye) {
+    // Seen from anywhere inside the sphere, every face of the cone points away
+    float dx = meshlet->center.x - eye->x;
+    float dy = meshlet->center.y - eye->y;
+    float dz = meshlet->center.z - eye->z;
+    float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+    float along_axis = dx * meshlet->cone_axis.x + dy * meshlet->cone_axis.y + dz * meshlet->cone_axis.z;
+
+    return along_axis >= meshlet->cone_cutoff * distance + meshlet->radius;
+}
+
+void record_meshlet_stats(uint64_t tested, uint64_t frustum_culled, uint64_t cone_culled) {
+    atomic_fetch_add(&meshlet_stats.frames, 1);
+    atomic_fetch_add(&meshlet_stats.tested, tested);
+    atomic_fetch_add(&meshlet_stats.frustum_culled, frustum_culled);
+    atomic_fetch_add(&meshlet_stats.cone_culled, cone_culled);
+}
+
+void print_meshlet_stats() {
+    MeshletStats *stats = &meshlet_stats;
+    if (stats->frames == 0 || stats->tested == 0) {
+        return;
+    }
+
+    printf("  %-20s %8.1f tested %7.1f%% frustum %7.1f%% cone culled\n", "meshlets",
+           stats->tested / (double)stats->frames,
+           100.0 * stats->frustum_culled / (double)stats->tested,
+           100.0 * stats->cone_culled / (double)stats->tested);
+
+    stats->frames = 0;
+    stats->tested = 0;
+    stats->frustum_culled = 0;
+    stats->cone_culled = 0;
+}
@@ -3,10 +3,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "compact_vertex.h"
 #include "constants.h"
 #include "geometry.h"
+#include "meshlet.h"
 #include "model.h"
 #include "obj_reader.h"
+#include "wireframe.h"
 
 FILE *open_file(char *filename) {
     FILE *ptr;
@@ -20,7 +23,12 @@ FILE *open_file(char *filename) {
     return ptr;
 }
 
-void generate_mesh(FILE *file, Mesh *mesh) {
+void generate_mesh(FILE *file, const char *directory, Mesh *mesh) {
+    read_mesh_vertices(file, mesh);
+    read_mesh_faces(file, directory, mesh);
+}
+
+void read_mesh_vertices(FILE *file, Mesh *mesh) {
     int *vertex_att = parse_vertex_attributes(file);
 
     // Store vertex attribute counts into the mesh
@@ -31,17 +39,43 @@ void generate_mesh(FILE *file, Mesh *mesh) {
 
     // Make vec array for each vertex
     mesh->vec_arr = (fVec4 *)malloc(mesh->vec_count * sizeof(fVec4));
+    mesh->uv_arr = mesh->vec_texture_count ? (fVec2 *)malloc(mesh->vec_texture_count * sizeof(fVec2)) : NULL;
 
     // Initialize Linked List of VecConnectionsPoints
     mesh->head = NULL;
-
-    // Restart and populate the verticies array
+    mesh->num_triangles = 0;
+
+    // Materials are filled in as mtllib lines are found, slot 0 is the fallback
+    mesh->materials = create_material_library();
+    mesh->submeshes = NULL;
+    mesh->submesh_count = 0;
+    mesh->meshlets = NULL;
+    mesh->meshlet_count = 0;
+    mesh->meshlet_vertices = NULL;
+    mesh->compact = NULL;
+
+    // Restart and populate the verticies array, the bounding box is known after this
     rewind(file);
     populate_vertices_arr(file, mesh);
+    free(vertex_att);
+}
 
+void read_mesh_faces(FILE *file, const char *directory, Mesh *mesh) {
     // Restart and obtain the vertex connections
     rewind(file);
-    parse_vertex_connections(file, mesh);
+    parse_vertex_connections(file, directory, mesh);
+
+    // Make every material's faces one contiguous run of the triangle list
+    group_mesh_submeshes(mesh);
+
+    // Per vertex normals so lighting can run once per vertex
+    calculate_vertex_normals(mesh);
+
+    // Unique edges for the wireframe, shared edges are only drawn once
+    build_mesh_edges(mesh);
+
+    // Small runs of every submesh, culled whole before their vertices are transformed
+    build_mesh_meshlets(mesh);
 }
 
 int *parse_vertex_attributes(FILE *file) {
@@ -82,8 +116,19 @@ void populate_vertices_arr(FILE *file, Mesh *mesh) {
     float maxz = FLT_MIN;
 
     int i = 0;
+    int uv_idx = 0;
     // Get x, y, and z
     while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        if (strncmp(buffer, "vt ", 3) == 0 && mesh->uv_arr) {
+            float u = 0;
+            float v = 0;
+            sscanf(buffer, "vt %f %f", &u, &v);
+
+            mesh->uv_arr[uv_idx].x = u;
+            mesh->uv_arr[uv_idx].y = 1.0f - v;
+            uv_idx++;
+        }
+
         if (strncmp(buffer, "v ", 2) == 0) {
             float x;
             float y;
@@ -98,6 +143,9 @@ void populate_vertices_arr(FILE *file, Mesh *mesh) {
                 (mesh->vec_arr + i)->x = x;
                 (mesh->vec_arr + i)->y = y;
                 (mesh->vec_arr + i)->z = z;
+                (mesh->vec_arr + i)->w = 1.0f;
+            } else {
+                *(mesh->vec_arr + i) = (fVec4){0.0f, 0.0f, 0.0f, 1.0f};
             }
             i++;
         }
@@ -157,10 +205,22 @@ void define_bounding_box(Mesh *mesh, float minx, float maxx, float miny, float m
     }
 }
 
-void parse_vertex_connections(FILE *file, Mesh *mesh) {
+void parse_vertex_connections(FILE *file, const char *directory, Mesh *mesh) {
     char buffer[MAX_BUFFER_SIZE];
+    int material = DEFAULT_MATERIAL;
 
     while (fgets(buffer, sizeof(buffer), file) != NULL) {
+        if (strncmp(buffer, "mtllib ", 7) == 0 && mesh->materials) {
+            strip_line_end(buffer);
+            load_material_library(mesh->materials, directory, buffer + 7);
+        }
+
+        // Faces keep the material of the last usemtl above them
+        if (strncmp(buffer, "usemtl ", 7) == 0 && mesh->materials) {
+            strip_line_end(buffer);
+            material = find_material(mesh->materials, buffer + 7);
+        }
+
         if ((strncmp(buffer, "f ", 2)) == 0) {
             // Duplicate string twice
             char *line1 = strdup(buffer + 2);
@@ -191,8 +251,7 @@ void parse_vertex_connections(FILE *file, Mesh *mesh) {
             int temp_idx = 0;
             char *token2 = strtok_r(line2, " \n\r", &saveptr2);
             while (token2 != NULL) {
-                char *sub_saveptr;
-                char *sub_token = strtok_r(token2, "/", &sub_saveptr);
+                char *sub_token = token2;
 
                 int v_idx = 0;
                 int vt_idx = 0;
@@ -223,7 +282,7 @@ void parse_vertex_connections(FILE *file, Mesh *mesh) {
             // Number of triangles is the number of vertecies - 2
             mesh->num_triangles += temp_idx - 2;
 
-            populate_vertex_connections(v_att_arr, vertex_groups, mesh);
+            populate_vertex_connections(v_att_arr, vt_att_arr, vertex_groups, material, mesh);
 
             free(line1);
             free(line2);
@@ -235,31 +294,160 @@ void parse_vertex_connections(FILE *file, Mesh *mesh) {
     }
 }
 
-void populate_vertex_connections(int *v_att_arr, int vertex_groups, Mesh *mesh) {
+void populate_vertex_connections(int *v_att_arr, int *vt_att_arr, int vertex_groups, int material, Mesh *mesh) {
     // Create a VecConnectionsPoints and add it to the linked list
     for (int i = 2; i < vertex_groups; i++) {
         VecConnectionsPoints *current_vec = (VecConnectionsPoints *)malloc(sizeof(VecConnectionsPoints));
         // attributes have 1 based indexing and vec_arr is 0 based indexing
-        current_vec->triangle_points[0] = &mesh->vec_arr[v_att_arr[0] - 1];
-        current_vec->triangle_points[1] = &mesh->vec_arr[v_att_arr[i - 1] - 1];
-        current_vec->triangle_points[2] = &mesh->vec_arr[v_att_arr[i] - 1];
+        current_vec->vertices[0] = v_att_arr[0] - 1;
+        current_vec->vertices[1] = v_att_arr[i - 1] - 1;
+        current_vec->vertices[2] = v_att_arr[i] - 1;
+
+        int corners[NUM_TRIANGLE_VERTEX] = {0, i - 1, i};
+        for (int j = 0; j < NUM_TRIANGLE_VERTEX; j++) {
+            int vt_idx = vt_att_arr[corners[j]];
+            current_vec->uvs[j] = (vt_idx > 0 && vt_idx <= mesh->vec_texture_count) ? vt_idx - 1 : -1;
+        }
 
-        calculate_surface_normal(current_vec, current_vec->triangle_points[0], current_vec->triangle_points[1], current_vec->triangle_points[2]);
+        current_vec->material = material;
+
+        fVec4 *points = mesh->vec_arr;
+        calculate_surface_normal(current_vec, &points[current_vec->vertices[0]], &points[current_vec->vertices[1]], &points[current_vec->vertices[2]]);
 
         current_vec->next = mesh->head;
         mesh->head = current_vec;
     }
 }
 
+int compare_submesh_keys(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+void group_mesh_submeshes(Mesh *mesh) {
+    int material_count = mesh->materials ? mesh->materials->count : 1;
+
+    VecConnectionsPoints **heads = (VecConnectionsPoints **)calloc(material_count, sizeof(VecConnectionsPoints *));
+    VecConnectionsPoints **tails = (VecConnectionsPoints **)calloc(material_count, sizeof(VecConnectionsPoints *));
+    int *counts = (int *)calloc(material_count, sizeof(int));
+    int *order = (int *)malloc(material_count * sizeof(int));
+
+    if (!heads || !tails || !counts || !order) {
+        printf("Could not allocate mem for submeshes");
+        free(heads);
+        free(tails);
+        free(counts);
+        free(order);
+        return;
+    }
+
+    // Split the triangle list into one list per material, keeping file order
+    for (VecConnectionsPoints *triangle = mesh->head; triangle != NULL;) {
+        VecConnectionsPoints *next = triangle->next;
+        int material = triangle->material < material_count ? triangle->material : DEFAULT_MATERIAL;
+
+        triangle->next = NULL;
+        if (tails[material]) {
+            tails[material]->next = triangle;
+        } else {
+            heads[material] = triangle;
+        }
+        tails[material] = triangle;
+        counts[material]++;
+
+        triangle = next;
+    }
+
+    // Sort key is the pipeline state with the material index in the low part:
+    // opaque before see-through so blending sees what is behind it, then
+    // untextured before textured so each kernel runs back to back
+    int used_count = 0;
+    for (int i = 0; i < material_count; i++) {
+        if (!counts[i]) {
+            continue;
+        }
+
+        order[used_count++] = get_submesh_key(mesh->materials, i);
+    }
+
+    qsort(order, used_count, sizeof(int), compare_submesh_keys);
+
+    // Stitch the lists back together in draw order
+    mesh->submeshes = (MeshSubmesh *)malloc((used_count ? used_count : 1) * sizeof(MeshSubmesh));
+    mesh->submesh_count = mesh->submeshes ? used_count : 0;
+    mesh->head = NULL;
+
+    VecConnectionsPoints *tail = NULL;
+    int first_triangle = 0;
+    for (int i = 0; i < used_count; i++) {
+        int material = order[i] % material_count;
+
+        if (tail) {
+            tail->next = heads[material];
+        } else {
+            mesh->head = heads[material];
+        }
+        tail = tails[material];
+
+        if (mesh->submeshes) {
+            mesh->submeshes[i].material = material;
+            mesh->submeshes[i].first_triangle = first_triangle;
+            mesh->submeshes[i].triangle_count = counts[material];
+            mesh->submeshes[i].head = heads[material];
+        }
+        first_triangle += counts[material];
+    }
+
+    free(heads);
+    free(tails);
+    free(counts);
+    free(order);
+}
+
+int get_submesh_key(MaterialLibrary *materials, int material) {
+    if (!materials) {
+        return material;
+    }
+
+    Material *entry = &materials->materials[material];
+    int state = (entry->opacity < 1.0f) * 2 + (entry->diffuse_texture != NULL);
+    return state * materials->count + material;
+}
+
 void calculate_surface_normal(VecConnectionsPoints *current_vec, fVec4 *a, fVec4 *b, fVec4 *c) {
-    fVec4 *v1 = sub_fvec4(a, b);
-    fVec4 *v2 = sub_fvec4(a, c);
+    current_vec->surface_normal = create_fvec4(0, 0, 0, 0);
+    compute_face_normal(a, b, c, current_vec->surface_normal);
+}
+
+void compute_face_normal(const fVec4 *a, const fVec4 *b, const fVec4 *c, fVec4 *normal) {
+    fVec4 v1 = {a->x - b->x, a->y - b->y, a->z - b->z, a->w - b->w};
+    fVec4 v2 = {a->x - c->x, a->y - c->y, a->z - c->z, a->w - c->w};
+
+    normal->x = (v1.y * v2.z) - (v1.z * v2.y);
+    normal->y = (v1.z * v2.x) - (v1.x * v2.z);
+    normal->z = (v1.x * v2.y) - (v1.y * v2.x);
+    normal->w = 0;
+    normalize_fvec4(normal);
+}
 
-    current_vec->surface_normal = cross_fvec4(v1, v2);
-    normalize_fvec4(current_vec->surface_normal);
+void calculate_vertex_normals(Mesh *mesh) {
+    mesh->normal_arr = (fVec4 *)calloc(mesh->vec_count, sizeof(fVec4));
+    if (!mesh->normal_arr) {
+        printf("Could not allocate mem for vertex normals");
+        return;
+    }
+
+    // Sum the normal of every triangle touching the vertex, then normalize
+    for (VecConnectionsPoints *triangle = mesh->head; triangle != NULL; triangle = triangle->next) {
+        for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+            fVec4 *normal = &mesh->normal_arr[triangle->vertices[i]];
+            add_fvec4_in_place(normal, triangle->surface_normal);
+        }
+    }
 
-    free(v1);
-    free(v2);
+    for (int i = 0; i < mesh->vec_count; i++) {
+        normalize_fvec4(&mesh->normal_arr[i]);
+        mesh->normal_arr[i].w = 0;
+    }
 }
 
 void free_obj_reader(Mesh *mesh) {
@@ -284,6 +472,48 @@ void free_obj_reader(Mesh *mesh) {
 
     mesh->vec_arr = NULL;
 
+    if (mesh->uv_arr) {
+        free(mesh->uv_arr);
+        mesh->uv_arr = NULL;
+    }
+
+    if (mesh->normal_arr) {
+        free(mesh->normal_arr);
+        mesh->normal_arr = NULL;
+    }
+
+    if (mesh->edges) {
+        free(mesh->edges);
+        mesh->edges = NULL;
+    }
+
+    if (mesh->submeshes) {
+        free(mesh->submeshes);
+        mesh->submeshes = NULL;
+    }
+
+    if (mesh->meshlets) {
+        free(mesh->meshlets);
+        mesh->meshlets = NULL;
+    }
+
+    if (mesh->meshlet_vertices) {
+        free(mesh->meshlet_vertices);
+        mesh->meshlet_vertices = NULL;
+    }
+
+    free_compact_vertices(mesh->compact);
+    mesh->compact = NULL;
+
+    free_material_library(mesh->materials);
+    mesh->materials = NULL;
+
+    // V reloads the obj, so a mesh is freed every toggle and not just at quit
+    for (int i = 0; i < NUM_BOUNDING_BOX_VERTEX; i++) {
+        free(mesh->bounding_box_vec[i]);
+        mesh->bounding_box_vec[i] = NULL;
+    }
+
     free(mesh);
     mesh = NULL;
 }
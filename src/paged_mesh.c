@@ -0,0 +1,1528 @@
+#include <float.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "camera.h"
+#include "compact_vertex.h"
+#include "constants.h"
+#include "geometry.h"
+#include "material.h"
+#include "meshlet.h"
+#include "model.h"
+#include "obj_reader.h"
+#include "paged_mesh.h"
+#include "texture.h"
+#include "wireframe.h"
+
+static PagedMeshStats paged_mesh_stats;
+
+// WRITING //
+
+int write_paged_mesh(FILE *obj, const char *directory, const char *path) {
+    char buffer[MAX_BUFFER_SIZE];
+    int *corners = NULL;
+    int *corner_uvs = NULL;
+    int corner_capacity = 0;
+
+    // Counting pass, only the materials are loaded, they decide the draw order
+    MaterialLibrary *materials = create_material_library();
+    if (!materials) {
+        printf("Could not allocate mem for paged mesh materials");
+        return 0;
+    }
+
+    int vec_count = 0;
+    int uv_count = 0;
+    int64_t triangle_total = 0;
+    while (fgets(buffer, sizeof(buffer), obj) != NULL) {
+        if (strncmp(buffer, "v ", 2) == 0) {
+            vec_count++;
+        } else if (strncmp(buffer, "vt ", 3) == 0) {
+            uv_count++;
+        } else if (strncmp(buffer, "mtllib ", 7) == 0) {
+            strip_line_end(buffer);
+            load_material_library(materials, directory, buffer + 7);
+        } else if (strncmp(buffer, "f ", 2) == 0) {
+            int corner_count = read_paged_face_corners(buffer + 2, &corners, &corner_uvs, &corner_capacity);
+            triangle_total += corner_count > 2 ? corner_count - 2 : 0;
+        }
+    }
+
+    if (triangle_total == 0 || triangle_total > INT32_MAX) {
+        printf("Could not page %lld triangles", (long long)triangle_total);
+        free(corners);
+        free(corner_uvs);
+        free_material_library(materials);
+        return 0;
+    }
+
+    // Per vertex data stays resident, every face only passes through
+    int material_count = materials->count;
+    fVec4 *positions = (fVec4 *)malloc((vec_count ? vec_count : 1) * sizeof(fVec4));
+    fVec4 *normals = (fVec4 *)calloc(vec_count ? vec_count : 1, sizeof(fVec4));
+    fVec2 *uvs = uv_count ? (fVec2 *)malloc(uv_count * sizeof(fVec2)) : NULL;
+    int *remap = (int *)malloc((vec_count ? vec_count : 1) * sizeof(int));
+    uint32_t *orders = (uint32_t *)malloc(material_count * sizeof(uint32_t));
+    PagedFace *faces = (PagedFace *)malloc(PAGED_MESH_SPILL_FACES * sizeof(PagedFace));
+    unsigned char *page = (unsigned char *)calloc(1, PAGED_MESH_PAGE_SIZE);
+    unsigned char *blob = (unsigned char *)malloc(PAGED_MESH_PAGE_SIZE);
+    unsigned char *coarse_blob = (unsigned char *)malloc(PAGED_MESH_PAGE_SIZE / 2);
+    FILE *coarse = tmpfile();
+    FILE *file = fopen(path, "wb");
+    FILE *spill = NULL;
+    PagedCluster *clusters = NULL;
+    PagedRun *runs = NULL;
+    int *heap = NULL;
+
+    int ok = positions && normals && (uvs || !uv_count) && remap && orders && faces && page && blob && coarse_blob && coarse && file;
+    if (!ok) {
+        printf("Could not allocate mem for paged mesh %s", path);
+    }
+
+    // Same key as the submeshes, opaque before see-through and untextured before textured
+    for (int m = 0; m < material_count && ok; m++) {
+        Material *material = &materials->materials[m];
+        uint32_t state = (material->opacity < 1.0f) * 2 + (material->diffuse_texture != NULL);
+        orders[m] = state * material_count + m;
+    }
+
+    // Bounds pass, positions and uvs as the obj reader stores them
+    float minx = FLT_MAX;
+    float miny = FLT_MAX;
+    float minz = FLT_MAX;
+    float maxx = FLT_MIN;
+    float maxy = FLT_MIN;
+    float maxz = FLT_MIN;
+
+    int v = 0;
+    int uv_idx = 0;
+    rewind(obj);
+    while (ok && fgets(buffer, sizeof(buffer), obj) != NULL) {
+        if (strncmp(buffer, "vt ", 3) == 0 && uvs) {
+            float u = 0;
+            float w = 0;
+            sscanf(buffer, "vt %f %f", &u, &w);
+            uvs[uv_idx].x = u;
+            uvs[uv_idx].y = 1.0f - w;
+            uv_idx++;
+        }
+
+        if (strncmp(buffer, "v ", 2) == 0) {
+            float x = 0;
+            float y = 0;
+            float z = 0;
+            if (sscanf(buffer, "v %f %f %f", &x, &y, &z) == NUM_TRIANGLE_VERTEX) {
+                positions[v] = (fVec4){x, y, z, 1.0f};
+            } else {
+                positions[v] = (fVec4){0.0f, 0.0f, 0.0f, 1.0f};
+            }
+            determine_min_max(&minx, &miny, &minz, &maxx, &maxy, &maxz, x, y, z);
+            remap[v++] = -1;
+        }
+    }
+
+    float extent_x = maxx - minx > 0 ? maxx - minx : 1.0f;
+    float extent_y = maxy - miny > 0 ? maxy - miny : 1.0f;
+    float extent_z = maxz - minz > 0 ? maxz - minz : 1.0f;
+
+    // Key pass, every face gets its Morton code and adds its normal to its corners.
+    // A full buffer is sorted and spilled as one run
+    int material = DEFAULT_MATERIAL;
+    int64_t triangle = 0;
+    int64_t face_total = 0;
+    int face_count = 0;
+    int run_count = 0;
+    rewind(obj);
+    while (ok && fgets(buffer, sizeof(buffer), obj) != NULL) {
+        if (strncmp(buffer, "usemtl ", 7) == 0) {
+            strip_line_end(buffer);
+            material = find_material(materials, buffer + 7);
+        }
+
+        if (strncmp(buffer, "f ", 2) != 0) {
+            continue;
+        }
+
+        int corner_count = read_paged_face_corners(buffer + 2, &corners, &corner_uvs, &corner_capacity);
+        for (int i = 2; i < corner_count && ok; i++) {
+            // Fan order of the obj reader, serials count down like its prepended list
+            int picks[NUM_TRIANGLE_VERTEX] = {0, i - 1, i};
+            PagedFace *face = &faces[face_count];
+            face->serial = (uint32_t)(triangle_total - 1 - triangle++);
+
+            int valid = 1;
+            for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+                int vertex = corners[picks[k]] - 1;
+                int uv = corner_uvs[picks[k]];
+                valid = valid && vertex >= 0 && vertex < vec_count;
+                face->vertices[k] = vertex;
+                face->uvs[k] = uv > 0 && uv <= uv_count ? uv - 1 : -1;
+            }
+            if (!valid) {
+                continue;
+            }
+
+            fVec4 *a = &positions[face->vertices[0]];
+            fVec4 *b = &positions[face->vertices[1]];
+            fVec4 *c = &positions[face->vertices[2]];
+            fVec4 normal;
+            compute_face_normal(a, b, c, &normal);
+            for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+                add_fvec4_in_place(&normals[face->vertices[k]], &normal);
+            }
+
+            float x = ((a->x + b->x + c->x) * (1.0f / 3.0f) - minx) / extent_x;
+            float y = ((a->y + b->y + c->y) * (1.0f / 3.0f) - miny) / extent_y;
+            float z = ((a->z + b->z + c->z) * (1.0f / 3.0f) - minz) / extent_z;
+            face->morton = compute_morton_code(x, y, z);
+            face->order = orders[material < material_count ? material : DEFAULT_MATERIAL];
+            face->material = material;
+            face_count++;
+            face_total++;
+
+            if (face_count == PAGED_MESH_SPILL_FACES) {
+                spill = spill ? spill : tmpfile();
+                qsort(faces, face_count, sizeof(PagedFace), compare_paged_faces);
+                ok = spill && spill_paged_faces(spill, faces, face_count);
+                run_count++;
+                face_count = 0;
+            }
+        }
+    }
+
+    for (int n = 0; n < vec_count && ok; n++) {
+        normalize_fvec4(&normals[n]);
+        normals[n].w = 0;
+    }
+
+    // Everything fit, the one run is the buffer. Otherwise the tail is spilled too
+    // and the runs are merged from small windows
+    qsort(faces, face_count, sizeof(PagedFace), compare_paged_faces);
+    if (ok && spill && face_count > 0) {
+        ok = spill_paged_faces(spill, faces, face_count);
+        run_count++;
+    }
+
+    int heap_count = spill ? run_count : 1;
+    runs = (PagedRun *)calloc(heap_count, sizeof(PagedRun));
+    heap = (int *)malloc(heap_count * sizeof(int));
+    ok = ok && runs && heap;
+
+    if (ok && !spill) {
+        runs[0].faces = faces;
+        runs[0].count = face_count;
+    }
+    for (int r = 0; r < heap_count && ok && spill; r++) {
+        int64_t length = r < heap_count - 1 || face_count == 0 ? PAGED_MESH_SPILL_FACES : face_count;
+        runs[r].faces = (PagedFace *)malloc(PAGED_MESH_MERGE_FACES * sizeof(PagedFace));
+        runs[r].offset = (off_t)r * PAGED_MESH_SPILL_FACES * sizeof(PagedFace);
+        runs[r].remaining = length;
+        ok = runs[r].faces != NULL;
+    }
+    for (int r = 0; r < heap_count && ok; r++) {
+        heap[r] = r;
+    }
+    for (int r = heap_count / 2 - 1; r >= 0 && ok; r--) {
+        sift_paged_runs(runs, heap, heap_count, r);
+    }
+
+    int cluster_count = (int)((face_total + PAGED_MESH_CLUSTER_TRIANGLES - 1) / PAGED_MESH_CLUSTER_TRIANGLES);
+    clusters = (PagedCluster *)calloc(cluster_count ? cluster_count : 1, sizeof(PagedCluster));
+    ok = ok && clusters && cluster_count > 0;
+
+    // Page 0 is the header, written last once the counts are known
+    ok = ok && fwrite(page, 1, PAGED_MESH_PAGE_SIZE, file) == PAGED_MESH_PAGE_SIZE;
+    uint32_t page_index = 1;
+    size_t page_used = 0;
+    size_t coarse_size = 0;
+
+    // Spill pass, consecutive runs of the merged curve become the clusters, the
+    // coarse level goes to its own temp file until it is copied behind the directory
+    PagedFace cluster_faces[PAGED_MESH_CLUSTER_TRIANGLES];
+    for (int cluster = 0; cluster < cluster_count && ok; cluster++) {
+        int triangle_count = 0;
+        while (triangle_count < PAGED_MESH_CLUSTER_TRIANGLES) {
+            int taken = take_paged_face(spill, runs, heap, &heap_count, &cluster_faces[triangle_count]);
+            ok = taken >= 0;
+            if (taken <= 0) {
+                break;
+            }
+            triangle_count++;
+        }
+        if (!ok || triangle_count == 0) {
+            break;
+        }
+
+        size_t cluster_coarse_size = 0;
+        size_t size = build_paged_cluster(positions, normals, uvs, cluster_faces, triangle_count, remap, blob, coarse_blob, &cluster_coarse_size, &clusters[cluster]);
+        ok = fwrite(coarse_blob, 1, cluster_coarse_size, coarse) == cluster_coarse_size;
+
+        // Clusters never straddle pages, a page is whatever fits whole
+        if (ok && page_used + size > PAGED_MESH_PAGE_SIZE) {
+            ok = fwrite(page, 1, PAGED_MESH_PAGE_SIZE, file) == PAGED_MESH_PAGE_SIZE;
+            memset(page, 0, PAGED_MESH_PAGE_SIZE);
+            page_index++;
+            page_used = 0;
+        }
+
+        memcpy(page + page_used, blob, size);
+        clusters[cluster].page = page_index;
+        clusters[cluster].offset = (uint32_t)page_used;
+        clusters[cluster].size = (uint32_t)size;
+        clusters[cluster].coarse_offset = (uint32_t)coarse_size;
+        clusters[cluster].coarse_size = (uint32_t)cluster_coarse_size;
+        page_used += size;
+        coarse_size += cluster_coarse_size;
+    }
+
+    if (ok && page_used > 0) {
+        ok = fwrite(page, 1, PAGED_MESH_PAGE_SIZE, file) == PAGED_MESH_PAGE_SIZE;
+        page_index++;
+    }
+
+    // Directory, materials and the coarse level, read whole when the mesh is opened
+    if (ok) {
+        ok = fwrite(clusters, sizeof(PagedCluster), cluster_count, file) == (size_t)cluster_count;
+    }
+    for (int m = 0; m < material_count && ok; m++) {
+        Material *source = &materials->materials[m];
+        PagedMaterial record;
+        memset(&record, 0, sizeof(PagedMaterial));
+        memcpy(record.name, source->name, sizeof(record.name));
+        memcpy(record.diffuse, source->diffuse, sizeof(record.diffuse));
+        memcpy(record.specular, source->specular, sizeof(record.specular));
+        record.shininess = source->shininess;
+        record.opacity = source->opacity;
+        memcpy(record.diffuse_map, source->diffuse_map, sizeof(record.diffuse_map));
+        ok = fwrite(&record, sizeof(PagedMaterial), 1, file) == 1;
+    }
+
+    ok = ok && fseeko(coarse, 0, SEEK_SET) == 0;
+    for (size_t copied = 0; copied < coarse_size && ok;) {
+        size_t chunk = coarse_size - copied < PAGED_MESH_PAGE_SIZE ? coarse_size - copied : PAGED_MESH_PAGE_SIZE;
+        ok = fread(page, 1, chunk, coarse) == chunk && fwrite(page, 1, chunk, file) == chunk;
+        copied += chunk;
+    }
+
+    PagedMeshHeader header;
+    memset(&header, 0, sizeof(PagedMeshHeader));
+    header.magic = PAGED_MESH_MAGIC;
+    header.version = PAGED_MESH_VERSION;
+    header.page_size = PAGED_MESH_PAGE_SIZE;
+    header.page_count = page_index;
+    header.cluster_count = cluster_count;
+    header.material_count = material_count;
+    header.has_uvs = uvs != NULL;
+    header.min[0] = minx;
+    header.min[1] = miny;
+    header.min[2] = minz;
+    header.max[0] = maxx;
+    header.max[1] = maxy;
+    header.max[2] = maxz;
+    header.coarse_size = coarse_size;
+
+    if (ok) {
+        ok = fseeko(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(PagedMeshHeader), 1, file) == 1;
+    }
+    if (file) {
+        ok = (fclose(file) == 0) && ok;
+    }
+
+    if (!ok) {
+        printf("Could not write paged mesh %s", path);
+    }
+
+    for (int r = 0; spill && runs && r < run_count; r++) {
+        free(runs[r].faces);
+    }
+    if (spill) {
+        fclose(spill);
+    }
+    if (coarse) {
+        fclose(coarse);
+    }
+    free(runs);
+    free(heap);
+    free(clusters);
+    free(faces);
+    free(page);
+    free(blob);
+    free(coarse_blob);
+    free(orders);
+    free(remap);
+    free(uvs);
+    free(normals);
+    free(positions);
+    free(corners);
+    free(corner_uvs);
+    free_material_library(materials);
+
+    return ok ? (int)face_total : 0;
+}
+
+int read_paged_face_corners(char *line, int **vertices, int **uvs, int *capacity) {
+    int count = 0;
+    char *saveptr;
+
+    // v, v/vt, v//vn and v/vt/vn, only the position and uv indices are kept
+    for (char *token = strtok_r(line, " \n\r", &saveptr); token != NULL; token = strtok_r(NULL, " \n\r", &saveptr)) {
+        if (count == *capacity) {
+            int grown = *capacity ? *capacity * 2 : 8;
+            int *grown_vertices = (int *)realloc(*vertices, grown * sizeof(int));
+            if (grown_vertices) {
+                *vertices = grown_vertices;
+            }
+            int *grown_uvs = (int *)realloc(*uvs, grown * sizeof(int));
+            if (grown_uvs) {
+                *uvs = grown_uvs;
+            }
+            if (!grown_vertices || !grown_uvs) {
+                printf("Could not allocate mem for face corners");
+                return 0;
+            }
+            *capacity = grown;
+        }
+
+        int v_idx = 0;
+        int vt_idx = NO_ATTRIBUTE;
+        if (sscanf(token, "%d/%d", &v_idx, &vt_idx) < 2) {
+            vt_idx = NO_ATTRIBUTE;
+        }
+        (*vertices)[count] = v_idx;
+        (*uvs)[count] = vt_idx;
+        count++;
+    }
+
+    return count;
+}
+
+int spill_paged_faces(FILE *spill, PagedFace *faces, int count) {
+    // Runs are appended in order, run r starts at r full buffers in
+    return fseeko(spill, 0, SEEK_END) == 0 && fwrite(faces, sizeof(PagedFace), count, spill) == (size_t)count;
+}
+
+int take_paged_face(FILE *spill, PagedRun *runs, int *heap, int *heap_count, PagedFace *face) {
+    if (*heap_count == 0) {
+        return 0;
+    }
+
+    PagedRun *run = &runs[heap[0]];
+
+    // Window ran dry, the next one comes from where the run left off in the file
+    if (run->next == run->count && run->remaining > 0) {
+        int count = run->remaining < PAGED_MESH_MERGE_FACES ? (int)run->remaining : PAGED_MESH_MERGE_FACES;
+        if (fseeko(spill, run->offset, SEEK_SET) != 0 || fread(run->faces, sizeof(PagedFace), count, spill) != (size_t)count) {
+            return -1;
+        }
+        run->offset += (off_t)count * sizeof(PagedFace);
+        run->remaining -= count;
+        run->count = count;
+        run->next = 0;
+        sift_paged_runs(runs, heap, *heap_count, 0);
+        return take_paged_face(spill, runs, heap, heap_count, face);
+    }
+
+    *face = run->faces[run->next++];
+
+    // A finished run leaves the heap, the last one takes its place
+    if (run->next == run->count && run->remaining == 0) {
+        heap[0] = heap[--(*heap_count)];
+    }
+    sift_paged_runs(runs, heap, *heap_count, 0);
+
+    return 1;
+}
+
+void sift_paged_runs(PagedRun *runs, int *heap, int count, int index) {
+    // Min heap on each run's next face, a run with an empty window sorts first so it gets refilled
+    while (1) {
+        int smallest = index;
+        for (int child = index * 2 + 1; child <= index * 2 + 2 && child < count; child++) {
+            PagedRun *a = &runs[heap[child]];
+            PagedRun *b = &runs[heap[smallest]];
+            int a_empty = a->next == a->count;
+            int b_empty = b->next == b->count;
+            if (a_empty > b_empty || (a_empty == b_empty && !a_empty && compare_paged_faces(&a->faces[a->next], &b->faces[b->next]) < 0)) {
+                smallest = child;
+            }
+        }
+
+        if (smallest == index) {
+            return;
+        }
+
+        int swap = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+int compare_paged_faces(const void *a, const void *b) {
+    const PagedFace *face_a = (const PagedFace *)a;
+    const PagedFace *face_b = (const PagedFace *)b;
+    if (face_a->morton != face_b->morton) {
+        return face_a->morton < face_b->morton ? -1 : 1;
+    }
+    if (face_a->order != face_b->order) {
+        return face_a->order < face_b->order ? -1 : 1;
+    }
+    return (face_a->serial > face_b->serial) - (face_a->serial < face_b->serial);
+}
+
+uint32_t compute_morton_code(float x, float y, float z) {
+    // 10 bits per axis, each spread out to every third bit and interleaved
+    uint32_t axes[3];
+    float values[3] = {x, y, z};
+    for (int i = 0; i < 3; i++) {
+        float value = values[i] < 0.0f ? 0.0f : (values[i] > 1.0f ? 1.0f : values[i]);
+        uint32_t bits = (uint32_t)(value * 1023.0f);
+        bits = (bits | (bits << 16)) & 0x030000ffu;
+        bits = (bits | (bits << 8)) & 0x0300f00fu;
+        bits = (bits | (bits << 4)) & 0x030c30c3u;
+        bits = (bits | (bits << 2)) & 0x09249249u;
+        axes[i] = bits;
+    }
+
+    return (axes[0] << 2) | (axes[1] << 1) | axes[2];
+}
+
+size_t pack_paged_cluster(unsigned char *out, int vertex_count, const float *positions, const float *normals, int triangle_count, const uint32_t *indices, const float *uvs, const int32_t *materials) {
+    // Counts, then positions, normals, corner indices, corner uvs and materials
+    uint32_t counts[2] = {(uint32_t)vertex_count, (uint32_t)triangle_count};
+    size_t size = 0;
+
+    memcpy(out + size, counts, sizeof(counts));
+    size += sizeof(counts);
+    memcpy(out + size, positions, vertex_count * 3 * sizeof(float));
+    size += vertex_count * 3 * sizeof(float);
+    memcpy(out + size, normals, vertex_count * 3 * sizeof(float));
+    size += vertex_count * 3 * sizeof(float);
+    memcpy(out + size, indices, triangle_count * 3 * sizeof(uint32_t));
+    size += triangle_count * 3 * sizeof(uint32_t);
+    memcpy(out + size, uvs, triangle_count * 6 * sizeof(float));
+    size += triangle_count * 6 * sizeof(float);
+    memcpy(out + size, materials, triangle_count * sizeof(int32_t));
+    size += triangle_count * sizeof(int32_t);
+
+    return size;
+}
+
+size_t build_paged_cluster(const fVec4 *vertices, const fVec4 *vertex_normals, const fVec2 *vertex_uvs, const PagedFace *faces, int count, int *remap, unsigned char *out, unsigned char *coarse_out, size_t *coarse_size, PagedCluster *record) {
+    float positions[PAGED_MESH_CLUSTER_TRIANGLES * 9];
+    float normals[PAGED_MESH_CLUSTER_TRIANGLES * 9];
+    uint32_t indices[PAGED_MESH_CLUSTER_TRIANGLES * 3];
+    float uvs[PAGED_MESH_CLUSTER_TRIANGLES * 6];
+    int32_t materials[PAGED_MESH_CLUSTER_TRIANGLES];
+    int touched[PAGED_MESH_CLUSTER_TRIANGLES * 3];
+    int vertex_count = 0;
+
+    // A cluster always has a face, the writer never asks for an empty one
+    if (count < 1 || count > PAGED_MESH_CLUSTER_TRIANGLES) {
+        *coarse_size = 0;
+        return 0;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        record->min[i] = INFINITY;
+        record->max[i] = -INFINITY;
+    }
+
+    // Mesh vertices get cluster local indices the first time a face uses them
+    for (int t = 0; t < count; t++) {
+        const PagedFace *face = &faces[t];
+        for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+            int vertex = face->vertices[k];
+            if (remap[vertex] < 0) {
+                const fVec4 *position = &vertices[vertex];
+                const fVec4 *normal = &vertex_normals[vertex];
+                float point[3] = {position->x, position->y, position->z};
+
+                for (int i = 0; i < 3; i++) {
+                    positions[vertex_count * 3 + i] = point[i];
+                    record->min[i] = point[i] < record->min[i] ? point[i] : record->min[i];
+                    record->max[i] = point[i] > record->max[i] ? point[i] : record->max[i];
+                }
+                normals[vertex_count * 3] = normal->x;
+                normals[vertex_count * 3 + 1] = normal->y;
+                normals[vertex_count * 3 + 2] = normal->z;
+
+                remap[vertex] = vertex_count;
+                touched[vertex_count++] = vertex;
+            }
+
+            const fVec2 *uv = face->uvs[k] >= 0 ? &vertex_uvs[face->uvs[k]] : NULL;
+            indices[t * 3 + k] = remap[vertex];
+            uvs[t * 6 + k * 2] = uv ? uv->x : 0.0f;
+            uvs[t * 6 + k * 2 + 1] = uv ? uv->y : 0.0f;
+        }
+        materials[t] = face->material;
+    }
+
+    for (int v = 0; v < vertex_count; v++) {
+        remap[touched[v]] = -1;
+    }
+
+    size_t size = pack_paged_cluster(out, vertex_count, positions, normals, count, indices, uvs, materials);
+
+    // Coarse level, interior vertices sharing a grid cell of the cluster's box merge
+    // into their average and faces left with two corners in one cell disappear. Edges
+    // only one face of the cluster uses are its border, those vertices stay put so
+    // neighbours at either level still meet without cracks
+    uint64_t edges[PAGED_MESH_CLUSTER_TRIANGLES * 3];
+    unsigned char locked[PAGED_MESH_CLUSTER_TRIANGLES * 3];
+    for (int t = 0; t < count; t++) {
+        for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+            uint64_t a = indices[t * 3 + k];
+            uint64_t b = indices[t * 3 + (k + 1) % NUM_TRIANGLE_VERTEX];
+            edges[t * 3 + k] = a < b ? (a << 32) | b : (b << 32) | a;
+        }
+    }
+    qsort(edges, count * 3, sizeof(uint64_t), compare_paged_keys);
+
+    memset(locked, 0, vertex_count);
+    for (int e = 0; e < count * 3;) {
+        int run = 1;
+        while (e + run < count * 3 && edges[e + run] == edges[e]) {
+            run++;
+        }
+        if (run == 1) {
+            locked[edges[e] >> 32] = 1;
+            locked[edges[e] & 0xffffffffu] = 1;
+        }
+        e += run;
+    }
+
+    int cells[PAGED_MESH_COARSE_GRID * PAGED_MESH_COARSE_GRID * PAGED_MESH_COARSE_GRID];
+    int collapsed[PAGED_MESH_CLUSTER_TRIANGLES * 3];
+    int merged[PAGED_MESH_CLUSTER_TRIANGLES * 3];
+    float coarse_positions[PAGED_MESH_CLUSTER_TRIANGLES * 9];
+    float coarse_normals[PAGED_MESH_CLUSTER_TRIANGLES * 9];
+    int coarse_vertices = 0;
+    int coarse_triangles = 0;
+
+    memset(cells, -1, sizeof(cells));
+    for (int v = 0; v < vertex_count; v++) {
+        int cell = 0;
+        for (int i = 0; i < 3; i++) {
+            float extent = record->max[i] - record->min[i];
+            int index = extent > 0 ? (int)((positions[v * 3 + i] - record->min[i]) / extent * PAGED_MESH_COARSE_GRID) : 0;
+            index = index >= PAGED_MESH_COARSE_GRID ? PAGED_MESH_COARSE_GRID - 1 : index;
+            cell = cell * PAGED_MESH_COARSE_GRID + index;
+        }
+
+        if (locked[v] || cells[cell] < 0) {
+            memcpy(&coarse_positions[coarse_vertices * 3], &positions[v * 3], 3 * sizeof(float));
+            memcpy(&coarse_normals[coarse_vertices * 3], &normals[v * 3], 3 * sizeof(float));
+            merged[coarse_vertices] = 1;
+            collapsed[v] = coarse_vertices++;
+            if (!locked[v]) {
+                cells[cell] = collapsed[v];
+            }
+            continue;
+        }
+
+        int target = cells[cell];
+        for (int i = 0; i < 3; i++) {
+            coarse_positions[target * 3 + i] += positions[v * 3 + i];
+            coarse_normals[target * 3 + i] += normals[v * 3 + i];
+        }
+        merged[target]++;
+        collapsed[v] = target;
+    }
+
+    for (int v = 0; v < coarse_vertices; v++) {
+        float *normal = &coarse_normals[v * 3];
+        float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for (int i = 0; i < 3; i++) {
+            coarse_positions[v * 3 + i] /= merged[v];
+            normal[i] = length > 0 ? normal[i] / length : 0.0f;
+        }
+    }
+
+    // Compacted in place, a kept face never moves past where it was read
+    for (int t = 0; t < count; t++) {
+        uint32_t a = collapsed[indices[t * 3]];
+        uint32_t b = collapsed[indices[t * 3 + 1]];
+        uint32_t c = collapsed[indices[t * 3 + 2]];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+
+        indices[coarse_triangles * 3] = a;
+        indices[coarse_triangles * 3 + 1] = b;
+        indices[coarse_triangles * 3 + 2] = c;
+        memmove(&uvs[coarse_triangles * 6], &uvs[t * 6], 6 * sizeof(float));
+        materials[coarse_triangles] = materials[t];
+        coarse_triangles++;
+    }
+
+    *coarse_size = pack_paged_cluster(coarse_out, coarse_vertices, coarse_positions, coarse_normals, coarse_triangles, indices, uvs, materials);
+
+    return size;
+}
+
+int compare_paged_keys(const void *a, const void *b) {
+    uint64_t key_a = *(const uint64_t *)a;
+    uint64_t key_b = *(const uint64_t *)b;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+// STREAMING //
+
+PagedMesh *open_paged_mesh(const char *path, int cache_pages, int compact) {
+    PagedMesh *paged = (PagedMesh *)calloc(1, sizeof(PagedMesh));
+    if (!paged) {
+        printf("Could not allocate mem for paged mesh");
+        return NULL;
+    }
+
+    paged->file = fopen(path, "rb");
+    if (!paged->file) {
+        printf("ERROR: Could not find paged mesh %s", path);
+        free_paged_mesh(paged);
+        return NULL;
+    }
+
+    PagedMeshHeader *header = &paged->header;
+    if (fread(header, sizeof(PagedMeshHeader), 1, paged->file) != 1 || header->magic != PAGED_MESH_MAGIC || header->version != PAGED_MESH_VERSION ||
+        header->page_size < sizeof(PagedMeshHeader) || header->cluster_count == 0) {
+        printf("ERROR: %s is not a paged mesh", path);
+        free_paged_mesh(paged);
+        return NULL;
+    }
+
+    paged->clusters = (PagedCluster *)malloc(header->cluster_count * sizeof(PagedCluster));
+    paged->coarse = (unsigned char *)malloc(header->coarse_size ? header->coarse_size : 1);
+    paged->materials = create_material_library();
+    paged->slot_count = cache_pages < 1 ? 1 : cache_pages;
+    paged->slots = (PagedPageSlot *)calloc(paged->slot_count, sizeof(PagedPageSlot));
+    paged->page_slots = (int *)malloc(header->page_count * sizeof(int));
+    paged->levels = (unsigned char *)calloc(header->cluster_count, 1);
+    paged->wanted = (unsigned char *)calloc(header->cluster_count, 1);
+    paged->order = (PagedClusterOrder *)malloc(header->cluster_count * sizeof(PagedClusterOrder));
+    paged->pages_per_frame = PAGED_MESH_PAGES_PER_FRAME;
+
+    if (!paged->clusters || !paged->coarse || !paged->materials || !paged->slots || !paged->page_slots || !paged->levels || !paged->wanted || !paged->order) {
+        printf("Could not allocate mem for paged mesh directory");
+        free_paged_mesh(paged);
+        return NULL;
+    }
+
+    // Everything past the pages is resident for as long as the mesh is open
+    int ok = fseeko(paged->file, (off_t)header->page_count * header->page_size, SEEK_SET) == 0 &&
+             fread(paged->clusters, sizeof(PagedCluster), header->cluster_count, paged->file) == header->cluster_count;
+
+    for (uint32_t m = 0; m < header->material_count && ok; m++) {
+        PagedMaterial record;
+        ok = fread(&record, sizeof(PagedMaterial), 1, paged->file) == 1;
+        record.name[sizeof(record.name) - 1] = '\0';
+        record.diffuse_map[sizeof(record.diffuse_map) - 1] = '\0';
+
+        // Slot 0 is the default the library starts with, same as in the obj
+        Material *material = m == 0 ? &paged->materials->materials[DEFAULT_MATERIAL] : add_material(paged->materials, record.name);
+        if (!ok || !material) {
+            ok = 0;
+            break;
+        }
+
+        memcpy(material->diffuse, record.diffuse, sizeof(material->diffuse));
+        memcpy(material->specular, record.specular, sizeof(material->specular));
+        material->shininess = record.shininess;
+        material->opacity = record.opacity;
+        memcpy(material->diffuse_map, record.diffuse_map, sizeof(material->diffuse_map));
+        if (material->diffuse_map[0]) {
+            material->diffuse_texture = find_loaded_texture(paged->materials, material->diffuse_map);
+            if (!material->diffuse_texture) {
+                material->diffuse_texture = load_texture(material->diffuse_map);
+            }
+        }
+    }
+
+    if (ok && header->coarse_size > 0) {
+        ok = fread(paged->coarse, 1, header->coarse_size, paged->file) == header->coarse_size;
+    }
+
+    for (int s = 0; s < paged->slot_count && ok; s++) {
+        paged->slots[s].page = -1;
+        paged->slots[s].data = (unsigned char *)malloc(header->page_size);
+        ok = paged->slots[s].data != NULL;
+    }
+    for (uint32_t p = 0; p < header->page_count; p++) {
+        paged->page_slots[p] = -1;
+    }
+
+    if (!ok) {
+        printf("ERROR: Could not read paged mesh %s", path);
+        free_paged_mesh(paged);
+        return NULL;
+    }
+
+    paged->compact_storage = compact;
+    if (!create_paged_mesh_pools(paged)) {
+        free_paged_mesh(paged);
+        return NULL;
+    }
+
+    return paged;
+}
+
+void free_paged_mesh(PagedMesh *paged) {
+    if (paged == NULL) {
+        return;
+    }
+
+    if (paged->file) {
+        fclose(paged->file);
+    }
+
+    if (paged->slots) {
+        for (int s = 0; s < paged->slot_count; s++) {
+            free(paged->slots[s].data);
+        }
+    }
+
+    free_paged_mesh_geometry(paged->mesh);
+    free_paged_mesh_geometry(paged->retired);
+    free_paged_mesh_pools(paged);
+    free_material_library(paged->materials);
+    free(paged->clusters);
+    free(paged->coarse);
+    free(paged->slots);
+    free(paged->page_slots);
+    free(paged->levels);
+    free(paged->wanted);
+    free(paged->order);
+    free(paged);
+}
+
+int update_paged_mesh(PagedMesh *paged, UserCamera *camera) {
+    PagedMeshHeader *header = &paged->header;
+    paged->frame++;
+
+    // This frame's view, recording computes the same planes again
+    update_frustum_planes(camera);
+    fVec4 *eye = camera->camera_position;
+
+    int visible = 0;
+    for (uint32_t c = 0; c < header->cluster_count; c++) {
+        PagedCluster *cluster = &paged->clusters[c];
+        fVec4 center = {(cluster->min[0] + cluster->max[0]) * 0.5f, (cluster->min[1] + cluster->max[1]) * 0.5f, (cluster->min[2] + cluster->max[2]) * 0.5f, 1.0f};
+        float dx = cluster->max[0] - center.x;
+        float dy = cluster->max[1] - center.y;
+        float dz = cluster->max[2] - center.z;
+        float radius = sqrtf(dx * dx + dy * dy + dz * dz);
+
+        if (!sphere_in_frustum(&camera->frustum, &center, radius)) {
+            paged->wanted[c] = PAGED_CLUSTER_HIDDEN;
+            continue;
+        }
+
+        dx = center.x - eye->x;
+        dy = center.y - eye->y;
+        dz = center.z - eye->z;
+        float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+        // Everything in view has its coarse level at hand, the close ones ask for pages
+        paged->wanted[c] = distance < radius * PAGED_MESH_DETAIL_DISTANCE ? PAGED_CLUSTER_FULL : PAGED_CLUSTER_COARSE;
+        paged->order[visible].distance = distance;
+        paged->order[visible].cluster = c;
+        visible++;
+    }
+
+    // Nothing in view to draw, whatever is there now can stay
+    if (visible == 0 && paged->mesh) {
+        return 0;
+    }
+
+    // Nearest first, pages that do not fit in this frame's reads or the cache stay coarse
+    qsort(paged->order, visible, sizeof(PagedClusterOrder), compare_paged_distances);
+    int reads = paged->pages_per_frame;
+    uint64_t full = 0;
+    for (int i = 0; i < visible; i++) {
+        int c = paged->order[i].cluster;
+        if (paged->wanted[c] != PAGED_CLUSTER_FULL) {
+            continue;
+        }
+
+        if (fetch_paged_page(paged, paged->clusters[c].page, &reads)) {
+            full++;
+        } else {
+            paged->wanted[c] = PAGED_CLUSTER_COARSE;
+        }
+    }
+
+    int rebuilt = 0;
+    uint64_t built = 0;
+    if (!paged->mesh || memcmp(paged->wanted, paged->levels, header->cluster_count) != 0) {
+        // The frame waiting to be presented may still draw the current mesh, the one
+        // before it is done, and so are the pieces only it used
+        free_paged_mesh_geometry(paged->retired);
+        paged->retired = NULL;
+        release_paged_quarantine(paged);
+
+        Mesh *mesh = assemble_paged_mesh(paged, paged->wanted, &built);
+        if (mesh) {
+            paged->retired = paged->mesh;
+            paged->mesh = mesh;
+            rebuilt = 1;
+        }
+    }
+
+    record_paged_mesh_stats(paged->pages_per_frame - reads, rebuilt, built, full, visible - full);
+    return rebuilt;
+}
+
+int set_paged_mesh_storage(PagedMesh *paged, int compact) {
+    if (paged->compact_storage == compact) {
+        return 1;
+    }
+
+    // Every piece is built again in the new format, the caller made sure no frame
+    // still draws either mesh. Cached pages stay, so the next update reads nothing
+    free_paged_mesh_geometry(paged->mesh);
+    free_paged_mesh_geometry(paged->retired);
+    paged->mesh = NULL;
+    paged->retired = NULL;
+    free_paged_mesh_pools(paged);
+    memset(paged->levels, PAGED_CLUSTER_HIDDEN, paged->header.cluster_count);
+
+    paged->compact_storage = compact;
+    if (create_paged_mesh_pools(paged)) {
+        return 1;
+    }
+
+    // Back to the format that fit before
+    free_paged_mesh_pools(paged);
+    paged->compact_storage = !compact;
+    create_paged_mesh_pools(paged);
+    return 0;
+}
+
+unsigned char *fetch_paged_page(PagedMesh *paged, int page, int *reads_left) {
+    int slot = paged->page_slots[page];
+    if (slot >= 0) {
+        paged->slots[slot].last_used = paged->frame;
+        return paged->slots[slot].data;
+    }
+
+    if (*reads_left <= 0) {
+        return NULL;
+    }
+
+    // Least recently needed page goes, never one this frame already relies on
+    int victim = -1;
+    for (int s = 0; s < paged->slot_count; s++) {
+        PagedPageSlot *candidate = &paged->slots[s];
+        if (candidate->page < 0) {
+            victim = s;
+            break;
+        }
+        if (candidate->last_used < paged->frame && (victim < 0 || candidate->last_used < paged->slots[victim].last_used)) {
+            victim = s;
+        }
+    }
+
+    if (victim < 0) {
+        return NULL;
+    }
+
+    PagedPageSlot *target = &paged->slots[victim];
+    if (target->page >= 0) {
+        paged->page_slots[target->page] = -1;
+        target->page = -1;
+    }
+
+    uint32_t page_size = paged->header.page_size;
+    if (fseeko(paged->file, (off_t)page * page_size, SEEK_SET) != 0 || fread(target->data, 1, page_size, paged->file) != page_size) {
+        printf("ERROR: Could not read page %d of paged mesh", page);
+        return NULL;
+    }
+
+    (*reads_left)--;
+    target->page = page;
+    target->last_used = paged->frame;
+    paged->page_slots[page] = victim;
+
+    return target->data;
+}
+
+const unsigned char *get_paged_cluster_data(PagedMesh *paged, int cluster, int level) {
+    PagedCluster *record = &paged->clusters[cluster];
+    if (level == PAGED_CLUSTER_COARSE) {
+        return paged->coarse + record->coarse_offset;
+    }
+
+    // Only asked for when the page was fetched this frame
+    return paged->slots[paged->page_slots[record->page]].data + record->offset;
+}
+
+int create_paged_mesh_pools(PagedMesh *paged) {
+    PagedMeshHeader *header = &paged->header;
+
+    // Room for every cluster at its coarse level, plus all the full detail the page
+    // cache holds. A full triangle takes 40 bytes of its page and a vertex 24, with
+    // at most three vertices per triangle
+    int64_t vertex_count = 0;
+    int64_t triangle_count = 0;
+    for (uint32_t c = 0; c < header->cluster_count; c++) {
+        uint32_t counts[2];
+        memcpy(counts, paged->coarse + paged->clusters[c].coarse_offset, sizeof(counts));
+        vertex_count += counts[0];
+        triangle_count += counts[1];
+    }
+
+    int64_t cached = (int64_t)paged->slot_count * header->page_size;
+    vertex_count += cached * 3 / 112;
+    triangle_count += cached / 40;
+
+    // Twice over, pieces the retired mesh still draws stay until the rebuild after
+    vertex_count *= 2;
+    triangle_count *= 2;
+    if (triangle_count * NUM_TRIANGLE_VERTEX * 3 > INT32_MAX || vertex_count > INT32_MAX) {
+        printf("ERROR: Paged mesh is too big to stream");
+        return 0;
+    }
+
+    // Calloc'd so the pages are only backed once a piece first reaches them
+    int triangles = (int)triangle_count;
+    int corners = header->has_uvs ? triangles * NUM_TRIANGLE_VERTEX : 0;
+    if (paged->compact_storage) {
+        paged->compact_vertices = (CompactVertex *)calloc(vertex_count, sizeof(CompactVertex));
+        paged->compact_uvs = corners ? (uint32_t *)calloc(corners, sizeof(uint32_t)) : NULL;
+    } else {
+        paged->vertices = (fVec4 *)calloc(vertex_count, sizeof(fVec4));
+        paged->normals = (fVec4 *)calloc(vertex_count, sizeof(fVec4));
+        paged->uvs = corners ? (fVec2 *)calloc(corners, sizeof(fVec2)) : NULL;
+    }
+    paged->triangles = (VecConnectionsPoints *)calloc(triangles, sizeof(VecConnectionsPoints));
+    paged->surface_normals = (fVec4 *)calloc(triangles, sizeof(fVec4));
+    paged->edges = (MeshEdge *)calloc(triangles, NUM_TRIANGLE_VERTEX * sizeof(MeshEdge));
+    paged->meshlet_vertices = (int *)calloc(triangles, NUM_TRIANGLE_VERTEX * 3 * sizeof(int));
+    paged->pieces = (PagedPiece *)calloc(header->cluster_count, sizeof(PagedPiece));
+
+    int pooled = paged->compact_storage ? paged->compact_vertices && (!corners || paged->compact_uvs)
+                                        : paged->vertices && paged->normals && (!corners || paged->uvs);
+    if (!pooled || !paged->triangles || !paged->surface_normals || !paged->edges || !paged->meshlet_vertices || !paged->pieces) {
+        printf("Could not allocate mem for paged mesh geometry");
+        return 0;
+    }
+
+    paged->vertex_ranges.capacity = (int)vertex_count;
+    paged->corner_ranges.capacity = corners;
+    paged->triangle_ranges.capacity = triangles;
+    paged->edge_ranges.capacity = triangles * NUM_TRIANGLE_VERTEX;
+    paged->meshlet_vertex_ranges.capacity = triangles * NUM_TRIANGLE_VERTEX * 3;
+
+    set_compact_vertex_box(&paged->compact, header->min, header->max);
+    return 1;
+}
+
+void free_paged_mesh_pools(PagedMesh *paged) {
+    if (paged->pieces) {
+        for (uint32_t c = 0; c < paged->header.cluster_count; c++) {
+            release_paged_piece(paged, &paged->pieces[c]);
+        }
+    }
+    release_paged_quarantine(paged);
+
+    free(paged->vertices);
+    free(paged->normals);
+    free(paged->compact_vertices);
+    free(paged->uvs);
+    free(paged->compact_uvs);
+    free(paged->triangles);
+    free(paged->surface_normals);
+    free(paged->edges);
+    free(paged->meshlet_vertices);
+    free(paged->pieces);
+    free(paged->vertex_ranges.free);
+    free(paged->corner_ranges.free);
+    free(paged->triangle_ranges.free);
+    free(paged->edge_ranges.free);
+    free(paged->meshlet_vertex_ranges.free);
+
+    // Left empty for the pools of another format
+    paged->vertices = NULL;
+    paged->normals = NULL;
+    paged->compact_vertices = NULL;
+    paged->uvs = NULL;
+    paged->compact_uvs = NULL;
+    paged->triangles = NULL;
+    paged->surface_normals = NULL;
+    paged->edges = NULL;
+    paged->meshlet_vertices = NULL;
+    paged->pieces = NULL;
+    memset(&paged->vertex_ranges, 0, sizeof(PagedRanges));
+    memset(&paged->corner_ranges, 0, sizeof(PagedRanges));
+    memset(&paged->triangle_ranges, 0, sizeof(PagedRanges));
+    memset(&paged->edge_ranges, 0, sizeof(PagedRanges));
+    memset(&paged->meshlet_vertex_ranges, 0, sizeof(PagedRanges));
+}
+
+int take_paged_range(PagedRanges *ranges, int count, int *first, int *taken) {
+    if (count <= 0) {
+        return 1;
+    }
+
+    for (int i = 0; i < ranges->free_count; i++) {
+        PagedRange *range = &ranges->free[i];
+        if (range->count < count) {
+            continue;
+        }
+
+        *first = range->first;
+        *taken = count;
+        range->first += count;
+        range->count -= count;
+        if (range->count == 0) {
+            memmove(range, range + 1, (ranges->free_count - i - 1) * sizeof(PagedRange));
+            ranges->free_count--;
+        }
+        return 1;
+    }
+
+    if (count > ranges->capacity - ranges->high) {
+        return 0;
+    }
+
+    *first = ranges->high;
+    *taken = count;
+    ranges->high += count;
+    return 1;
+}
+
+void release_paged_range(PagedRanges *ranges, int first, int count) {
+    if (count <= 0) {
+        return;
+    }
+
+    // The top of the pool just lowers the mark, and takes a free run below it along
+    if (first + count == ranges->high) {
+        ranges->high = first;
+        PagedRange *last = ranges->free_count ? &ranges->free[ranges->free_count - 1] : NULL;
+        if (last && last->first + last->count == ranges->high) {
+            ranges->high = last->first;
+            ranges->free_count--;
+        }
+        return;
+    }
+
+    int i = 0;
+    while (i < ranges->free_count && ranges->free[i].first < first) {
+        i++;
+    }
+
+    if (i > 0 && ranges->free[i - 1].first + ranges->free[i - 1].count == first) {
+        i--;
+        ranges->free[i].count += count;
+    } else {
+        if (ranges->free_count == ranges->free_capacity) {
+            int capacity = ranges->free_capacity ? ranges->free_capacity * 2 : 64;
+            PagedRange *grown = (PagedRange *)realloc(ranges->free, capacity * sizeof(PagedRange));
+            if (!grown) {
+                // Lost until the pool is freed, pieces that do not fit fall back a level
+                printf("Could not allocate mem for paged mesh free ranges");
+                return;
+            }
+            ranges->free = grown;
+            ranges->free_capacity = capacity;
+        }
+
+        memmove(&ranges->free[i + 1], &ranges->free[i], (ranges->free_count - i) * sizeof(PagedRange));
+        ranges->free[i].first = first;
+        ranges->free[i].count = count;
+        ranges->free_count++;
+    }
+
+    if (i + 1 < ranges->free_count && ranges->free[i].first + ranges->free[i].count == ranges->free[i + 1].first) {
+        ranges->free[i].count += ranges->free[i + 1].count;
+        memmove(&ranges->free[i + 1], &ranges->free[i + 2], (ranges->free_count - i - 2) * sizeof(PagedRange));
+        ranges->free_count--;
+    }
+}
+
+int build_paged_piece(PagedMesh *paged, const unsigned char *data, PagedPiece *piece) {
+    uint32_t counts[2];
+    memcpy(counts, data, sizeof(counts));
+    const unsigned char *positions = data + sizeof(counts);
+    const unsigned char *normals = positions + counts[0] * 3 * sizeof(float);
+    const unsigned char *indices = normals + counts[0] * 3 * sizeof(float);
+    const unsigned char *uvs = indices + counts[1] * 3 * sizeof(uint32_t);
+    const unsigned char *materials = uvs + counts[1] * 6 * sizeof(float);
+
+    memset(piece, 0, sizeof(PagedPiece));
+    if (counts[1] == 0) {
+        return 1;
+    }
+
+    int corner_count = paged->corner_ranges.capacity ? (int)counts[1] * NUM_TRIANGLE_VERTEX : 0;
+    if (!take_paged_range(&paged->vertex_ranges, counts[0], &piece->first_vertex, &piece->vertex_count) ||
+        !take_paged_range(&paged->triangle_ranges, counts[1], &piece->first_triangle, &piece->triangle_count) ||
+        !take_paged_range(&paged->corner_ranges, corner_count, &piece->first_corner, &piece->corner_count)) {
+        release_paged_piece(paged, piece);
+        return 0;
+    }
+
+    // Floats go straight into their pools, compact pools are encoded from scratch floats
+    fVec4 *scratch = NULL;
+    if (paged->compact_storage) {
+        scratch = (fVec4 *)malloc(counts[0] * 2 * sizeof(fVec4) + corner_count * sizeof(fVec2));
+        if (!scratch) {
+            printf("Could not allocate mem for paged mesh piece");
+            release_paged_piece(paged, piece);
+            return 0;
+        }
+    }
+
+    fVec4 *piece_vertices = scratch ? scratch : paged->vertices + piece->first_vertex;
+    fVec4 *piece_normals = scratch ? scratch + counts[0] : paged->normals + piece->first_vertex;
+    for (uint32_t v = 0; v < counts[0]; v++) {
+        float point[3];
+        float normal[3];
+        memcpy(point, positions + v * 3 * sizeof(float), sizeof(point));
+        memcpy(normal, normals + v * 3 * sizeof(float), sizeof(normal));
+        piece_vertices[v] = (fVec4){point[0], point[1], point[2], 1.0f};
+        piece_normals[v] = (fVec4){normal[0], normal[1], normal[2], 0.0f};
+    }
+
+    // Every corner has its own uv, like an obj face whose corners all name a vt
+    VecConnectionsPoints *piece_triangles = paged->triangles + piece->first_triangle;
+    fVec2 *piece_uvs = NULL;
+    if (corner_count) {
+        piece_uvs = scratch ? (fVec2 *)(scratch + counts[0] * 2) : paged->uvs + piece->first_corner;
+    }
+    for (uint32_t t = 0; t < counts[1]; t++) {
+        VecConnectionsPoints *triangle = &piece_triangles[t];
+
+        uint32_t corners[NUM_TRIANGLE_VERTEX];
+        memcpy(corners, indices + t * 3 * sizeof(uint32_t), sizeof(corners));
+        memcpy(&triangle->material, materials + t * sizeof(int32_t), sizeof(int32_t));
+
+        for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+            triangle->vertices[k] = corners[k];
+            triangle->uvs[k] = -1;
+            if (piece_uvs) {
+                memcpy(&piece_uvs[t * NUM_TRIANGLE_VERTEX + k], uvs + (t * 6 + k * 2) * sizeof(float), sizeof(fVec2));
+                triangle->uvs[k] = t * NUM_TRIANGLE_VERTEX + k;
+            }
+        }
+
+        triangle->surface_normal = &paged->surface_normals[piece->first_triangle + t];
+        compute_face_normal(&piece_vertices[corners[0]], &piece_vertices[corners[1]], &piece_vertices[corners[2]], triangle->surface_normal);
+        triangle->next = t + 1 < counts[1] ? &piece_triangles[t + 1] : NULL;
+    }
+
+    // The import builders run on a mesh of just this piece, their indices are
+    // shifted into the pools after
+    Mesh view;
+    memset(&view, 0, sizeof(Mesh));
+    view.vec_arr = piece_vertices;
+    view.normal_arr = piece_normals;
+    view.uv_arr = piece_uvs;
+    view.vec_count = counts[0];
+    view.vec_normal_count = counts[0];
+    view.vec_texture_count = corner_count;
+    view.num_triangles = counts[1];
+    view.face_count = counts[1];
+    view.head = piece_triangles;
+    view.materials = paged->materials;
+
+    group_mesh_submeshes(&view);
+    build_mesh_edges(&view);
+    build_mesh_meshlets(&view);
+
+    piece->runs = view.submeshes;
+    piece->run_count = view.submesh_count;
+    piece->meshlets = view.meshlets;
+    piece->meshlet_count = view.meshlet_count;
+
+    MeshMeshlet *last = view.meshlet_count ? &view.meshlets[view.meshlet_count - 1] : NULL;
+    int meshlet_vertex_count = last ? last->first_vertex + last->vertex_count : 0;
+    int ok = view.submeshes && view.edges && view.meshlets &&
+             take_paged_range(&paged->edge_ranges, view.edge_count, &piece->first_edge, &piece->edge_count) &&
+             take_paged_range(&paged->meshlet_vertex_ranges, meshlet_vertex_count, &piece->first_meshlet_vertex, &piece->meshlet_vertex_count);
+
+    if (ok) {
+        for (int e = 0; e < view.edge_count; e++) {
+            paged->edges[piece->first_edge + e].v0 = view.edges[e].v0 + piece->first_vertex;
+            paged->edges[piece->first_edge + e].v1 = view.edges[e].v1 + piece->first_vertex;
+        }
+        for (uint32_t t = 0; t < counts[1]; t++) {
+            for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+                piece_triangles[t].vertices[k] += piece->first_vertex;
+                piece_triangles[t].uvs[k] += piece_uvs ? piece->first_corner : 0;
+                piece_triangles[t].edges[k] += piece->first_edge;
+            }
+        }
+
+        for (int v = 0; v < meshlet_vertex_count; v++) {
+            paged->meshlet_vertices[piece->first_meshlet_vertex + v] = view.meshlet_vertices[v] + piece->first_vertex;
+        }
+        for (int m = 0; m < view.meshlet_count; m++) {
+            view.meshlets[m].first_vertex += piece->first_meshlet_vertex;
+        }
+    }
+
+    free(view.edges);
+    free(view.meshlet_vertices);
+
+    if (ok && scratch) {
+        for (uint32_t v = 0; v < counts[0]; v++) {
+            encode_compact_vertex(&paged->compact, &piece_vertices[v], &piece_normals[v], &paged->compact_vertices[piece->first_vertex + v]);
+        }
+        for (int c = 0; c < corner_count; c++) {
+            paged->compact_uvs[piece->first_corner + c] = encode_compact_uv(&piece_uvs[c]);
+        }
+    }
+    free(scratch);
+
+    if (!ok) {
+        release_paged_piece(paged, piece);
+        return 0;
+    }
+
+    return 1;
+}
+
+void release_paged_piece(PagedMesh *paged, PagedPiece *piece) {
+    release_paged_range(&paged->vertex_ranges, piece->first_vertex, piece->vertex_count);
+    release_paged_range(&paged->corner_ranges, piece->first_corner, piece->corner_count);
+    release_paged_range(&paged->triangle_ranges, piece->first_triangle, piece->triangle_count);
+    release_paged_range(&paged->edge_ranges, piece->first_edge, piece->edge_count);
+    release_paged_range(&paged->meshlet_vertex_ranges, piece->first_meshlet_vertex, piece->meshlet_vertex_count);
+    free(piece->runs);
+    free(piece->meshlets);
+    memset(piece, 0, sizeof(PagedPiece));
+}
+
+void release_paged_quarantine(PagedMesh *paged) {
+    for (int i = 0; i < paged->quarantine_count; i++) {
+        release_paged_piece(paged, &paged->quarantine[i]);
+    }
+
+    free(paged->quarantine);
+    paged->quarantine = NULL;
+    paged->quarantine_count = 0;
+}
+
+Mesh *assemble_paged_mesh(PagedMesh *paged, const unsigned char *levels, uint64_t *built) {
+    PagedMeshHeader *header = &paged->header;
+    *built = 0;
+
+    // Only clusters whose level changed get a new piece, the rest are drawn from where they are
+    int changed_count = 0;
+    for (uint32_t c = 0; c < header->cluster_count; c++) {
+        changed_count += levels[c] != paged->pieces[c].level;
+    }
+
+    int *changed = (int *)malloc((changed_count ? changed_count : 1) * sizeof(int));
+    PagedPiece *replaced = (PagedPiece *)malloc((changed_count ? changed_count : 1) * sizeof(PagedPiece));
+    if (!changed || !replaced) {
+        printf("Could not allocate mem for paged mesh pieces");
+        free(changed);
+        free(replaced);
+        return NULL;
+    }
+
+    int i = 0;
+    for (uint32_t c = 0; c < header->cluster_count; c++) {
+        if (levels[c] == paged->pieces[c].level) {
+            continue;
+        }
+
+        // A full piece that does not fit in the pools falls back to coarse, then to nothing
+        PagedPiece piece;
+        int level = levels[c];
+        memset(&piece, 0, sizeof(PagedPiece));
+        while (level != PAGED_CLUSTER_HIDDEN && !build_paged_piece(paged, get_paged_cluster_data(paged, c, level), &piece)) {
+            level--;
+        }
+        piece.level = level;
+        *built += level != PAGED_CLUSTER_HIDDEN;
+
+        changed[i] = c;
+        replaced[i] = paged->pieces[c];
+        paged->pieces[c] = piece;
+        i++;
+    }
+
+    Mesh *mesh = link_paged_pieces(paged);
+    if (!mesh) {
+        // The mesh being drawn keeps its pieces, the new ones were never seen
+        for (int j = 0; j < changed_count; j++) {
+            release_paged_piece(paged, &paged->pieces[changed[j]]);
+            paged->pieces[changed[j]] = replaced[j];
+        }
+        free(changed);
+        free(replaced);
+        return NULL;
+    }
+
+    // Replaced pieces go with the mesh that is retired now
+    paged->quarantine = replaced;
+    paged->quarantine_count = changed_count;
+    for (uint32_t c = 0; c < header->cluster_count; c++) {
+        paged->levels[c] = (unsigned char)paged->pieces[c].level;
+    }
+
+    free(changed);
+    return mesh;
+}
+
+Mesh *link_paged_pieces(PagedMesh *paged) {
+    PagedMeshHeader *header = &paged->header;
+    int key_count = paged->materials->count * 4;
+
+    Mesh *mesh = (Mesh *)calloc(1, sizeof(Mesh));
+    int *starts = (int *)calloc(key_count * 3, sizeof(int));
+    if (!mesh || !starts) {
+        printf("Could not allocate mem for paged mesh geometry");
+        free(mesh);
+        free(starts);
+        return NULL;
+    }
+
+    // Runs, faces and meshlets per draw state key, runs of one key go in cluster order
+    int *run_starts = starts;
+    int *triangle_starts = starts + key_count;
+    int *meshlet_starts = starts + key_count * 2;
+    int run_count = 0;
+    int meshlet_count = 0;
+    for (uint32_t c = 0; c < header->cluster_count; c++) {
+        PagedPiece *piece = &paged->pieces[c];
+        for (int r = 0; r < piece->run_count; r++) {
+            int key = get_submesh_key(paged->materials, piece->runs[r].material);
+            run_starts[key]++;
+            triangle_starts[key] += piece->runs[r].triangle_count;
+            meshlet_starts[key] += piece->runs[r].meshlet_count;
+        }
+        run_count += piece->run_count;
+        meshlet_count += piece->meshlet_count;
+    }
+
+    int runs = 0;
+    int triangles = 0;
+    int meshlets = 0;
+    for (int k = 0; k < key_count; k++) {
+        int key_runs = run_starts[k];
+        int key_triangles = triangle_starts[k];
+        int key_meshlets = meshlet_starts[k];
+        run_starts[k] = runs;
+        triangle_starts[k] = triangles;
+        meshlet_starts[k] = meshlets;
+        runs += key_runs;
+        triangles += key_triangles;
+        meshlets += key_meshlets;
+    }
+
+    mesh->submeshes = (MeshSubmesh *)malloc((run_count ? run_count : 1) * sizeof(MeshSubmesh));
+    mesh->meshlets = (MeshMeshlet *)malloc((meshlet_count ? meshlet_count : 1) * sizeof(MeshMeshlet));
+    mesh->compact = paged->compact_storage ? (CompactVertices *)malloc(sizeof(CompactVertices)) : NULL;
+    define_bounding_box(mesh, header->min[0], header->max[0], header->min[1], header->max[1], header->min[2], header->max[2]);
+
+    if (!mesh->submeshes || !mesh->meshlets || (paged->compact_storage && !mesh->compact)) {
+        printf("Could not allocate mem for paged mesh geometry");
+        free(starts);
+        free_paged_mesh_geometry(mesh);
+        return NULL;
+    }
+
+    for (uint32_t c = 0; c < header->cluster_count; c++) {
+        PagedPiece *piece = &paged->pieces[c];
+        for (int r = 0; r < piece->run_count; r++) {
+            MeshSubmesh *run = &piece->runs[r];
+            int key = get_submesh_key(paged->materials, run->material);
+            MeshSubmesh *submesh = &mesh->submeshes[run_starts[key]++];
+
+            *submesh = *run;
+            submesh->first_triangle = triangle_starts[key];
+            submesh->first_meshlet = meshlet_starts[key];
+            memcpy(&mesh->meshlets[submesh->first_meshlet], &piece->meshlets[run->first_meshlet], run->meshlet_count * sizeof(MeshMeshlet));
+
+            triangle_starts[key] += run->triangle_count;
+            meshlet_starts[key] += run->meshlet_count;
+        }
+    }
+    free(starts);
+
+    // Arrays are the pools up to their marks, holes left by released pieces
+    // are never named by a face
+    mesh->vec_arr = paged->vertices;
+    mesh->normal_arr = paged->normals;
+    mesh->uv_arr = paged->uvs;
+    mesh->vec_count = paged->vertex_ranges.high;
+    mesh->vec_normal_count = mesh->vec_count;
+    mesh->vec_texture_count = paged->corner_ranges.high;
+    mesh->num_triangles = triangles;
+    mesh->face_count = triangles;
+    mesh->edges = paged->edges;
+    mesh->edge_count = paged->edge_ranges.high;
+    mesh->submesh_count = run_count;
+    mesh->meshlet_count = meshlet_count;
+    mesh->meshlet_vertices = paged->meshlet_vertices;
+    mesh->materials = paged->materials;
+
+    if (mesh->compact) {
+        *mesh->compact = paged->compact;
+        mesh->compact->vertices = paged->compact_vertices;
+        mesh->compact->count = mesh->vec_count;
+        mesh->compact->uvs = paged->compact_uvs;
+        mesh->compact->uv_count = mesh->vec_texture_count;
+    }
+
+    return mesh;
+}
+
+void free_paged_mesh_geometry(Mesh *mesh) {
+    if (mesh == NULL) {
+        return;
+    }
+
+    // Everything else is in the paged mesh's pools
+    for (int i = 0; i < NUM_BOUNDING_BOX_VERTEX; i++) {
+        free(mesh->bounding_box_vec[i]);
+    }
+    free(mesh->submeshes);
+    free(mesh->meshlets);
+    free(mesh->compact);
+    free(mesh);
+}
+
+int compare_paged_distances(const void *a, const void *b) {
+    float distance_a = ((const PagedClusterOrder *)a)->distance;
+    float distance_b = ((const PagedClusterOrder *)b)->distance;
+    return (distance_a > distance_b) - (distance_a < distance_b);
+}
+
+void record_paged_mesh_stats(uint64_t page_reads, uint64_t rebuilds, uint64_t built, uint64_t full, uint64_t coarse) {
+    atomic_fetch_add(&paged_mesh_stats.frames, 1);
+    atomic_fetch_add(&paged_mesh_stats.page_reads, page_reads);
+    atomic_fetch_add(&paged_mesh_stats.rebuilds, rebuilds);
+    atomic_fetch_add(&paged_mesh_stats.built_clusters, built);
+    atomic_fetch_add(&paged_mesh_stats.full_clusters, full);
+    atomic_fetch_add(&paged_mesh_stats.coarse_clusters, coarse);
+}
+
+void print_paged_mesh_stats() {
+    PagedMeshStats *stats = &paged_mesh_stats;
+    if (stats->frames == 0) {
+        return;
+    }
+
+    printf("  %-20s %8llu pages read %8llu rebuilds %8llu clusters built %8.1f full %8.1f coarse clusters/frame\n", "paged_mesh",
+           (unsigned long long)stats->page_reads, (unsigned long long)stats->rebuilds, (unsigned long long)stats->built_clusters,
+           stats->full_clusters / (double)stats->frames, stats->coarse_clusters / (double)stats->frames);
+
+    stats->frames = 0;
+    stats->page_reads = 0;
+    stats->rebuilds = 0;
+    stats->built_clusters = 0;
+    stats->full_clusters = 0;
+    stats->coarse_clusters = 0;
+}
@@ -0,0 +1,279 @@
+#include <SDL3/SDL.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "frame_arena.h"
+#include "framebuffer.h"
+#include "job_system.h"
+#include "post_process.h"
+#include "shading.h"
+
+static PostProcessStats post_process_stats;
+static uint8_t display_lut[POST_PROCESS_GAMMA_LUT_SIZE];
+static pthread_once_t display_lut_once = PTHREAD_ONCE_INIT;
+
+void post_process_framebuffer(Framebuffer *framebuffer, float exposure, int use_hdr, FrameArena *arena, JobSystem *jobs) {
+    if (!create_post_process_targets(framebuffer)) {
+        return;
+    }
+
+    uint64_t start_time = SDL_GetTicksNS();
+    build_display_lut();
+
+    PostProcessJob job;
+    job.framebuffer = framebuffer;
+    job.exposure = exposure;
+    job.use_hdr = use_hdr;
+    job.arena = arena;
+    atomic_init(&job.edge_pixels, 0);
+
+    // Tone curve, gamma and luma in one read and write of every pixel, FXAA
+    // needs its neighbours' luma so it waits for the whole frame
+    int bands = (framebuffer->height + POST_PROCESS_ROW_BAND - 1) / POST_PROCESS_ROW_BAND;
+    parallel_for(jobs, bands, 1, tone_map_rows, &job);
+    parallel_for(jobs, bands, 1, fxaa_rows, &job);
+
+    // The anti-aliased frame is the one presented, the old color is scratch now
+    uint32_t *color = framebuffer->color;
+    framebuffer->color = framebuffer->resolve;
+    framebuffer->resolve = color;
+
+    post_process_stats.passes++;
+    post_process_stats.pixels += (uint64_t)framebuffer->width * framebuffer->height;
+    post_process_stats.edge_pixels += atomic_load(&job.edge_pixels);
+    post_process_stats.workers = get_job_worker_count(jobs);
+    post_process_stats.time_ns += SDL_GetTicksNS() - start_time;
+}
+
+void tone_map_rows(void *arg, int first_band, int last_band) {
+    PostProcessJob *job = (PostProcessJob *)arg;
+    Framebuffer *framebuffer = job->framebuffer;
+    int width = framebuffer->width;
+    int height = framebuffer->height;
+
+    // One row of linear light split per channel, so the curve runs over plain float arrays
+    float *channels = (float *)frame_arena_alloc(job->arena, width * 3 * sizeof(float));
+    if (!channels) {
+        printf("Could not allocate mem for tone mapping rows");
+        return;
+    }
+
+    float *red = channels;
+    float *green = channels + width;
+    float *blue = channels + width * 2;
+    const float lut_scale = POST_PROCESS_GAMMA_LUT_SIZE - 1;
+
+    int first_row = first_band * POST_PROCESS_ROW_BAND;
+    int last_row = last_band * POST_PROCESS_ROW_BAND < height ? last_band * POST_PROCESS_ROW_BAND : height;
+
+    for (int y = first_row; y < last_row; y++) {
+        uint32_t *color = &framebuffer->color[y * width];
+        uint8_t *luma = &framebuffer->luma[y * width];
+
+        for (int x = 0; x < width; x++) {
+            red[x] = ((color[x] >> 16) & 0xFF) * (1.0f / 255.0f);
+            green[x] = ((color[x] >> 8) & 0xFF) * (1.0f / 255.0f);
+            blue[x] = (color[x] & 0xFF) * (1.0f / 255.0f);
+        }
+
+        // The deferred light only still holds where nothing blended or drew
+        // over it, the packed color is then exactly its clamped copy
+        if (job->use_hdr) {
+            const float *hdr = &framebuffer->hdr[y * width * 3];
+
+            for (int x = 0; x < width; x++) {
+                const float *light = &hdr[x * 3];
+                if (color[x] == pack_color(light[0], light[1], light[2])) {
+                    red[x] = light[0];
+                    green[x] = light[1];
+                    blue[x] = light[2];
+                }
+            }
+        }
+
+        for (int x = 0; x < width; x++) {
+            red[x] = tone_map_aces(red[x] * job->exposure) * lut_scale + 0.5f;
+            green[x] = tone_map_aces(green[x] * job->exposure) * lut_scale + 0.5f;
+            blue[x] = tone_map_aces(blue[x] * job->exposure) * lut_scale + 0.5f;
+        }
+
+        // Coverage in alpha is left as it was
+        for (int x = 0; x < width; x++) {
+            uint32_t r = display_lut[(int)red[x]];
+            uint32_t g = display_lut[(int)green[x]];
+            uint32_t b = display_lut[(int)blue[x]];
+
+            color[x] = (color[x] & 0xFF000000u) | (r << 16) | (g << 8) | b;
+            luma[x] = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+        }
+    }
+}
+
+void fxaa_rows(void *arg, int first_band, int last_band) {
+    PostProcessJob *job = (PostProcessJob *)arg;
+    Framebuffer *framebuffer = job->framebuffer;
+    int width = framebuffer->width;
+    int height = framebuffer->height;
+
+    int first_row = first_band * POST_PROCESS_ROW_BAND;
+    int last_row = last_band * POST_PROCESS_ROW_BAND < height ? last_band * POST_PROCESS_ROW_BAND : height;
+
+    uint64_t edge_pixels = 0;
+
+    for (int y = first_row; y < last_row; y++) {
+        uint32_t *resolve = &framebuffer->resolve[y * width];
+
+        for (int x = 0; x < width; x++) {
+            resolve[x] = fxaa_pixel(framebuffer, x, y, &edge_pixels);
+        }
+    }
+
+    atomic_fetch_add(&job->edge_pixels, edge_pixels);
+}
+
+uint32_t fxaa_pixel(const Framebuffer *framebuffer, int x, int y, uint64_t *edge_pixels) {
+    int width = framebuffer->width;
+    int height = framebuffer->height;
+    const uint8_t *luma = framebuffer->luma;
+    const uint32_t *color = framebuffer->color;
+
+    // Neighbours past the border repeat the border
+    int left = x > 0 ? x - 1 : 0;
+    int right = x < width - 1 ? x + 1 : x;
+    int up = y > 0 ? y - 1 : 0;
+    int down = y < height - 1 ? y + 1 : y;
+
+    int m = luma[y * width + x];
+    int n = luma[up * width + x];
+    int s = luma[down * width + x];
+    int w = luma[y * width + left];
+    int e = luma[y * width + right];
+
+    int luma_max = m > n ? m : n;
+    luma_max = luma_max > s ? luma_max : s;
+    luma_max = luma_max > w ? luma_max : w;
+    luma_max = luma_max > e ? luma_max : e;
+    int luma_min = m < n ? m : n;
+    luma_min = luma_min < s ? luma_min : s;
+    luma_min = luma_min < w ? luma_min : w;
+    luma_min = luma_min < e ? luma_min : e;
+
+    // Flat areas are most of the frame, they go out untouched
+    int range = luma_max - luma_min;
+    if (range < FXAA_EDGE_THRESHOLD_MIN || range < luma_max * FXAA_EDGE_THRESHOLD) {
+        return color[y * width + x];
+    }
+
+    int nw = luma[up * width + left];
+    int ne = luma[up * width + right];
+    int sw = luma[down * width + left];
+    int se = luma[down * width + right];
+
+    // Change across rows against change across columns, an edge running along
+    // the rows changes most from one row to the next
+    int edge_horizontal = abs(nw + sw - 2 * w) + 2 * abs(n + s - 2 * m) + abs(ne + se - 2 * e);
+    int edge_vertical = abs(nw + ne - 2 * n) + 2 * abs(w + e - 2 * m) + abs(sw + se - 2 * s);
+    int horizontal = edge_horizontal >= edge_vertical;
+
+    // The other side of the edge is the neighbour with the steeper step
+    int luma_negative = horizontal ? n : w;
+    int luma_positive = horizontal ? s : e;
+    int step_negative = abs(luma_negative - m);
+    int step_positive = abs(luma_positive - m);
+    int toward_negative = step_negative >= step_positive;
+    int gradient = toward_negative ? step_negative : step_positive;
+
+    int across_x = horizontal ? 0 : (toward_negative ? -1 : 1);
+    int across_y = horizontal ? (toward_negative ? -1 : 1) : 0;
+    float edge_luma = (m + (toward_negative ? luma_negative : luma_positive)) * 0.5f;
+
+    // Walk both ways along the edge until the pair straddling it stops looking like it
+    int distances[2];
+    float end_luma[2];
+    for (int side = 0; side < 2; side++) {
+        int direction = side ? 1 : -1;
+        distances[side] = FXAA_SEARCH_STEPS;
+        end_luma[side] = edge_luma;
+
+        for (int i = 1; i <= FXAA_SEARCH_STEPS; i++) {
+            int sx = horizontal ? x + direction * i : x;
+            int sy = horizontal ? y : y + direction * i;
+            sx = sx < 0 ? 0 : (sx >= width ? width - 1 : sx);
+            sy = sy < 0 ? 0 : (sy >= height ? height - 1 : sy);
+
+            int ox = sx + across_x < 0 ? 0 : (sx + across_x >= width ? width - 1 : sx + across_x);
+            int oy = sy + across_y < 0 ? 0 : (sy + across_y >= height ? height - 1 : sy + across_y);
+
+            end_luma[side] = (luma[sy * width + sx] + luma[oy * width + ox]) * 0.5f;
+            if (fabsf(end_luma[side] - edge_luma) >= gradient * 0.25f) {
+                distances[side] = i;
+                break;
+            }
+        }
+    }
+
+    // Pixels near the end the edge steps away at take more of the other side,
+    // but only if they are on the side of the edge that step bends towards
+    int nearer = distances[0] < distances[1] ? 0 : 1;
+    float edge_blend = 0;
+    if ((end_luma[nearer] < edge_luma) != (m < edge_luma)) {
+        edge_blend = 0.5f - distances[nearer] / (float)(distances[0] + distances[1]);
+    }
+
+    // Single pixel detail stands out against the average of its neighbourhood
+    float average = (2 * (n + s + w + e) + nw + ne + sw + se) * (1.0f / 12.0f);
+    float subpixel = fabsf(average - m) / range;
+    subpixel = subpixel > 1.0f ? 1.0f : subpixel;
+    subpixel = (3.0f - 2.0f * subpixel) * subpixel * subpixel;
+    subpixel = subpixel * subpixel * FXAA_SUBPIXEL_QUALITY;
+
+    float blend = edge_blend > subpixel ? edge_blend : subpixel;
+    (*edge_pixels)++;
+
+    int other_x = x + across_x < 0 ? 0 : (x + across_x >= width ? width - 1 : x + across_x);
+    int other_y = y + across_y < 0 ? 0 : (y + across_y >= height ? height - 1 : y + across_y);
+
+    return blend_pixel(color[other_y * width + other_x], color[y * width + x], (uint32_t)(blend * 256.0f));
+}
+
+float tone_map_aces(float x) {
+    // Narkowicz's fit of the ACES filmic curve, bright light rolls off instead of clipping
+    float mapped = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+    return mapped < 0 ? 0 : (mapped > 1.0f ? 1.0f : mapped);
+}
+
+void build_display_lut() {
+    // Render contexts on other threads may get here first
+    pthread_once(&display_lut_once, fill_display_lut);
+}
+
+void fill_display_lut() {
+    // Linear light to sRGB, the power curve is too slow to run per channel
+    for (int i = 0; i < POST_PROCESS_GAMMA_LUT_SIZE; i++) {
+        float linear = i / (float)(POST_PROCESS_GAMMA_LUT_SIZE - 1);
+        float encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+        display_lut[i] = (uint8_t)(encoded * 255.0f + 0.5f);
+    }
+}
+
+void print_post_process_stats() {
+    PostProcessStats *stats = &post_process_stats;
+    if (stats->passes == 0) {
+        return;
+    }
+
+    double seconds = stats->time_ns / NS_TO_SEC_FLOAT;
+    double edge_share = stats->pixels ? 100.0 * stats->edge_pixels / stats->pixels : 0.0;
+    printf("  %-20s %8.2f ms/pass %8.2f Mpix/s %6.2f%% edges (%d workers)\n", "post_process",
+           seconds * 1000.0 / stats->passes, stats->pixels / seconds / 1e6, edge_share, stats->workers);
+
+    stats->passes = 0;
+    stats->pixels = 0;
+    stats->edge_pixels = 0;
+    stats->time_ns = 0;
+}
@@ -0,0 +1,337 @@
+#include <SDL3/SDL.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "framebuffer.h"
+#include "job_system.h"
+#include "raster_bins.h"
+#include "raster_kernel.h"
+#include "triangle.h"
+#include "triangle_setup.h"
+
+RasterBins *create_raster_bins(int width, int height, int chunk_triangles, int attribute_count) {
+    RasterBins *bins = (RasterBins *)malloc(sizeof(RasterBins));
+    if (!bins) {
+        printf("Could not allocate mem for raster bins");
+        return NULL;
+    }
+
+    bins->width = width;
+    bins->height = height;
+    bins->tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    bins->tiles_y = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    bins->tile_count = bins->tiles_x * bins->tiles_y;
+    bins->chunks = NULL;
+    bins->chunk_count = 0;
+    bins->chunk_capacity = 0;
+    bins->free_segments = NULL;
+    bins->segment_count = 0;
+    pthread_mutex_init(&bins->segment_lock, NULL);
+    bins->chunk_triangles = chunk_triangles < 1 ? 1 : (chunk_triangles > RASTER_BIN_CHUNK_TRIANGLES ? RASTER_BIN_CHUNK_TRIANGLES : chunk_triangles);
+    bins->attribute_count = attribute_count;
+
+    return bins;
+}
+
+RasterBins *prepare_raster_bins(RasterBins *bins, int width, int height, int chunk_triangles, int attribute_count) {
+    chunk_triangles = chunk_triangles < 1 ? 1 : (chunk_triangles > RASTER_BIN_CHUNK_TRIANGLES ? RASTER_BIN_CHUNK_TRIANGLES : chunk_triangles);
+
+    // Segments that are big enough are kept, only a resize or more attributes start over
+    if (bins && bins->width == width && bins->height == height && bins->attribute_count >= attribute_count) {
+        reset_raster_bins(bins);
+        bins->chunk_triangles = chunk_triangles;
+        return bins;
+    }
+
+    free_raster_bins(bins);
+    return create_raster_bins(width, height, chunk_triangles, attribute_count);
+}
+
+void reset_raster_bins(RasterBins *bins) {
+    // Every segment goes back to the pool, the next draws fill them again
+    for (int i = 0; i < bins->chunk_count; i++) {
+        RasterSegment *segment = bins->chunks[i].segments;
+        while (segment) {
+            RasterSegment *next = segment->next;
+            segment->next = bins->free_segments;
+            bins->free_segments = segment;
+            segment = next;
+        }
+        bins->chunks[i].segments = NULL;
+    }
+
+    bins->chunk_count = 0;
+}
+
+int reserve_raster_chunks(RasterBins *bins, int chunk_count) {
+    if (chunk_count <= bins->chunk_capacity) {
+        return 1;
+    }
+
+    RasterChunk *chunks = (RasterChunk *)realloc(bins->chunks, chunk_count * sizeof(RasterChunk));
+    if (!chunks) {
+        printf("Could not allocate mem for raster chunks");
+        return 0;
+    }
+    bins->chunks = chunks;
+
+    // Chunks own nothing until setup gives them segments
+    for (int i = bins->chunk_capacity; i < chunk_count; i++) {
+        bins->chunks[i].segments = NULL;
+        bins->chunks[i].triangle = NULL;
+        bins->chunks[i].next = 0;
+        bins->chunks[i].end = 0;
+    }
+    bins->chunk_capacity = chunk_count;
+
+    return 1;
+}
+
+void free_raster_bins(RasterBins *bins) {
+    if (bins == NULL) {
+        return;
+    }
+
+    reset_raster_bins(bins);
+    while (bins->free_segments) {
+        RasterSegment *next = bins->free_segments->next;
+        free_raster_segment(bins->free_segments);
+        bins->free_segments = next;
+    }
+
+    pthread_mutex_destroy(&bins->segment_lock);
+    free(bins->chunks);
+    free(bins);
+}
+
+RasterSegment *create_raster_segment(RasterBins *bins) {
+    RasterSegment *segment = (RasterSegment *)malloc(sizeof(RasterSegment));
+    if (!segment) {
+        printf("Could not allocate mem for raster segment");
+        return NULL;
+    }
+
+    segment->queue = create_raster_queue(RASTER_SEGMENT_TRIANGLES, bins->attribute_count);
+    segment->triangle_offsets = (int *)malloc((bins->tile_count + 1) * sizeof(int));
+    segment->triangle_indices = NULL;
+    segment->triangle_index_capacity = 0;
+    segment->pixel_offsets = (int *)malloc((bins->tile_count + 1) * sizeof(int));
+    segment->pixels = segment->queue ? (RasterPixel *)malloc(segment->queue->capacity * sizeof(RasterPixel)) : NULL;
+    segment->next = NULL;
+
+    if (!segment->queue || !segment->triangle_offsets || !segment->pixel_offsets || !segment->pixels) {
+        printf("Could not allocate mem for raster segment");
+        free_raster_segment(segment);
+        return NULL;
+    }
+
+    return segment;
+}
+
+RasterSegment *take_raster_segment(RasterBins *bins, int force) {
+    // Taken once per segment's worth of triangles, so the lock is rarely contended
+    pthread_mutex_lock(&bins->segment_lock);
+    RasterSegment *segment = bins->free_segments;
+    if (segment) {
+        bins->free_segments = segment->next;
+    } else if (bins->segment_count < RASTER_SEGMENT_BUDGET || force) {
+        segment = create_raster_segment(bins);
+        bins->segment_count += segment != NULL;
+    }
+    pthread_mutex_unlock(&bins->segment_lock);
+
+    if (segment) {
+        reset_raster_queue(segment->queue);
+        segment->next = NULL;
+    }
+
+    return segment;
+}
+
+void release_raster_segment(RasterBins *bins, RasterSegment *segment) {
+    pthread_mutex_lock(&bins->segment_lock);
+    segment->next = bins->free_segments;
+    bins->free_segments = segment;
+    pthread_mutex_unlock(&bins->segment_lock);
+}
+
+void release_raster_chunks(RasterBins *bins, int first_chunk, int last_chunk) {
+    // Already drawn, setup of the chunks after them can fill the segments again
+    pthread_mutex_lock(&bins->segment_lock);
+    for (int i = first_chunk; i < last_chunk; i++) {
+        RasterSegment *segment = bins->chunks[i].segments;
+        while (segment) {
+            RasterSegment *next = segment->next;
+            segment->next = bins->free_segments;
+            bins->free_segments = segment;
+            segment = next;
+        }
+        bins->chunks[i].segments = NULL;
+    }
+    pthread_mutex_unlock(&bins->segment_lock);
+}
+
+void free_raster_segment(RasterSegment *segment) {
+    if (segment == NULL) {
+        return;
+    }
+
+    free_raster_queue(segment->queue);
+    free(segment->triangle_offsets);
+    free(segment->triangle_indices);
+    free(segment->pixel_offsets);
+    free(segment->pixels);
+    free(segment);
+}
+
+void bin_raster_segment(RasterBins *bins, RasterSegment *segment) {
+    RasterQueue *queue = segment->queue;
+    int *offsets = segment->triangle_offsets;
+    int *pixel_offsets = segment->pixel_offsets;
+    int last_x = bins->tiles_x - 1;
+    int last_y = bins->tiles_y - 1;
+
+    // Counting sort, counts land one slot up so the prefix sum leaves each
+    // tile's start in its own slot
+    memset(offsets, 0, (bins->tile_count + 1) * sizeof(int));
+    memset(pixel_offsets, 0, (bins->tile_count + 1) * sizeof(int));
+
+    for (int i = 0; i < queue->count; i++) {
+        RasterTriangle *triangle = &queue->triangles[i];
+        int tile_x0 = triangle->min_x < 0 ? 0 : triangle->min_x / RASTER_TILE_SIZE;
+        int tile_y0 = triangle->min_y < 0 ? 0 : triangle->min_y / RASTER_TILE_SIZE;
+        int tile_x1 = triangle->max_x / RASTER_TILE_SIZE < last_x ? triangle->max_x / RASTER_TILE_SIZE : last_x;
+        int tile_y1 = triangle->max_y / RASTER_TILE_SIZE < last_y ? triangle->max_y / RASTER_TILE_SIZE : last_y;
+
+        for (int tile_y = tile_y0; tile_y <= tile_y1; tile_y++) {
+            for (int tile_x = tile_x0; tile_x <= tile_x1; tile_x++) {
+                offsets[tile_y * bins->tiles_x + tile_x + 1]++;
+            }
+        }
+    }
+
+    for (int i = 0; i < queue->pixel_count; i++) {
+        RasterPixel *pixel = &queue->pixels[i];
+        pixel_offsets[(pixel->y / RASTER_TILE_SIZE) * bins->tiles_x + pixel->x / RASTER_TILE_SIZE + 1]++;
+    }
+
+    for (int t = 0; t < bins->tile_count; t++) {
+        offsets[t + 1] += offsets[t];
+        pixel_offsets[t + 1] += pixel_offsets[t];
+    }
+
+    int entries = offsets[bins->tile_count];
+    if (entries > segment->triangle_index_capacity) {
+        int *indices = (int *)realloc(segment->triangle_indices, entries * sizeof(int));
+        if (!indices) {
+            printf("Could not allocate mem for raster segment bins");
+            memset(offsets, 0, (bins->tile_count + 1) * sizeof(int));
+            memset(pixel_offsets, 0, (bins->tile_count + 1) * sizeof(int));
+            return;
+        }
+        segment->triangle_indices = indices;
+        segment->triangle_index_capacity = entries;
+    }
+
+    // Scatter in submission order, every start moves up to the next tile's
+    for (int i = 0; i < queue->count; i++) {
+        RasterTriangle *triangle = &queue->triangles[i];
+        int tile_x0 = triangle->min_x < 0 ? 0 : triangle->min_x / RASTER_TILE_SIZE;
+        int tile_y0 = triangle->min_y < 0 ? 0 : triangle->min_y / RASTER_TILE_SIZE;
+        int tile_x1 = triangle->max_x / RASTER_TILE_SIZE < last_x ? triangle->max_x / RASTER_TILE_SIZE : last_x;
+        int tile_y1 = triangle->max_y / RASTER_TILE_SIZE < last_y ? triangle->max_y / RASTER_TILE_SIZE : last_y;
+
+        for (int tile_y = tile_y0; tile_y <= tile_y1; tile_y++) {
+            for (int tile_x = tile_x0; tile_x <= tile_x1; tile_x++) {
+                segment->triangle_indices[offsets[tile_y * bins->tiles_x + tile_x]++] = i;
+            }
+        }
+    }
+
+    for (int i = 0; i < queue->pixel_count; i++) {
+        RasterPixel *pixel = &queue->pixels[i];
+        segment->pixels[pixel_offsets[(pixel->y / RASTER_TILE_SIZE) * bins->tiles_x + pixel->x / RASTER_TILE_SIZE]++] = *pixel;
+    }
+
+    // And back down one slot to starts again
+    for (int t = bins->tile_count; t > 0; t--) {
+        offsets[t] = offsets[t - 1];
+        pixel_offsets[t] = pixel_offsets[t - 1];
+    }
+    offsets[0] = 0;
+    pixel_offsets[0] = 0;
+}
+
+void rasterize_raster_bins(Framebuffer *framebuffer, RasterBins *bins, int first_chunk, int chunk_count, const RasterKernel *kernel, const RasterState *state, JobSystem *jobs) {
+    uint64_t start_time = SDL_GetTicksNS();
+
+    RasterTileJob job;
+    job.framebuffer = framebuffer;
+    job.bins = bins;
+    job.first_chunk = first_chunk;
+    job.last_chunk = first_chunk + chunk_count;
+    job.kernel = kernel;
+    job.state = state;
+    atomic_init(&job.pixels, 0);
+
+    // Tiles never share a pixel, so every one can be drawn at once
+    parallel_for(jobs, bins->tile_count, 1, rasterize_tiles, &job);
+
+    uint64_t triangles = 0;
+    for (int i = job.first_chunk; i < job.last_chunk; i++) {
+        for (RasterSegment *segment = bins->chunks[i].segments; segment; segment = segment->next) {
+            triangles += segment->queue->count + segment->queue->pixel_count;
+        }
+    }
+
+    record_raster_kernel_stats(kernel, triangles, atomic_load(&job.pixels), SDL_GetTicksNS() - start_time);
+}
+
+void rasterize_tiles(void *arg, int first_tile, int last_tile) {
+    RasterTileJob *job = (RasterTileJob *)arg;
+    RasterBins *bins = job->bins;
+    uint64_t pixels = 0;
+
+    for (int t = first_tile; t < last_tile; t++) {
+        int x0 = (t % bins->tiles_x) * RASTER_TILE_SIZE;
+        int y0 = (t / bins->tiles_x) * RASTER_TILE_SIZE;
+        int x1 = x0 + RASTER_TILE_SIZE - 1 < bins->width - 1 ? x0 + RASTER_TILE_SIZE - 1 : bins->width - 1;
+        int y1 = y0 + RASTER_TILE_SIZE - 1 < bins->height - 1 ? y0 + RASTER_TILE_SIZE - 1 : bins->height - 1;
+
+        // Chunks and their segments in order keep the draw order of a single queue within the tile
+        for (int c = job->first_chunk; c < job->last_chunk; c++) {
+            for (RasterSegment *segment = bins->chunks[c].segments; segment; segment = segment->next) {
+                int pixel = segment->pixel_offsets[t];
+                int pixel_end = segment->pixel_offsets[t + 1];
+
+                for (int i = segment->triangle_offsets[t]; i < segment->triangle_offsets[t + 1]; i++) {
+                    int index = segment->triangle_indices[i];
+
+                    // Micro triangles queued before this one go first, setup already resolved their single pixel
+                    int run = pixel;
+                    while (pixel < pixel_end && segment->pixels[pixel].order <= index) {
+                        pixel++;
+                    }
+                    if (pixel > run) {
+                        job->kernel->draw_pixels(job->framebuffer, &segment->pixels[run], pixel - run, job->state);
+                        pixels += pixel - run;
+                    }
+
+                    pixels += fill_triangle(job->framebuffer, &segment->queue->triangles[index], job->kernel, job->state, x0, y0, x1, y1);
+                }
+
+                if (pixel_end > pixel) {
+                    job->kernel->draw_pixels(job->framebuffer, &segment->pixels[pixel], pixel_end - pixel, job->state);
+                    pixels += pixel_end - pixel;
+                }
+            }
+        }
+    }
+
+    atomic_fetch_add(&job->pixels, pixels);
+}
@@ -0,0 +1,490 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "constants.h"
+#include "framebuffer.h"
+#include "gbuffer.h"
+#include "raster_kernel.h"
+#include "shading.h"
+#include "texture.h"
+#include "triangle.h"
+#include "triangle_setup.h"
+
+// The generic loops below are only ever called with constant depth/shade/blend
+// arguments, forcing them inline lets each kernel fold its state away so the
+// inner loop has no per pixel branches left
+#define RASTER_INLINE static inline __attribute__((always_inline))
+
+// Flat color comes from setup and depth only needs depth, neither reads the planes
+#define RASTER_SHADE_USES_PLANES(shade) ((shade) != RASTER_SHADE_FLAT && (shade) != RASTER_SHADE_DEPTH)
+
+// 4x rotated grid in subpixels from the pixel center, no two samples share a row or column
+static const int raster_sample_offsets[FRAMEBUFFER_SAMPLE_COUNT][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+
+static RasterKernelStats raster_kernel_stats[RASTER_KERNEL_COUNT];
+
+void evaluate_planes(RasterTriangle *triangle, int x, int y, float *values) {
+    const float *origin = triangle->planes;
+    const float *step_x = &triangle->planes[triangle->plane_count];
+    const float *step_y = &triangle->planes[2 * triangle->plane_count];
+
+    for (int plane = 0; plane < triangle->plane_count; plane++) {
+        values[plane] = origin[plane] + step_x[plane] * (x - triangle->min_x) + step_y[plane] * (y - triangle->min_y);
+    }
+}
+
+RASTER_INLINE int resolve_texture_coords(RasterTriangle *triangle, const Texture *texture, const float *values, float *out_u, float *out_v) {
+    const float *step_x = &triangle->planes[triangle->plane_count];
+    const float *step_y = &triangle->planes[2 * triangle->plane_count];
+    const int u_plane = 1 + ATTRIBUTE_UV;
+    const int v_plane = u_plane + 1;
+
+    float w = values[0] > 0 ? 1.0f / values[0] : 0.0f;
+    float u = values[u_plane] * w;
+    float v = values[v_plane] * w;
+
+    // UV derivatives straight from the plane steps, d(U / Q) = (dU - u * dQ) / Q,
+    // scaled to level 0 texels to find how far one pixel steps in the texture
+    float width = (float)texture->levels[0].width;
+    float height = (float)texture->levels[0].height;
+    float du_dx = (step_x[u_plane] - u * step_x[0]) * w * width;
+    float dv_dx = (step_x[v_plane] - v * step_x[0]) * w * height;
+    float du_dy = (step_y[u_plane] - u * step_y[0]) * w * width;
+    float dv_dy = (step_y[v_plane] - v * step_y[0]) * w * height;
+
+    float footprint_x = du_dx * du_dx + dv_dx * dv_dx;
+    float footprint_y = du_dy * du_dy + dv_dy * dv_dy;
+
+    *out_u = u;
+    *out_v = v;
+    return select_texture_level(texture, footprint_x > footprint_y ? footprint_x : footprint_y);
+}
+
+RASTER_INLINE uint32_t resolve_textured_color(RasterTriangle *triangle, const Texture *texture, const float *values) {
+    float u;
+    float v;
+    int level = resolve_texture_coords(triangle, texture, values, &u, &v);
+    uint32_t texel = sample_texture_bilinear(&texture->levels[level], u, v);
+
+    // Lighting still comes from the interpolated color
+    float w = values[0] > 0 ? 1.0f / values[0] : 0.0f;
+    const float *color = &values[1 + ATTRIBUTE_COLOR];
+    float scale = w * (1.0f / 255.0f);
+    return pack_color(((texel >> 16) & 0xFF) * color[0] * scale,
+                      ((texel >> 8) & 0xFF) * color[1] * scale,
+                      (texel & 0xFF) * color[2] * scale);
+}
+
+RASTER_INLINE uint32_t modulate_color(uint32_t color, uint32_t texel) {
+    uint32_t r = (((color >> 16) & 0xFF) * ((texel >> 16) & 0xFF) + 127) / 255;
+    uint32_t g = (((color >> 8) & 0xFF) * ((texel >> 8) & 0xFF) + 127) / 255;
+    uint32_t b = ((color & 0xFF) * (texel & 0xFF) + 127) / 255;
+
+    return 0xFF000000u | (r << 16) | (g << 8) | b;
+}
+
+RASTER_INLINE uint32_t shade_pixel(RasterTriangle *triangle, const RasterState *state, const float *values, const RasterShade shade) {
+    if (shade == RASTER_SHADE_FLAT) {
+        return triangle->flat_color;
+    }
+    if (shade == RASTER_SHADE_INTERPOLATED) {
+        return resolve_plane_color(values);
+    }
+    return resolve_textured_color(triangle, state->texture, values);
+}
+
+RASTER_INLINE float evaluate_depth(RasterTriangle *triangle, int x, int y) {
+    return triangle->depth_origin + triangle->depth_dx * (x - triangle->min_x) + triangle->depth_dy * (y - triangle->min_y);
+}
+
+RASTER_INLINE void write_pixel(uint32_t *color, float *depth, uint32_t src, float z, int covered,
+                               const RasterState *state, const int depth_test, const RasterBlend blend) {
+    uint32_t out = blend == RASTER_BLEND_ALPHA ? blend_pixel(src, *color, state->alpha) : src;
+    int pass = depth_test ? covered & (z < *depth) : covered;
+
+    *color = pass ? out : *color;
+
+    // Blended surfaces are tested against depth but never occlude anything
+    if (depth_test && blend == RASTER_BLEND_OPAQUE) {
+        *depth = pass ? z : *depth;
+    }
+}
+
+RASTER_INLINE void evaluate_sample_depths(RasterTriangle *triangle, float *sample_depths) {
+    // Depth moves linearly away from the center, steps are per whole pixel
+    for (int s = 0; s < FRAMEBUFFER_SAMPLE_COUNT; s++) {
+        sample_depths[s] = (triangle->depth_dx * raster_sample_offsets[s][0] + triangle->depth_dy * raster_sample_offsets[s][1]) * (1.0f / SUBPIXEL_SCALE);
+    }
+}
+
+RASTER_INLINE void write_samples(uint32_t *colors, float *depths, RasterTriangle *triangle, const RasterState *state, const float *values,
+                                 float z, int coverage, const float *sample_depths, const int depth_test, const RasterShade shade, const RasterBlend blend) {
+    int pass[FRAMEBUFFER_SAMPLE_COUNT];
+    int any = 0;
+    for (int s = 0; s < FRAMEBUFFER_SAMPLE_COUNT; s++) {
+        pass[s] = (coverage >> s) & 1;
+        pass[s] &= depth_test ? z + sample_depths[s] < depths[s] : 1;
+        any |= pass[s];
+    }
+
+    // Shaded once at the pixel center however many samples it ends up in
+    if (!any) {
+        return;
+    }
+
+    uint32_t src = shade_pixel(triangle, state, values, shade);
+    for (int s = 0; s < FRAMEBUFFER_SAMPLE_COUNT; s++) {
+        uint32_t out = blend == RASTER_BLEND_ALPHA ? blend_pixel(src, colors[s], state->alpha) : src;
+        colors[s] = pass[s] ? out : colors[s];
+
+        if (depth_test && blend == RASTER_BLEND_OPAQUE) {
+            depths[s] = pass[s] ? z + sample_depths[s] : depths[s];
+        }
+    }
+}
+
+RASTER_INLINE void write_depth_pixel(float *depth, float z, int covered, const int depth_test) {
+    int pass = depth_test ? covered & (z < *depth) : covered;
+    *depth = pass ? z : *depth;
+}
+
+RASTER_INLINE void write_gbuffer_pixel(Framebuffer *framebuffer, int offset, RasterTriangle *triangle, const RasterState *state,
+                                       const float *values, float z, int covered, const int depth_test) {
+    GBuffer *gbuffer = framebuffer->gbuffer;
+    int pass = depth_test ? covered & (z < framebuffer->depth[offset]) : covered;
+
+    // The color planes carry the normal remapped to 0 - 1, octahedral
+    // encoding divides by its own length so the 1/w scale cancels out
+    const float *normal = &values[1 + ATTRIBUTE_COLOR];
+    float inv_w = values[0];
+    uint16_t encoded = encode_gbuffer_normal(normal[0] * 2.0f - inv_w, normal[1] * 2.0f - inv_w, normal[2] * 2.0f - inv_w);
+
+    // Untextured materials still get a level so the store stays unconditional
+    uint32_t uv = 0;
+    int level = 0;
+    if (state->texture) {
+        float u;
+        float v;
+        level = resolve_texture_coords(triangle, state->texture, values, &u, &v);
+        uv = encode_gbuffer_uv(u, v);
+    }
+
+    framebuffer->depth[offset] = pass ? z : framebuffer->depth[offset];
+    gbuffer->normal[offset] = pass ? encoded : gbuffer->normal[offset];
+    gbuffer->uv[offset] = pass ? uv : gbuffer->uv[offset];
+    gbuffer->material[offset] = pass ? state->material : gbuffer->material[offset];
+    gbuffer->texture_level[offset] = pass ? (uint8_t)level : gbuffer->texture_level[offset];
+}
+
+RASTER_INLINE void fill_spans_generic(Framebuffer *framebuffer, RasterTriangle *triangle, const RasterState *state, int x0, int y0, int x1, int y1,
+                                      const int depth_test, const RasterShade shade, const RasterBlend blend, const int multisample) {
+    const float *step_x = &triangle->planes[triangle->plane_count];
+    float values[RASTER_PLANE_COUNT(MAX_VERTEX_ATTRIBUTES)];
+    const int full_coverage = (1 << FRAMEBUFFER_SAMPLE_COUNT) - 1;
+
+    float sample_depths[FRAMEBUFFER_SAMPLE_COUNT];
+    if (multisample) {
+        evaluate_sample_depths(triangle, sample_depths);
+    }
+
+    // Trivially accepted, every pixel is covered so only depth can reject it
+    for (int y = y0; y <= y1; y++) {
+        // Depth only targets have no color plane
+        uint32_t *row = shade == RASTER_SHADE_DEPTH ? NULL : &framebuffer->color[y * framebuffer->width];
+        float *depth_row = &framebuffer->depth[y * framebuffer->width];
+        float z = depth_test ? evaluate_depth(triangle, x0, y) : 0;
+
+        // Planes are evaluated once per row then stepped a pixel at a time
+        if (RASTER_SHADE_USES_PLANES(shade)) {
+            evaluate_planes(triangle, x0, y, values);
+        }
+
+        for (int x = x0; x <= x1; x++) {
+            if (shade == RASTER_SHADE_DEPTH) {
+                write_depth_pixel(&depth_row[x], z, 1, depth_test);
+            } else if (shade == RASTER_SHADE_GBUFFER) {
+                write_gbuffer_pixel(framebuffer, y * framebuffer->width + x, triangle, state, values, z, 1, depth_test);
+            } else if (multisample) {
+                // The block test took the sample reach into account, every sample is in
+                int offset = (y * framebuffer->width + x) * FRAMEBUFFER_SAMPLE_COUNT;
+                write_samples(&framebuffer->sample_color[offset], &framebuffer->sample_depth[offset], triangle, state, values, z,
+                              full_coverage, sample_depths, depth_test, shade, blend);
+            } else {
+                uint32_t src = shade_pixel(triangle, state, values, shade);
+                write_pixel(&row[x], &depth_row[x], src, z, 1, state, depth_test, blend);
+            }
+
+            if (depth_test) {
+                z += triangle->depth_dx;
+            }
+            if (RASTER_SHADE_USES_PLANES(shade)) {
+                for (int plane = 0; plane < triangle->plane_count; plane++) {
+                    values[plane] += step_x[plane];
+                }
+            }
+        }
+    }
+}
+
+RASTER_INLINE void fill_partial_generic(Framebuffer *framebuffer, RasterTriangle *triangle, const RasterState *state,
+                                        int64_t edge[NUM_TRIANGLE_VERTEX], int64_t min_corner[NUM_TRIANGLE_VERTEX],
+                                        int block_x, int block_y, int x0, int y0, int x1, int y1,
+                                        const int depth_test, const RasterShade shade, const RasterBlend blend, const int multisample) {
+    const float *plane_step_x = &triangle->planes[triangle->plane_count];
+    float values[RASTER_PLANE_COUNT(MAX_VERTEX_ATTRIBUTES)];
+
+    // Edges that cover the whole block drop out, the rest cross it and stay
+    // small enough for 32 bit lanes
+    int row_edge[NUM_TRIANGLE_VERTEX];
+    int step_x[NUM_TRIANGLE_VERTEX];
+    int step_y[NUM_TRIANGLE_VERTEX];
+    for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+        int covers_block = edge[i] + min_corner[i] >= 0;
+        row_edge[i] = covers_block ? 0 : (int)edge[i];
+        step_x[i] = covers_block ? 0 : triangle->edge_a[i];
+        step_y[i] = covers_block ? 0 : triangle->edge_b[i];
+    }
+
+    // Where each edge stands at every sample relative to the pixel center, the
+    // steps are whole pixels of subpixel units so the offsets divide exactly
+    int sample_edge[FRAMEBUFFER_SAMPLE_COUNT][NUM_TRIANGLE_VERTEX];
+    float sample_depths[FRAMEBUFFER_SAMPLE_COUNT];
+    if (multisample) {
+        for (int s = 0; s < FRAMEBUFFER_SAMPLE_COUNT; s++) {
+            for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+                sample_edge[s][i] = (step_x[i] * raster_sample_offsets[s][0] + step_y[i] * raster_sample_offsets[s][1]) / SUBPIXEL_SCALE;
+            }
+        }
+        evaluate_sample_depths(triangle, sample_depths);
+    }
+
+    for (int row = 0; row < RASTER_BLOCK_SIZE; row++) {
+        int y = block_y + row;
+
+        if (y >= y0 && y <= y1) {
+            uint32_t *pixels = shade == RASTER_SHADE_DEPTH ? NULL : &framebuffer->color[y * framebuffer->width + block_x];
+            float *depths = &framebuffer->depth[y * framebuffer->width + block_x];
+            float z = depth_test ? evaluate_depth(triangle, x0, y) : 0;
+
+            if (RASTER_SHADE_USES_PLANES(shade)) {
+                evaluate_planes(triangle, x0, y, values);
+            }
+
+            // One lane per pixel of the row, the stores are selects rather than branches
+            for (int lane = x0 - block_x; lane <= x1 - block_x; lane++) {
+                int e0 = row_edge[0] + lane * step_x[0];
+                int e1 = row_edge[1] + lane * step_x[1];
+                int e2 = row_edge[2] + lane * step_x[2];
+
+                if (shade == RASTER_SHADE_DEPTH) {
+                    write_depth_pixel(&depths[lane], z, (e0 | e1 | e2) >= 0, depth_test);
+                } else if (shade == RASTER_SHADE_GBUFFER) {
+                    write_gbuffer_pixel(framebuffer, y * framebuffer->width + block_x + lane, triangle, state, values, z, (e0 | e1 | e2) >= 0, depth_test);
+                } else if (multisample) {
+                    int coverage = 0;
+                    for (int s = 0; s < FRAMEBUFFER_SAMPLE_COUNT; s++) {
+                        int inside = ((e0 + sample_edge[s][0]) | (e1 + sample_edge[s][1]) | (e2 + sample_edge[s][2])) >= 0;
+                        coverage |= inside << s;
+                    }
+
+                    int offset = (y * framebuffer->width + block_x + lane) * FRAMEBUFFER_SAMPLE_COUNT;
+                    write_samples(&framebuffer->sample_color[offset], &framebuffer->sample_depth[offset], triangle, state, values, z,
+                                  coverage, sample_depths, depth_test, shade, blend);
+                } else {
+                    uint32_t src = shade_pixel(triangle, state, values, shade);
+                    write_pixel(&pixels[lane], &depths[lane], src, z, (e0 | e1 | e2) >= 0, state, depth_test, blend);
+                }
+
+                if (depth_test) {
+                    z += triangle->depth_dx;
+                }
+                if (RASTER_SHADE_USES_PLANES(shade)) {
+                    for (int plane = 0; plane < triangle->plane_count; plane++) {
+                        values[plane] += plane_step_x[plane];
+                    }
+                }
+            }
+        }
+
+        row_edge[0] += step_y[0];
+        row_edge[1] += step_y[1];
+        row_edge[2] += step_y[2];
+    }
+}
+
+RASTER_INLINE void draw_pixels_generic(Framebuffer *framebuffer, const RasterPixel *pixels, int count, const RasterState *state,
+                                       const int depth_test, const RasterShade shade, const RasterBlend blend, const int multisample) {
+    // Textures are far too minified to sample here, the coarsest mip stands in
+    uint32_t average = 0xFFFFFFFFu;
+    if (shade == RASTER_SHADE_TEXTURED) {
+        const TextureLevel *last = &state->texture->levels[state->texture->level_count - 1];
+        average = fetch_texel(last, 0, 0);
+    }
+
+    // Setup already resolved their coverage and color
+    for (int i = 0; i < count; i++) {
+        const RasterPixel *pixel = &pixels[i];
+        int offset = pixel->y * framebuffer->width + pixel->x;
+
+        if (shade == RASTER_SHADE_DEPTH) {
+            write_depth_pixel(&framebuffer->depth[offset], pixel->depth, 1, depth_test);
+            continue;
+        }
+
+        // The packed color is the remapped normal, the texture gets its coarsest mip
+        if (shade == RASTER_SHADE_GBUFFER) {
+            GBuffer *gbuffer = framebuffer->gbuffer;
+            int pass = depth_test ? pixel->depth < framebuffer->depth[offset] : 1;
+            if (pass) {
+                float nx = ((pixel->color >> 16) & 0xFF) * (2.0f / 255.0f) - 1.0f;
+                float ny = ((pixel->color >> 8) & 0xFF) * (2.0f / 255.0f) - 1.0f;
+                float nz = (pixel->color & 0xFF) * (2.0f / 255.0f) - 1.0f;
+                framebuffer->depth[offset] = pixel->depth;
+                gbuffer->normal[offset] = encode_gbuffer_normal(nx, ny, nz);
+                gbuffer->uv[offset] = 0;
+                gbuffer->material[offset] = state->material;
+                gbuffer->texture_level[offset] = state->texture ? (uint8_t)(state->texture->level_count - 1) : 0;
+            }
+            continue;
+        }
+
+        uint32_t src = shade == RASTER_SHADE_TEXTURED ? modulate_color(pixel->color, average) : pixel->color;
+
+        // Multisampled setup keeps these as triangles, anything left covers the whole pixel
+        if (multisample) {
+            for (int s = 0; s < FRAMEBUFFER_SAMPLE_COUNT; s++) {
+                int sample = offset * FRAMEBUFFER_SAMPLE_COUNT + s;
+                write_pixel(&framebuffer->sample_color[sample], &framebuffer->sample_depth[sample], src, pixel->depth, 1, state, depth_test, blend);
+            }
+            continue;
+        }
+
+        write_pixel(&framebuffer->color[offset], &framebuffer->depth[offset], src, pixel->depth, 1, state, depth_test, blend);
+    }
+}
+
+// Stamps out one kernel per pipeline state, every argument must be a constant.
+// Each state gets a single sampled and a multisampled variant, G-buffer and
+// depth only writes can neither blend nor multisample, their extra variants
+// only keep the table dense
+#define DEFINE_RASTER_KERNEL_VARIANT(name, depth_test, shade, blend, multisample)                                                          \
+    static void fill_spans_##name(Framebuffer *framebuffer, RasterTriangle *triangle, const RasterState *state,                            \
+                                  int x0, int y0, int x1, int y1) {                                                                       \
+        fill_spans_generic(framebuffer, triangle, state, x0, y0, x1, y1, depth_test, shade, blend, multisample);                           \
+    }                                                                                                                                      \
+    static void fill_partial_##name(Framebuffer *framebuffer, RasterTriangle *triangle, const RasterState *state,                         \
+                                    int64_t edge[NUM_TRIANGLE_VERTEX], int64_t min_corner[NUM_TRIANGLE_VERTEX],                            \
+                                    int block_x, int block_y, int x0, int y0, int x1, int y1) {                                           \
+        fill_partial_generic(framebuffer, triangle, state, edge, min_corner, block_x, block_y, x0, y0, x1, y1, depth_test, shade, blend,   \
+                             multisample);                                                                                                 \
+    }                                                                                                                                      \
+    static void draw_pixels_##name(Framebuffer *framebuffer, const RasterPixel *pixels, int count, const RasterState *state) {             \
+        draw_pixels_generic(framebuffer, pixels, count, state, depth_test, shade, blend, multisample);                                    \
+    }
+
+#define DEFINE_RASTER_KERNEL(name, depth_test, shade, blend)            \
+    DEFINE_RASTER_KERNEL_VARIANT(name, depth_test, shade, blend, 0)     \
+    DEFINE_RASTER_KERNEL_VARIANT(msaa_##name, depth_test, shade, blend, 1)
+
+DEFINE_RASTER_KERNEL(flat_opaque, 0, RASTER_SHADE_FLAT, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(flat_blend, 0, RASTER_SHADE_FLAT, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(smooth_opaque, 0, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(smooth_blend, 0, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(textured_opaque, 0, RASTER_SHADE_TEXTURED, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(textured_blend, 0, RASTER_SHADE_TEXTURED, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(gbuffer_opaque, 0, RASTER_SHADE_GBUFFER, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(gbuffer_blend, 0, RASTER_SHADE_GBUFFER, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(z_only_opaque, 0, RASTER_SHADE_DEPTH, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(z_only_blend, 0, RASTER_SHADE_DEPTH, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(depth_flat_opaque, 1, RASTER_SHADE_FLAT, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(depth_flat_blend, 1, RASTER_SHADE_FLAT, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(depth_smooth_opaque, 1, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(depth_smooth_blend, 1, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(depth_textured_opaque, 1, RASTER_SHADE_TEXTURED, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(depth_textured_blend, 1, RASTER_SHADE_TEXTURED, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(depth_gbuffer_opaque, 1, RASTER_SHADE_GBUFFER, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(depth_gbuffer_blend, 1, RASTER_SHADE_GBUFFER, RASTER_BLEND_ALPHA)
+DEFINE_RASTER_KERNEL(depth_z_only_opaque, 1, RASTER_SHADE_DEPTH, RASTER_BLEND_OPAQUE)
+DEFINE_RASTER_KERNEL(depth_z_only_blend, 1, RASTER_SHADE_DEPTH, RASTER_BLEND_ALPHA)
+
+#define RASTER_KERNEL_INDEX(depth_test, shade, blend, multisample) \
+    ((((multisample) * RASTER_DEPTH_COUNT + (depth_test)) * RASTER_SHADE_COUNT + (shade)) * RASTER_BLEND_COUNT + (blend))
+#define RASTER_KERNEL_ENTRY(name, depth_test, shade, blend) \
+    {#name, RASTER_KERNEL_INDEX(depth_test, shade, blend, 0), 1, fill_spans_##name, fill_partial_##name, draw_pixels_##name}
+#define RASTER_MSAA_KERNEL_ENTRY(name, depth_test, shade, blend)                                                         \
+    {"msaa_" #name, RASTER_KERNEL_INDEX(depth_test, shade, blend, 1), FRAMEBUFFER_SAMPLE_COUNT, fill_spans_msaa_##name, \
+     fill_partial_msaa_##name, draw_pixels_msaa_##name}
+
+// Ordered by RASTER_KERNEL_INDEX
+static const RasterKernel raster_kernels[RASTER_KERNEL_COUNT] = {
+    RASTER_KERNEL_ENTRY(flat_opaque, 0, RASTER_SHADE_FLAT, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(flat_blend, 0, RASTER_SHADE_FLAT, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(smooth_opaque, 0, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(smooth_blend, 0, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(textured_opaque, 0, RASTER_SHADE_TEXTURED, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(textured_blend, 0, RASTER_SHADE_TEXTURED, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(gbuffer_opaque, 0, RASTER_SHADE_GBUFFER, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(gbuffer_blend, 0, RASTER_SHADE_GBUFFER, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(z_only_opaque, 0, RASTER_SHADE_DEPTH, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(z_only_blend, 0, RASTER_SHADE_DEPTH, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(depth_flat_opaque, 1, RASTER_SHADE_FLAT, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(depth_flat_blend, 1, RASTER_SHADE_FLAT, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(depth_smooth_opaque, 1, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(depth_smooth_blend, 1, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(depth_textured_opaque, 1, RASTER_SHADE_TEXTURED, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(depth_textured_blend, 1, RASTER_SHADE_TEXTURED, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(depth_gbuffer_opaque, 1, RASTER_SHADE_GBUFFER, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(depth_gbuffer_blend, 1, RASTER_SHADE_GBUFFER, RASTER_BLEND_ALPHA),
+    RASTER_KERNEL_ENTRY(depth_z_only_opaque, 1, RASTER_SHADE_DEPTH, RASTER_BLEND_OPAQUE),
+    RASTER_KERNEL_ENTRY(depth_z_only_blend, 1, RASTER_SHADE_DEPTH, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(flat_opaque, 0, RASTER_SHADE_FLAT, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(flat_blend, 0, RASTER_SHADE_FLAT, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(smooth_opaque, 0, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(smooth_blend, 0, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(textured_opaque, 0, RASTER_SHADE_TEXTURED, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(textured_blend, 0, RASTER_SHADE_TEXTURED, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(gbuffer_opaque, 0, RASTER_SHADE_GBUFFER, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(gbuffer_blend, 0, RASTER_SHADE_GBUFFER, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(z_only_opaque, 0, RASTER_SHADE_DEPTH, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(z_only_blend, 0, RASTER_SHADE_DEPTH, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(depth_flat_opaque, 1, RASTER_SHADE_FLAT, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(depth_flat_blend, 1, RASTER_SHADE_FLAT, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(depth_smooth_opaque, 1, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(depth_smooth_blend, 1, RASTER_SHADE_INTERPOLATED, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(depth_textured_opaque, 1, RASTER_SHADE_TEXTURED, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(depth_textured_blend, 1, RASTER_SHADE_TEXTURED, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(depth_gbuffer_opaque, 1, RASTER_SHADE_GBUFFER, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(depth_gbuffer_blend, 1, RASTER_SHADE_GBUFFER, RASTER_BLEND_ALPHA),
+    RASTER_MSAA_KERNEL_ENTRY(depth_z_only_opaque, 1, RASTER_SHADE_DEPTH, RASTER_BLEND_OPAQUE),
+    RASTER_MSAA_KERNEL_ENTRY(depth_z_only_blend, 1, RASTER_SHADE_DEPTH, RASTER_BLEND_ALPHA)};
+
+const RasterKernel *select_raster_kernel(int depth_test, RasterShade shade, RasterBlend blend, int multisample) {
+    return &raster_kernels[RASTER_KERNEL_INDEX(depth_test != 0, shade, blend, multisample != 0)];
+}
+
+void record_raster_kernel_stats(const RasterKernel *kernel, uint64_t triangles, uint64_t pixels, uint64_t time_ns) {
+    RasterKernelStats *stats = &raster_kernel_stats[kernel->index];
+    atomic_fetch_add(&stats->triangles, triangles);
+    atomic_fetch_add(&stats->pixels, pixels);
+    atomic_fetch_add(&stats->time_ns, time_ns);
+}
+
+void print_raster_kernel_stats() {
+    // Throughput of every kernel used since the last print, then start over
+    for (int i = 0; i < RASTER_KERNEL_COUNT; i++) {
+        RasterKernelStats *stats = &raster_kernel_stats[i];
+        if (stats->triangles == 0 || stats->time_ns == 0) {
+            continue;
+        }
+
+        const RasterKernel *kernel = &raster_kernels[i];
+        double seconds = stats->time_ns / NS_TO_SEC_FLOAT;
+        printf("  %-20s %8.2f Mtri/s %8.2f Mpix/s\n", kernel->name,
+               stats->triangles / seconds / 1e6, stats->pixels / seconds / 1e6);
+
+        stats->triangles = 0;
+        stats->pixels = 0;
+        stats->time_ns = 0;
+    }
+}
@@ -0,0 +1,128 @@
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "camera.h"
+#include "frame_pipeline.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "render_context.h"
+#include "render_pipeline.h"
+#include "shading.h"
+#include "wireframe.h"
+
+RenderContext *create_render_context(int width, int height, RenderSettings *settings) {
+    RenderContext *context = (RenderContext *)malloc(sizeof(RenderContext));
+    if (!context) {
+        printf("Could not allocate mem for render context");
+        return NULL;
+    }
+
+    context->width = width;
+    context->height = height;
+    context->settings = *settings;
+    context->model = NULL;
+    context->has_proxy = 0;
+
+    context->framebuffer = create_framebuffer(width, height);
+    context->camera = create_camera(width / (float)height);
+    context->pipeline = create_frame_pipeline(settings->jobs);
+
+    if (!context->framebuffer || !context->camera || !context->pipeline) {
+        printf("Could not allocate mem for render context targets");
+        free_render_context(context);
+        return NULL;
+    }
+
+    return context;
+}
+
+void free_render_context(RenderContext *context) {
+    if (context == NULL) {
+        return;
+    }
+
+    // The back end may still be drawing into the framebuffer
+    free_frame_pipeline(context->pipeline);
+    free_framebuffer(context->framebuffer);
+
+    if (context->camera) {
+        free(context->camera->camera_mat);
+        free(context->camera->projection_mat);
+        free(context->camera);
+    }
+
+    free(context);
+}
+
+void set_render_context_scene(RenderContext *context, ModelObject *model, LightingScene *lighting) {
+    // A frame in flight keeps drawing the old scene until it is done
+    wait_for_render_context(context);
+    context->model = model;
+    context->settings.lighting = lighting;
+}
+
+void set_render_context_proxy(RenderContext *context, const float *bounds_min, const float *bounds_max) {
+    for (int i = 0; i < 3; i++) {
+        context->proxy_min[i] = bounds_min[i];
+        context->proxy_max[i] = bounds_max[i];
+    }
+    context->has_proxy = 1;
+}
+
+int render_context_frame(RenderContext *context, SDL_Renderer *renderer, SDL_Texture *texture) {
+    // Nothing loaded yet, the window still gets a cleared frame so it keeps responding,
+    // with the mesh's box in it once the loader knows the bounds
+    if (!context->model) {
+        wait_for_render_context(context);
+        context->pipeline->snapshot.valid = 0;
+        clear_framebuffer(context->framebuffer, FRAMEBUFFER_CLEAR_COLOR);
+
+        if (context->has_proxy) {
+            fMatrix44 *view_projection = mult_fmatrix44(context->camera->camera_mat, context->camera->projection_mat);
+            if (view_projection) {
+                draw_bounding_box(context->framebuffer, view_projection, context->proxy_min, context->proxy_max);
+                free(view_projection);
+            }
+        }
+        clear_screen(renderer);
+        present_framebuffer(renderer, texture, context->framebuffer);
+        SDL_RenderPresent(renderer);
+        return 1;
+    }
+
+    // Records this frame and presents the one before it, 0 when nothing changed and
+    // the last one was shown again
+    return run_frame_pipeline(context->pipeline, renderer, texture, context->framebuffer, &context->settings, context->model, context->camera);
+}
+
+void render_context_still(RenderContext *context) {
+    if (!context->model) {
+        return;
+    }
+
+    // Nothing to overlap with, the finished image is in the framebuffer on return
+    wait_for_render_context(context);
+    FramePipeline *pipeline = context->pipeline;
+    pipeline->drawing = -1;
+
+    // Never presented, the next frame is drawn in full whatever it finds here
+    pipeline->snapshot.valid = 0;
+
+    RenderFrame *frame = &pipeline->frames[pipeline->recording];
+    record_render_frame(frame, context->framebuffer, &context->settings, context->model, context->camera, NULL);
+    draw_render_frame(context->framebuffer, frame);
+}
+
+void wait_for_render_context(RenderContext *context) {
+    wait_for_frame_pipeline(context->pipeline);
+}
+
+void drop_render_context_frame(RenderContext *context) {
+    // The frame being drawn finishes but is never presented, its wireframe would read
+    // a mesh the caller is about to free. The next frame is drawn in full
+    wait_for_render_context(context);
+    context->pipeline->drawing = -1;
+    context->pipeline->snapshot.valid = 0;
+}
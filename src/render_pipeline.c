@@ -1,104 +1,859 @@
 #include "render_pipeline.h"
 #include "camera.h"
+#include "compact_vertex.h"
 #include "constants.h"
+#include "deferred.h"
+#include "frame_arena.h"
+#include "frame_pipeline.h"
+#include "framebuffer.h"
+#include "gbuffer.h"
 #include "geometry.h"
+#include "job_system.h"
 #include "line.h"
+#include "meshlet.h"
 #include "model.h"
+#include "paged_mesh.h"
+#include "post_process.h"
+#include "raster_bins.h"
+#include "shadow.h"
+#include "triangle.h"
+#include "wireframe.h"
 #include <SDL3/SDL.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-uint64_t last_frame_time = 0;
-uint32_t frame_count = 0;
-uint64_t last_fps_update = 0;
-float fps = 0.0f;
-
 // MAIN PIPELINE //
 
-void execute_render_pipeline(SDL_Renderer *renderer, ModelObject *model, UserCamera *camera) {
-    // Update camera matrix
+void record_render_frame(RenderFrame *frame, Framebuffer *framebuffer, RenderSettings *settings, ModelObject *model, UserCamera *camera, JobCounter *in_flight) {
+    frame->settings = *settings;
+    frame->mesh = model->mesh;
+    frame->visible = 0;
+    frame->meshlet_visible = NULL;
+    frame->dirty = (ScreenRect){0, 0, framebuffer->width, framebuffer->height};
+    frame->command_count = 0;
+
+    // Last time's transient buffers were presented before this frame came around again
+    reset_frame_arena(&frame->arena);
+
+    // Update camera matrix, the model's is the scene owner's to keep current
     update_frustum_planes(camera);
 
-    // Update model matrix
-    update_model_space(model);
+    // Lights see the model before the camera does, through this view's own maps
+    copy_frame_lighting(frame, settings->lighting);
+    update_shadow_maps(&frame->settings, frame->shadow_maps, model, in_flight, &frame->arena);
 
-    // Being pipeline execution
-    start_render(renderer, model, camera);
+    if (!check_model_in_frustum(model, camera)) {
+        return;
+    }
+    record_model_geometry(frame, framebuffer, camera, model);
 }
 
-void start_render(SDL_Renderer *renderer, ModelObject *model, UserCamera *camera) {
-    render_bounding_box(model, camera);
-    if (!check_model_in_frustum(model, camera)) {
+void draw_render_frame(Framebuffer *framebuffer, RenderFrame *frame) {
+    RenderSettings *settings = &frame->settings;
+    ScreenRect *dirty = &frame->dirty;
+    clear_framebuffer_rect(framebuffer, FRAMEBUFFER_CLEAR_COLOR, dirty->x0, dirty->y0, dirty->x1, dirty->y1);
+
+    for (int i = 0; i < frame->command_count; i++) {
+        replay_render_command(framebuffer, frame, &frame->commands[i]);
+    }
+
+    // Lines go on top of the filled triangles
+    if (frame->visible && settings->wireframe_target == WIREFRAME_TARGET_FRAMEBUFFER) {
+        render_wireframe(NULL, framebuffer, settings, frame->mesh, &frame->vertex_cache);
+    }
+
+    // Image space passes over whatever ended up in the framebuffer
+    if (settings->post_process) {
+        post_process_framebuffer(framebuffer, settings->exposure, settings->mode == RENDER_MODE_FILLED && settings->deferred, &frame->arena, settings->jobs);
+    }
+}
+
+void present_render_frame(SDL_Renderer *renderer, SDL_Texture *texture, Framebuffer *framebuffer, RenderFrame *frame) {
+    clear_screen(renderer);
+
+    // SDL calls stay on the main thread, so batched lines wait until now
+    if (frame->visible && frame->settings.wireframe_target == WIREFRAME_TARGET_RENDERER) {
+        render_wireframe(renderer, framebuffer, &frame->settings, frame->mesh, &frame->vertex_cache);
+    }
+
+    present_framebuffer(renderer, texture, framebuffer);
+    SDL_RenderPresent(renderer);
+}
+
+void free_render_frame(RenderFrame *frame) {
+    free_frame_arena(&frame->arena);
+    free_raster_bins(frame->bins);
+    free(frame->commands);
+
+    frame->vertex_cache.vertices = NULL;
+    frame->vertex_cache.outcodes = NULL;
+    frame->bins = NULL;
+    frame->commands = NULL;
+    frame->command_capacity = 0;
+}
+
+RenderCommand *push_render_command(RenderFrame *frame, RenderCommandType type) {
+    if (frame->command_count == frame->command_capacity) {
+        int capacity = frame->command_capacity ? frame->command_capacity * 2 : 16;
+        RenderCommand *commands = (RenderCommand *)realloc(frame->commands, capacity * sizeof(RenderCommand));
+        if (!commands) {
+            printf("Could not allocate mem for render commands");
+            return NULL;
+        }
+        frame->commands = commands;
+        frame->command_capacity = capacity;
+    }
+
+    RenderCommand *command = &frame->commands[frame->command_count++];
+    command->type = type;
+    command->pass = RENDER_PASS_FORWARD;
+    command->first_chunk = 0;
+    command->chunk_count = 0;
+    command->kernel = NULL;
+    return command;
+}
+
+void replay_render_command(Framebuffer *framebuffer, RenderFrame *frame, RenderCommand *command) {
+    RenderSettings *settings = &frame->settings;
+
+    // Targets are made by the back end, the front end never touches the framebuffer
+    switch (command->type) {
+    case RENDER_COMMAND_CLEAR_SAMPLES:
+        if (create_multisample_targets(framebuffer)) {
+            clear_multisample_targets(framebuffer, FRAMEBUFFER_CLEAR_COLOR);
+        }
+        break;
+    case RENDER_COMMAND_RESOLVE_SAMPLES:
+        if (framebuffer->sample_color) {
+            resolve_multisample_targets(framebuffer);
+        }
+        break;
+    case RENDER_COMMAND_CLEAR_GBUFFER:
+        if (!framebuffer->gbuffer) {
+            framebuffer->gbuffer = create_gbuffer(framebuffer->width, framebuffer->height);
+        }
+        if (framebuffer->gbuffer) {
+            clear_gbuffer(framebuffer->gbuffer);
+        }
+        break;
+    case RENDER_COMMAND_LIGHT_GBUFFER:
+        if (framebuffer->gbuffer) {
+            // Lighting pass, once per visible pixel no matter how much overdraw there was
+            LightingScene *lighting = settings->shading == SHADING_UNLIT ? NULL : settings->lighting;
+            // Post processing tone maps the unclamped light instead of the packed color
+            float *hdr = settings->post_process && create_post_process_targets(framebuffer) ? framebuffer->hdr : NULL;
+            light_gbuffer(framebuffer, lighting, frame->mesh->materials, &frame->view_projection, hdr, &frame->arena, settings->jobs);
+        }
+        break;
+    case RENDER_COMMAND_DRAW:
+        // Without the target there is nowhere for these draws to go
+        if ((command->pass == RENDER_PASS_GBUFFER && !framebuffer->gbuffer) || (command->pass == RENDER_PASS_MULTISAMPLE && !framebuffer->sample_color)) {
+            break;
+        }
+        rasterize_submesh_chunks(framebuffer, &command->setup, command->chunk_count, command->kernel, &command->state, settings->jobs);
+        break;
+    }
+}
+
+void record_model_geometry(RenderFrame *frame, Framebuffer *framebuffer, UserCamera *camera, ModelObject *model) {
+    RenderSettings *settings = &frame->settings;
+    ClipVertexCache *vertex_cache = &frame->vertex_cache;
+
+    // Transform every vertex once instead of once per triangle that uses it
+    vertex_cache->vertices = (ClipVertex *)frame_arena_alloc(&frame->arena, model->mesh->vec_count * sizeof(ClipVertex));
+    vertex_cache->outcodes = (uint16_t *)frame_arena_alloc(&frame->arena, model->mesh->vec_count * sizeof(uint16_t));
+    if (!vertex_cache->vertices || !vertex_cache->outcodes) {
+        printf("Could not allocate mem for frame geometry");
         return;
     }
-    render_model_geometry(renderer, camera, model);
+    vertex_cache->count = model->mesh->vec_count;
+    vertex_cache->compact = model->mesh->vec_arr ? NULL : model->mesh->compact;
+
+    // Only pay for uvs when they will be sampled
+    vertex_cache->attribute_count = mesh_uses_textures(settings, model->mesh) ? ATTRIBUTE_UV + ATTRIBUTE_UV_SIZE : ATTRIBUTE_COLOR_SIZE;
+
+    if (settings->mode == RENDER_MODE_FILLED) {
+        frame->bins = prepare_raster_bins(frame->bins, framebuffer->width, framebuffer->height, model->mesh->num_triangles, vertex_cache->attribute_count);
+        if (!frame->bins) {
+            return;
+        }
+    }
+
+    // Whole meshlets out of view or facing away never have their vertices transformed
+    unsigned char *vertex_mask;
+    frame->meshlet_visible = cull_mesh_meshlets(camera, model->mesh, &frame->arena, &vertex_mask);
+    vertex_cache->vertex_mask = vertex_mask;
+
+    transform_mesh_vertices(camera, model->mesh, vertex_cache, settings->jobs);
+    frame->visible = 1;
+
+    if (settings->mode == RENDER_MODE_FILLED && settings->deferred) {
+        record_model_deferred(frame, camera, model->mesh);
+    } else if (settings->mode == RENDER_MODE_FILLED && settings->multisample) {
+        shade_mesh_vertices(settings, model->mesh, vertex_cache, &frame->arena);
+        push_render_command(frame, RENDER_COMMAND_CLEAR_SAMPLES);
+        bin_model_triangles(frame, RENDER_PASS_MULTISAMPLE);
+        push_render_command(frame, RENDER_COMMAND_RESOLVE_SAMPLES);
+    } else if (settings->mode == RENDER_MODE_FILLED) {
+        shade_mesh_vertices(settings, model->mesh, vertex_cache, &frame->arena);
+        bin_model_triangles(frame, RENDER_PASS_FORWARD);
+    }
+}
+
+int mesh_uses_textures(RenderSettings *settings, Mesh *mesh) {
+    if (!settings->textured || !(mesh->uv_arr || (mesh->compact && mesh->compact->uvs)) || !mesh->materials) {
+        return 0;
+    }
+
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        if (mesh->materials->materials[mesh->submeshes[i].material].diffuse_texture) {
+            return 1;
+        }
+    }
+
+    return 0;
 }
 
-void render_model_geometry(SDL_Renderer *renderer, UserCamera *camera, ModelObject *model) {
-    VecConnectionsPoints *triangle = model->mesh->head;
+void record_model_deferred(RenderFrame *frame, UserCamera *camera, Mesh *mesh) {
+    RenderSettings *settings = &frame->settings;
 
-    int max_vertices = model->mesh->num_triangles * 27;
-    iVec2 *batch_triangles = (iVec2 *)calloc(max_vertices, sizeof(iVec2));
+    // Geometry pass, the vertex colors carry normals and nothing is lit yet
+    push_render_command(frame, RENDER_COMMAND_CLEAR_GBUFFER);
+    encode_mesh_vertex_normals(mesh, &frame->vertex_cache);
+    bin_model_triangles(frame, RENDER_PASS_GBUFFER);
 
-    int triangle_idx = 0;
+    // Lighting reconstructs positions with this frame's camera, not whatever it is by then
+    fMatrix44 *view_projection_mat = mult_fmatrix44(camera->camera_mat, camera->projection_mat);
+    if (view_projection_mat) {
+        frame->view_projection = *view_projection_mat;
+        free(view_projection_mat);
+        push_render_command(frame, RENDER_COMMAND_LIGHT_GBUFFER);
+    }
 
-    while (triangle != NULL) {
-        render_triangle_3d(renderer, camera, triangle, batch_triangles, &triangle_idx);
-        triangle = triangle->next;
+    // See-through submeshes cannot live in a G-buffer, they are sorted last and
+    // blend over the lit result the forward way
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        float opacity;
+        Material *material = &mesh->materials->materials[mesh->submeshes[i].material];
+        if (resolve_material_blend(settings, material, &opacity) != RASTER_BLEND_OPAQUE) {
+            shade_mesh_vertices(settings, mesh, &frame->vertex_cache, &frame->arena);
+            bin_model_triangles(frame, RENDER_PASS_TRANSPARENT);
+            break;
+        }
     }
+}
 
-    SDL_SetRenderDrawColor(renderer, 0, 255, 255, 255);
+RasterBlend resolve_material_blend(RenderSettings *settings, Material *material, float *opacity) {
+    // See-through materials blend even when the model as a whole does not
+    *opacity = material->opacity;
+    if (settings->blend == RASTER_BLEND_ALPHA) {
+        *opacity *= settings->opacity;
+    }
 
-    batch_draw_triangles(renderer, triangle_idx, batch_triangles);
-    free(batch_triangles);
+    return material->opacity < 1.0f ? RASTER_BLEND_ALPHA : settings->blend;
 }
 
-void render_triangle_3d(SDL_Renderer *renderer, UserCamera *camera, VecConnectionsPoints *triangle_data, iVec2 *batch_triangles, int *triangle_idx) {
-    ClipVertex clip_triangle[3];
+void bin_model_triangles(RenderFrame *frame, RenderPass pass) {
+    RenderSettings *settings = &frame->settings;
+    Mesh *mesh = frame->mesh;
+    ClipVertexCache *vertex_cache = &frame->vertex_cache;
+    RasterBins *bins = frame->bins;
 
-    // Convert triangle point from model to clip space
-    for (int i = 0; i < 3; i++) {
-        fVec4 *camera_space = create_fvec4(0, 0, 0, 0);
-        multiply_fvec4_matrix44(triangle_data->triangle_points[i], camera_space, camera->camera_mat);
-        multiply_fvec4_matrix44(camera_space, &clip_triangle[i].position, camera->projection_mat);
-        free(camera_space);
+    // Flat shading lights every face up front (or hands the G-buffer its normal), NULL otherwise
+    float *face_colors = pass == RENDER_PASS_GBUFFER ? encode_mesh_face_normals(settings, mesh, &frame->arena) : shade_mesh_faces(settings, mesh, &frame->arena);
+
+    TriangleChunkJob chunk_job;
+    chunk_job.mesh = mesh;
+    chunk_job.vertex_cache = vertex_cache;
+    chunk_job.bins = bins;
+    chunk_job.face_colors = face_colors;
+    chunk_job.viewport_width = bins->width;
+    chunk_job.viewport_height = bins->height;
+    chunk_job.multisample = pass == RENDER_PASS_MULTISAMPLE;
+    chunk_job.depth_only = 0;
+    chunk_job.meshlet_visible = frame->meshlet_visible;
+
+    // Submeshes are already in pipeline state order, so texture and kernel
+    // change once per material and never inside one
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        MeshSubmesh *submesh = &mesh->submeshes[i];
+        Material *material = &mesh->materials->materials[submesh->material];
+
+        float opacity;
+        RasterBlend blend = resolve_material_blend(settings, material, &opacity);
+        if ((pass == RENDER_PASS_GBUFFER && blend != RASTER_BLEND_OPAQUE) || (pass == RENDER_PASS_TRANSPARENT && blend == RASTER_BLEND_OPAQUE)) {
+            continue;
+        }
+
+        Texture *texture = vertex_cache->attribute_count > ATTRIBUTE_UV ? material->diffuse_texture : NULL;
+        chunk_job.attribute_count = texture ? vertex_cache->attribute_count : ATTRIBUTE_COLOR_SIZE;
+        // The G-buffer keeps the material id, its color is applied when lighting
+        for (int c = 0; c < 3; c++) {
+            chunk_job.diffuse[c] = pass == RENDER_PASS_GBUFFER ? 1.0f : material->diffuse[c];
+        }
+
+        int chunk_count = bin_submesh_triangles(&chunk_job, submesh, settings->jobs);
+        if (chunk_count == 0) {
+            continue;
+        }
+
+        RenderCommand *command = push_render_command(frame, RENDER_COMMAND_DRAW);
+        if (!command) {
+            continue;
+        }
+
+        // One specialized kernel for the whole submesh instead of branching per pixel
+        RasterShade shade = settings->shading == SHADING_GOURAUD ? RASTER_SHADE_INTERPOLATED : RASTER_SHADE_FLAT;
+        if (texture) {
+            shade = RASTER_SHADE_TEXTURED;
+        }
+        if (pass == RENDER_PASS_GBUFFER) {
+            shade = RASTER_SHADE_GBUFFER;
+        }
+
+        command->pass = pass;
+        command->first_chunk = chunk_job.first_chunk;
+        command->chunk_count = chunk_count;
+        command->kernel = select_raster_kernel(settings->depth_test, shade, blend, chunk_job.multisample);
+        command->state.alpha = (uint32_t)(opacity * 256.0f + 0.5f);
+        command->state.texture = texture;
+        command->state.material = (uint16_t)submesh->material;
+        command->setup = chunk_job;
     }
+}
 
-    ClipVertexList clipped_vertices;
-    if (!clip_triangle_3d(clip_triangle, &clipped_vertices)) {
+int bin_submesh_triangles(TriangleChunkJob *job, MeshSubmesh *submesh, JobSystem *jobs) {
+    RasterBins *bins = job->bins;
+    int chunk_triangles = bins->chunk_triangles;
+
+    // Every meshlet culled, nothing of the submesh is walked or binned
+    job->first_meshlet = submesh->first_meshlet;
+    if (job->meshlet_visible && submesh->meshlet_count > 0) {
+        int visible = 0;
+        for (int m = 0; m < submesh->meshlet_count && !visible; m++) {
+            visible = job->meshlet_visible[submesh->first_meshlet + m];
+        }
+        if (!visible) {
+            return 0;
+        }
+    }
+
+    // Appended after the chunks of earlier draws, which are still waiting to be drawn
+    int max_chunks = (submesh->triangle_count + chunk_triangles - 1) / chunk_triangles;
+    if (max_chunks == 0 || !reserve_raster_chunks(bins, bins->chunk_count + max_chunks)) {
+        return 0;
+    }
+
+    // The list is only walked once here, each chunk then runs from its own first triangle
+    RasterChunk *chunks = &bins->chunks[bins->chunk_count];
+    int count = 0;
+    VecConnectionsPoints *triangle = submesh->head;
+    for (; count < submesh->triangle_count && triangle != NULL; count++, triangle = triangle->next) {
+        if (count % chunk_triangles == 0) {
+            RasterChunk *chunk = &chunks[count / chunk_triangles];
+            chunk->segments = NULL;
+            chunk->triangle = triangle;
+            chunk->next = count;
+            chunk->end = count + chunk_triangles;
+        }
+    }
+
+    int chunk_count = (count + chunk_triangles - 1) / chunk_triangles;
+    if (chunk_count == 0) {
+        return 0;
+    }
+    chunks[chunk_count - 1].end = count;
+
+    job->first_triangle = submesh->first_triangle;
+    job->triangle_count = count;
+    job->first_chunk = bins->chunk_count;
+    job->force_chunk = -1;
+    bins->chunk_count += chunk_count;
+
+    parallel_for(jobs, chunk_count, 1, setup_triangle_chunks, job);
+
+    return chunk_count;
+}
+
+void setup_triangle_chunks(void *arg, int first_chunk, int last_chunk) {
+    TriangleChunkJob *job = (TriangleChunkJob *)arg;
+    RasterBins *bins = job->bins;
+    ClipVertexCache *vertex_cache = job->vertex_cache;
+
+    TriangleSetupBatch setup_batch;
+    setup_batch.count = 0;
+    setup_batch.attribute_count = job->attribute_count;
+    setup_batch.viewport_width = job->viewport_width;
+    setup_batch.viewport_height = job->viewport_height;
+    setup_batch.multisample = job->multisample;
+
+    for (int c = first_chunk; c < last_chunk; c++) {
+        RasterChunk *chunk = &bins->chunks[job->first_chunk + c];
+        if (chunk->next >= chunk->end) {
+            continue;
+        }
+
+        int force = job->first_chunk + c == job->force_chunk;
+        RasterSegment *segment = NULL;
+        // Where the next segment gets linked into the chunk, after any it still holds
+        RasterSegment **tail = &chunk->segments;
+        while (*tail) {
+            tail = &(*tail)->next;
+        }
+
+        VecConnectionsPoints *triangle = chunk->triangle;
+        int j = chunk->next;
+        for (; j < chunk->end && triangle != NULL; j++, triangle = triangle->next) {
+            if (job->meshlet_visible && !job->meshlet_visible[job->first_meshlet + j / MESHLET_TRIANGLES]) {
+                continue;
+            }
+
+            // A full segment is binned as it is and the chunk goes on in a fresh one
+            if (!segment || raster_queue_full(segment->queue)) {
+                if (segment) {
+                    flush_triangle_setup_batch(&setup_batch, segment->queue);
+                    bin_raster_segment(bins, segment);
+                    tail = &segment->next;
+                }
+
+                // Out of segments, the back end sets up the rest once it has drawn what came before
+                segment = take_raster_segment(bins, force);
+                if (!segment) {
+                    break;
+                }
+                *tail = segment;
+            }
+
+            if (!job->depth_only) {
+                const float *face_color = job->face_colors ? &job->face_colors[(job->first_triangle + j) * 3] : NULL;
+                render_triangle_3d(job->mesh, triangle, vertex_cache, face_color, job->diffuse, &setup_batch, segment->queue);
+                continue;
+            }
+
+            ClipVertex clip_triangle[3];
+            uint16_t outcodes[3];
+
+            for (int k = 0; k < 3; k++) {
+                int vertex_idx = triangle->vertices[k];
+                clip_triangle[k].position = vertex_cache->vertices[vertex_idx].position;
+                outcodes[k] = vertex_cache->outcodes[vertex_idx];
+            }
+
+            submit_clip_triangle(clip_triangle, outcodes, 0, &setup_batch, segment->queue);
+        }
+
+        // A list that ends early ends the chunk too
+        chunk->triangle = triangle;
+        chunk->next = triangle ? j : chunk->end;
+
+        if (!segment) {
+            continue;
+        }
+
+        // Every chunk drains its own batch, nothing carries over into the next queue
+        flush_triangle_setup_batch(&setup_batch, segment->queue);
+
+        // Culled away entirely, another chunk can fill it
+        if (segment->queue->count == 0 && segment->queue->pixel_count == 0) {
+            *tail = NULL;
+            release_raster_segment(bins, segment);
+        } else {
+            bin_raster_segment(bins, segment);
+        }
+    }
+}
+
+void rasterize_submesh_chunks(Framebuffer *framebuffer, TriangleChunkJob *job, int chunk_count, const RasterKernel *kernel, const RasterState *state, JobSystem *jobs) {
+    RasterBins *bins = job->bins;
+    int last_chunk = job->first_chunk + chunk_count;
+
+    for (int first = job->first_chunk; first < last_chunk;) {
+        // Finished chunks in order, then whatever the first unfinished one has so far
+        int stalled = first;
+        while (stalled < last_chunk && bins->chunks[stalled].next >= bins->chunks[stalled].end) {
+            stalled++;
+        }
+
+        int drawn = stalled < last_chunk ? stalled + 1 : last_chunk;
+        rasterize_raster_bins(framebuffer, bins, first, drawn - first, kernel, state, jobs);
+        if (stalled == last_chunk) {
+            break;
+        }
+
+        // Their segments set up the rest, the stalled chunk may take more than the
+        // budget so it always finishes and draw order within a tile holds
+        release_raster_chunks(bins, first, drawn);
+        job->force_chunk = stalled;
+        parallel_for(jobs, chunk_count, 1, setup_triangle_chunks, job);
+        first = stalled;
+    }
+}
+
+void copy_frame_lighting(RenderFrame *frame, LightingScene *lighting) {
+    if (!lighting) {
+        return;
+    }
+
+    // The scene's owner edits its lights between frames, and other views point
+    // them at their own shadow maps, so the back end only ever reads this copy
+    Light *lights = (Light *)frame_arena_alloc(&frame->arena, (lighting->light_count ? lighting->light_count : 1) * sizeof(Light));
+    if (!lights) {
+        printf("Could not allocate mem for frame lights");
+        return;
+    }
+
+    for (int i = 0; i < lighting->light_count; i++) {
+        lights[i] = lighting->lights[i];
+        lights[i].shadow = NULL;
+    }
+
+    frame->lighting = *lighting;
+    frame->lighting.lights = lights;
+    frame->lighting.light_capacity = lighting->light_count;
+    frame->settings.lighting = &frame->lighting;
+}
+
+void update_shadow_maps(RenderSettings *settings, ShadowMapSet *shadow_maps, ModelObject *model, JobCounter *in_flight, FrameArena *arena) {
+    LightingScene *lighting = settings->lighting;
+    if (!lighting || !shadow_maps) {
+        return;
+    }
+
+    for (int i = 0; i < lighting->light_count; i++) {
+        Light *light = &lighting->lights[i];
+        if (light->shadow_size == 0) {
+            continue;
+        }
+
+        ShadowMap *map = find_view_shadow_map(shadow_maps, i, light->shadow_size);
+        if (!map) {
+            continue;
+        }
+        light->shadow = map;
+
+        // Unlit frames never sample, so there is nothing to keep up to date
+        int enabled = settings->shadows && settings->shading != SHADING_UNLIT;
+        int stale = enabled && is_shadow_map_stale(map, light, model);
+
+        // The frame still being drawn samples the map, it has to finish lighting first
+        if (in_flight && (stale || enabled != map->enabled)) {
+            wait_for_counter(settings->jobs, in_flight);
+        }
+
+        if (enabled != map->enabled) {
+            map->enabled = enabled;
+        }
+
+        // Casters and light both still, last frame's depth is still right
+        if (enabled && !stale) {
+            record_shadow_map_stats(0, 0);
+        } else if (stale) {
+            uint64_t start_time = SDL_GetTicksNS();
+            if (fit_shadow_camera(map, light, model->mesh)) {
+                render_shadow_map(map, model->mesh, settings->jobs, arena);
+                mark_shadow_map_rendered(map, light, model);
+            }
+            record_shadow_map_stats(1, SDL_GetTicksNS() - start_time);
+        }
+    }
+}
+
+void render_shadow_map(ShadowMap *map, Mesh *mesh, JobSystem *jobs, FrameArena *arena) {
+    // Positions only, nothing past 1/w gets a plane
+    ClipVertexCache vertex_cache;
+    vertex_cache.count = mesh->vec_count;
+    vertex_cache.attribute_count = 0;
+    vertex_cache.vertex_mask = NULL;
+    vertex_cache.compact = mesh->vec_arr ? NULL : mesh->compact;
+    vertex_cache.vertices = (ClipVertex *)frame_arena_alloc(arena, vertex_cache.count * sizeof(ClipVertex));
+    vertex_cache.outcodes = (uint16_t *)frame_arena_alloc(arena, vertex_cache.count * sizeof(uint16_t));
+
+    // The map keeps its chunks, a light that moves every frame stops reallocating them
+    map->bins = prepare_raster_bins(map->bins, map->size, map->size, mesh->num_triangles, 0);
+    RasterBins *bins = map->bins;
+
+    if (!vertex_cache.vertices || !vertex_cache.outcodes || !bins) {
+        printf("Could not allocate mem for shadow map geometry");
+        return;
+    }
+
+    transform_mesh_vertices(map->light_camera, mesh, &vertex_cache, jobs);
+    clear_framebuffer(map->depth_map, 0);
+
+    TriangleChunkJob chunk_job;
+    chunk_job.mesh = mesh;
+    chunk_job.vertex_cache = &vertex_cache;
+    chunk_job.bins = bins;
+    chunk_job.face_colors = NULL;
+    chunk_job.diffuse[0] = 0.0f;
+    chunk_job.diffuse[1] = 0.0f;
+    chunk_job.diffuse[2] = 0.0f;
+    chunk_job.attribute_count = 0;
+    chunk_job.viewport_width = map->size;
+    chunk_job.viewport_height = map->size;
+    chunk_job.multisample = 0;
+    chunk_job.depth_only = 1;
+    chunk_job.meshlet_visible = NULL;
+
+    RasterState raster_state;
+    raster_state.alpha = 256;
+    raster_state.texture = NULL;
+    raster_state.material = 0;
+    const RasterKernel *kernel = select_raster_kernel(1, RASTER_SHADE_DEPTH, RASTER_BLEND_OPAQUE, 0);
+
+    // See-through materials let the light pass, everything else casts
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        MeshSubmesh *submesh = &mesh->submeshes[i];
+        if (mesh->materials->materials[submesh->material].opacity < 1.0f) {
+            continue;
+        }
+
+        // Drawn right away, so every submesh reuses the same segments
+        reset_raster_bins(bins);
+        int chunk_count = bin_submesh_triangles(&chunk_job, submesh, jobs);
+        if (chunk_count > 0) {
+            rasterize_submesh_chunks(map->depth_map, &chunk_job, chunk_count, kernel, &raster_state, jobs);
+        }
+    }
+}
+
+void shade_mesh_vertices(RenderSettings *settings, Mesh *mesh, ClipVertexCache *vertex_cache, FrameArena *arena) {
+    // Vertices of culled meshlets were never transformed and no face drawn uses them
+    const unsigned char *mask = vertex_cache->vertex_mask;
+
+    if (settings->shading != SHADING_GOURAUD || !settings->lighting || !(mesh->normal_arr || vertex_cache->compact)) {
+        // Unlit and flat leave the vertices white, flat swaps in the face color later
+        for (int i = 0; i < vertex_cache->count; i++) {
+            if (mask && !mask[i]) {
+                continue;
+            }
+            float *color = &vertex_cache->vertices[i].attributes[ATTRIBUTE_COLOR];
+            color[0] = 1.0f;
+            color[1] = 1.0f;
+            color[2] = 1.0f;
+        }
+        return;
+    }
+
+    float *colors = (float *)frame_arena_alloc(arena, vertex_cache->count * 3 * sizeof(float));
+    if (!colors) {
+        printf("Could not allocate mem for vertex colors");
         return;
     }
 
-    // Convert clipped vertices to screen space
-    iVec2 screen_points[NUM_CLIP_TRIANLGE_VERTEX];
-    int valid_screen_points = 0;
+    // Light every unique vertex once, the rasterizer interpolates between them
+    float *red = colors;
+    float *green = colors + vertex_cache->count;
+    float *blue = colors + vertex_cache->count * 2;
+    if (vertex_cache->compact) {
+        light_compact_vertices(settings->lighting, vertex_cache->compact, mask, red, green, blue, settings->jobs);
+    } else {
+        light_points_parallel(settings->lighting, mesh->vec_arr, mesh->normal_arr, mask, vertex_cache->count, red, green, blue, settings->jobs);
+    }
+
+    for (int i = 0; i < vertex_cache->count; i++) {
+        if (mask && !mask[i]) {
+            continue;
+        }
+        float *color = &vertex_cache->vertices[i].attributes[ATTRIBUTE_COLOR];
+        color[0] = red[i];
+        color[1] = green[i];
+        color[2] = blue[i];
+    }
+}
+
+float *shade_mesh_faces(RenderSettings *settings, Mesh *mesh, FrameArena *arena) {
+    if (settings->shading != SHADING_FLAT || !settings->lighting || mesh->num_triangles == 0) {
+        return NULL;
+    }
+
+    int count = mesh->num_triangles;
+    fVec4 *centroids = (fVec4 *)frame_arena_alloc(arena, count * sizeof(fVec4));
+    fVec4 *normals = (fVec4 *)frame_arena_alloc(arena, count * sizeof(fVec4));
+    float *channels = (float *)frame_arena_alloc(arena, count * 3 * sizeof(float));
+    float *face_colors = (float *)frame_arena_alloc(arena, count * 3 * sizeof(float));
+
+    if (!centroids || !normals || !channels || !face_colors) {
+        printf("Could not allocate mem for face colors");
+        return NULL;
+    }
+
+    // Gather faces into flat arrays so the lighting loop runs over them in one go,
+    // a face sits at its submesh's first_triangle plus its place in the run
+    for (int s = 0; s < mesh->submesh_count; s++) {
+        MeshSubmesh *submesh = &mesh->submeshes[s];
+        VecConnectionsPoints *triangle = submesh->head;
+        for (int j = 0; j < submesh->triangle_count && triangle != NULL; j++, triangle = triangle->next) {
+            int i = submesh->first_triangle + j;
+            fVec4 decoded[NUM_TRIANGLE_VERTEX];
+            fVec4 *points[NUM_TRIANGLE_VERTEX];
+            for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+                points[k] = read_mesh_position(mesh, triangle->vertices[k], &decoded[k]);
+            }
+            centroids[i].x = (points[0]->x + points[1]->x + points[2]->x) * (1.0f / 3.0f);
+            centroids[i].y = (points[0]->y + points[1]->y + points[2]->y) * (1.0f / 3.0f);
+            centroids[i].z = (points[0]->z + points[1]->z + points[2]->z) * (1.0f / 3.0f);
+            centroids[i].w = 1.0f;
+            normals[i] = *triangle->surface_normal;
+        }
+    }
+
+    float *red = channels;
+    float *green = channels + count;
+    float *blue = channels + count * 2;
+    light_points_parallel(settings->lighting, centroids, normals, NULL, count, red, green, blue, settings->jobs);
 
-    for (int i = 0; i < clipped_vertices.count; i++) {
-        if (clip_to_screen(&clipped_vertices.vertices[i], &screen_points[valid_screen_points])) {
-            valid_screen_points++;
+    for (int j = 0; j < count; j++) {
+        face_colors[j * 3] = red[j];
+        face_colors[j * 3 + 1] = green[j];
+        face_colors[j * 3 + 2] = blue[j];
+    }
+
+    return face_colors;
+}
+
+void encode_mesh_vertex_normals(Mesh *mesh, ClipVertexCache *vertex_cache) {
+    // Remapped to 0 - 1 so they survive the color path, micro triangles included.
+    // Culled meshlets' vertices are left alone like in the transform
+    fVec4 decoded;
+    for (int i = 0; i < vertex_cache->count; i++) {
+        if (vertex_cache->vertex_mask && !vertex_cache->vertex_mask[i]) {
+            continue;
+        }
+        float *color = &vertex_cache->vertices[i].attributes[ATTRIBUTE_COLOR];
+        fVec4 *normal = read_mesh_normal(mesh, i, &decoded);
+        color[0] = normal ? normal->x * 0.5f + 0.5f : 0.5f;
+        color[1] = normal ? normal->y * 0.5f + 0.5f : 0.5f;
+        color[2] = normal ? normal->z * 0.5f + 0.5f : 1.0f;
+    }
+}
+
+float *encode_mesh_face_normals(RenderSettings *settings, Mesh *mesh, FrameArena *arena) {
+    if (settings->shading != SHADING_FLAT || mesh->num_triangles == 0) {
+        return NULL;
+    }
+
+    float *face_normals = (float *)frame_arena_alloc(arena, mesh->num_triangles * 3 * sizeof(float));
+    if (!face_normals) {
+        printf("Could not allocate mem for face normals");
+        return NULL;
+    }
+
+    for (int s = 0; s < mesh->submesh_count; s++) {
+        MeshSubmesh *submesh = &mesh->submeshes[s];
+        VecConnectionsPoints *triangle = submesh->head;
+        for (int j = 0; j < submesh->triangle_count && triangle != NULL; j++, triangle = triangle->next) {
+            int i = submesh->first_triangle + j;
+            face_normals[i * 3] = triangle->surface_normal->x * 0.5f + 0.5f;
+            face_normals[i * 3 + 1] = triangle->surface_normal->y * 0.5f + 0.5f;
+            face_normals[i * 3 + 2] = triangle->surface_normal->z * 0.5f + 0.5f;
+        }
+    }
+
+    return face_normals;
+}
+
+void transform_mesh_vertices(UserCamera *camera, Mesh *mesh, ClipVertexCache *vertex_cache, JobSystem *jobs) {
+    fMatrix44 *view_projection_mat = mult_fmatrix44(camera->camera_mat, camera->projection_mat);
+
+    VertexTransformJob job;
+    job.mesh = mesh;
+    job.vertex_cache = vertex_cache;
+    job.view_projection = view_projection_mat;
+    if (vertex_cache->compact && view_projection_mat) {
+        build_compact_projection(vertex_cache->compact, view_projection_mat, &job.decode_projection);
+    }
+    parallel_for(jobs, vertex_cache->count, VERTEX_TRANSFORM_GRAIN, transform_vertex_range, &job);
+
+    free(view_projection_mat);
+}
+
+void transform_vertex_range(void *arg, int start, int end) {
+    VertexTransformJob *job = (VertexTransformJob *)arg;
+    ClipVertexCache *vertex_cache = job->vertex_cache;
+
+    for (int i = start; i < end; i++) {
+        if (vertex_cache->vertex_mask && !vertex_cache->vertex_mask[i]) {
+            continue;
+        }
+
+        // Steps go through the folded matrix as they are, 8 bytes read instead of 16
+        if (vertex_cache->compact) {
+            const uint16_t *steps = vertex_cache->compact->vertices[i].position;
+            fVec4 point = {steps[0], steps[1], steps[2], 1.0f};
+            multiply_fvec4_matrix44(&point, &vertex_cache->vertices[i].position, &job->decode_projection);
+            vertex_cache->outcodes[i] = compute_clip_outcode(&vertex_cache->vertices[i].position);
+            continue;
+        }
+
+        multiply_fvec4_matrix44(&job->mesh->vec_arr[i], &vertex_cache->vertices[i].position, job->view_projection);
+        vertex_cache->outcodes[i] = compute_clip_outcode(&vertex_cache->vertices[i].position);
+    }
+}
+
+void render_triangle_3d(Mesh *mesh, VecConnectionsPoints *triangle_data, ClipVertexCache *vertex_cache, const float *face_color,
+                        const float *diffuse, TriangleSetupBatch *setup_batch, RasterQueue *raster_queue) {
+    ClipVertex clip_triangle[3];
+    uint16_t outcodes[3];
+
+    // Look up the already transformed clip space points
+    for (int i = 0; i < 3; i++) {
+        int vertex_idx = triangle_data->vertices[i];
+        clip_triangle[i] = vertex_cache->vertices[vertex_idx];
+        outcodes[i] = vertex_cache->outcodes[vertex_idx];
+
+        // Light times the material's diffuse color
+        float *color = &clip_triangle[i].attributes[ATTRIBUTE_COLOR];
+        const float *light = face_color ? face_color : color;
+        color[0] = light[0] * diffuse[0];
+        color[1] = light[1] * diffuse[1];
+        color[2] = light[2] * diffuse[2];
+
+        // Uvs belong to the corner, not the shared vertex
+        if (vertex_cache->attribute_count > ATTRIBUTE_UV) {
+            int uv = triangle_data->uvs[i];
+            float *attributes = &clip_triangle[i].attributes[ATTRIBUTE_UV];
+            if (uv >= 0 && vertex_cache->compact && vertex_cache->compact->uvs) {
+                decode_compact_uv(vertex_cache->compact, uv, &attributes[0], &attributes[1]);
+            } else {
+                attributes[0] = uv >= 0 && mesh->uv_arr ? mesh->uv_arr[uv].x : 0.0f;
+                attributes[1] = uv >= 0 && mesh->uv_arr ? mesh->uv_arr[uv].y : 0.0f;
+            }
         }
     }
 
-    if (valid_screen_points < 3) {
+    submit_clip_triangle(clip_triangle, outcodes, vertex_cache->attribute_count, setup_batch, raster_queue);
+}
+
+void submit_clip_triangle(ClipVertex clip_triangle[3], uint16_t outcodes[3], int attribute_count, TriangleSetupBatch *setup_batch, RasterQueue *raster_queue) {
+    // Trivial reject when every vertex is outside the same plane
+    if (outcodes[0] & outcodes[1] & outcodes[2]) {
         return;
     }
 
-    // Check backface culling on only first triangle
-    if (!is_front_facing(screen_points)) {
+    // Trivial accept unless a vertex crosses near/far or leaves the guard band,
+    // anything else off screen is left to the rasterizer's scissor
+    uint16_t clip_planes = (outcodes[0] | outcodes[1] | outcodes[2]) & OUTCODE_CLIP_MASK;
+
+    if (!clip_planes) {
+        push_setup_triangle(setup_batch, raster_queue, &clip_triangle[0], &clip_triangle[1], &clip_triangle[2]);
         return;
     }
 
-    // Triangulate the clipped polygon (fan triangulation)
-    for (int i = 2; i < valid_screen_points; i++) {
-        int new_idx_base = *triangle_idx * 3;
-        batch_triangles[new_idx_base + 0] = screen_points[0];
-        batch_triangles[new_idx_base + 1] = screen_points[i - 1];
-        batch_triangles[new_idx_base + 2] = screen_points[i];
+    ClipVertexList clipped_vertices;
+    if (!clip_triangle_3d(clip_triangle, clip_planes, attribute_count, &clipped_vertices)) {
+        return;
+    }
 
-        render_normal_vector(renderer, camera, triangle_data, batch_triangles);
-        (*triangle_idx)++;
+    // Triangulate the clipped polygon (fan triangulation), setup culls each piece
+    for (int i = 2; i < clipped_vertices.count; i++) {
+        push_setup_triangle(setup_batch, raster_queue,
+                            &clipped_vertices.vertices[0],
+                            &clipped_vertices.vertices[i - 1],
+                            &clipped_vertices.vertices[i]);
     }
 }
 
@@ -154,49 +909,97 @@ int determine_winding_order(iVec2 *arr) {
 
 // CLIPPING PIPELINE //
 
-ClipVertex interpolate_clip_vertex(const ClipVertex *v1, const ClipVertex *v2, float t) {
+ClipVertex interpolate_clip_vertex(const ClipVertex *v1, const ClipVertex *v2, float t, int attribute_count) {
     ClipVertex result;
     result.position.x = v1->position.x + t * (v2->position.x - v1->position.x);
     result.position.y = v1->position.y + t * (v2->position.y - v1->position.y);
     result.position.z = v1->position.z + t * (v2->position.z - v1->position.z);
     result.position.w = v1->position.w + t * (v2->position.w - v1->position.w);
+
+    // Clip space is still linear, so attributes lerp with the same t
+    for (int i = 0; i < attribute_count; i++) {
+        result.attributes[i] = v1->attributes[i] + t * (v2->attributes[i] - v1->attributes[i]);
+    }
     return result;
 }
 
-int clip_triangle_3d(ClipVertex triangle[3], ClipVertexList *clipped_output) {
-    ClipVertexList input;
+uint16_t compute_clip_outcode(const fVec4 *position) {
+    uint16_t outcode = 0;
+    float guard_w = GUARD_BAND_SCALE * position->w;
+
+    if (position->x < -position->w)
+        outcode |= OUTCODE_LEFT;
+    if (position->x > position->w)
+        outcode |= OUTCODE_RIGHT;
+    if (position->y < -position->w)
+        outcode |= OUTCODE_BOTTOM;
+    if (position->y > position->w)
+        outcode |= OUTCODE_TOP;
+    if (position->z < -position->w)
+        outcode |= OUTCODE_NEAR;
+    if (position->z > position->w)
+        outcode |= OUTCODE_FAR;
+
+    if (position->x < -guard_w)
+        outcode |= OUTCODE_GUARD_LEFT;
+    if (position->x > guard_w)
+        outcode |= OUTCODE_GUARD_RIGHT;
+    if (position->y < -guard_w)
+        outcode |= OUTCODE_GUARD_BOTTOM;
+    if (position->y > guard_w)
+        outcode |= OUTCODE_GUARD_TOP;
+
+    return outcode;
+}
+
+int clip_triangle_3d(ClipVertex triangle[3], uint16_t clip_planes, int attribute_count, ClipVertexList *clipped_output) {
     ClipVertexList temp;
 
+    // x/y planes sit on the guard band, the rasterizer scissors the rest
     float plane_boundaries[6][4] = {{0, 0, 1, 1},
                                     {0, 0, -1, 1},
-                                    {1, 0, 0, 1},
-                                    {-1, 0, 0, 1},
-                                    {0, 1, 0, 1},
-                                    {0, -1, 0, 1}};
+                                    {1, 0, 0, GUARD_BAND_SCALE},
+                                    {-1, 0, 0, GUARD_BAND_SCALE},
+                                    {0, 1, 0, GUARD_BAND_SCALE},
+                                    {0, -1, 0, GUARD_BAND_SCALE}};
+    uint16_t plane_outcodes[6] = {OUTCODE_NEAR, OUTCODE_FAR,
+                                  OUTCODE_GUARD_LEFT, OUTCODE_GUARD_RIGHT,
+                                  OUTCODE_GUARD_BOTTOM, OUTCODE_GUARD_TOP};
 
     // Initialize input with the triangle
-    input.count = NUM_TRIANGLE_VERTEX;
+    clipped_output->count = NUM_TRIANGLE_VERTEX;
+    clipped_output->attribute_count = attribute_count;
     for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
-        input.vertices[i] = triangle[i];
+        clipped_output->vertices[i] = triangle[i];
     }
 
-    for (int i = 0; i < NUM_FRUSTUM_PLANES; i++) {
-        clip_against_plane(&input, &temp, plane_boundaries[i]);
-        if (i < NUM_FRUSTUM_PLANES - 1) {
+    // Ping-pong between the two lists, only visiting planes a vertex crossed
+    ClipVertexList *input = clipped_output;
+    ClipVertexList *output = &temp;
 
-            input = temp;
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; i++) {
+        if (!(clip_planes & plane_outcodes[i])) {
+            continue;
+        }
 
-            if (input.count == 0) {
-                return 0;
-            }
+        clip_against_plane(input, output, plane_boundaries[i]);
+        if (output->count == 0) {
+            return 0;
         }
+
+        ClipVertexList *swap_list = input;
+        input = output;
+        output = swap_list;
+    }
+
+    if (input != clipped_output) {
+        *clipped_output = *input;
     }
-    *clipped_output = temp;
 
     return clipped_output->count >= NUM_TRIANGLE_VERTEX;
 }
 
-int clip_to_screen(const ClipVertex *clip_vertex, iVec2 *screen_point) {
+int clip_to_screen(const ClipVertex *clip_vertex, iVec2 *screen_point, int width, int height) {
     // Check for valid w component
     if (clip_vertex->position.w <= 0) {
         return 0;
@@ -207,14 +1010,15 @@ int clip_to_screen(const ClipVertex *clip_vertex, iVec2 *screen_point) {
     float ndc_y = clip_vertex->position.y / clip_vertex->position.w;
 
     // Convert to screen coordinates
-    screen_point->x = (int)((ndc_x + 1.0f) * 0.5f * SCREEN_WIDTH);
-    screen_point->y = (int)((1.0f - (ndc_y + 1.0f) * 0.5f) * SCREEN_HEIGHT);
+    screen_point->x = (int)((ndc_x + 1.0f) * 0.5f * width);
+    screen_point->y = (int)((1.0f - (ndc_y + 1.0f) * 0.5f) * height);
 
     return 1;
 }
 
 void clip_against_plane(ClipVertexList *input, ClipVertexList *output, float boundary[4]) {
     output->count = 0;
+    output->attribute_count = input->attribute_count;
 
     if (input->count == 0)
         return;
@@ -232,14 +1036,14 @@ void clip_against_plane(ClipVertexList *input, ClipVertexList *output, float bou
             output->count++;
         } else if (curr_distance >= 0 && prev_distance < 0) {
             float percentage_distance = prev_distance / (prev_distance - curr_distance);
-            output->vertices[output->count] = interpolate_clip_vertex(prev_vertex, curr_vertex, percentage_distance);
+            output->vertices[output->count] = interpolate_clip_vertex(prev_vertex, curr_vertex, percentage_distance, input->attribute_count);
             output->count++;
 
             output->vertices[output->count] = *curr_vertex;
             output->count++;
         } else if (curr_distance <= 0 && prev_distance >= 0) {
             float percentage_distance = prev_distance / (prev_distance - curr_distance);
-            output->vertices[output->count] = interpolate_clip_vertex(prev_vertex, curr_vertex, percentage_distance);
+            output->vertices[output->count] = interpolate_clip_vertex(prev_vertex, curr_vertex, percentage_distance, input->attribute_count);
             output->count++;
         }
 
@@ -257,19 +1061,40 @@ void clear_screen(SDL_Renderer *renderer) {
     SDL_RenderClear(renderer);
 }
 
-void update_fps() {
+void present_framebuffer(SDL_Renderer *renderer, SDL_Texture *texture, Framebuffer *framebuffer) {
+    // Filled pixels are opaque and blend over whatever was drawn with SDL
+    SDL_UpdateTexture(texture, NULL, framebuffer->color, framebuffer->width * sizeof(uint32_t));
+    SDL_RenderTexture(renderer, texture, NULL, NULL);
+}
+
+void update_fps(FrameTimer *timer, int print_stats) {
     // Calculate the current fps from this and prev tick times
     uint64_t current_time = SDL_GetTicksNS();
-    last_frame_time = current_time;
+    timer->last_frame_time = current_time;
+
+    timer->frame_count++;
 
-    frame_count++;
+    if (current_time - timer->last_fps_update >= NS_TO_SEC_INT) {
+        timer->fps = (float)timer->frame_count / ((current_time - timer->last_fps_update) / NS_TO_SEC_FLOAT);
+        printf("FPS: %.2f\n", timer->fps);
 
-    if (current_time - last_fps_update >= NS_TO_SEC_INT) {
-        fps = (float)frame_count / ((current_time - last_fps_update) / NS_TO_SEC_FLOAT);
-        printf("FPS: %.2f\n", fps);
+        // Stats are only worth reading when every frame is actually drawn
+        if (!print_stats) {
+            timer->frame_count = 0;
+            timer->last_fps_update = current_time;
+            return;
+        }
+        print_raster_kernel_stats();
+        print_deferred_lighting_stats();
+        print_shadow_map_stats();
+        print_post_process_stats();
+        print_frame_arena_stats();
+        print_paged_mesh_stats();
+        print_meshlet_stats();
+        print_frame_reuse_stats();
 
-        frame_count = 0;
-        last_fps_update = current_time;
+        timer->frame_count = 0;
+        timer->last_fps_update = current_time;
     }
 }
 
@@ -278,9 +1103,15 @@ void update_model_space(ModelObject *model) {
     update_model_mat(model);
 }
 
-fVec4 *calculate_triangle_centroid(fVec4 *triangle_points[3]) {
-    fVec4 *centroid = add_fvec4(triangle_points[0], triangle_points[1]);
-    add_fvec4_in_place(centroid, triangle_points[2]);
+fVec4 *calculate_triangle_centroid(Mesh *mesh, VecConnectionsPoints *triangle_data) {
+    fVec4 decoded[NUM_TRIANGLE_VERTEX];
+    fVec4 *points[NUM_TRIANGLE_VERTEX];
+    for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+        points[i] = read_mesh_position(mesh, triangle_data->vertices[i], &decoded[i]);
+    }
+
+    fVec4 *centroid = add_fvec4(points[0], points[1]);
+    add_fvec4_in_place(centroid, points[2]);
     scale_fvec4_in_place(centroid, 1.0f / 3.0f);
     centroid->w = 1.0f;
 
@@ -297,9 +1128,9 @@ fVec4 *calculate_normal_endpoint(fVec4 *centroid, fVec4 *surface_normal) {
     return endpoint;
 }
 
-void render_normal_vector(SDL_Renderer *renderer, UserCamera *camera, VecConnectionsPoints *triangle_data, iVec2 *screen_points) {
+void render_normal_vector(SDL_Renderer *renderer, UserCamera *camera, Mesh *mesh, VecConnectionsPoints *triangle_data, iVec2 *screen_points) {
     // Get center of triangle and normalize it to length of one
-    fVec4 *centroid_fvec4 = calculate_triangle_centroid(triangle_data->triangle_points);
+    fVec4 *centroid_fvec4 = calculate_triangle_centroid(mesh, triangle_data);
     fVec4 *endpoint_fvec4 = calculate_normal_endpoint(centroid_fvec4, triangle_data->surface_normal);
 
     free(centroid_fvec4);
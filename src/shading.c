@@ -0,0 +1,277 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "geometry.h"
+#include "job_system.h"
+#include "shading.h"
+#include "shadow.h"
+
+LightingScene *create_lighting_scene(int max_lights) {
+    LightingScene *scene = (LightingScene *)malloc(sizeof(LightingScene));
+    if (!scene) {
+        printf("Could not allocate mem for lighting scene");
+        return NULL;
+    }
+
+    scene->lights = (Light *)malloc(max_lights * sizeof(Light));
+    if (!scene->lights) {
+        printf("Could not allocate mem for lights");
+        free(scene);
+        return NULL;
+    }
+
+    scene->light_count = 0;
+    scene->light_capacity = max_lights;
+    scene->ambient = (fVec4){0.1f, 0.1f, 0.1f, 1.0f};
+
+    return scene;
+}
+
+Light *add_directional_light(LightingScene *scene, fVec4 direction, fVec4 color, float intensity) {
+    if (scene->light_count == scene->light_capacity) {
+        printf("Lighting scene is full");
+        return NULL;
+    }
+
+    Light *light = &scene->lights[scene->light_count++];
+    light->type = LIGHT_DIRECTIONAL;
+    light->direction = direction;
+    normalize_fvec4(&light->direction);
+    light->position = (fVec4){0, 0, 0, 1.0f};
+    light->range = 0;
+    light->cos_inner_cone = -1.0f;
+    light->cos_outer_cone = -1.0f;
+    light->color = color;
+    light->intensity = intensity;
+    light->shadow_size = 0;
+    light->shadow = NULL;
+
+    return light;
+}
+
+Light *add_point_light(LightingScene *scene, fVec4 position, float range, fVec4 color, float intensity) {
+    if (scene->light_count == scene->light_capacity) {
+        printf("Lighting scene is full");
+        return NULL;
+    }
+
+    Light *light = &scene->lights[scene->light_count++];
+    light->type = LIGHT_POINT;
+    light->direction = (fVec4){0, 0, 0, 0};
+    light->position = position;
+    light->range = range;
+    light->cos_inner_cone = -1.0f;
+    light->cos_outer_cone = -1.0f;
+    light->color = color;
+    light->intensity = intensity;
+    light->shadow_size = 0;
+    light->shadow = NULL;
+
+    return light;
+}
+
+Light *add_spot_light(LightingScene *scene, fVec4 position, fVec4 direction, float range, float cone_angle, fVec4 color, float intensity) {
+    Light *light = add_point_light(scene, position, range, color, intensity);
+    if (!light) {
+        return NULL;
+    }
+
+    // cone_angle is the full opening in degrees, the last fifth of it fades out
+    light->type = LIGHT_SPOT;
+    light->direction = direction;
+    normalize_fvec4(&light->direction);
+    light->cos_outer_cone = cosf(cone_angle * 0.5f * (float)M_PI / 180.0f);
+    light->cos_inner_cone = cosf(cone_angle * 0.4f * (float)M_PI / 180.0f);
+
+    return light;
+}
+
+void free_lighting_scene(LightingScene *scene) {
+    if (scene == NULL) {
+        return;
+    }
+
+    // Shadow maps belong to the views, the lights only say how big
+    free(scene->lights);
+    free(scene);
+}
+
+Light *scatter_point_lights(LightingScene *scene, fVec4 *box_min, fVec4 *box_max, int count, float range, uint32_t seed) {
+    Light *first = NULL;
+
+    for (int i = 0; i < count; i++) {
+        // Small LCG so the same seed always builds the same scene
+        float random[6];
+        for (int r = 0; r < 6; r++) {
+            seed = seed * 1664525u + 1013904223u;
+            random[r] = (seed >> 8) * (1.0f / 16777216.0f);
+        }
+
+        // Anywhere in the box grown by half a range, so lights hug the surface from outside too
+        fVec4 position = {
+            box_min->x - range * 0.5f + random[0] * (box_max->x - box_min->x + range),
+            box_min->y - range * 0.5f + random[1] * (box_max->y - box_min->y + range),
+            box_min->z - range * 0.5f + random[2] * (box_max->z - box_min->z + range),
+            1.0f};
+        fVec4 color = {0.3f + 0.7f * random[3], 0.3f + 0.7f * random[4], 0.3f + 0.7f * random[5], 0.0f};
+
+        Light *light = add_point_light(scene, position, range, color, 0.5f);
+        if (!light) {
+            break;
+        }
+        first = first ? first : light;
+    }
+
+    return first;
+}
+
+void light_points(LightingScene *scene, const fVec4 *positions, const fVec4 *normals, int count, float *red, float *green, float *blue) {
+    for (int i = 0; i < count; i++) {
+        red[i] = scene->ambient.x;
+        green[i] = scene->ambient.y;
+        blue[i] = scene->ambient.z;
+    }
+
+    // Lights on the outside so the inner loop runs the same math over every point
+    for (int l = 0; l < scene->light_count; l++) {
+        apply_light(&scene->lights[l], positions, normals, count, red, green, blue);
+    }
+}
+
+void light_points_parallel(LightingScene *scene, const fVec4 *positions, const fVec4 *normals, const unsigned char *mask, int count,
+                           float *red, float *green, float *blue, JobSystem *jobs) {
+    LightPointsJob job = {scene, positions, normals, mask, red, green, blue};
+    parallel_for(jobs, count, LIGHT_POINTS_GRAIN, light_point_range, &job);
+}
+
+void light_point_range(void *arg, int start, int end) {
+    // Every point is lit on its own, so a slice is just a shorter call
+    LightPointsJob *job = (LightPointsJob *)arg;
+    if (!job->mask) {
+        light_points(job->scene, &job->positions[start], &job->normals[start], end - start,
+                     &job->red[start], &job->green[start], &job->blue[start]);
+        return;
+    }
+
+    // Only the points the mask keeps, packed a block at a time and scattered back
+    fVec4 positions[LIGHT_MASKED_BLOCK];
+    fVec4 normals[LIGHT_MASKED_BLOCK];
+    float channels[LIGHT_MASKED_BLOCK * 3];
+    int indices[LIGHT_MASKED_BLOCK];
+    for (int i = start; i < end;) {
+        int count = 0;
+        for (; i < end && count < LIGHT_MASKED_BLOCK; i++) {
+            if (job->mask[i]) {
+                positions[count] = job->positions[i];
+                normals[count] = job->normals[i];
+                indices[count++] = i;
+            }
+        }
+
+        light_points(job->scene, positions, normals, count, channels, channels + LIGHT_MASKED_BLOCK, channels + LIGHT_MASKED_BLOCK * 2);
+        for (int j = 0; j < count; j++) {
+            job->red[indices[j]] = channels[j];
+            job->green[indices[j]] = channels[LIGHT_MASKED_BLOCK + j];
+            job->blue[indices[j]] = channels[LIGHT_MASKED_BLOCK * 2 + j];
+        }
+    }
+}
+
+void light_points_culled(LightingScene *scene, const uint16_t *light_indices, int light_count, const fVec4 *positions, const fVec4 *normals, int count, float *red, float *green, float *blue) {
+    for (int i = 0; i < count; i++) {
+        red[i] = scene->ambient.x;
+        green[i] = scene->ambient.y;
+        blue[i] = scene->ambient.z;
+    }
+
+    // Same sum as light_points, only over the lights that survived culling
+    for (int l = 0; l < light_count; l++) {
+        apply_light(&scene->lights[light_indices[l]], positions, normals, count, red, green, blue);
+    }
+}
+
+void apply_light(const Light *light, const fVec4 *positions, const fVec4 *normals, int count, float *red, float *green, float *blue) {
+    float light_r = light->color.x * light->intensity;
+    float light_g = light->color.y * light->intensity;
+    float light_b = light->color.z * light->intensity;
+
+    // Only maps rendered this frame are sampled
+    const ShadowMap *shadow = light->shadow && light->shadow->enabled && light->shadow->valid ? light->shadow : NULL;
+
+    if (light->type == LIGHT_DIRECTIONAL) {
+        // Direction is where the light travels, so the surface faces -direction
+        float lx = -light->direction.x;
+        float ly = -light->direction.y;
+        float lz = -light->direction.z;
+
+        for (int i = 0; i < count; i++) {
+            float n_dot_l = normals[i].x * lx + normals[i].y * ly + normals[i].z * lz;
+            n_dot_l = n_dot_l > 0 ? n_dot_l : 0;
+
+            if (shadow && n_dot_l > 0) {
+                n_dot_l *= sample_shadow_map(shadow, &positions[i], &normals[i]);
+            }
+
+            red[i] += n_dot_l * light_r;
+            green[i] += n_dot_l * light_g;
+            blue[i] += n_dot_l * light_b;
+        }
+    } else {
+        float inv_range_sq = 1.0f / (light->range * light->range);
+        float cone_width = light->cos_inner_cone - light->cos_outer_cone;
+        float inv_cone_width = cone_width > 0 ? 1.0f / cone_width : 1.0f;
+
+        for (int i = 0; i < count; i++) {
+            float lx = light->position.x - positions[i].x;
+            float ly = light->position.y - positions[i].y;
+            float lz = light->position.z - positions[i].z;
+            float distance_sq = lx * lx + ly * ly + lz * lz;
+            float inv_distance = 1.0f / sqrtf(distance_sq + 1e-12f);
+
+            float n_dot_l = (normals[i].x * lx + normals[i].y * ly + normals[i].z * lz) * inv_distance;
+            n_dot_l = n_dot_l > 0 ? n_dot_l : 0;
+
+            // Smooth window so the light reaches exactly zero at its range
+            float falloff = 1.0f - distance_sq * inv_range_sq;
+            falloff = falloff > 0 ? falloff * falloff : 0;
+
+            // Spot lights fade from the inner to the outer cone
+            if (light->type == LIGHT_SPOT) {
+                float cos_angle = -(light->direction.x * lx + light->direction.y * ly + light->direction.z * lz) * inv_distance;
+                float cone = (cos_angle - light->cos_outer_cone) * inv_cone_width;
+                cone = cone < 0 ? 0 : (cone > 1 ? 1 : cone);
+                falloff *= cone * cone;
+            }
+
+            if (shadow && n_dot_l * falloff > 0) {
+                falloff *= sample_shadow_map(shadow, &positions[i], &normals[i]);
+            }
+
+            red[i] += n_dot_l * falloff * light_r;
+            green[i] += n_dot_l * falloff * light_g;
+            blue[i] += n_dot_l * falloff * light_b;
+        }
+    }
+}
+
+uint32_t pack_color(float r, float g, float b) {
+    r = r < 0 ? 0 : (r > 1 ? 1 : r);
+    g = g < 0 ? 0 : (g > 1 ? 1 : g);
+    b = b < 0 ? 0 : (b > 1 ? 1 : b);
+
+    return 0xFF000000u |
+           ((uint32_t)(r * 255.0f + 0.5f) << 16) |
+           ((uint32_t)(g * 255.0f + 0.5f) << 8) |
+           (uint32_t)(b * 255.0f + 0.5f);
+}
+
+uint32_t blend_pixel(uint32_t src, uint32_t dst, uint32_t alpha) {
+    // Two channels per multiply, alpha/green and red/blue
+    uint32_t inv_alpha = 256 - alpha;
+    uint32_t ag = (((src >> 8) & 0x00FF00FFu) * alpha + ((dst >> 8) & 0x00FF00FFu) * inv_alpha) & 0xFF00FF00u;
+    uint32_t rb = ((src & 0x00FF00FFu) * alpha + (dst & 0x00FF00FFu) * inv_alpha) >> 8 & 0x00FF00FFu;
+
+    return ag | rb;
+}
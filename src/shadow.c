@@ -0,0 +1,269 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camera.h"
+#include "constants.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "raster_bins.h"
+#include "shading.h"
+#include "shadow.h"
+
+static ShadowMapStats shadow_map_stats;
+
+ShadowMap *create_shadow_map(int size) {
+    ShadowMap *map = (ShadowMap *)malloc(sizeof(ShadowMap));
+    if (!map) {
+        printf("Could not allocate mem for shadow map");
+        return NULL;
+    }
+
+    map->size = size;
+    map->bins = NULL;
+    map->depth_map = create_depth_framebuffer(size, size);
+    // Square map, fit_shadow_camera replaces the projection anyway
+    map->light_camera = create_camera(1.0f);
+
+    if (!map->depth_map || !map->light_camera) {
+        printf("Could not allocate mem for shadow map targets");
+        free_shadow_map(map);
+        return NULL;
+    }
+
+    map->normal_offset = 0;
+    map->enabled = 0;
+    map->valid = 0;
+    map->rendered_mesh = NULL;
+
+    return map;
+}
+
+int attach_shadow_map(Light *light, int size) {
+    // Point lights would need six maps, only one facing lights get one
+    if (light->type == LIGHT_POINT) {
+        printf("Point lights cannot cast shadows");
+        return 0;
+    }
+
+    // Every view draws its own map of the light from the next frame on
+    light->shadow_size = size;
+    return 1;
+}
+
+void free_shadow_map(ShadowMap *map) {
+    if (map == NULL) {
+        return;
+    }
+
+    free_framebuffer(map->depth_map);
+    free_raster_bins(map->bins);
+
+    if (map->light_camera) {
+        free(map->light_camera->camera_mat);
+        free(map->light_camera->projection_mat);
+        free(map->light_camera);
+    }
+
+    free(map);
+}
+
+ShadowMap *find_view_shadow_map(ShadowMapSet *set, int index, int size) {
+    if (index >= set->count) {
+        ShadowMap **maps = (ShadowMap **)realloc(set->maps, (index + 1) * sizeof(ShadowMap *));
+        if (!maps) {
+            printf("Could not allocate mem for view shadow maps");
+            return NULL;
+        }
+
+        for (int i = set->count; i <= index; i++) {
+            maps[i] = NULL;
+        }
+        set->maps = maps;
+        set->count = index + 1;
+    }
+
+    // A different light in the slot just makes the map stale, only a new size replaces it
+    if (set->maps[index] && set->maps[index]->size != size) {
+        free_shadow_map(set->maps[index]);
+        set->maps[index] = NULL;
+    }
+    if (!set->maps[index]) {
+        set->maps[index] = create_shadow_map(size);
+    }
+
+    return set->maps[index];
+}
+
+void free_shadow_map_set(ShadowMapSet *set) {
+    for (int i = 0; i < set->count; i++) {
+        free_shadow_map(set->maps[i]);
+    }
+
+    free(set->maps);
+    set->maps = NULL;
+    set->count = 0;
+}
+
+int is_shadow_map_stale(const ShadowMap *map, const Light *light, const ModelObject *model) {
+    if (!map->valid) {
+        return 1;
+    }
+
+    // Anything the light camera or the casters depend on
+    return map->rendered_type != light->type ||
+           memcmp(&map->rendered_direction, &light->direction, sizeof(fVec4)) != 0 ||
+           memcmp(&map->rendered_position, &light->position, sizeof(fVec4)) != 0 ||
+           map->rendered_range != light->range ||
+           map->rendered_cone != light->cos_outer_cone ||
+           map->rendered_mesh != model->mesh ||
+           map->rendered_compact != (model->mesh && !model->mesh->vec_arr) ||
+           memcmp(&map->rendered_model_mat, model->model_mat, sizeof(fMatrix44)) != 0;
+}
+
+void mark_shadow_map_rendered(ShadowMap *map, const Light *light, const ModelObject *model) {
+    map->valid = 1;
+    map->rendered_type = light->type;
+    map->rendered_direction = light->direction;
+    map->rendered_position = light->position;
+    map->rendered_range = light->range;
+    map->rendered_cone = light->cos_outer_cone;
+    map->rendered_mesh = model->mesh;
+    // A rebuilt mesh can come back at the same address in the other format
+    map->rendered_compact = model->mesh && !model->mesh->vec_arr;
+    map->rendered_model_mat = *model->model_mat;
+}
+
+int fit_shadow_camera(ShadowMap *map, const Light *light, const Mesh *mesh) {
+    UserCamera *camera = map->light_camera;
+    CameraSettings *settings = &camera->settings;
+
+    if (light->type == LIGHT_DIRECTIONAL) {
+        // A box around the casters' bounding sphere, seen from outside it along the light
+        fVec4 *box_min = mesh->bounding_box_vec[0];
+        fVec4 *box_max = mesh->bounding_box_vec[NUM_BOUNDING_BOX_VERTEX - 1];
+        fVec4 center = {(box_min->x + box_max->x) * 0.5f, (box_min->y + box_max->y) * 0.5f, (box_min->z + box_max->z) * 0.5f, 1.0f};
+        float dx = box_max->x - center.x;
+        float dy = box_max->y - center.y;
+        float dz = box_max->z - center.z;
+        float radius = sqrtf(dx * dx + dy * dy + dz * dz);
+
+        fVec4 eye = {center.x - light->direction.x * radius * 2.0f,
+                     center.y - light->direction.y * radius * 2.0f,
+                     center.z - light->direction.z * radius * 2.0f, 1.0f};
+        fVec4 up = fabsf(light->direction.y) > 0.99f ? (fVec4){1.0f, 0, 0, 0} : (fVec4){0, 1.0f, 0, 0};
+        camera_look_at(camera, &eye, &center, &up);
+
+        settings->left = -radius;
+        settings->right = radius;
+        settings->bottom = -radius;
+        settings->top = radius;
+        settings->near = radius;
+        settings->far = radius * 3.0f;
+        orthographic(&settings->bottom, &settings->top, &settings->left, &settings->right, &settings->near, &settings->far, camera->projection_mat);
+
+        map->normal_offset = 2.0f * radius / map->size * SHADOW_NORMAL_OFFSET_TEXELS;
+    } else if (light->type == LIGHT_SPOT) {
+        // The outer cone fits the frustum, near is pulled out to keep depth precision
+        fVec4 eye = light->position;
+        fVec4 target = {eye.x + light->direction.x, eye.y + light->direction.y, eye.z + light->direction.z, 1.0f};
+        fVec4 up = fabsf(light->direction.y) > 0.99f ? (fVec4){1.0f, 0, 0, 0} : (fVec4){0, 1.0f, 0, 0};
+        camera_look_at(camera, &eye, &target, &up);
+
+        settings->fov = 2.0f * acosf(light->cos_outer_cone) * 180.0f / (float)M_PI;
+        settings->aspect_ratio = 1.0f;
+        settings->near = light->range * 0.05f;
+        settings->far = light->range;
+        perspective(&settings->fov, &settings->aspect_ratio, &settings->near, &settings->far,
+                    &settings->bottom, &settings->top, &settings->left, &settings->right);
+        frustum(&settings->bottom, &settings->top, &settings->left, &settings->right, &settings->near, &settings->far, camera->projection_mat);
+
+        // Texels grow with distance, size the offset for the middle of the range
+        float half_width = (settings->right / settings->near) * light->range * 0.5f;
+        map->normal_offset = 2.0f * half_width / map->size * SHADOW_NORMAL_OFFSET_TEXELS;
+    } else {
+        return 0;
+    }
+
+    fMatrix44 *view_projection_mat = mult_fmatrix44(camera->camera_mat, camera->projection_mat);
+    if (!view_projection_mat) {
+        return 0;
+    }
+
+    map->light_view_projection = *view_projection_mat;
+    free(view_projection_mat);
+
+    return 1;
+}
+
+float sample_shadow_map(const ShadowMap *map, const fVec4 *position, const fVec4 *normal) {
+    // Normal offset keeps a surface from shadowing itself at grazing angles
+    float px = position->x + normal->x * map->normal_offset;
+    float py = position->y + normal->y * map->normal_offset;
+    float pz = position->z + normal->z * map->normal_offset;
+
+    const float(*m)[4] = map->light_view_projection.mat;
+    float clip_x = px * m[0][0] + py * m[1][0] + pz * m[2][0] + m[3][0];
+    float clip_y = px * m[0][1] + py * m[1][1] + pz * m[2][1] + m[3][1];
+    float clip_z = px * m[0][2] + py * m[1][2] + pz * m[2][2] + m[3][2];
+    float clip_w = px * m[0][3] + py * m[1][3] + pz * m[2][3] + m[3][3];
+
+    // Behind the light or outside the map, nothing was drawn there to block it
+    if (clip_w <= 0) {
+        return 1.0f;
+    }
+
+    float inv_w = 1.0f / clip_w;
+    float ndc_x = clip_x * inv_w;
+    float ndc_y = clip_y * inv_w;
+    float ndc_z = clip_z * inv_w;
+    if (ndc_x < -1.0f || ndc_x > 1.0f || ndc_y < -1.0f || ndc_y > 1.0f || ndc_z > 1.0f) {
+        return 1.0f;
+    }
+
+    // Same viewport mapping the rasterizer used to draw the map
+    int size = map->size;
+    int center_x = (int)((ndc_x + 1.0f) * 0.5f * size);
+    int center_y = (int)((1.0f - (ndc_y + 1.0f) * 0.5f) * size);
+    float depth = ndc_z - SHADOW_DEPTH_BIAS;
+
+    // Fraction of the neighbouring texels the receiver is in front of
+    int lit = 0;
+    for (int y = center_y - SHADOW_PCF_RADIUS; y <= center_y + SHADOW_PCF_RADIUS; y++) {
+        const float *row = &map->depth_map->depth[(y < 0 ? 0 : (y >= size ? size - 1 : y)) * size];
+
+        for (int x = center_x - SHADOW_PCF_RADIUS; x <= center_x + SHADOW_PCF_RADIUS; x++) {
+            lit += depth <= row[x < 0 ? 0 : (x >= size ? size - 1 : x)];
+        }
+    }
+
+    const int taps = (2 * SHADOW_PCF_RADIUS + 1) * (2 * SHADOW_PCF_RADIUS + 1);
+    return lit * (1.0f / taps);
+}
+
+void record_shadow_map_stats(int rendered, uint64_t time_ns) {
+    if (rendered) {
+        shadow_map_stats.renders++;
+        shadow_map_stats.time_ns += time_ns;
+    } else {
+        shadow_map_stats.reuses++;
+    }
+}
+
+void print_shadow_map_stats() {
+    ShadowMapStats *stats = &shadow_map_stats;
+    if (stats->renders == 0 && stats->reuses == 0) {
+        return;
+    }
+
+    double milliseconds = stats->renders ? stats->time_ns / 1e6 / stats->renders : 0.0;
+    printf("  %-20s %8.2f ms/map %8llu drawn %8llu reused\n", "shadow_maps", milliseconds,
+           (unsigned long long)stats->renders, (unsigned long long)stats->reuses);
+
+    stats->renders = 0;
+    stats->reuses = 0;
+    stats->time_ns = 0;
+}
@@ -0,0 +1,307 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shading.h"
+#include "texture.h"
+
+Texture *load_texture(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("ERROR: Could not find texture %s", filename);
+        return NULL;
+    }
+
+    // Pick the reader from the extension, both hand back linear ARGB
+    int width = 0;
+    int height = 0;
+    uint32_t *pixels = NULL;
+    const char *extension = strrchr(filename, '.');
+
+    if (extension && (strcmp(extension, ".ppm") == 0 || strcmp(extension, ".PPM") == 0)) {
+        pixels = read_ppm(file, &width, &height);
+    } else if (extension && (strcmp(extension, ".tga") == 0 || strcmp(extension, ".TGA") == 0)) {
+        pixels = read_tga(file, &width, &height);
+    } else {
+        printf("ERROR: Unsupported texture format %s", filename);
+    }
+
+    fclose(file);
+
+    if (!pixels) {
+        return NULL;
+    }
+
+    Texture *texture = create_texture(pixels, width, height);
+    free(pixels);
+
+    return texture;
+}
+
+Texture *create_texture(const uint32_t *pixels, int width, int height) {
+    Texture *texture = (Texture *)calloc(1, sizeof(Texture));
+    if (!texture) {
+        printf("Could not allocate mem for texture");
+        return NULL;
+    }
+
+    // Build every mip down to 1x1, each level is tiled as soon as it exists
+    const uint32_t *level_pixels = pixels;
+    uint32_t *owned_pixels = NULL;
+    int level_width = width;
+    int level_height = height;
+
+    while (texture->level_count < TEXTURE_MAX_LEVELS) {
+        if (!tile_level(&texture->levels[texture->level_count], level_pixels, level_width, level_height)) {
+            free(owned_pixels);
+            free_texture(texture);
+            return NULL;
+        }
+        texture->level_count++;
+
+        if (level_width == 1 && level_height == 1) {
+            break;
+        }
+
+        uint32_t *next_pixels = downsample_level(level_pixels, level_width, level_height, &level_width, &level_height);
+        free(owned_pixels);
+        if (!next_pixels) {
+            free_texture(texture);
+            return NULL;
+        }
+
+        owned_pixels = next_pixels;
+        level_pixels = next_pixels;
+    }
+
+    free(owned_pixels);
+    return texture;
+}
+
+void free_texture(Texture *texture) {
+    if (texture == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < texture->level_count; i++) {
+        free(texture->levels[i].texels);
+    }
+    free(texture);
+}
+
+uint32_t *read_ppm(FILE *file, int *width, int *height) {
+    // Binary P6 only, comments may sit between the header fields
+    char magic[3] = {0};
+    int max_value = 0;
+
+    if (fscanf(file, "%2s", magic) != 1 || strcmp(magic, "P6") != 0) {
+        printf("ERROR: Only binary P6 PPM textures are supported");
+        return NULL;
+    }
+
+    int *fields[3] = {width, height, &max_value};
+    for (int i = 0; i < 3; i++) {
+        int c;
+        while ((c = fgetc(file)) == '#' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            if (c == '#') {
+                while ((c = fgetc(file)) != '\n' && c != EOF) {
+                }
+            }
+        }
+        ungetc(c, file);
+
+        if (fscanf(file, "%d", fields[i]) != 1) {
+            printf("ERROR: Malformed PPM header");
+            return NULL;
+        }
+    }
+    fgetc(file);
+
+    if (*width <= 0 || *height <= 0 || max_value <= 0 || max_value > 255) {
+        printf("ERROR: Unsupported PPM size or depth");
+        return NULL;
+    }
+
+    int count = *width * *height;
+    uint8_t *rgb = (uint8_t *)malloc(count * 3);
+    uint32_t *pixels = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (!rgb || !pixels) {
+        printf("Could not allocate mem for texture pixels");
+        free(rgb);
+        free(pixels);
+        return NULL;
+    }
+
+    if (fread(rgb, 3, count, file) != (size_t)count) {
+        printf("ERROR: PPM pixel data is truncated");
+        free(rgb);
+        free(pixels);
+        return NULL;
+    }
+
+    for (int i = 0; i < count; i++) {
+        uint32_t r = rgb[i * 3] * 255 / max_value;
+        uint32_t g = rgb[i * 3 + 1] * 255 / max_value;
+        uint32_t b = rgb[i * 3 + 2] * 255 / max_value;
+        pixels[i] = 0xFF000000u | (r << 16) | (g << 8) | b;
+    }
+
+    free(rgb);
+    return pixels;
+}
+
+uint32_t *read_tga(FILE *file, int *width, int *height) {
+    uint8_t header[18];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        printf("ERROR: Malformed TGA header");
+        return NULL;
+    }
+
+    // Uncompressed true color only (image type 2), 24 or 32 bits per pixel
+    int image_type = header[2];
+    int bits_per_pixel = header[16];
+    int top_origin = (header[17] & 0x20) != 0;
+    *width = header[12] | (header[13] << 8);
+    *height = header[14] | (header[15] << 8);
+
+    if (image_type != 2 || (bits_per_pixel != 24 && bits_per_pixel != 32) || *width <= 0 || *height <= 0) {
+        printf("ERROR: Only uncompressed 24/32 bit TGA textures are supported");
+        return NULL;
+    }
+
+    // Skip the image id and any color map
+    int color_map_bytes = (header[5] | (header[6] << 8)) * ((header[7] + 7) / 8);
+    fseek(file, header[0] + color_map_bytes, SEEK_CUR);
+
+    int bytes_per_pixel = bits_per_pixel / 8;
+    int count = *width * *height;
+    uint8_t *data = (uint8_t *)malloc(count * bytes_per_pixel);
+    uint32_t *pixels = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (!data || !pixels) {
+        printf("Could not allocate mem for texture pixels");
+        free(data);
+        free(pixels);
+        return NULL;
+    }
+
+    if (fread(data, bytes_per_pixel, count, file) != (size_t)count) {
+        printf("ERROR: TGA pixel data is truncated");
+        free(data);
+        free(pixels);
+        return NULL;
+    }
+
+    // Stored BGR(A), bottom row first unless the origin bit says otherwise
+    for (int y = 0; y < *height; y++) {
+        int src_row = top_origin ? y : *height - 1 - y;
+        for (int x = 0; x < *width; x++) {
+            uint8_t *texel = &data[(src_row * *width + x) * bytes_per_pixel];
+            uint32_t a = bytes_per_pixel == 4 ? texel[3] : 0xFF;
+            pixels[y * *width + x] = (a << 24) | ((uint32_t)texel[2] << 16) | ((uint32_t)texel[1] << 8) | texel[0];
+        }
+    }
+
+    free(data);
+    return pixels;
+}
+
+uint32_t *downsample_level(const uint32_t *pixels, int width, int height, int *next_width, int *next_height) {
+    *next_width = width > 1 ? width / 2 : 1;
+    *next_height = height > 1 ? height / 2 : 1;
+
+    uint32_t *next = (uint32_t *)malloc(*next_width * *next_height * sizeof(uint32_t));
+    if (!next) {
+        printf("Could not allocate mem for texture mip");
+        return NULL;
+    }
+
+    // 2x2 box filter, odd edges clamp onto the last row/column
+    for (int y = 0; y < *next_height; y++) {
+        int y0 = y * 2;
+        int y1 = y0 + 1 < height ? y0 + 1 : y0;
+
+        for (int x = 0; x < *next_width; x++) {
+            int x0 = x * 2;
+            int x1 = x0 + 1 < width ? x0 + 1 : x0;
+            uint32_t quad[4] = {pixels[y0 * width + x0], pixels[y0 * width + x1], pixels[y1 * width + x0], pixels[y1 * width + x1]};
+
+            uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = 2;
+                for (int i = 0; i < 4; i++) {
+                    sum += (quad[i] >> shift) & 0xFF;
+                }
+                result |= (sum >> 2) << shift;
+            }
+            next[y * *next_width + x] = result;
+        }
+    }
+
+    return next;
+}
+
+int tile_level(TextureLevel *level, const uint32_t *pixels, int width, int height) {
+    int tiles_x = (width + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SHIFT;
+    int tiles_y = (height + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SHIFT;
+
+    level->width = width;
+    level->height = height;
+    level->tiles_x = tiles_x;
+    level->texels = (uint32_t *)calloc(tiles_x * tiles_y * TEXTURE_TILE_TEXELS, sizeof(uint32_t));
+    if (!level->texels) {
+        printf("Could not allocate mem for texture level");
+        return 0;
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int tile = (y >> TEXTURE_TILE_SHIFT) * tiles_x + (x >> TEXTURE_TILE_SHIFT);
+            int offset = ((y & (TEXTURE_TILE_SIZE - 1)) << TEXTURE_TILE_SHIFT) + (x & (TEXTURE_TILE_SIZE - 1));
+            level->texels[tile * TEXTURE_TILE_TEXELS + offset] = pixels[y * width + x];
+        }
+    }
+
+    return 1;
+}
+
+int select_texture_level(const Texture *texture, float footprint_sq) {
+    // footprint_sq is the squared number of level 0 texels a pixel steps over,
+    // half its base 2 exponent is the level where that step is about one texel
+    int exponent = footprint_sq > 1.0f ? ilogbf(footprint_sq) : 0;
+    int level = exponent >> 1;
+
+    return level < texture->level_count ? level : texture->level_count - 1;
+}
+
+uint32_t fetch_texel(const TextureLevel *level, int x, int y) {
+    int tile = (y >> TEXTURE_TILE_SHIFT) * level->tiles_x + (x >> TEXTURE_TILE_SHIFT);
+    int offset = ((y & (TEXTURE_TILE_SIZE - 1)) << TEXTURE_TILE_SHIFT) + (x & (TEXTURE_TILE_SIZE - 1));
+
+    return level->texels[tile * TEXTURE_TILE_TEXELS + offset];
+}
+
+uint32_t sample_texture_bilinear(const TextureLevel *level, float u, float v) {
+    // Texel centers sit at half coordinates, addressing wraps. Lanes outside
+    // the triangle can extrapolate wildly, clamping also turns NaN into a number
+    float x = fminf(fmaxf(u * level->width - 0.5f, -TEXTURE_COORD_LIMIT), TEXTURE_COORD_LIMIT);
+    float y = fminf(fmaxf(v * level->height - 0.5f, -TEXTURE_COORD_LIMIT), TEXTURE_COORD_LIMIT);
+    float floor_x = floorf(x);
+    float floor_y = floorf(y);
+
+    uint32_t weight_x = (uint32_t)((x - floor_x) * 256.0f);
+    uint32_t weight_y = (uint32_t)((y - floor_y) * 256.0f);
+
+    int x0 = (int)fmodf(floor_x, (float)level->width);
+    int y0 = (int)fmodf(floor_y, (float)level->height);
+    x0 += x0 < 0 ? level->width : 0;
+    y0 += y0 < 0 ? level->height : 0;
+    int x1 = x0 + 1 < level->width ? x0 + 1 : 0;
+    int y1 = y0 + 1 < level->height ? y0 + 1 : 0;
+
+    uint32_t top = blend_pixel(fetch_texel(level, x1, y0), fetch_texel(level, x0, y0), weight_x);
+    uint32_t bottom = blend_pixel(fetch_texel(level, x1, y1), fetch_texel(level, x0, y1), weight_x);
+
+    return blend_pixel(bottom, top, weight_y);
+}
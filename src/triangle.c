@@ -9,6 +9,8 @@
 
 #include <SDL3/SDL.h>
 
+#include "constants.h"
+#include "framebuffer.h"
 #include "geometry.h"
 #include "line.h"
 #include "triangle.h"
@@ -28,7 +30,6 @@ Triangle *create_triangle(SDL_Renderer *renderer, iVec2 *v1, iVec2 *v2, iVec2 *v
     render_line(renderer, v1, v2);
     render_line(renderer, v2, v3);
     render_line(renderer, v3, v1);
-    // populate_uv_map(triangle);
 
     return triangle;
 }
@@ -39,67 +40,80 @@ void draw_triangle(SDL_Renderer *renderer, iVec2 *v1, iVec2 *v2, iVec2 *v3) {
     render_line(renderer, v3, v1);
 }
 
-void batch_draw_triangles(SDL_Renderer *renderer, int size, iVec2 *point_arr) {
-    for (int i = 0; i < size * 3; i += 3) {
-        iVec2 p1 = point_arr[i + 0];
-        iVec2 p2 = point_arr[i + 1];
-        iVec2 p3 = point_arr[i + 2];
+void batch_draw_triangles(SDL_Renderer *renderer, RasterQueue *queue) {
+    for (int i = 0; i < queue->count; i++) {
+        RasterTriangle *triangle = &queue->triangles[i];
 
-        render_line(renderer, &p1, &p2);
-        render_line(renderer, &p2, &p3);
-        render_line(renderer, &p3, &p1);
-
-        fill_triangle(renderer, &p1, &p2, &p3);
+        render_line(renderer, &triangle->points[0], &triangle->points[1]);
+        render_line(renderer, &triangle->points[1], &triangle->points[2]);
+        render_line(renderer, &triangle->points[2], &triangle->points[0]);
     }
 }
 
-void populate_uv_map(Triangle *triangle) {
-    // int min_x = fmin(triangle->v1->x, fmin(triangle->v2->x, triangle->v3->x));
-    // int max_x = fmax(triangle->v1->x, fmax(triangle->v2->x, triangle->v3->x));
-    // int min_y = fmin(triangle->v1->y, fmin(triangle->v2->y, triangle->v3->y));
-    // int max_y = fmax(triangle->v1->y, fmax(triangle->v2->y, triangle->v3->y));
-
-    // float width = (float)fmax(1, max_x - min_x);
-    // float height = (float)fmax(1, max_y - min_y);
-
-    // triangle->v1->u = (triangle->v1->x - min_x) / width;
-    // triangle->v1->v = (triangle->v1->y - min_y) / height;
-
-    // triangle->v2->u = (triangle->v2->x - min_x) / width;
-    // triangle->v2->v = (triangle->v2->y - min_y) / height;
-
-    // triangle->v3->u = (triangle->v3->x - min_x) / width;
-    // triangle->v3->v = (triangle->v3->y - min_y) / height;
-}
-
-void fill_triangle(SDL_Renderer *renderer, iVec2 *p1, iVec2 *p2, iVec2 *p3) {
-
-    int xa = p1->x;
-    int xb = p2->x;
-    int xc = p3->x;
-
-    int ya = p1->y;
-    int yb = p2->y;
-    int yc = p3->y;
+uint64_t fill_triangle(Framebuffer *framebuffer, RasterTriangle *triangle, const RasterKernel *kernel, const RasterState *state,
+                       int clip_x0, int clip_y0, int clip_x1, int clip_y1) {
+    const int block_span = RASTER_BLOCK_SIZE - 1;
+    uint64_t pixels = 0;
+
+    // Offsets from a block's top left pixel to the corner where each edge is
+    // largest and smallest, which bound the edge over the whole block
+    int64_t max_corner[NUM_TRIANGLE_VERTEX];
+    int64_t min_corner[NUM_TRIANGLE_VERTEX];
+    for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+        int a = triangle->edge_a[i];
+        int b = triangle->edge_b[i];
+        max_corner[i] = (int64_t)(a > 0 ? a : 0) * block_span + (int64_t)(b > 0 ? b : 0) * block_span;
+        min_corner[i] = (int64_t)(a < 0 ? a : 0) * block_span + (int64_t)(b < 0 ? b : 0) * block_span;
+
+        // Samples sit off the pixel centers, a block only counts as inside or
+        // outside when every sample is
+        if (kernel->samples > 1) {
+            int64_t reach = (int64_t)((a < 0 ? -a : a) + (b < 0 ? -b : b)) * RASTER_SAMPLE_REACH / SUBPIXEL_SCALE;
+            max_corner[i] += reach;
+            min_corner[i] -= reach;
+        }
+    }
 
-    int min_x = fmin(p1->x, fmin(p2->x, p3->x));
-    int max_x = fmax(p1->x, fmax(p2->x, p3->x));
-    int min_y = fmin(p1->y, fmin(p2->y, p3->y));
-    int max_y = fmax(p1->y, fmax(p2->y, p3->y));
+    // Only the part inside the clip rect, a block aligned screen tile
+    int min_x = triangle->min_x > clip_x0 ? triangle->min_x : clip_x0;
+    int min_y = triangle->min_y > clip_y0 ? triangle->min_y : clip_y0;
+    int max_x = triangle->max_x < clip_x1 ? triangle->max_x : clip_x1;
+    int max_y = triangle->max_y < clip_y1 ? triangle->max_y : clip_y1;
+
+    int start_x = min_x & ~block_span;
+    int start_y = min_y & ~block_span;
+
+    for (int block_y = start_y; block_y <= max_y; block_y += RASTER_BLOCK_SIZE) {
+        for (int block_x = start_x; block_x <= max_x; block_x += RASTER_BLOCK_SIZE) {
+            int64_t edge[NUM_TRIANGLE_VERTEX];
+            int outside = 0;
+            int inside = 1;
+
+            for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+                edge[i] = (int64_t)triangle->edge_a[i] * block_x + (int64_t)triangle->edge_b[i] * block_y + triangle->edge_c[i];
+                outside |= edge[i] + max_corner[i] < 0;
+                inside &= edge[i] + min_corner[i] >= 0;
+            }
 
-    for (int y = min_y; y <= max_y; y++) {
-        for (int x = min_x; x <= max_x; x++) {
-            float alpha = (float)(((-(x - xb)) * (yc - yb)) + ((y - yb) * (xc - xb))) /
-                          (((-(xa - xb)) * (yc - yb)) + ((ya - yb) * (xc - xb)));
-            float beta = (float)(((-(x - xc)) * (ya - yc)) + ((y - yc) * (xa - xc))) /
-                         (((-(xb - xc)) * (ya - yc)) + ((yb - yc) * (xa - xc)));
-            float gamma = 1 - alpha - beta;
+            // Trivial reject, some edge is negative at every corner
+            if (outside) {
+                continue;
+            }
 
-            if (gamma >= 0 && beta >= 0 && alpha >= 0) {
+            // Only the blocks along the bounding box border are cut short
+            int x0 = block_x > min_x ? block_x : min_x;
+            int y0 = block_y > min_y ? block_y : min_y;
+            int x1 = block_x + block_span < max_x ? block_x + block_span : max_x;
+            int y1 = block_y + block_span < max_y ? block_y + block_span : max_y;
 
-                SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-                SDL_RenderPoint(renderer, x, y);
+            if (inside) {
+                kernel->fill_spans(framebuffer, triangle, state, x0, y0, x1, y1);
+            } else {
+                kernel->fill_partial(framebuffer, triangle, state, edge, min_corner, block_x, block_y, x0, y0, x1, y1);
             }
+            pixels += (uint64_t)(x1 - x0 + 1) * (y1 - y0 + 1);
         }
     }
+
+    return pixels;
 }
@@ -0,0 +1,322 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+#include "geometry.h"
+#include "shading.h"
+#include "triangle_setup.h"
+
+RasterQueue *create_raster_queue(int max_triangles, int attribute_count) {
+    RasterQueue *queue = (RasterQueue *)malloc(sizeof(RasterQueue));
+    if (!queue) {
+        printf("Could not allocate mem for raster queue");
+        return NULL;
+    }
+
+    // Survivors are compacted with unconditional stores, so leave a batch of slack
+    queue->capacity = max_triangles + TRIANGLE_SETUP_LANES;
+    queue->count = 0;
+    queue->triangles = (RasterTriangle *)malloc(queue->capacity * sizeof(RasterTriangle));
+    queue->pixel_count = 0;
+    queue->pixels = (RasterPixel *)malloc(queue->capacity * sizeof(RasterPixel));
+
+    // Three values (origin, x step, y step) per plane per triangle
+    queue->attribute_count = attribute_count;
+    queue->planes = (float *)malloc((size_t)queue->capacity * 3 * RASTER_PLANE_COUNT(attribute_count) * sizeof(float));
+
+    if (!queue->triangles || !queue->pixels || !queue->planes) {
+        printf("Could not allocate mem for raster queue triangles");
+        free(queue->triangles);
+        free(queue->pixels);
+        free(queue->planes);
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void reset_raster_queue(RasterQueue *queue) {
+    queue->count = 0;
+    queue->pixel_count = 0;
+}
+
+int raster_queue_full(const RasterQueue *queue) {
+    // One clipped triangle pushes at most one flush, so room for the pending
+    // batch plus that one more is all a caller has to keep free
+    int room = queue->capacity - 2 * TRIANGLE_SETUP_LANES;
+    return queue->count > room || queue->pixel_count > room;
+}
+
+void free_raster_queue(RasterQueue *queue) {
+    if (queue == NULL) {
+        return;
+    }
+
+    free(queue->triangles);
+    free(queue->pixels);
+    free(queue->planes);
+    free(queue);
+}
+
+void push_setup_triangle(TriangleSetupBatch *batch, RasterQueue *queue, const ClipVertex *a, const ClipVertex *b, const ClipVertex *c) {
+    const ClipVertex *vertices[NUM_TRIANGLE_VERTEX] = {a, b, c};
+    int lane = batch->count;
+
+    for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+        batch->x[i][lane] = vertices[i]->position.x;
+        batch->y[i][lane] = vertices[i]->position.y;
+        batch->z[i][lane] = vertices[i]->position.z;
+        batch->w[i][lane] = vertices[i]->position.w;
+
+        for (int attribute = 0; attribute < batch->attribute_count; attribute++) {
+            batch->attributes[attribute][i][lane] = vertices[i]->attributes[attribute];
+        }
+    }
+
+    batch->count++;
+    if (batch->count == TRIANGLE_SETUP_LANES) {
+        flush_triangle_setup_batch(batch, queue);
+    }
+}
+
+void flush_triangle_setup_batch(TriangleSetupBatch *batch, RasterQueue *queue) {
+    // Every step below runs across all lanes so the loops stay vectorizable,
+    // unused lanes are computed and then masked off during compaction
+    int screen_x[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    int screen_y[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    float vertex_inv_w[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    float vertex_depth[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    int plane_count = RASTER_PLANE_COUNT(batch->attribute_count);
+
+    if (batch->count == 0) {
+        return;
+    }
+
+    // Fill the unused lanes with the first triangle so they never divide by zero
+    for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+        for (int lane = batch->count; lane < TRIANGLE_SETUP_LANES; lane++) {
+            batch->x[i][lane] = batch->x[i][0];
+            batch->y[i][lane] = batch->y[i][0];
+            batch->z[i][lane] = batch->z[i][0];
+            batch->w[i][lane] = batch->w[i][0];
+            for (int attribute = 0; attribute < batch->attribute_count; attribute++) {
+                batch->attributes[attribute][i][lane] = batch->attributes[attribute][i][0];
+            }
+        }
+    }
+
+    // Perspective divide and viewport transform into fixed point subpixels
+    for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+        for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+            float inv_w = 1.0f / batch->w[i][lane];
+            vertex_inv_w[i][lane] = inv_w;
+            vertex_depth[i][lane] = batch->z[i][lane] * inv_w;
+
+            float ndc_x = batch->x[i][lane] * inv_w;
+            float ndc_y = batch->y[i][lane] * inv_w;
+
+            screen_x[i][lane] = (int)floorf((ndc_x + 1.0f) * 0.5f * batch->viewport_width * SUBPIXEL_SCALE + 0.5f);
+            screen_y[i][lane] = (int)floorf((1.0f - (ndc_y + 1.0f) * 0.5f) * batch->viewport_height * SUBPIXEL_SCALE + 0.5f);
+        }
+    }
+
+    int64_t area[TRIANGLE_SETUP_LANES];
+    int min_x[TRIANGLE_SETUP_LANES];
+    int min_y[TRIANGLE_SETUP_LANES];
+    int max_x[TRIANGLE_SETUP_LANES];
+    int max_y[TRIANGLE_SETUP_LANES];
+    int edge_a[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    int edge_b[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    int64_t edge_c[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    int accept[TRIANGLE_SETUP_LANES];
+    int single_pixel[TRIANGLE_SETUP_LANES];
+    int flat[TRIANGLE_SETUP_LANES];
+    float plane_origin[RASTER_PLANE_COUNT(MAX_VERTEX_ATTRIBUTES)][TRIANGLE_SETUP_LANES];
+    float plane_dx[RASTER_PLANE_COUNT(MAX_VERTEX_ATTRIBUTES)][TRIANGLE_SETUP_LANES];
+    float plane_dy[RASTER_PLANE_COUNT(MAX_VERTEX_ATTRIBUTES)][TRIANGLE_SETUP_LANES];
+    float depth_origin[TRIANGLE_SETUP_LANES];
+    float depth_dx[TRIANGLE_SETUP_LANES];
+    float depth_dy[TRIANGLE_SETUP_LANES];
+
+    for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+        int x0 = screen_x[0][lane], y0 = screen_y[0][lane];
+        int x1 = screen_x[1][lane], y1 = screen_y[1][lane];
+        int x2 = screen_x[2][lane], y2 = screen_y[2][lane];
+
+        // Screen y points down, so front faces wind with a negative signed area
+        area[lane] = -((int64_t)(x1 - x0) * (y2 - y0) - (int64_t)(x2 - x0) * (y1 - y0));
+
+        int lo_x = x0 < x1 ? x0 : x1;
+        int lo_y = y0 < y1 ? y0 : y1;
+        int hi_x = x0 > x1 ? x0 : x1;
+        int hi_y = y0 > y1 ? y0 : y1;
+        lo_x = lo_x < x2 ? lo_x : x2;
+        lo_y = lo_y < y2 ? lo_y : y2;
+        hi_x = hi_x > x2 ? hi_x : x2;
+        hi_y = hi_y > y2 ? hi_y : y2;
+
+        // Pixels whose centers (or samples) land inside the bounding box, scissored to the screen
+        int reach = batch->multisample ? RASTER_SAMPLE_REACH : 0;
+        int first_x = (lo_x - SUBPIXEL_HALF - reach + SUBPIXEL_SCALE - 1) >> SUBPIXEL_BITS;
+        int first_y = (lo_y - SUBPIXEL_HALF - reach + SUBPIXEL_SCALE - 1) >> SUBPIXEL_BITS;
+        int last_x = (hi_x - SUBPIXEL_HALF + reach) >> SUBPIXEL_BITS;
+        int last_y = (hi_y - SUBPIXEL_HALF + reach) >> SUBPIXEL_BITS;
+
+        min_x[lane] = first_x > 0 ? first_x : 0;
+        min_y[lane] = first_y > 0 ? first_y : 0;
+        max_x[lane] = last_x < batch->viewport_width - 1 ? last_x : batch->viewport_width - 1;
+        max_y[lane] = last_y < batch->viewport_height - 1 ? last_y : batch->viewport_height - 1;
+    }
+
+    // Edge equations rebased to step a whole pixel between pixel centers
+    for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+        int next = (i + 1) % NUM_TRIANGLE_VERTEX;
+
+        for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+            int a = screen_y[next][lane] - screen_y[i][lane];
+            int b = screen_x[i][lane] - screen_x[next][lane];
+            int64_t c = (int64_t)screen_x[next][lane] * screen_y[i][lane] - (int64_t)screen_x[i][lane] * screen_y[next][lane];
+
+            // Top-left rule, samples exactly on a right or bottom edge are left out
+            int top_left = (a > 0) | ((a == 0) & (b > 0));
+
+            edge_a[i][lane] = a * SUBPIXEL_SCALE;
+            edge_b[i][lane] = b * SUBPIXEL_SCALE;
+            edge_c[i][lane] = c + (int64_t)(a + b) * SUBPIXEL_HALF + top_left - 1;
+        }
+    }
+
+    // Barycentric weights from the edge equations, vertex k is weighted by the
+    // edge opposite it divided by the area, at min_x/min_y and per pixel step
+    double weight_origin[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    double weight_dx[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+    double weight_dy[NUM_TRIANGLE_VERTEX][TRIANGLE_SETUP_LANES];
+
+    for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+        int opposite = (k + 1) % NUM_TRIANGLE_VERTEX;
+
+        for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+            double inv_area = area[lane] > 0 ? 1.0 / (double)area[lane] : 0.0;
+            int64_t origin = (int64_t)edge_a[opposite][lane] * min_x[lane] + (int64_t)edge_b[opposite][lane] * min_y[lane] + edge_c[opposite][lane];
+
+            weight_origin[k][lane] = (double)origin * inv_area;
+            weight_dx[k][lane] = edge_a[opposite][lane] * inv_area;
+            weight_dy[k][lane] = edge_b[opposite][lane] * inv_area;
+        }
+    }
+
+    for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+        float *z = &vertex_depth[0][lane];
+        depth_origin[lane] = (float)(weight_origin[0][lane] * z[0] + weight_origin[1][lane] * z[TRIANGLE_SETUP_LANES] + weight_origin[2][lane] * z[2 * TRIANGLE_SETUP_LANES]);
+        depth_dx[lane] = (float)(weight_dx[0][lane] * z[0] + weight_dx[1][lane] * z[TRIANGLE_SETUP_LANES] + weight_dx[2][lane] * z[2 * TRIANGLE_SETUP_LANES]);
+        depth_dy[lane] = (float)(weight_dy[0][lane] * z[0] + weight_dy[1][lane] * z[TRIANGLE_SETUP_LANES] + weight_dy[2][lane] * z[2 * TRIANGLE_SETUP_LANES]);
+    }
+
+    // Plane 0 is 1/w, the rest are attribute/w so they interpolate linearly in
+    // screen space, the rasterizer divides back per pixel
+    for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+        flat[lane] = 1;
+    }
+
+    for (int plane = 0; plane < plane_count; plane++) {
+        for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+            float value[NUM_TRIANGLE_VERTEX];
+            for (int k = 0; k < NUM_TRIANGLE_VERTEX; k++) {
+                float attribute = plane ? batch->attributes[plane - 1][k][lane] : 1.0f;
+                value[k] = attribute * vertex_inv_w[k][lane];
+            }
+
+            if (plane) {
+                float *attribute = &batch->attributes[plane - 1][0][lane];
+                flat[lane] &= (attribute[0] == attribute[TRIANGLE_SETUP_LANES]) & (attribute[0] == attribute[2 * TRIANGLE_SETUP_LANES]);
+            }
+
+            plane_origin[plane][lane] = (float)(weight_origin[0][lane] * value[0] + weight_origin[1][lane] * value[1] + weight_origin[2][lane] * value[2]);
+            plane_dx[plane][lane] = (float)(weight_dx[0][lane] * value[0] + weight_dx[1][lane] * value[1] + weight_dx[2][lane] * value[2]);
+            plane_dy[plane][lane] = (float)(weight_dy[0][lane] * value[0] + weight_dy[1][lane] * value[1] + weight_dy[2][lane] * value[2]);
+        }
+    }
+
+    for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+        // Backface and zero area culling, plus bounding boxes holding no pixel center
+        int covers_pixels = (area[lane] > 0) & (min_x[lane] <= max_x[lane]) & (min_y[lane] <= max_y[lane]) & (lane < batch->count);
+
+        // Micro triangles with a single candidate pixel just test that pixel
+        int one_candidate = (min_x[lane] == max_x[lane]) & (min_y[lane] == max_y[lane]);
+        int sample_inside = 1;
+        for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+            int64_t e = (int64_t)edge_a[i][lane] * min_x[lane] + (int64_t)edge_b[i][lane] * min_y[lane] + edge_c[i][lane];
+            sample_inside &= e >= 0;
+        }
+
+        // A multisampled pixel can be partly covered, so it is rasterized like the rest
+        accept[lane] = covers_pixels & ((one_candidate == 0) | (batch->multisample != 0));
+        single_pixel[lane] = covers_pixels & one_candidate & sample_inside & (batch->multisample == 0);
+    }
+
+    // Compact the survivors, every lane is stored but only accepted ones advance
+    for (int lane = 0; lane < TRIANGLE_SETUP_LANES; lane++) {
+        RasterTriangle *triangle = &queue->triangles[queue->count];
+
+        for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+            triangle->points[i].x = screen_x[i][lane] >> SUBPIXEL_BITS;
+            triangle->points[i].y = screen_y[i][lane] >> SUBPIXEL_BITS;
+
+            triangle->edge_a[i] = edge_a[i][lane];
+            triangle->edge_b[i] = edge_b[i][lane];
+            triangle->edge_c[i] = edge_c[i][lane];
+        }
+
+        triangle->min_x = min_x[lane];
+        triangle->min_y = min_y[lane];
+        triangle->max_x = max_x[lane];
+        triangle->max_y = max_y[lane];
+        triangle->area = area[lane];
+
+        triangle->depth_origin = depth_origin[lane];
+        triangle->depth_dx = depth_dx[lane];
+        triangle->depth_dy = depth_dy[lane];
+        triangle->plane_count = plane_count;
+        triangle->planes = &queue->planes[(size_t)queue->count * 3 * plane_count];
+
+        float *origin = triangle->planes;
+        for (int plane = 0; plane < plane_count; plane++) {
+            origin[plane] = plane_origin[plane][lane];
+            origin[plane_count + plane] = plane_dx[plane][lane];
+            origin[2 * plane_count + plane] = plane_dy[plane][lane];
+        }
+
+        // Single pixels sample the planes at min_x/min_y, flat triangles keep
+        // their exact vertex color. Depth only batches carry no color at all
+        if (batch->attribute_count >= ATTRIBUTE_COLOR_SIZE) {
+            float *color = &batch->attributes[ATTRIBUTE_COLOR][0][lane];
+            uint32_t vertex_color = pack_color(color[0], color[TRIANGLE_SETUP_LANES * NUM_TRIANGLE_VERTEX], color[2 * TRIANGLE_SETUP_LANES * NUM_TRIANGLE_VERTEX]);
+            triangle->flat_color = flat[lane] ? vertex_color : resolve_plane_color(origin);
+        } else {
+            triangle->flat_color = 0;
+        }
+
+        queue->count += accept[lane];
+
+        RasterPixel *pixel = &queue->pixels[queue->pixel_count];
+        pixel->x = min_x[lane];
+        pixel->y = min_y[lane];
+        pixel->color = triangle->flat_color;
+        pixel->depth = depth_origin[lane];
+        pixel->order = queue->count;
+        queue->pixel_count += single_pixel[lane];
+    }
+
+    batch->count = 0;
+}
+
+uint32_t resolve_plane_color(const float *values) {
+    // values[0] is 1/w, the attributes follow it premultiplied by 1/w. Lanes
+    // that get culled can sample outside the triangle, keep them finite
+    float w = values[0] > 0 ? 1.0f / values[0] : 0.0f;
+    const float *color = &values[1 + ATTRIBUTE_COLOR];
+
+    return pack_color(color[0] * w, color[1] * w, color[2] * w);
+}
@@ -0,0 +1,445 @@
+#include <SDL3/SDL.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compact_vertex.h"
+#include "constants.h"
+#include "framebuffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "render_pipeline.h"
+#include "wireframe.h"
+
+// EDGE EXTRACTION //
+
+void build_mesh_edges(Mesh *mesh) {
+    // Every triangle adds at most 3 edges, size the hash table to stay half empty
+    int max_edges = mesh->num_triangles * NUM_TRIANGLE_VERTEX;
+    int table_size = 1;
+    while (table_size < max_edges * 2) {
+        table_size <<= 1;
+    }
+
+    mesh->edge_count = 0;
+    mesh->edges = (MeshEdge *)malloc(max_edges * sizeof(MeshEdge));
+    int *edge_table = (int *)malloc(table_size * sizeof(int));
+    int *welded = weld_mesh_vertices(mesh);
+
+    if (!mesh->edges || !edge_table || !welded) {
+        printf("Could not allocate mem for mesh edges");
+        free(mesh->edges);
+        mesh->edges = NULL;
+        free(edge_table);
+        free(welded);
+        return;
+    }
+
+    memset(edge_table, -1, table_size * sizeof(int));
+
+    VecConnectionsPoints *triangle = mesh->head;
+    while (triangle != NULL) {
+        for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+            int a = welded[triangle->vertices[i]];
+            int b = welded[triangle->vertices[(i + 1) % NUM_TRIANGLE_VERTEX]];
+            triangle->edges[i] = find_or_add_edge(mesh, edge_table, table_size, a, b);
+        }
+        triangle = triangle->next;
+    }
+
+    free(edge_table);
+    free(welded);
+}
+
+int *weld_mesh_vertices(Mesh *mesh) {
+    // Exporters often duplicate vertices per face, map every vertex to the
+    // first one with the exact same position so shared edges line up
+    int table_size = 1;
+    while (table_size < mesh->vec_count * 2) {
+        table_size <<= 1;
+    }
+
+    int *welded = (int *)malloc(mesh->vec_count * sizeof(int));
+    int *vertex_table = (int *)malloc(table_size * sizeof(int));
+    if (!welded || !vertex_table) {
+        free(welded);
+        free(vertex_table);
+        return NULL;
+    }
+
+    memset(vertex_table, -1, table_size * sizeof(int));
+
+    for (int i = 0; i < mesh->vec_count; i++) {
+        fVec4 decoded;
+        fVec4 *v = read_mesh_position(mesh, i, &decoded);
+        uint32_t bits[3];
+        memcpy(&bits[0], &v->x, sizeof(uint32_t));
+        memcpy(&bits[1], &v->y, sizeof(uint32_t));
+        memcpy(&bits[2], &v->z, sizeof(uint32_t));
+
+        uint32_t hash = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        int slot = hash & (table_size - 1);
+
+        while (vertex_table[slot] != -1) {
+            fVec4 decoded_other;
+            fVec4 *other = read_mesh_position(mesh, vertex_table[slot], &decoded_other);
+            if (other->x == v->x && other->y == v->y && other->z == v->z) {
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (vertex_table[slot] == -1) {
+            vertex_table[slot] = i;
+        }
+        welded[i] = vertex_table[slot];
+    }
+
+    free(vertex_table);
+    return welded;
+}
+
+int find_or_add_edge(Mesh *mesh, int *edge_table, int table_size, int a, int b) {
+    // Edges are undirected, store them low index first
+    int v0 = a < b ? a : b;
+    int v1 = a < b ? b : a;
+
+    uint32_t hash = ((uint32_t)v0 * 73856093u) ^ ((uint32_t)v1 * 19349663u);
+    int slot = hash & (table_size - 1);
+
+    while (edge_table[slot] != -1) {
+        MeshEdge *edge = &mesh->edges[edge_table[slot]];
+        if (edge->v0 == v0 && edge->v1 == v1) {
+            return edge_table[slot];
+        }
+        slot = (slot + 1) & (table_size - 1);
+    }
+
+    mesh->edges[mesh->edge_count].v0 = v0;
+    mesh->edges[mesh->edge_count].v1 = v1;
+    edge_table[slot] = mesh->edge_count;
+
+    return mesh->edge_count++;
+}
+
+// WIREFRAME RENDERING //
+
+void render_wireframe(SDL_Renderer *renderer, Framebuffer *framebuffer, RenderSettings *settings, Mesh *mesh, ClipVertexCache *vertex_cache) {
+    if (!mesh->edges || mesh->edge_count == 0) {
+        return;
+    }
+
+    uint8_t *visible = (uint8_t *)calloc(mesh->edge_count, sizeof(uint8_t));
+    if (!visible) {
+        printf("Could not allocate mem for edge visibility");
+        return;
+    }
+
+    mark_visible_edges(mesh, vertex_cache, visible);
+
+    // Points handed to SDL in one call when drawing through the renderer
+    SDL_FPoint *points = NULL;
+    int point_count = 0;
+    int point_capacity = 0;
+
+    for (int i = 0; i < mesh->edge_count; i++) {
+        if (!visible[i]) {
+            continue;
+        }
+
+        int idx0 = mesh->edges[i].v0;
+        int idx1 = mesh->edges[i].v1;
+
+        // Both ends outside the same plane
+        if (vertex_cache->outcodes[idx0] & vertex_cache->outcodes[idx1]) {
+            continue;
+        }
+
+        fVec4 p0 = vertex_cache->vertices[idx0].position;
+        fVec4 p1 = vertex_cache->vertices[idx1].position;
+
+        if ((vertex_cache->outcodes[idx0] | vertex_cache->outcodes[idx1]) & (OUTCODE_NEAR | OUTCODE_FAR)) {
+            if (!clip_line_near_far(&p0, &p1)) {
+                continue;
+            }
+        }
+
+        // Perspective divide and viewport transform
+        float x0 = (p0.x / p0.w + 1.0f) * 0.5f * framebuffer->width;
+        float y0 = (1.0f - (p0.y / p0.w + 1.0f) * 0.5f) * framebuffer->height;
+        float x1 = (p1.x / p1.w + 1.0f) * 0.5f * framebuffer->width;
+        float y1 = (1.0f - (p1.y / p1.w + 1.0f) * 0.5f) * framebuffer->height;
+
+        // Clip once up front so the drawing loops never bounds check
+        if (!clip_line_to_viewport(&x0, &y0, &x1, &y1, framebuffer->width, framebuffer->height)) {
+            continue;
+        }
+
+        if (settings->wireframe_target == WIREFRAME_TARGET_RENDERER) {
+            if (!append_line_points(&points, &point_count, &point_capacity, (int)x0, (int)y0, (int)x1, (int)y1)) {
+                break;
+            }
+        } else {
+            draw_line_unchecked(framebuffer, (int)x0, (int)y0, (int)x1, (int)y1, FRAMEBUFFER_WIREFRAME_COLOR);
+        }
+    }
+
+    if (point_count > 0) {
+        SDL_SetRenderDrawColor(renderer, 0, 255, 255, 255);
+        SDL_RenderPoints(renderer, points, point_count);
+    }
+
+    free(points);
+    free(visible);
+}
+
+void draw_bounding_box(Framebuffer *framebuffer, fMatrix44 *view_projection, const float *bounds_min, const float *bounds_max) {
+    // Corner bits pick max over min per axis, x is 4, y is 2 and z is 1
+    fVec4 corners[NUM_BOUNDING_BOX_VERTEX];
+    for (int i = 0; i < NUM_BOUNDING_BOX_VERTEX; i++) {
+        fVec4 corner = {(i & 4) ? bounds_max[0] : bounds_min[0], (i & 2) ? bounds_max[1] : bounds_min[1],
+                        (i & 1) ? bounds_max[2] : bounds_min[2], 1.0f};
+        multiply_fvec4_matrix44(&corner, &corners[i], view_projection);
+    }
+
+    // The 12 edges join corners one bit apart
+    for (int i = 0; i < NUM_BOUNDING_BOX_VERTEX; i++) {
+        for (int bit = 1; bit < NUM_BOUNDING_BOX_VERTEX; bit <<= 1) {
+            if (i & bit) {
+                continue;
+            }
+
+            fVec4 p0 = corners[i];
+            fVec4 p1 = corners[i | bit];
+            if (!clip_line_near_far(&p0, &p1)) {
+                continue;
+            }
+
+            float x0 = (p0.x / p0.w + 1.0f) * 0.5f * framebuffer->width;
+            float y0 = (1.0f - (p0.y / p0.w + 1.0f) * 0.5f) * framebuffer->height;
+            float x1 = (p1.x / p1.w + 1.0f) * 0.5f * framebuffer->width;
+            float y1 = (1.0f - (p1.y / p1.w + 1.0f) * 0.5f) * framebuffer->height;
+
+            if (clip_line_to_viewport(&x0, &y0, &x1, &y1, framebuffer->width, framebuffer->height)) {
+                draw_line_unchecked(framebuffer, (int)x0, (int)y0, (int)x1, (int)y1, FRAMEBUFFER_WIREFRAME_COLOR);
+            }
+        }
+    }
+}
+
+void mark_visible_edges(Mesh *mesh, ClipVertexCache *vertex_cache, uint8_t *visible) {
+    // An edge is drawn when any triangle using it faces the camera
+    for (int s = 0; s < mesh->submesh_count; s++) {
+        VecConnectionsPoints *triangle = mesh->submeshes[s].head;
+        for (int t = 0; t < mesh->submeshes[s].triangle_count && triangle != NULL; t++, triangle = triangle->next) {
+            const fVec4 *p[NUM_TRIANGLE_VERTEX];
+            int transformed = 1;
+            for (int i = 0; i < NUM_TRIANGLE_VERTEX; i++) {
+                int vertex = triangle->vertices[i];
+                p[i] = &vertex_cache->vertices[vertex].position;
+                transformed &= !vertex_cache->vertex_mask || vertex_cache->vertex_mask[vertex];
+            }
+
+            // Faces of culled meshlets were off screen or facing away, and never transformed
+            if (transformed && is_front_facing_clip(p[0], p[1], p[2])) {
+                visible[triangle->edges[0]] = 1;
+                visible[triangle->edges[1]] = 1;
+                visible[triangle->edges[2]] = 1;
+            }
+        }
+    }
+}
+
+int is_front_facing_clip(const fVec4 *a, const fVec4 *b, const fVec4 *c) {
+    // Determinant of the (x, y, w) rows keeps the sign of the projected area
+    // without dividing, so it also holds for vertices behind the camera
+    float det = a->x * (b->y * c->w - b->w * c->y) -
+                a->y * (b->x * c->w - b->w * c->x) +
+                a->w * (b->x * c->y - b->y * c->x);
+    return det > 0;
+}
+
+// LINE CLIPPING //
+
+int clip_line_near_far(fVec4 *p0, fVec4 *p1) {
+    // Liang-Barsky against -w <= z <= w in homogeneous clip space
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+
+    float near0 = p0->z + p0->w;
+    float near1 = p1->z + p1->w;
+    float far0 = p0->w - p0->z;
+    float far1 = p1->w - p1->z;
+
+    float distances[2][2] = {{near0, near1}, {far0, far1}};
+    for (int i = 0; i < 2; i++) {
+        float d0 = distances[i][0];
+        float d1 = distances[i][1];
+
+        if (d0 < 0 && d1 < 0) {
+            return 0;
+        }
+
+        if (d0 < 0) {
+            float t = d0 / (d0 - d1);
+            t0 = t > t0 ? t : t0;
+        } else if (d1 < 0) {
+            float t = d0 / (d0 - d1);
+            t1 = t < t1 ? t : t1;
+        }
+    }
+
+    if (t0 > t1) {
+        return 0;
+    }
+
+    fVec4 start = *p0;
+    fVec4 delta = {p1->x - p0->x, p1->y - p0->y, p1->z - p0->z, p1->w - p0->w};
+
+    p0->x = start.x + t0 * delta.x;
+    p0->y = start.y + t0 * delta.y;
+    p0->z = start.z + t0 * delta.z;
+    p0->w = start.w + t0 * delta.w;
+
+    p1->x = start.x + t1 * delta.x;
+    p1->y = start.y + t1 * delta.y;
+    p1->z = start.z + t1 * delta.z;
+    p1->w = start.w + t1 * delta.w;
+
+    return 1;
+}
+
+int compute_line_outcode(float x, float y, int width, int height) {
+    int outcode = 0;
+
+    if (x < 0)
+        outcode |= LINE_OUTCODE_LEFT;
+    else if (x > width - 1)
+        outcode |= LINE_OUTCODE_RIGHT;
+
+    if (y < 0)
+        outcode |= LINE_OUTCODE_TOP;
+    else if (y > height - 1)
+        outcode |= LINE_OUTCODE_BOTTOM;
+
+    return outcode;
+}
+
+int clip_line_to_viewport(float *x0, float *y0, float *x1, float *y1, int width, int height) {
+    // Cohen-Sutherland, moves endpoints onto the screen rectangle
+    int outcode0 = compute_line_outcode(*x0, *y0, width, height);
+    int outcode1 = compute_line_outcode(*x1, *y1, width, height);
+
+    while (1) {
+        if (!(outcode0 | outcode1)) {
+            return 1;
+        }
+
+        if (outcode0 & outcode1) {
+            return 0;
+        }
+
+        int outcode_out = outcode0 ? outcode0 : outcode1;
+        float x;
+        float y;
+
+        if (outcode_out & LINE_OUTCODE_BOTTOM) {
+            x = *x0 + (*x1 - *x0) * (height - 1 - *y0) / (*y1 - *y0);
+            y = height - 1;
+        } else if (outcode_out & LINE_OUTCODE_TOP) {
+            x = *x0 + (*x1 - *x0) * (0 - *y0) / (*y1 - *y0);
+            y = 0;
+        } else if (outcode_out & LINE_OUTCODE_RIGHT) {
+            y = *y0 + (*y1 - *y0) * (width - 1 - *x0) / (*x1 - *x0);
+            x = width - 1;
+        } else {
+            y = *y0 + (*y1 - *y0) * (0 - *x0) / (*x1 - *x0);
+            x = 0;
+        }
+
+        if (outcode_out == outcode0) {
+            *x0 = x;
+            *y0 = y;
+            outcode0 = compute_line_outcode(*x0, *y0, width, height);
+        } else {
+            *x1 = x;
+            *y1 = y;
+            outcode1 = compute_line_outcode(*x1, *y1, width, height);
+        }
+    }
+}
+
+// LINE DRAWING //
+
+void draw_line_unchecked(Framebuffer *framebuffer, int x0, int y0, int x1, int y1, uint32_t color) {
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+
+    // Step through memory directly, a row step is a whole framebuffer width
+    int step_x = (x0 < x1) ? 1 : -1;
+    int step_y = (y0 < y1) ? framebuffer->width : -framebuffer->width;
+
+    uint32_t *pixel = &framebuffer->color[y0 * framebuffer->width + x0];
+    int remaining = dx > -dy ? dx : -dy;
+    int error = dx + dy;
+
+    for (int i = 0; i <= remaining; i++) {
+        *pixel = color;
+
+        int e2 = error * 2;
+        if (e2 >= dy) {
+            error += dy;
+            pixel += step_x;
+        }
+        if (e2 <= dx) {
+            error += dx;
+            pixel += step_y;
+        }
+    }
+}
+
+int append_line_points(SDL_FPoint **points, int *count, int *capacity, int x0, int y0, int x1, int y1) {
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int remaining = dx > -dy ? dx : -dy;
+
+    if (*count + remaining + 1 > *capacity) {
+        int new_capacity = *capacity ? *capacity : 1024;
+        while (new_capacity < *count + remaining + 1) {
+            new_capacity <<= 1;
+        }
+
+        SDL_FPoint *grown = (SDL_FPoint *)realloc(*points, new_capacity * sizeof(SDL_FPoint));
+        if (!grown) {
+            printf("Could not allocate mem for wireframe points");
+            return 0;
+        }
+
+        *points = grown;
+        *capacity = new_capacity;
+    }
+
+    int step_x = (x0 < x1) ? 1 : -1;
+    int step_y = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+
+    for (int i = 0; i <= remaining; i++) {
+        (*points)[*count].x = x0;
+        (*points)[*count].y = y0;
+        (*count)++;
+
+        int e2 = error * 2;
+        if (e2 >= dy) {
+            error += dy;
+            x0 += step_x;
+        }
+        if (e2 <= dx) {
+            error += dx;
+            y0 += step_y;
+        }
+    }
+
+    return 1;
+}
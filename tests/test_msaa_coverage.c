@@ -0,0 +1,145 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "framebuffer.h"
+#include "raster_kernel.h"
+#include "triangle.h"
+#include "triangle_setup.h"
+
+// Every sample the multisampled kernels cover has to be exactly the samples
+// inside the triangle's three edges, evaluated straight from the snapped vertices
+
+#define TEST_WIDTH 256
+#define TEST_HEIGHT 128
+#define TEST_TRIANGLES 1000
+
+// Rotated grid in subpixels from the pixel center, same pattern as the kernels
+static const int test_sample_offsets[FRAMEBUFFER_SAMPLE_COUNT][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+
+static uint32_t test_seed = 3;
+
+static float random_signed(void) {
+    test_seed = test_seed * 1664525u + 1013904223u;
+    return (test_seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+static int sample_inside(const int64_t *sub_x, const int64_t *sub_y, int64_t x, int64_t y) {
+    for (int e = 0; e < 3; e++) {
+        int i = e;
+        int n = (e + 1) % 3;
+        int64_t a = sub_y[n] - sub_y[i];
+        int64_t b = sub_x[i] - sub_x[n];
+        int64_t c = sub_x[n] * sub_y[i] - sub_x[i] * sub_y[n];
+
+        // Top left fill rule, samples exactly on other edges belong to the neighbour
+        int top_left = a > 0 || (a == 0 && b > 0);
+        if (a * x + b * y + c + top_left - 1 < 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int main(void) {
+    Framebuffer *framebuffer = create_framebuffer(TEST_WIDTH, TEST_HEIGHT);
+    RasterQueue *queue = create_raster_queue(64, 3);
+    if (!framebuffer || !queue || !create_multisample_targets(framebuffer)) {
+        printf("Could not allocate mem for msaa coverage test\n");
+        return 1;
+    }
+
+    TriangleSetupBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.viewport_width = TEST_WIDTH;
+    batch.viewport_height = TEST_HEIGHT;
+    batch.multisample = 1;
+    batch.attribute_count = 3;
+
+    const RasterKernel *kernel = select_raster_kernel(0, RASTER_SHADE_FLAT, RASTER_BLEND_OPAQUE, 1);
+    RasterState state;
+    memset(&state, 0, sizeof(state));
+
+    long tested = 0;
+    long mismatches = 0;
+
+    for (int t = 0; t < TEST_TRIANGLES; t++) {
+        // Micro, small and screen filling triangles in turn
+        float scale = t % 3 == 0 ? 0.01f : (t % 3 == 1 ? 0.1f : 1.5f);
+        float center_x = random_signed();
+        float center_y = random_signed();
+
+        ClipVertex vertices[3];
+        memset(vertices, 0, sizeof(vertices));
+        for (int i = 0; i < 3; i++) {
+            vertices[i].position.x = center_x + random_signed() * scale;
+            vertices[i].position.y = center_y + random_signed() * scale;
+            vertices[i].position.w = 1.0f;
+            vertices[i].attributes[0] = 1.0f;
+            vertices[i].attributes[1] = 1.0f;
+            vertices[i].attributes[2] = 1.0f;
+        }
+
+        // Both windings, whichever one is front facing gets drawn
+        reset_raster_queue(queue);
+        push_setup_triangle(&batch, queue, &vertices[0], &vertices[1], &vertices[2]);
+        push_setup_triangle(&batch, queue, &vertices[0], &vertices[2], &vertices[1]);
+        flush_triangle_setup_batch(&batch, queue);
+
+        clear_multisample_targets(framebuffer, 0);
+        for (int i = 0; i < queue->count; i++) {
+            fill_triangle(framebuffer, &queue->triangles[i], kernel, &state, 0, 0, TEST_WIDTH - 1, TEST_HEIGHT - 1);
+        }
+
+        // Reference edges from the vertices snapped to subpixels, wound clockwise on screen
+        int64_t sub_x[3];
+        int64_t sub_y[3];
+        for (int i = 0; i < 3; i++) {
+            sub_x[i] = (int64_t)floorf((vertices[i].position.x + 1.0f) * 0.5f * TEST_WIDTH * SUBPIXEL_SCALE + 0.5f);
+            sub_y[i] = (int64_t)floorf((1.0f - (vertices[i].position.y + 1.0f) * 0.5f) * TEST_HEIGHT * SUBPIXEL_SCALE + 0.5f);
+        }
+
+        int64_t area = (sub_x[1] - sub_x[0]) * (sub_y[2] - sub_y[0]) - (sub_x[2] - sub_x[0]) * (sub_y[1] - sub_y[0]);
+        if (area == 0) {
+            continue;
+        }
+        if (area > 0) {
+            int64_t swap_x = sub_x[1];
+            int64_t swap_y = sub_y[1];
+            sub_x[1] = sub_x[2];
+            sub_y[1] = sub_y[2];
+            sub_x[2] = swap_x;
+            sub_y[2] = swap_y;
+        }
+
+        for (int y = 0; y < TEST_HEIGHT; y++) {
+            for (int x = 0; x < TEST_WIDTH; x++) {
+                for (int s = 0; s < FRAMEBUFFER_SAMPLE_COUNT; s++) {
+                    int64_t sample_x = x * SUBPIXEL_SCALE + SUBPIXEL_HALF + test_sample_offsets[s][0];
+                    int64_t sample_y = y * SUBPIXEL_SCALE + SUBPIXEL_HALF + test_sample_offsets[s][1];
+
+                    int expected = sample_inside(sub_x, sub_y, sample_x, sample_y);
+                    int got = framebuffer->sample_color[(y * TEST_WIDTH + x) * FRAMEBUFFER_SAMPLE_COUNT + s] != 0;
+                    tested++;
+
+                    if (got != expected) {
+                        if (mismatches < 5) {
+                            printf("triangle %d pixel %d,%d sample %d covered %d expected %d\n", t, x, y, s, got, expected);
+                        }
+                        mismatches++;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("msaa coverage: %ld of %ld samples differ\n", mismatches, tested);
+
+    free_raster_queue(queue);
+    free_framebuffer(framebuffer);
+    return mismatches == 0 ? 0 : 1;
+}
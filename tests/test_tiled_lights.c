@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "camera.h"
+#include "deferred.h"
+#include "frame_arena.h"
+#include "framebuffer.h"
+#include "gbuffer.h"
+#include "geometry.h"
+#include "job_system.h"
+#include "material.h"
+#include "shading.h"
+
+// Tiled light culling only skips lights that add exactly zero, so every pixel
+// of the deferred pass has to match lighting it with every light in the scene
+
+#define TEST_WIDTH 320
+#define TEST_HEIGHT 180
+#define TEST_POINT_LIGHTS 400
+
+static uint32_t test_seed = 7;
+
+static float random_unit(void) {
+    test_seed = test_seed * 1664525u + 1013904223u;
+    return (test_seed >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32_t reference_pixel(Framebuffer *framebuffer, LightingScene *lighting, MaterialLibrary *materials, fMatrix44 *inverse, int x, int y) {
+    int offset = y * framebuffer->width + x;
+
+    // Same reconstruction as the lighting pass
+    float ndc_step_x = 2.0f / framebuffer->width;
+    float ndc_step_y = -2.0f / framebuffer->height;
+    fVec4 ndc = {-1.0f + (x + 0.5f) * ndc_step_x, 1.0f + (y + 0.5f) * ndc_step_y, framebuffer->depth[offset], 1.0f};
+    fVec4 position;
+    multiply_fvec4_matrix44(&ndc, &position, inverse);
+
+    float inv_w = 1.0f / position.w;
+    position.x *= inv_w;
+    position.y *= inv_w;
+    position.z *= inv_w;
+    position.w = 1.0f;
+
+    fVec4 normal;
+    decode_gbuffer_normal(framebuffer->gbuffer->normal[offset], &normal.x, &normal.y, &normal.z);
+    normal.w = 0;
+
+    float red;
+    float green;
+    float blue;
+    light_points(lighting, &position, &normal, 1, &red, &green, &blue);
+
+    Material *material = &materials->materials[framebuffer->gbuffer->material[offset]];
+    return pack_color(red * material->diffuse[0], green * material->diffuse[1], blue * material->diffuse[2]);
+}
+
+int main(void) {
+    Framebuffer *framebuffer = create_framebuffer(TEST_WIDTH, TEST_HEIGHT);
+    UserCamera *camera = create_camera(TEST_WIDTH / (float)TEST_HEIGHT);
+    LightingScene *lighting = create_lighting_scene(TEST_POINT_LIGHTS + 1);
+    MaterialLibrary *materials = create_material_library();
+    JobSystem *jobs = create_job_system(4);
+    if (!framebuffer || !camera || !lighting || !materials || !jobs) {
+        printf("Could not allocate mem for tiled light test\n");
+        return 1;
+    }
+
+    framebuffer->gbuffer = create_gbuffer(TEST_WIDTH, TEST_HEIGHT);
+    if (!framebuffer->gbuffer) {
+        return 1;
+    }
+    clear_gbuffer(framebuffer->gbuffer);
+
+    // Camera at the origin looking down -z, the view projection is the projection
+    fMatrix44 view_projection = *camera->projection_mat;
+
+    // Surfaces at random depths facing roughly back at the camera, a few pixels left empty
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        for (int x = 0; x < TEST_WIDTH; x++) {
+            int offset = y * TEST_WIDTH + x;
+            if (random_unit() < 0.1f) {
+                continue;
+            }
+
+            fVec4 view = {0.0f, 0.0f, -(2.0f + 18.0f * random_unit()), 1.0f};
+            fVec4 clip;
+            multiply_fvec4_matrix44(&view, &clip, &view_projection);
+
+            framebuffer->depth[offset] = clip.z / clip.w;
+            framebuffer->gbuffer->normal[offset] = encode_gbuffer_normal(random_unit() - 0.5f, random_unit() - 0.5f, 1.0f);
+            framebuffer->gbuffer->material[offset] = DEFAULT_MATERIAL;
+        }
+    }
+
+    fVec4 box_min = {-20.0f, -12.0f, -20.0f, 1.0f};
+    fVec4 box_max = {20.0f, 12.0f, -2.0f, 1.0f};
+    scatter_point_lights(lighting, &box_min, &box_max, TEST_POINT_LIGHTS, 2.5f, 11);
+    add_directional_light(lighting, (fVec4){-0.3f, -1.0f, -0.5f, 0.0f}, (fVec4){1.0f, 1.0f, 1.0f, 0.0f}, 0.3f);
+
+    FrameArena arena;
+    init_frame_arena(&arena);
+    light_gbuffer(framebuffer, lighting, materials, &view_projection, NULL, &arena, jobs);
+
+    fMatrix44 eliminated = view_projection;
+    fMatrix44 *inverse = create_inverse_matrix(&eliminated);
+    if (!inverse) {
+        return 1;
+    }
+
+    int lit = 0;
+    int mismatches = 0;
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        for (int x = 0; x < TEST_WIDTH; x++) {
+            if (framebuffer->gbuffer->material[y * TEST_WIDTH + x] == GBUFFER_EMPTY_MATERIAL) {
+                continue;
+            }
+
+            uint32_t expected = reference_pixel(framebuffer, lighting, materials, inverse, x, y);
+            uint32_t got = framebuffer->color[y * TEST_WIDTH + x];
+            lit++;
+
+            if (got != expected) {
+                if (mismatches < 5) {
+                    printf("pixel %d,%d tiled %08x all lights %08x\n", x, y, got, expected);
+                }
+                mismatches++;
+            }
+        }
+    }
+
+    printf("tiled lights: %d of %d pixels differ\n", mismatches, lit);
+
+    free(inverse);
+    free_frame_arena(&arena);
+    free_job_system(jobs);
+    free_material_library(materials);
+    free_lighting_scene(lighting);
+    free_framebuffer(framebuffer);
+    return mismatches == 0 && lit > 0 ? 0 : 1;
+}